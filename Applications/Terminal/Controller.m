@@ -307,10 +307,20 @@
   TerminalFinder *finder = [TerminalFinder sharedInstance];
   NSString	 *string;
   TerminalView   *tv;
+  NSRange	 range;
+  unichar	 *buf;
 
   tv = [[self terminalWindowForWindow:[NSApp keyWindow]] terminalView];
-  string = [[tv stringRepresentation] substringFromRange:[tv selectedRange]];
+  range = [tv selectedRange];
+  if (range.length == 0)
+    return;
+  buf = malloc(range.length * sizeof(unichar));
+  [tv getCharacters:buf range:range];
+  string = [[NSString alloc] initWithCharactersNoCopy:buf
+                                               length:range.length
+                                         freeWhenDone:YES];
   [finder setFindString:string];
+  [string release];
 }
 - (void)jumpToSelection:(id)sender
 {
@@ -203,6 +203,16 @@ extern NSString *ScrollBackLinesKey;
 extern NSString *ScrollBackEnabledKey;
 extern NSString *ScrollBackUnlimitedKey;
 extern NSString *ScrollBottomOnInputKey;
+// Not in Preferences panel. Whether older scrollback lines are compressed.
+extern NSString *ScrollBackCompressedKey;
+// Not in Preferences panel. How much program output is processed before
+// the screen is updated: higher values give more throughput, lower values
+// smoother updates and less latency.
+extern NSString *ReadBytesPerUpdateKey;
+extern NSString *ReadScrollsPerUpdateKey;
+// Not in Preferences panel. How often at most the screen is updated while
+// a program writes output. 0 updates it after every read.
+extern NSString *UpdatesPerSecondKey;
 
 @interface Defaults (Display)
 - (int)scrollBackLines;
@@ -211,8 +221,16 @@ extern NSString *ScrollBottomOnInputKey;
 - (void)setScrollBackEnabled:(BOOL)yn;
 - (BOOL)scrollBackUnlimited;
 - (void)setScrollBackUnlimited:(BOOL)yn;
+- (BOOL)scrollBackCompressed;
+- (void)setScrollBackCompressed:(BOOL)yn;
 - (BOOL)scrollBottomOnInput;
 - (void)setScrollBottomOnInput:(BOOL)yn;
+- (int)readBytesPerUpdate;
+- (void)setReadBytesPerUpdate:(int)bytes;
+- (int)readScrollsPerUpdate;
+- (void)setReadScrollsPerUpdate:(int)scrolls;
+- (int)updatesPerSecond;
+- (void)setUpdatesPerSecond:(int)ups;
 @end
 
 //----------------------------------------------------------------------------
@@ -737,6 +737,10 @@ NSString *ScrollBackLinesKey = @"ScrollBackLines";
 NSString *ScrollBackEnabledKey = @"ScrollBackEnabled";
 NSString *ScrollBackUnlimitedKey = @"ScrollBackUnlimited";
 NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
+NSString *ScrollBackCompressedKey = @"ScrollBackCompressed";
+NSString *ReadBytesPerUpdateKey = @"ReadBytesPerUpdate";
+NSString *ReadScrollsPerUpdateKey = @"ReadScrollsPerUpdate";
+NSString *UpdatesPerSecondKey = @"UpdatesPerSecond";
 //---
 @implementation Defaults (Display)
 - (int)scrollBackLines
@@ -756,15 +760,10 @@ NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
     {
       if ([self scrollBackUnlimited] == YES)
         {
-          // TODO: now TerminalView allocates memory for to hold all lines
-          // at start (-init). If caluculations is based on INT_MAX TerminalView
-          // needs to allocate ~2GB of RAM. So TerminalView memory management
-          // must be rewritten to lazy allocating before "Unlimited" options
-          // can be used. For now it's hardocded to some reasonable value.
-          // scrollBackLines =
-          //   (INT_MAX-1)/([self defaultWindowWidth]*sizeof(screen_char_t));
-          // fprintf(stderr, "scrollBackLines=%i\n", scrollBackLines);
-          scrollBackLines = 1024;
+          // Scrollback memory is taken as lines arrive, so this only
+          // keeps character offsets of the whole buffer (lines * width)
+          // in an int.
+          scrollBackLines = 1000000;
         }
       else // scrollback limited
         {
@@ -804,6 +803,17 @@ NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
 {
   [self setBool:yn forKey:ScrollBackUnlimitedKey];
 }
+- (BOOL)scrollBackCompressed
+{
+  if ([self objectForKey:ScrollBackCompressedKey] == nil)
+    return YES;
+  
+  return [self boolForKey:ScrollBackCompressedKey];
+}
+- (void)setScrollBackCompressed:(BOOL)yn
+{
+  [self setBool:yn forKey:ScrollBackCompressedKey];
+}
 - (BOOL)scrollBottomOnInput
 {
   if ([self objectForKey:ScrollBottomOnInputKey] == nil)
@@ -815,6 +825,42 @@ NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
 {
   [self setBool:yn forKey:ScrollBottomOnInputKey];
 }
+- (int)readBytesPerUpdate
+{
+  int bytes = [self integerForKey:ReadBytesPerUpdateKey];
+
+  if (bytes <= 0)
+    bytes = 65536;
+  return bytes;
+}
+- (void)setReadBytesPerUpdate:(int)bytes
+{
+  [self setInteger:bytes forKey:ReadBytesPerUpdateKey];
+}
+- (int)readScrollsPerUpdate
+{
+  int scrolls = [self integerForKey:ReadScrollsPerUpdateKey];
+
+  if (scrolls <= 0)
+    scrolls = 10;
+  return scrolls;
+}
+- (void)setReadScrollsPerUpdate:(int)scrolls
+{
+  [self setInteger:scrolls forKey:ReadScrollsPerUpdateKey];
+}
+- (int)updatesPerSecond
+{
+  int ups = [self integerForKey:UpdatesPerSecondKey];
+
+  if (ups < 0)
+    ups = 60;
+  return ups;
+}
+- (void)setUpdatesPerSecond:(int)ups
+{
+  [self setInteger:ups forKey:UpdatesPerSecondKey];
+}
 
 @end
 
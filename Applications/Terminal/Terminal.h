@@ -23,7 +23,8 @@ typedef struct
     2     00000100 - 0x4   - underline
     3     00001000 - 0x8   - inverse
     4     00010000 - 0x10  - blink
-    5     00100000 - 0x20  - unused
+    5     00100000 - 0x20  - set on the last cell of a row whose text goes on
+                             on the next row (soft wrap)
     6     01000000 - 0x40  - used as a selected flag internally
     7     10000000 - 0x80  - used as a dirty flag internally
   */
@@ -41,6 +42,9 @@ typedef struct
 -(void) ts_goto:(int)x :(int)y;
 -(void) ts_putChar:(screen_char_t)ch count:(int)c at:(int)x :(int)y;
 -(void) ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs;
+/* Puts c different characters starting at x:y. The characters must fit
+in the row; nothing wraps. */
+-(void) ts_putChars:(screen_char_t *)chars count:(int)c at:(int)x :(int)y;
 
 /* The portions scrolled/shifted from remain unchanged. However, it's
 assumed that they will be cleared or overwritten before the redraw is
@@ -48,6 +52,9 @@ complete. (TODO check this) */
 -(void) ts_scrollUp:(int)top :(int)bottom rows:(int)nr save:(BOOL)save;
 -(void) ts_scrollDown:(int)top :(int)bottom rows:(int)nr;
 -(void) ts_shiftRow:(int)y  at:(int)x0  delta:(int)d;
+/* The text reached the end of row y and goes on on the next row. Writing
+to the last cell of the row clears this again. */
+-(void) ts_setWrapped:(int)y;
 
 -(screen_char_t) ts_getCharAt:(int)x :(int)y;
 
@@ -62,6 +69,9 @@ complete. (TODO check this) */
 @protocol TerminalParser
 - initWithTerminalScreen:(id<TerminalScreen>)ats width:(int)w height:(int)h;
 - (void)processByte:(unsigned char)c;
+/* Same as calling -processByte: for each byte, but runs of plain text
+are put on the screen in one call. */
+- (void)processBytes:(const unsigned char *)buf length:(int)len;
 - (void)setTerminalScreenWidth:(int)w
                         height:(int)h
                        cursorY:(int)cursor_y;
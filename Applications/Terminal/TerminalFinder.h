@@ -24,6 +24,8 @@
 */
 #import <Foundation/NSObject.h>
 
+#import "TerminalSearch.h"
+
 #define Forward YES
 #define Backward NO
 
@@ -38,6 +40,18 @@
   NSString *findString;
   BOOL findStringChangedSinceLastPasteboardUpdate;
   BOOL lastFindWasSuccessful;		/* A bit of a kludge */
+
+  /* The search of the last find, kept to go on from the last match (counted
+     from the end of the text, which doesn't move as output arrives) when
+     the selection is gone. */
+  TerminalSearch *search;
+  NSRange lastMatch;
+  NSUInteger lastMatchFromEnd;
+
+  /* Matches of search are counted a part of the text at a time while the
+     application is idle. */
+  NSUInteger countPosition, countEnd;
+  NSUInteger matchCount;
 }
 
 /* Common way to get a text finder.
@@ -61,6 +75,7 @@
 /* Misc internal methods */
 - (void)appDidActivate:(NSNotification *)notification;
 - (void)addWillDeactivate:(NSNotification *)notification;
+- (void)windowWillClose:(NSNotification *)notification;
 - (void)loadFindStringFromPasteboard;
 - (void)loadFindStringToPasteboard;
 
@@ -71,14 +86,3 @@
 - (void)orderFrontFindPanel:(id)sender;
 
 @end
-
-
-@interface NSString (NSStringTextFinding)
-
-- (NSRange)findString:(NSString *)string
-        selectedRange:(NSRange)selectedRange
-              options:(unsigned)mask
-                 wrap:(BOOL)wrapFlag;
-
-@end
-        
@@ -34,6 +34,11 @@
        selector:@selector (addWillDeactivate:)
            name:NSApplicationWillResignActiveNotification
          object:[NSApplication sharedApplication]];
+  [[NSNotificationCenter defaultCenter]
+    addObserver:self
+       selector:@selector (windowWillClose:)
+           name:NSWindowWillCloseNotification
+         object:nil];
 
   [self setFindString: @""];
   [self loadFindStringFromPasteboard];
@@ -51,6 +56,20 @@
   [self loadFindStringToPasteboard];
 }
 
+/* The search doesn't keep its view; drop it with the view's window. */
+- (void)windowWillClose:(NSNotification *)notification
+{
+  if (search && [[search view] window] == [notification object])
+    {
+      [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                               selector:@selector(_countMatches)
+                                                 object:nil];
+      [search release];
+      search = nil;
+      lastMatch = NSMakeRange(0, 0);
+    }
+}
+
 - (void)loadFindStringFromPasteboard
 {
   NSPasteboard *pasteboard = [NSPasteboard pasteboardWithName:NSFindPboard];
@@ -111,6 +130,8 @@ static id	sharedFindObject = nil;
 {
   if (self != sharedFindObject)
     {
+      [NSObject cancelPreviousPerformRequestsWithTarget:self];
+      [search release];
       [findString release];
       [super dealloc];
     }
@@ -153,6 +174,80 @@ static id	sharedFindObject = nil;
   return findPanel;
 }
 
+/* how much text is looked at for counting matches at a time */
+#define COUNT_SLICE (4 * 65536)
+
+- (void)_showCount
+{
+  NSString *format;
+
+  if (countPosition < countEnd)
+    format = NSLocalizedStringFromTable(@"%lu found...", @"FindPanel", @"Status displayed in find panel while matches are being counted.");
+  else
+    format = NSLocalizedStringFromTable(@"%lu found", @"FindPanel", @"Status displayed in find panel with the number of matches.");
+  [statusField setStringValue:[NSString stringWithFormat:format,
+                                        (unsigned long)matchCount]];
+}
+
+- (void)_countedMatch:(NSValue *)range
+{
+  matchCount++;
+  /* the next slice starts after this match */
+  if (NSMaxRange([range rangeValue]) > countPosition)
+    countPosition = NSMaxRange([range rangeValue]);
+}
+
+- (void)_countMatches
+{
+  NSUInteger start = countPosition;
+  NSUInteger length = countEnd - start;
+
+  if (length > COUNT_SLICE)
+    length = COUNT_SLICE;
+  [search findAllInRange:NSMakeRange(start, length)
+                  target:self
+                  action:@selector(_countedMatch:)];
+  if (countPosition < start + length)
+    countPosition = start + length;
+
+  if (lastFindWasSuccessful)
+    [self _showCount];
+  if (countPosition < countEnd)
+    [self performSelector:@selector(_countMatches)
+               withObject:nil
+               afterDelay:0];
+}
+
+/* Returns the search for the current find string in tView, starting a new
+   one if anything changed. */
+- (TerminalSearch *)_searchInView:(TerminalView *)tView
+{
+  BOOL ignoreCase = [ignoreCaseButton state] ? YES : NO;
+
+  if (search && [search view] == tView && [search ignoreCase] == ignoreCase
+      && [[search string] isEqualToString:[self findString]])
+    return search;
+
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(_countMatches)
+                                             object:nil];
+  [search release];
+  search = [[TerminalSearch alloc] initWithView:tView
+                                         string:[self findString]
+                                     ignoreCase:ignoreCase];
+  lastMatch = NSMakeRange(0, 0);
+
+  matchCount = 0;
+  countPosition = 0;
+  countEnd = [tView textLength];
+  if (search)
+    [self performSelector:@selector(_countMatches)
+               withObject:nil
+               afterDelay:0];
+
+  return search;
+}
+
 /*
   The primitive for finding; this ends up setting the status field (and
   beeping if necessary)...
@@ -160,53 +255,73 @@ static id	sharedFindObject = nil;
 - (BOOL)find:(BOOL)direction
 {
   TerminalView	*tView;
+  NSString	*status;
 
   tView = [[[NSApp delegate] terminalWindowForWindow:[NSApp mainWindow]]
             terminalView];
 
-  NSLog(@"TerminalView: %@", tView);
-  
   lastFindWasSuccessful = NO;
+  status = NSLocalizedStringFromTable(@"Not found", @"FindPanel", @"Status displayed in find panel when the find string is not found.");
+
+  if (tView && ![self _searchInView:tView])
+    {
+      tView = nil;
+      status = NSLocalizedStringFromTable(@"Invalid expression", @"FindPanel", @"Status displayed in find panel when the find string is not a valid regular expression.");
+    }
 
   if (tView)
     {
-      NSString		*textContents = [[tView stringRepresentation] copy];
-      NSUInteger	textLength;
+      NSUInteger	textLength = [tView textLength];
+      NSRange		selected = [tView selectedRange];
+      NSRange		range;
+
+      /* Output clears the selection; go on from the last match then. */
+      if (!selected.length && lastMatch.length
+          && lastMatchFromEnd <= textLength)
+        {
+          selected = lastMatch;
+          selected.location = textLength - lastMatchFromEnd;
+        }
+
+      if (direction == Forward)
+        {
+          range = [search findInRange:
+                            NSMakeRange(NSMaxRange(selected),
+                                        textLength - NSMaxRange(selected))
+                            backwards:NO];
+          if (range.location == NSNotFound)
+            range = [search findInRange:NSMakeRange(0, selected.location)
+                              backwards:NO];
+        }
+      else
+        {
+          range = [search findInRange:NSMakeRange(0, selected.location)
+                            backwards:YES];
+          if (range.location == NSNotFound)
+            range = [search findInRange:
+                              NSMakeRange(NSMaxRange(selected),
+                                          textLength - NSMaxRange(selected))
+                              backwards:YES];
+        }
 
-       NSLog(@"Terminal contents length: %lu", [textContents length]);
-      
-      if (textContents && (textLength = [textContents length]))
+      if (range.location != NSNotFound)
         {
-          NSRange	range;
-          unsigned int	options = 0;
-
-          if (direction == Backward)
-            options |= NSBackwardsSearch;
-          if ([ignoreCaseButton state])
-            options |= NSCaseInsensitiveSearch;
-
-          range = [textContents findString:[self findString]
-                             selectedRange:[tView selectedRange]
-                                   options:options
-                                      wrap:YES];
-          if (range.length)
-            {
-              [tView setSelectedRange:range];
-              [tView scrollRangeToVisible:range];
-              lastFindWasSuccessful = YES;
-            }
+          [tView setSelectedRange:range];
+          [tView scrollRangeToVisible:range];
+          lastMatch = range;
+          lastMatchFromEnd = textLength - range.location;
+          lastFindWasSuccessful = YES;
         }
-      [textContents release];
     }
 
   if (!lastFindWasSuccessful)
     {
       NSBeep ();
-      [statusField setStringValue:NSLocalizedStringFromTable(@"Not found", @"FindPanel", @"Status displayed in find panel when the find string is not found.")];
+      [statusField setStringValue:status];
     }
   else
     {
-      [statusField setStringValue: @""];
+      [self _showCount];
     }
   
   return lastFindWasSuccessful;
@@ -259,46 +374,3 @@ static id	sharedFindObject = nil;
 }
 
 @end
-
-
-@implementation NSString (NSStringTextFinding)
-
-- (NSRange)findString:(NSString *)string
-        selectedRange:(NSRange)selectedRange
-              options:(unsigned)options
-                 wrap:(BOOL)wrap
-{
-  BOOL		forwards = (options & NSBackwardsSearch) == 0;
-  unsigned int	length = [self length];
-  NSRange	searchRange, range;
-
-  if (forwards)
-    {
-      searchRange.location = NSMaxRange(selectedRange);
-      searchRange.length = length - searchRange.location;
-      range = [self rangeOfString:string options:options range:searchRange];
-
-      if ((range.length == 0) && wrap)
-        { /* If not found look at the first part of the string */
-          searchRange.location = 0;
-          searchRange.length = selectedRange.location;
-          range = [self rangeOfString:string options:options range:searchRange];
-        }
-    }
-  else
-    {
-      searchRange.location = 0;
-      searchRange.length = selectedRange.location;
-      range = [self rangeOfString:string options:options range:searchRange];
-
-      if ((range.length == 0) && wrap)
-        {
-          searchRange.location = NSMaxRange(selectedRange);
-          searchRange.length = length - searchRange.location;
-          range = [self rangeOfString:string options:options range:searchRange];
-        }
-    }
-  return range;
-}
-
-@end
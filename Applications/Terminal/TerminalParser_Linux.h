@@ -66,6 +66,7 @@
   int saved_G0,saved_G1;
 
   iconv_t iconv_state;
+  BOOL    iconv_ascii; /* printable ASCII converts to itself */
   iconv_t iconv_input_state;
   
   BOOL alternateAsMeta;
@@ -1119,6 +1119,7 @@ static unsigned char color_table[] = { 0, 4, 2, 6, 1, 5, 3, 7,
 #define PUTCH                                                           \
       if ((x >= width) && decawm)                                       \
         {                                                               \
+          [ts ts_setWrapped:y];                                         \
           cr();                                                         \
           lf();                                                         \
         }                                                               \
@@ -1226,6 +1227,68 @@ static unsigned char color_table[] = { 0, 4, 2, 6, 1, 5, 3, 7,
 }
 
 
+/*
+  Printable ASCII met in the normal state, that needs no conversion and
+  fits on the current row, is collected into runs and put on the screen
+  with one ts_putChars call. Everything else, including wrapping at the
+  end of the row, goes through -processByte:.
+*/
+#define MAX_RUN 256
+
+- (void)processBytes:(const unsigned char *)buf length:(int)len
+{
+  screen_char_t run[MAX_RUN];
+  const unichar *map;
+  unsigned char attr;
+  BOOL multi_cell = [ts useMultiCellGlyphs];
+  int n, i;
+
+  while (len > 0)
+    {
+      if (vc_state != ESnormal || *buf < 32 || *buf > 126
+          || x >= width || decim || toggle_meta || input_buf_len
+          || multi_cell)
+        {
+          [self processByte:*buf++];
+          len--;
+          continue;
+        }
+
+      if (!iconv_state || translate != translate_maps[0])
+        map = translate;
+      else if (iconv_ascii)
+        map = NULL;
+      else
+        {
+          [self processByte:*buf++];
+          len--;
+          continue;
+        }
+
+      n = width - x;
+      if (n > len)
+        n = len;
+      if (n > MAX_RUN)
+        n = MAX_RUN;
+
+      attr = (intensity)|(underline<<2)|(reverse<<3)|(blink<<4);
+      for (i = 0; i < n && buf[i] >= 32 && buf[i] <= 126; i++)
+        {
+          run[i].ch = map ? map[buf[i]] : buf[i];
+          run[i].color = color;
+          run[i].attr = attr;
+        }
+
+      [ts ts_putChars:run count:i at:x :y];
+      x += i;
+      [ts ts_goto:x :y];
+
+      buf += i;
+      len -= i;
+    }
+}
+
+
 /*
   Translates '\n' to '\r' when sending.
 */
@@ -1434,6 +1497,33 @@ static unsigned char color_table[] = { 0, 4, 2, 6, 1, 5, 3, 7,
     }
 }
 
+/* Whether printable ASCII comes out of cd unchanged, so that
+   -processBytes:length: may skip iconv() for it. */
+static BOOL _iconv_keeps_ascii(iconv_t cd)
+{
+  char          in[95];
+  unsigned int  out[95];
+  char          *inp = in, *outp = (char *)out;
+  size_t        in_size = sizeof(in), out_size = sizeof(out);
+  size_t        ret;
+  int           i;
+
+  for (i = 0; i < 95; i++)
+    in[i] = 32 + i;
+
+  ret = iconv(cd, &inp, &in_size, &outp, &out_size);
+  iconv(cd, NULL, NULL, NULL, NULL);
+  if (ret == (size_t)-1 || in_size || out_size)
+    return NO;
+
+  for (i = 0; i < 95; i++)
+    {
+      if (ntohl(out[i]) != 32 + i)
+        return NO;
+    }
+  return YES;
+}
+
 - (void)setCharset:(NSString *)charsetName
 {
   const char *iconv_charset = [charsetName cString];
@@ -1448,6 +1538,10 @@ static unsigned char color_table[] = { 0, 4, 2, 6, 1, 5, 3, 7,
                 iconv_charset);
           NSLog(@"Falling back to ISO-8859-1 (Latin1).");
         }
+      else
+        {
+          iconv_ascii = _iconv_keeps_ascii(iconv_state);
+        }
 
       iconv_input_state = iconv_open(iconv_charset, "UCS-4");
       if (iconv_input_state == (iconv_t)-1)
@@ -0,0 +1,88 @@
+/*
+  This file is a part of Terminal.app. Terminal.app is free software; you
+  can redistribute it and/or modify it under the terms of the GNU General
+  Public License as published by the Free Software Foundation; version 2
+  of the License. See COPYING or main.m for more information.
+*/
+
+/*
+  Scrollback buffer. Lines are kept in a ring of segments of about
+  SB_SEGMENT_ROWS lines each, so adding a line and dropping the oldest one
+  cost the same however long the history is.
+
+  Segments that are not among the newest few may be compressed: the
+  characters are kept as UTF-16 text with the trailing run of equal
+  characters of each line cut off, and colors and attributes as runs. A
+  compressed segment is expanded again when one of its lines is looked at;
+  only a few such segments are kept expanded at a time.
+
+  Each line records whether it was wrapped, that is whether the text
+  went on on the next line because it reached the end of the row (the
+  screen marks such rows with bit 0x20 in the attributes of their last
+  cell). The lines of a wrapped text form one logical line, which is
+  flowed again into rows of the new width when the width changes.
+  Segments start with a logical line where possible, so each one can be
+  flowed again on its own: after a resize only the number of rows of
+  each segment is counted, and its cells are flowed again when one of
+  its lines is looked at.
+
+  Tests/scrollbacktest checks wrapping of the ring, compression and
+  reflowing.
+*/
+
+#ifndef TerminalScrollback_h
+#define TerminalScrollback_h
+
+#import <Foundation/NSString.h>
+
+#import "Terminal.h"
+
+#define SB_SEGMENT_ROWS 256
+
+typedef struct sb_segment_s sb_segment_t;
+
+typedef struct
+{
+  sb_segment_t	**segments; /* ring, oldest segment at head */
+  int		size, head, count;
+
+  int		width;      /* of the lines, see sb_set_width() */
+  int		length;     /* lines in the buffer at that width */
+  int		max_length;
+  BOOL		compress;
+
+  /* segment found last by sb_line() and the number of its first line
+     counting from the oldest, valid if find_index >= 0 */
+  int		find_index, find_start;
+
+  unsigned int	thaw_clock;
+  int		num_thawed;
+
+  /* the line returned last by sb_line() */
+  screen_char_t	*last_line;
+  int		last_row;
+} terminal_scrollback_t;
+
+void sb_init(terminal_scrollback_t *sb, int max_length, BOOL compress);
+void sb_free(terminal_scrollback_t *sb);
+void sb_clear(terminal_scrollback_t *sb);
+void sb_set_max_length(terminal_scrollback_t *sb, int max_length);
+/* Flows the lines again into rows of width cells. length changes, and
+   the oldest lines are dropped if there are more than max_length. */
+void sb_set_width(terminal_scrollback_t *sb, int width);
+
+/* Adds num lines of width cells after the newest line, dropping the
+   oldest lines if needed. Empty lines are added if lines is NULL. The
+   lines are flowed again first if width is not the buffer's width. */
+void sb_append(terminal_scrollback_t *sb, const screen_char_t *lines,
+               int width, int num);
+/* Removes the num newest lines. */
+void sb_remove_last(terminal_scrollback_t *sb, int num);
+
+/* Returns line row (-1 is the newest line, -length the oldest) as width
+   cells that may be changed, flowing the lines again first if width is
+   not the buffer's width. The pointer is valid until the next call of
+   any of these functions. */
+screen_char_t *sb_line(terminal_scrollback_t *sb, int row, int width);
+
+#endif
@@ -0,0 +1,577 @@
+/*
+  This file is a part of Terminal.app. Terminal.app is free software; you
+  can redistribute it and/or modify it under the terms of the GNU General
+  Public License as published by the Free Software Foundation; version 2
+  of the License. See COPYING or main.m for more information.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "TerminalScrollback.h"
+
+/* the newest segments are never compressed */
+#define HOT_SEGMENTS 2
+/* compressed segments that may stay expanded after being looked at */
+#define MAX_THAWED 8
+/* a segment is closed after SB_SEGMENT_ROWS lines at the end of a logical
+   line, or after this many lines in any case */
+#define MAX_SEGMENT_ROWS (4 * SB_SEGMENT_ROWS)
+
+/* in the attributes of the last cell of a wrapped line */
+#define WRAPPED 0x20
+/* cells that look the same; the internal attribute bits don't count */
+#define SAME_CELL(a, b) ((a).ch == (b).ch && (a).color == (b).color \
+                         && ((a).attr & 0x1f) == ((b).attr & 0x1f))
+
+typedef struct
+{
+  unsigned int   count;
+  unsigned char  color;
+  unsigned char  attr;
+} sb_run_t;
+
+/* A line that isn't wrapped ends with a run of blank cells equal to its
+   last cell, which is left out when it is flowed again and put back to
+   fill the last row. The cell is kept for when the text fills the last
+   row at some width, so that it is there again at the next one. */
+typedef struct
+{
+  screen_char_t  fill;
+  unsigned short used;    /* cells before that run */
+  unsigned char  wrapped;
+} sb_info_t;
+
+struct sb_segment_s
+{
+  int		width;
+  int		first, rows;    /* lines first..rows-1 are in use */
+  int		size;           /* lines cells and info have room for */
+  int		length;         /* lines at the width of the buffer */
+
+  /* size * width cells, NULL while compressed */
+  screen_char_t	*cells;
+  sb_info_t	*info;          /* kept while compressed too */
+
+  /* compressed: the characters of each line up to text_length, then
+     fill up to width; colors and attributes of all cells as runs */
+  unichar	*text;
+  unsigned short *text_length;
+  unichar	*fill;
+  sb_run_t	*runs;
+  int		num_runs;
+
+  unsigned int	thawed; /* when it was expanded, 0 if it isn't */
+};
+
+#define SEGMENT(sb,i) ((sb)->segments[((sb)->head + (i)) % (sb)->size])
+
+
+static sb_segment_t *segment_new(int width)
+{
+  sb_segment_t *seg = calloc(1, sizeof(sb_segment_t));
+
+  seg->width = width;
+  seg->size = SB_SEGMENT_ROWS;
+  seg->cells = calloc(seg->size * width, sizeof(screen_char_t));
+  seg->info = malloc(seg->size * sizeof(sb_info_t));
+  return seg;
+}
+
+static void segment_grow(sb_segment_t *seg)
+{
+  seg->size *= 2;
+  seg->cells = realloc(seg->cells,
+                       seg->size * seg->width * sizeof(screen_char_t));
+  seg->info = realloc(seg->info, seg->size * sizeof(sb_info_t));
+}
+
+static void set_info(sb_info_t *info, const screen_char_t *line, int width)
+{
+  const screen_char_t *last = &line[width - 1];
+  int used = width;
+
+  info->wrapped = (last->attr & WRAPPED) != 0;
+  memset(&info->fill, 0, sizeof(screen_char_t));
+  if (!info->wrapped && (last->ch == 0 || last->ch == ' '))
+    {
+      info->fill = *last;
+      used--;
+      while (used > 0 && SAME_CELL(line[used - 1], *last))
+        used--;
+    }
+  info->used = used;
+}
+
+static void segment_free_packed(sb_segment_t *seg)
+{
+  free(seg->text);
+  free(seg->text_length);
+  free(seg->fill);
+  free(seg->runs);
+  seg->text = seg->fill = NULL;
+  seg->text_length = NULL;
+  seg->runs = NULL;
+  seg->num_runs = 0;
+}
+
+static void segment_free(terminal_scrollback_t *sb, sb_segment_t *seg)
+{
+  if (seg->thawed)
+    sb->num_thawed--;
+  free(seg->cells);
+  free(seg->info);
+  segment_free_packed(seg);
+  free(seg);
+}
+
+static void segment_compress(terminal_scrollback_t *sb, sb_segment_t *seg)
+{
+  screen_char_t *line, *c, *end;
+  sb_run_t *run;
+  int r, len, t;
+
+  if (!seg->cells)
+    return;
+
+  seg->text_length = malloc(seg->rows * sizeof(unsigned short));
+  seg->fill = malloc(seg->rows * sizeof(unichar));
+  seg->text = malloc(seg->rows * seg->width * sizeof(unichar));
+
+  for (r = t = 0; r < seg->rows; r++)
+    {
+      line = seg->cells + r * seg->width;
+      len = seg->width;
+      while (len > 1 && line[len - 2].ch == line[len - 1].ch)
+        len--;
+      seg->fill[r] = line[len - 1].ch;
+      len--;
+      seg->text_length[r] = len;
+      for (c = line; c < line + len; c++)
+        seg->text[t++] = c->ch;
+    }
+  if (t)
+    seg->text = realloc(seg->text, t * sizeof(unichar));
+  else
+    {
+      free(seg->text);
+      seg->text = NULL;
+    }
+
+  end = seg->cells + seg->rows * seg->width;
+  seg->num_runs = 0;
+  for (c = seg->cells; c < end; c++)
+    {
+      if (c == seg->cells || c->color != c[-1].color || c->attr != c[-1].attr)
+        seg->num_runs++;
+    }
+  seg->runs = run = malloc(seg->num_runs * sizeof(sb_run_t));
+  run->count = 0;
+  for (c = seg->cells; c < end; c++)
+    {
+      if (c != seg->cells
+          && (c->color != run->color || c->attr != run->attr))
+        {
+          run++;
+          run->count = 0;
+        }
+      run->color = c->color;
+      run->attr = c->attr;
+      run->count++;
+    }
+
+  free(seg->cells);
+  seg->cells = NULL;
+
+  if (seg->thawed)
+    {
+      seg->thawed = 0;
+      sb->num_thawed--;
+    }
+}
+
+/* Gives a compressed segment its cells again. */
+static void segment_expand(sb_segment_t *seg)
+{
+  screen_char_t *dst;
+  unichar *t = seg->text;
+  sb_run_t *run = seg->runs;
+  int left = run->count;
+  int r, i;
+
+  seg->cells = calloc(seg->size * seg->width, sizeof(screen_char_t));
+
+  for (r = 0; r < seg->rows; r++)
+    {
+      dst = seg->cells + r * seg->width;
+      for (i = 0; i < seg->width; i++)
+        {
+          if (!left)
+            {
+              run++;
+              left = run->count;
+            }
+          left--;
+          if (i < seg->text_length[r])
+            dst[i].ch = *t++;
+          else
+            dst[i].ch = seg->fill[r];
+          dst[i].color = run->color;
+          dst[i].attr = run->attr;
+        }
+    }
+  segment_free_packed(seg);
+}
+
+/* Rows of width cells needed for len cells of a logical line */
+static inline int rows_for(int len, int width)
+{
+  return len > 0 ? (len + width - 1) / width : 1;
+}
+
+/* Finds the logical line starting with line r of the segment: stores
+   its last line in end and returns the cells of its text. */
+static int logical_line(sb_segment_t *seg, int r, int *end)
+{
+  int e;
+
+  for (e = r; e < seg->rows - 1 && seg->info[e].wrapped; e++)
+    ;
+  *end = e;
+  return ((e - r) * seg->width
+          + (seg->info[e].wrapped ? seg->width : seg->info[e].used));
+}
+
+/* Lines the segment has when it is flowed into rows of width cells */
+static int segment_count(sb_segment_t *seg, int width)
+{
+  int r, e, count = 0;
+
+  for (r = seg->first; r < seg->rows; r = e + 1)
+    count += rows_for(logical_line(seg, r, &e), width);
+  return count;
+}
+
+/* Flows the logical lines of an expanded segment into rows of width
+   cells. The lines of a logical line follow each other in cells, so its
+   text is len cells from its first line on. */
+static void segment_reflow(sb_segment_t *seg, int width)
+{
+  screen_char_t *cells, *src, *dst;
+  sb_info_t *info, *last;
+  int size, r, e, len, n, j, k, i, take;
+
+  size = segment_count(seg, width);
+  cells = malloc(size * width * sizeof(screen_char_t));
+  info = malloc(size * sizeof(sb_info_t));
+
+  j = 0;
+  for (r = seg->first; r < seg->rows; r = e + 1)
+    {
+      len = logical_line(seg, r, &e);
+      src = seg->cells + r * seg->width;
+      last = &seg->info[e];
+
+      n = rows_for(len, width);
+      for (k = 0; k < n; k++, j++)
+        {
+          dst = cells + j * width;
+          take = len - k * width;
+          if (take > width)
+            take = width;
+          if (take < 0)
+            take = 0;
+          memcpy(dst, src + k * width, take * sizeof(screen_char_t));
+          for (i = 0; i < take; i++)
+            dst[i].attr &= ~WRAPPED;
+          for (i = take; i < width; i++)
+            dst[i] = last->fill;
+
+          info[j].fill = last->fill;
+          info[j].wrapped = (k < n - 1) || last->wrapped;
+          info[j].used = info[j].wrapped ? width : take;
+          if (info[j].wrapped)
+            dst[width - 1].attr |= WRAPPED;
+        }
+    }
+
+  free(seg->cells);
+  free(seg->info);
+  seg->cells = cells;
+  seg->info = info;
+  seg->width = width;
+  seg->first = 0;
+  seg->rows = seg->size = seg->length = size;
+}
+
+/* Compresses the segment that was expanded first, other than except. */
+static void freeze_oldest_thawed(terminal_scrollback_t *sb,
+                                 sb_segment_t *except)
+{
+  sb_segment_t *seg, *oldest = NULL;
+  int i;
+
+  for (i = 0; i < sb->count; i++)
+    {
+      seg = SEGMENT(sb, i);
+      if (seg->thawed && seg != except
+          && (!oldest || seg->thawed < oldest->thawed))
+        oldest = seg;
+    }
+  if (oldest)
+    segment_compress(sb, oldest);
+}
+
+static void push_segment(terminal_scrollback_t *sb, sb_segment_t *seg)
+{
+  if (sb->count == sb->size)
+    {
+      sb_segment_t **segments;
+      int size = sb->size ? sb->size * 2 : 8;
+      int i;
+
+      segments = malloc(size * sizeof(sb_segment_t *));
+      for (i = 0; i < sb->count; i++)
+        segments[i] = SEGMENT(sb, i);
+      free(sb->segments);
+      sb->segments = segments;
+      sb->size = size;
+      sb->head = 0;
+    }
+
+  sb->segments[(sb->head + sb->count) % sb->size] = seg;
+  sb->count++;
+
+  if (sb->compress && sb->count > HOT_SEGMENTS)
+    segment_compress(sb, SEGMENT(sb, sb->count - 1 - HOT_SEGMENTS));
+}
+
+/* Gives the segment its cells at the width of the buffer. */
+static void segment_prepare(terminal_scrollback_t *sb, sb_segment_t *seg)
+{
+  if (!seg->cells)
+    {
+      segment_expand(seg);
+      seg->thawed = ++sb->thaw_clock;
+      sb->num_thawed++;
+      if (sb->num_thawed > MAX_THAWED)
+        freeze_oldest_thawed(sb, seg);
+    }
+  if (seg->width != sb->width)
+    segment_reflow(seg, sb->width);
+}
+
+static void drop_first_line(terminal_scrollback_t *sb)
+{
+  sb_segment_t *seg = SEGMENT(sb, 0);
+
+  /* a compressed segment of the right width loses its line as it is */
+  if (seg->width != sb->width)
+    segment_prepare(sb, seg);
+
+  seg->first++;
+  seg->length--;
+  sb->length--;
+  sb->find_index = -1;
+  if (seg->first == seg->rows)
+    {
+      segment_free(sb, seg);
+      sb->head = (sb->head + 1) % sb->size;
+      sb->count--;
+    }
+}
+
+/* Returns the index of the segment holding line k, counting from the
+   oldest line, and stores the number of its first line in start. */
+static int find_segment(terminal_scrollback_t *sb, int k, int *start)
+{
+  int i, s;
+
+  if (sb->find_index >= 0)
+    {
+      i = sb->find_index;
+      s = sb->find_start;
+    }
+  else if (k < sb->length / 2)
+    {
+      i = 0;
+      s = 0;
+    }
+  else
+    {
+      i = sb->count - 1;
+      s = sb->length - SEGMENT(sb, i)->length;
+    }
+
+  while (k < s)
+    {
+      i--;
+      s -= SEGMENT(sb, i)->length;
+    }
+  while (k >= s + SEGMENT(sb, i)->length)
+    {
+      s += SEGMENT(sb, i)->length;
+      i++;
+    }
+
+  sb->find_index = i;
+  sb->find_start = s;
+  *start = s;
+  return i;
+}
+
+
+void sb_init(terminal_scrollback_t *sb, int max_length, BOOL compress)
+{
+  memset(sb, 0, sizeof(terminal_scrollback_t));
+  sb->max_length = max_length;
+  sb->compress = compress;
+  sb->find_index = -1;
+}
+
+void sb_free(terminal_scrollback_t *sb)
+{
+  sb_clear(sb);
+  free(sb->segments);
+  sb->segments = NULL;
+  sb->size = 0;
+}
+
+void sb_clear(terminal_scrollback_t *sb)
+{
+  int i;
+
+  for (i = 0; i < sb->count; i++)
+    segment_free(sb, SEGMENT(sb, i));
+  sb->head = sb->count = 0;
+  sb->length = 0;
+  sb->last_line = NULL;
+  sb->find_index = -1;
+}
+
+void sb_set_max_length(terminal_scrollback_t *sb, int max_length)
+{
+  sb->max_length = max_length;
+  if (max_length <= 0)
+    {
+      sb_clear(sb);
+      return;
+    }
+  while (sb->length > max_length)
+    drop_first_line(sb);
+  sb->last_line = NULL;
+}
+
+void sb_set_width(terminal_scrollback_t *sb, int width)
+{
+  sb_segment_t *seg;
+  int i;
+
+  if (width == sb->width)
+    return;
+
+  /* only count the lines: segments are flowed again when they are used */
+  sb->width = width;
+  sb->length = 0;
+  for (i = 0; i < sb->count; i++)
+    {
+      seg = SEGMENT(sb, i);
+      if (seg->width == width)
+        seg->length = seg->rows - seg->first;
+      else
+        seg->length = segment_count(seg, width);
+      sb->length += seg->length;
+    }
+  sb->last_line = NULL;
+  sb->find_index = -1;
+
+  while (sb->length > sb->max_length)
+    drop_first_line(sb);
+}
+
+void sb_append(terminal_scrollback_t *sb, const screen_char_t *lines,
+               int width, int num)
+{
+  sb_segment_t *seg;
+  screen_char_t *line;
+
+  if (sb->max_length <= 0)
+    return;
+
+  sb_set_width(sb, width);
+  sb->last_line = NULL;
+  for (; num > 0; num--)
+    {
+      seg = sb->count ? SEGMENT(sb, sb->count - 1) : NULL;
+      if (!seg || seg->rows >= MAX_SEGMENT_ROWS
+          || (seg->rows >= SB_SEGMENT_ROWS && !seg->info[seg->rows - 1].wrapped))
+        {
+          seg = segment_new(width);
+          push_segment(sb, seg);
+        }
+      else
+        {
+          segment_prepare(sb, seg);
+          if (seg->rows == seg->size)
+            segment_grow(seg);
+        }
+
+      line = seg->cells + seg->rows * width;
+      if (lines)
+        {
+          memcpy(line, lines, width * sizeof(screen_char_t));
+          lines += width;
+        }
+      else
+        {
+          memset(line, 0, width * sizeof(screen_char_t));
+        }
+      set_info(&seg->info[seg->rows], line, width);
+      seg->rows++;
+      seg->length++;
+      sb->length++;
+
+      if (sb->length > sb->max_length)
+        drop_first_line(sb);
+    }
+}
+
+void sb_remove_last(terminal_scrollback_t *sb, int num)
+{
+  sb_segment_t *seg;
+
+  sb->last_line = NULL;
+  sb->find_index = -1;
+  for (; num > 0 && sb->length > 0; num--)
+    {
+      seg = SEGMENT(sb, sb->count - 1);
+      if (seg->width != sb->width)
+        segment_prepare(sb, seg);
+      seg->rows--;
+      seg->length--;
+      sb->length--;
+      if (seg->rows == seg->first)
+        {
+          segment_free(sb, seg);
+          sb->count--;
+        }
+    }
+}
+
+screen_char_t *sb_line(terminal_scrollback_t *sb, int row, int width)
+{
+  sb_segment_t *seg;
+  int k, start;
+
+  sb_set_width(sb, width);
+  if (sb->last_line && row == sb->last_row)
+    return sb->last_line;
+
+  k = sb->length + row;
+  seg = SEGMENT(sb, find_segment(sb, k, &start));
+  segment_prepare(sb, seg);
+
+  sb->last_line = seg->cells + (seg->first + k - start) * width;
+  sb->last_row = row;
+  return sb->last_line;
+}
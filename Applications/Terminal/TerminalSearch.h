@@ -0,0 +1,70 @@
+/*
+  This file is a part of Terminal.app. Terminal.app is free software; you
+  can redistribute it and/or modify it under the terms of the GNU General
+  Public License as published by the Free Software Foundation; version 2
+  of the License. See COPYING or main.m for more information.
+*/
+
+/*
+  Searches the contents of a TerminalView (screen and scrollback buffer)
+  without making a string of all of it. The text is read a chunk at a time
+  into a buffer that is kept between searches, so a search costs about as
+  much as the part of the history it has to look at.
+
+  A chunk is searched together with the first characters of the next one,
+  so matches running over the end of a chunk are found if they are not
+  longer than that overlap: twice the pattern for plain strings, a line of
+  the terminal for regular expressions.
+
+  Ranges are in the index space of -[TerminalView selectedRange].
+
+  The view is not retained, so a search kept by the find panel doesn't
+  keep a closed window's view and scrollback alive; its owner drops the
+  search when the view's window closes.
+*/
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSRange.h>
+
+@class NSString;
+@class NSRegularExpression;
+@class TerminalView;
+
+@interface TerminalSearch : NSObject
+{
+  TerminalView		*view;
+  NSString		*pattern;
+  NSRegularExpression	*expression; /* nil for plain string searches */
+  BOOL			ignoreCase;
+
+  unichar		*buffer;
+  NSUInteger		buffer_size;
+  NSUInteger		overlap;
+}
+
+/* Find strings written as /expression/ are regular expressions. */
++ (BOOL)isRegularExpression:(NSString *)string;
+
+/* Returns nil if string is not a valid regular expression. */
+- (id)initWithView:(TerminalView *)aView
+            string:(NSString *)string
+        ignoreCase:(BOOL)flag;
+
+- (TerminalView *)view;
+- (NSString *)string;
+- (BOOL)ignoreCase;
+
+/* Returns the first match (or the last one if backwards) that lies
+   completely in range, or a range with location NSNotFound. Chunks are
+   searched from the start (end) of range on, so finding the next match
+   only reads the text up to it. */
+- (NSRange)findInRange:(NSRange)range backwards:(BOOL)backwards;
+
+/* Sends action to target with an NSValue of each match starting in range,
+   in order, as it is found, and returns the number of matches. Matches
+   may run past the end of range. */
+- (NSUInteger)findAllInRange:(NSRange)range
+                      target:(id)target
+                      action:(SEL)action;
+
+@end
@@ -0,0 +1,246 @@
+/*
+  This file is a part of Terminal.app. Terminal.app is free software; you
+  can redistribute it and/or modify it under the terms of the GNU General
+  Public License as published by the Free Software Foundation; version 2
+  of the License. See COPYING or main.m for more information.
+*/
+
+#include <stdlib.h>
+
+#import <Foundation/NSRegularExpression.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+#import "TerminalView.h"
+#import "TerminalSearch.h"
+
+/* characters read at a time */
+#define SEARCH_CHUNK 65536
+
+@implementation TerminalSearch
+
++ (BOOL)isRegularExpression:(NSString *)string
+{
+  return ([string length] > 2
+          && [string hasPrefix:@"/"] && [string hasSuffix:@"/"]);
+}
+
+- (id)initWithView:(TerminalView *)aView
+            string:(NSString *)string
+        ignoreCase:(BOOL)flag
+{
+  if (!(self = [super init]))
+    return nil;
+
+  view = aView; /* not retained, see TerminalSearch.h */
+  pattern = [string copy];
+  ignoreCase = flag;
+
+  if ([TerminalSearch isRegularExpression:string])
+    {
+      NSString *regex;
+
+      regex = [string substringWithRange:NSMakeRange(1, [string length] - 2)];
+      expression = [[NSRegularExpression alloc]
+                     initWithPattern:regex
+                             options:(ignoreCase
+                                      ? NSRegularExpressionCaseInsensitive : 0)
+                               error:NULL];
+      if (!expression)
+        {
+          [self release];
+          return nil;
+        }
+      overlap = [view windowSize].width;
+    }
+  else
+    {
+      overlap = 2 * [pattern length];
+    }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  free(buffer);
+  [expression release];
+  [pattern release];
+  [super dealloc];
+}
+
+- (TerminalView *)view
+{
+  return view;
+}
+
+- (NSString *)string
+{
+  return pattern;
+}
+
+- (BOOL)ignoreCase
+{
+  return ignoreCase;
+}
+
+/* Returns a string of the text from location on, length characters and
+   the overlap but nothing past limit. The string uses buffer, so it must
+   be released before the next call. */
+- (NSString *)_newTextAt:(NSUInteger)location
+                  length:(NSUInteger)length
+                   limit:(NSUInteger)limit
+{
+  length = location + length + overlap;
+  if (length > limit)
+    length = limit;
+  length -= location;
+
+  if (length > buffer_size)
+    {
+      buffer_size = length;
+      buffer = realloc(buffer, buffer_size * sizeof(unichar));
+    }
+  [view getCharacters:buffer range:NSMakeRange(location, length)];
+
+  return [[NSString alloc] initWithCharactersNoCopy:buffer
+                                             length:length
+                                       freeWhenDone:NO];
+}
+
+/* Empty matches of regular expressions are skipped. */
+- (NSRange)_findIn:(NSString *)text
+             range:(NSRange)range
+         backwards:(BOOL)backwards
+{
+  NSRange	found = NSMakeRange(NSNotFound, 0);
+  NSArray	*matches;
+  NSInteger	i;
+
+  if (!expression)
+    {
+      return [text rangeOfString:pattern
+                         options:((backwards ? NSBackwardsSearch : 0)
+                                  | (ignoreCase ? NSCaseInsensitiveSearch : 0))
+                           range:range];
+    }
+
+  if (!backwards)
+    {
+      while (range.length)
+        {
+          found = [expression rangeOfFirstMatchInString:text
+                                                options:0
+                                                  range:range];
+          if (found.location == NSNotFound || found.length)
+            break;
+          range.length -= found.location + 1 - range.location;
+          range.location = found.location + 1;
+          found = NSMakeRange(NSNotFound, 0);
+        }
+      return found;
+    }
+
+  matches = [expression matchesInString:text options:0 range:range];
+  for (i = [matches count] - 1; i >= 0; i--)
+    {
+      found = [[matches objectAtIndex:i] range];
+      if (found.length)
+        return found;
+    }
+  return NSMakeRange(NSNotFound, 0);
+}
+
+- (NSRange)findInRange:(NSRange)range backwards:(BOOL)backwards
+{
+  NSUInteger	end = NSMaxRange(range);
+  NSUInteger	pos, length;
+  NSString	*text;
+  NSRange	found = NSMakeRange(NSNotFound, 0);
+
+  if (![pattern length])
+    return found;
+
+  /* A match starting after the chunk that is found in its overlap is
+     still the first match from the start of the chunk on. Going
+     backwards, matches starting after the chunk were looked for in the
+     chunk before. */
+  pos = backwards ? end : range.location;
+  while (found.location == NSNotFound
+         && (backwards ? pos > range.location : pos < end))
+    {
+      if (backwards)
+        {
+          length = pos - range.location;
+          if (length > SEARCH_CHUNK)
+            length = SEARCH_CHUNK;
+          pos -= length;
+        }
+      else
+        {
+          length = end - pos;
+          if (length > SEARCH_CHUNK)
+            length = SEARCH_CHUNK;
+        }
+
+      text = [self _newTextAt:pos length:length limit:end];
+      found = [self _findIn:text
+                      range:NSMakeRange(0, [text length])
+                  backwards:backwards];
+      [text release];
+
+      if (found.location != NSNotFound)
+        found.location += pos;
+      else if (!backwards)
+        pos += length;
+    }
+
+  return found;
+}
+
+- (NSUInteger)findAllInRange:(NSRange)range
+                      target:(id)target
+                      action:(SEL)action
+{
+  NSUInteger	end = NSMaxRange(range);
+  NSUInteger	limit = [view textLength];
+  NSUInteger	pos, length, count = 0;
+  NSString	*text;
+  NSRange	r, found;
+
+  if (![pattern length])
+    return 0;
+
+  if (end > limit)
+    end = limit;
+  for (pos = range.location; pos < end; )
+    {
+      length = end - pos;
+      if (length > SEARCH_CHUNK)
+        length = SEARCH_CHUNK;
+
+      text = [self _newTextAt:pos length:length limit:limit];
+      r = NSMakeRange(0, [text length]);
+      while (r.length)
+        {
+          found = [self _findIn:text range:r backwards:NO];
+          if (found.location == NSNotFound || found.location >= length)
+            break;
+
+          r.length -= NSMaxRange(found) - r.location;
+          r.location = NSMaxRange(found);
+          found.location += pos;
+          count++;
+          [target performSelector:action
+                       withObject:[NSValue valueWithRange:found]];
+        }
+      [text release];
+
+      /* the next chunk starts after the last match */
+      pos += (r.location > length ? r.location : length);
+    }
+
+  return count;
+}
+
+@end
@@ -18,6 +18,7 @@
 
 #import "Terminal.h"
 #import "TerminalParser_Linux.h"
+#import "TerminalScrollback.h"
 
 #import "Defaults.h"
 
@@ -54,9 +55,15 @@ struct selection_range
 
   BOOL		blackOnWhite;
 
+  /* bounding box of the cells changed since the last update, and the
+     changed cells of each row of the screen (x0 >= x1 if none) */
   struct {
     int x0,y0,x1,y1;
   } dirty;
+  struct {
+    int x0,x1;
+  } *dirty_rows;
+  BOOL		draw_runs; /* characters may be drawn several at once */
 
   NSScroller	*scroller;
   BOOL		scroll_bottom_on_input;
@@ -65,9 +72,8 @@ struct selection_range
   int		write_buf_len, write_buf_size;
 
   int		max_scrollback;
-  int		sb_length;
   int		current_scroll;
-  screen_char_t	*sbuf;
+  terminal_scrollback_t scrollback;
 
   int		sx,sy;
   screen_char_t *screen;
@@ -88,6 +94,22 @@ struct selection_range
      full-screen scrolls. pending_scroll is the combined pending line delta */
   int pending_scroll;
 
+  /* how much output readData processes before the screen is updated */
+  int read_bytes_per_update;
+  int read_scrolls_per_update;
+
+  /* Output is parsed as it arrives, but the screen is updated at most once
+     per update_interval; changes in between are collected in dirty and
+     shown by update_timer. Output that follows a key press shortly is
+     shown at once so that typing doesn't lag. */
+  NSTimeInterval update_interval;
+  NSTimeInterval last_update, last_key;
+  NSTimer	*update_timer;
+
+  /* statistics, see -benchmark: */
+  unsigned long long bytes_parsed;
+  unsigned int	updates, echo_updates, deferred_reads, frames_drawn;
+
   BOOL ignore_resize;
 
   float border_x, border_y;
@@ -143,6 +165,10 @@ struct selection_range
 - (void)setSelectedRange:(NSRange)range;
 - (void)scrollRangeToVisible:(NSRange)range;
 - (NSString *)stringRepresentation;
+/* Screen and scrollback buffer contents as by -stringRepresentation, read
+   in place. */
+- (NSUInteger)textLength;
+- (void)getCharacters:(unichar *)buffer range:(NSRange)range;
 
 - (void)setIgnoreResize:(BOOL)ignore;
 - (void)setBorder:(float)x :(float)y;
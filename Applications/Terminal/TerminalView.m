@@ -301,6 +301,10 @@ NSString *TerminalViewSizeDidChangeNotification=@"TerminalViewSizeDidChange";
 - (void)setScroller:(NSScroller *)sc;
 @end
 
+@interface TerminalView (display_private)
+- (NSRect)_dirtyRect;
+@end
+
 @interface TerminalView (selection)
 - (void)_clearSelection;
 @end
@@ -321,6 +325,7 @@ NSString *TerminalViewSizeDidChangeNotification=@"TerminalViewSizeDidChange";
 @implementation TerminalView (display)
 
 #define ADD_DIRTY(ax0,ay0,asx,asy) do { \
+		int _y; \
 		if (dirty.x0==-1) \
 		{ \
 			dirty.x0=(ax0); \
@@ -335,9 +340,24 @@ NSString *TerminalViewSizeDidChangeNotification=@"TerminalViewSizeDidChange";
 			if (dirty.x1<(ax0)+(asx)) dirty.x1=(ax0)+(asx); \
 			if (dirty.y1<(ay0)+(asy)) dirty.y1=(ay0)+(asy); \
 		} \
+		for (_y=(ay0); _y<(ay0)+(asy); _y++) \
+		{ \
+			if (_y<0 || _y>=sy) continue; \
+			if (dirty_rows[_y].x0>(ax0)) dirty_rows[_y].x0=(ax0); \
+			if (dirty_rows[_y].x1<(ax0)+(asx)) dirty_rows[_y].x1=(ax0)+(asx); \
+		} \
 	} while (0)
 
 #define SCREEN(x, y) (screen[(y) * sx + (x)])
+/* a cell already showing new, a character as the parser hands it over */
+#define SAME_CELL(cell, new) ((cell).ch == (new).ch \
+                              && (cell).color == (new).color \
+                              && ((cell).attr & 0x7f) == (new).attr)
+/* line y (negative) of the scrollback buffer */
+#define SB_LINE(y) (sb_line(&scrollback, (y), sx))
+/* cell i (negative) of the scrollback buffer, counting back from the first
+   cell of the screen */
+#define SBUF(i) (SB_LINE(-((sx - 1 - (i)) / sx))[((i) % sx + sx) % sx])
 
 /* handle accumulated pending scrolls with a single composite */
 - (void)_handlePendingScroll:(BOOL)lockFocus
@@ -388,7 +408,25 @@ NSString *TerminalViewSizeDidChangeNotification=@"TerminalViewSizeDidChange";
   pending_scroll=0;
 }
 
-static int total_draw = 0;
+static int total_draw = 0;  /* glyphs */
+static int total_cells = 0; /* cells */
+static int total_runs = 0;  /* DPSshow calls */
+
+/* Draws the characters collected in drawRect: since the last call with a
+   single DPSshow. Cells are collected as long as they are next to each
+   other and don't change the color or font. */
+#define FLUSH_RUN() do {                                \
+    if (run_text_len)                                   \
+      {                                                 \
+        run_buf[run_text_len] = 0;                      \
+        /* ~580 cycles */                               \
+        DPSmoveto(cur, run_x + fx0, scr_y + fy0);       \
+        /* ~3800 cycles for a single glyph */           \
+        DPSshow(cur, run_buf);                          \
+        total_runs++;                                   \
+      }                                                 \
+    run_len = run_text_len = 0;                         \
+  } while (0)
 
 static const float col_h[8]={  0, 240, 120, 180,   0, 300,  30,   0};
 static const float col_s[8]={0.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.0};
@@ -527,13 +565,19 @@ static void set_foreground(NSGraphicsContext *gc,
 - (void)drawRect:(NSRect)r
 {
   int ix,iy;
+  int rx0,rx1;
   char buf[8];
+  char run_buf[1024];
+  int run_len = 0, run_text_len = 0;
+  float run_x = 0;
+  BOOL bold_color_set = NO;
   NSGraphicsContext *cur = GSCurrentContext();
   int x0,y0,x1,y1;
   NSFont *f,*current_font = nil;
 
   int encoding;
 
+  frames_drawn++;
   NSDebugLLog(@"draw",@"drawRect: (%g %g)+(%g %g) %i\n",
               r.origin.x,r.origin.y,r.size.width,r.size.height,
               draw_all);
@@ -622,16 +666,25 @@ static void set_foreground(NSGraphicsContext *gc,
     for (iy = y0; iy < y1; iy++)
       {
         ry = iy + current_scroll;
+        rx0 = x0;
+        rx1 = x1;
+        if (!draw_all && ry >= 0)
+          {
+            if (rx0 < dirty_rows[ry].x0) rx0 = dirty_rows[ry].x0;
+            if (rx1 > dirty_rows[ry].x1) rx1 = dirty_rows[ry].x1;
+            if (rx0 >= rx1)
+              continue;
+          }
         if (ry >= 0)
-          ch = &SCREEN(x0,ry);
+          ch = &SCREEN(rx0,ry);
         else
-          ch = &sbuf[x0 + (max_scrollback + ry) * sx];
+          ch = &SB_LINE(ry)[rx0];
 
         scr_y = (sy - 1 - iy) * fy + border_y;
 
         /* ~400 cycles/cell on average */
         start_x = -1;
-        for (ix = x0; ix < x1; ix++,ch++)
+        for (ix = rx0; ix < rx1; ix++,ch++)
           {
             /* no need to draw && not dirty */
             if (!draw_all && !(ch->attr & 0x80))
@@ -752,21 +805,34 @@ static void set_foreground(NSGraphicsContext *gc,
     for (iy = y0; iy < y1; iy++)
       {
         ry = iy + current_scroll;
+        rx0 = x0;
+        rx1 = x1;
+        if (!draw_all && ry >= 0)
+          {
+            if (rx0 < dirty_rows[ry].x0) rx0 = dirty_rows[ry].x0;
+            if (rx1 > dirty_rows[ry].x1) rx1 = dirty_rows[ry].x1;
+            if (rx0 >= rx1)
+              continue;
+          }
         if (ry >= 0)
-          ch = &SCREEN(x0,ry);
+          ch = &SCREEN(rx0,ry);
         else
-          ch = &sbuf[x0 + (max_scrollback + ry) * sx];
+          ch = &SB_LINE(ry)[rx0];
 
         scr_y = (sy - 1 - iy) * fy + border_y;
 
-        for (ix = x0; ix < x1; ix++,ch++)
+        for (ix = rx0; ix < rx1; ix++,ch++)
           {
             /* no need to draw && not dirty */
             if (!draw_all && !(ch->attr & 0x80))
-              continue;
+              {
+                FLUSH_RUN();
+                continue;
+              }
 
             // Clear dirty bit
             ch->attr &= 0x7f;
+            total_cells++;
 
             scr_x = ix * fx + border_x;
 
@@ -781,6 +847,8 @@ static void set_foreground(NSGraphicsContext *gc,
                     
                     if (color != l_color || ch->attr != l_attr)
                       {
+                        FLUSH_RUN();
+                        bold_color_set = NO;
                         l_color = color;
                         l_attr = ch->attr;
                         
@@ -807,6 +875,8 @@ static void set_foreground(NSGraphicsContext *gc,
                     // fprintf(stderr, "'%c' blink\n", ch->ch);
                     if (ch->attr != l_attr)
                       {
+                        FLUSH_RUN();
+                        bold_color_set = NO;
                         l_attr = ch->attr;
                         if (l_attr & 0x40) // selection FG
                           {
@@ -826,6 +896,8 @@ static void set_foreground(NSGraphicsContext *gc,
                     
                     if (color != l_color || ch->attr != l_attr)
                       {
+                        FLUSH_RUN();
+                        bold_color_set = NO;
                         l_color = color;
                         l_attr = ch->attr;
                         
@@ -854,16 +926,23 @@ static void set_foreground(NSGraphicsContext *gc,
               }
 
             //--- FONTS & ENCODING
-            if (ch->ch != 0 && ch->ch != 32 && ch->ch != MULTI_CELL_GLYPH)
+            if (ch->ch == MULTI_CELL_GLYPH)
+              {
+                /* the glyph before is wider than a cell */
+                FLUSH_RUN();
+              }
+            else if (ch->ch != 0 && ch->ch != 32)
               {
                 total_draw++;
                 if ((ch->attr & 3) == 2)
                   {
                     encoding = boldFont_encoding;
                     f = boldFont;
-                    if ((ch->color & 0x0f) == 15)
+                    if ((ch->color & 0x0f) == 15 && !bold_color_set)
                       {
+                        FLUSH_RUN();
                         DPSsethsbcolor(cur,TEXT_BOLD_H,TEXT_BOLD_S,TEXT_BOLD_B);
+                        bold_color_set = YES;
                       }
                   }
                 else
@@ -874,35 +953,42 @@ static void set_foreground(NSGraphicsContext *gc,
                 if (f != current_font)
                   {
                     /* ~190 cycles/change */
+                    FLUSH_RUN();
                     [f set];
                     current_font = f;
                   }
+
+                if (run_len > (int)sizeof(run_buf) - 8)
+                  FLUSH_RUN();
+                if (!run_len)
+                  run_x = scr_x;
                  
                 /* we short-circuit utf8 for performance with back-art */
                 /* TODO: short-circuit latin1 too? */
                  if (encoding == NSUTF8StringEncoding)
                   {
                     unichar uch = ch->ch;
+                    char *p = run_buf + run_len;
                     if (uch >= 0x800)
                       {
-                        buf[2] = (uch & 0x3f) | 0x80;
+                        p[2] = (uch & 0x3f) | 0x80;
                         uch >>= 6;
-                        buf[1] = (uch & 0x3f) | 0x80;
+                        p[1] = (uch & 0x3f) | 0x80;
                         uch >>= 6;
-                        buf[0] = (uch & 0x0f) | 0xe0;
-                        buf[3] = 0;
+                        p[0] = (uch & 0x0f) | 0xe0;
+                        run_len += 3;
                       }
                     else if (uch >= 0x80)
                       {
-                        buf[1] = (uch & 0x3f) | 0x80;
+                        p[1] = (uch & 0x3f) | 0x80;
                         uch >>= 6;
-                        buf[0] = (uch & 0x1f) | 0xc0;
-                        buf[2] = 0;
+                        p[0] = (uch & 0x1f) | 0xc0;
+                        run_len += 2;
                       }
                     else
                       {
-                        buf[0] = uch;
-                        buf[1] = 0;
+                        p[0] = uch;
+                        run_len++;
                       }
                   }
                 else
@@ -910,8 +996,7 @@ static void set_foreground(NSGraphicsContext *gc,
                     unichar uch = ch->ch;
                     if (uch <= 0x80)
                       {
-                        buf[0] = uch;
-                        buf[1] = 0;
+                        run_buf[run_len++] = uch;
                       }
                     else
                       {
@@ -919,32 +1004,39 @@ static void set_foreground(NSGraphicsContext *gc,
                         unsigned int dlen = sizeof(buf) - 1;
                         GSFromUnicode(&pbuf,&dlen,&uch,1,encoding,NULL,
                                       GSUniTerminate);
+                        memcpy(run_buf + run_len, buf, strlen(buf));
+                        run_len += strlen(buf);
                       }
                   }
-                /* ~580 cycles */
-                DPSmoveto(cur,scr_x+fx0,scr_y+fy0);
-                /* baseline here for mc-case 0.65 */
-                /* ~3800 cycles */
-                DPSshow(cur,buf);
-
-                /* ~95 cycles to ARTGState -DPSshow:... */
-                /* ~343 cycles to isEmpty */
-                /* ~593 cycles to currentpoint */
-                /* ~688 cycles to transform */
-                /* ~1152 cycles to FTFont -drawString:... */
-                /* ~1375 cycles to -drawString:... setup */
-                /* ~1968 cycles cmap lookup */
-                /* ~2718 cycles sbit lookup */
-                /* ~~2750 cycles blit setup */
-                /* ~3140 cycles blit loop, empty call */
-                /* ~3140 cycles blit loop, setup */
-                /* ~3325 cycles blit loop, no write */
-                /* ~3800 cycles total */
+                run_text_len = run_len;
+
+                if (!draw_runs)
+                  FLUSH_RUN();
+              }
+            else if (run_len)
+              {
+                /* keep runs going over spaces, but don't draw them at
+                   the end of a run */
+                if (run_len < (int)sizeof(run_buf) - 8)
+                  run_buf[run_len++] = ' ';
+                else
+                  FLUSH_RUN();
               }
 
             //--- UNDERLINE
             if (ch->attr & 0x4)
-              DPSrectfill(cur,scr_x,scr_y,fx,1);
+              {
+                FLUSH_RUN();
+                DPSrectfill(cur,scr_x,scr_y,fx,1);
+              }
+          }
+        FLUSH_RUN();
+
+        /* the row is drawn, up to date cells or not */
+        if (ry >= 0 && rx0 <= dirty_rows[ry].x0 && rx1 >= dirty_rows[ry].x1)
+          {
+            dirty_rows[ry].x0 = sx;
+            dirty_rows[ry].x1 = 0;
           }
       }
   }
@@ -1002,11 +1094,87 @@ static void set_foreground(NSGraphicsContext *gc,
 }
 
 
-- (void)benchmark:(id)sender
+/* the bounding box of the cells changed since dirty was reset, in view
+   coordinates */
+- (NSRect)_dirtyRect
+{
+  NSRect dr;
+
+  dr.origin.x = dirty.x0*fx;
+  dr.origin.y = dirty.y0*fy;
+  dr.size.width = (dirty.x1-dirty.x0)*fx;
+  dr.size.height = (dirty.y1-dirty.y0)*fy;
+  dr.origin.y = fy*sy-(dr.origin.y+dr.size.height);
+  dr.origin.x += border_x;
+  dr.origin.y += border_y;
+  return dr;
+}
+
+/* Output of a few typical programs, one frame at a time: lines scrolling
+   by, a full screen editor redrawing its lines and a process monitor
+   changing a few fields of a mostly unchanged table. */
+static NSData *benchmark_frame(int workload, int frame, int sy)
 {
+  NSMutableData *d = [NSMutableData data];
+  char line[64];
   int i;
+
+#define ADD(s) [d appendBytes:(s) length:strlen(s)]
+  switch (workload)
+    {
+    case 0: /* scroll */
+      for (i = 0; i < 4; i++)
+        {
+          sprintf(line, "%6i: the quick brown fox jumps over the lazy dog\r\n",
+                  frame * 4 + i);
+          ADD(line);
+        }
+      break;
+    case 1: /* vim */
+      ADD("\033[H");
+      for (i = 0; i < sy - 1; i++)
+        {
+          sprintf(line, "\033[33m%4i \033[%im%s\033[0m\033[K\r\n",
+                  i + frame, 31 + (i + frame) % 6,
+                  (i + frame) % 3 ? "static int foo(int bar)" : "{");
+          ADD(line);
+        }
+      ADD("\033[7m-- INSERT --\033[0m\033[K");
+      break;
+    case 2: /* top */
+      ADD("\033[H");
+      sprintf(line, "top - 12:%02i:%02i up 3 days, load average: 0.%02i\033[K",
+              frame / 60 % 60, frame % 60, frame % 100);
+      ADD(line);
+      for (i = 1; i < sy; i++)
+        {
+          sprintf(line, "\033[%i;1H%5i user  20 0 %6i %5.1f %s",
+                  i + 1, 1000 + i, 4096 + i * 16,
+                  i == frame % sy ? (frame % 10) * 1.5 : 0.0,
+                  i % 4 ? "bash" : "Terminal");
+          ADD(line);
+        }
+      break;
+    }
+#undef ADD
+  return d;
+}
+
+- (void)benchmark:(id)sender
+{
+  static const char *workloads[3] = {"scroll", "vim", "top"};
+  int i, w;
   double t1,t2;
   NSRect r = [self frame];
+  NSData *d;
+  screen_char_t *saved_screen;
+  terminal_scrollback_t saved_scrollback;
+  struct selection_range saved_selection;
+  int saved_cursor_x, saved_cursor_y, saved_current_scroll;
+
+  fprintf(stderr,"%llu bytes parsed, %u updates (%u echo), %u reads not"
+          " shown at once, %u frames drawn\n",
+          bytes_parsed, updates, echo_updates, deferred_reads, frames_drawn);
   
   t1 = [NSDate timeIntervalSinceReferenceDate];
   total_draw = 0;
@@ -1020,6 +1188,56 @@ static void set_foreground(NSGraphicsContext *gc,
   t2 = [NSDate timeIntervalSinceReferenceDate];
   t2 -= t1;
   fprintf(stderr,"%8.4f  %8.5f/redraw   total_draw=%i\n",t2,t2/i,total_draw);
+
+  /* Update only what the output changed, like readData does. The
+     workloads are written to a copy of the screen and an empty scrollback
+     buffer, the user's ones are put back afterwards. */
+  saved_screen = screen;
+  saved_scrollback = scrollback;
+  saved_selection = selection;
+  saved_cursor_x = cursor_x;
+  saved_cursor_y = cursor_y;
+  saved_current_scroll = current_scroll;
+  screen = malloc(sizeof(screen_char_t)*sx*sy);
+  memcpy(screen, saved_screen, sizeof(screen_char_t)*sx*sy);
+  sb_init(&scrollback, max_scrollback, saved_scrollback.compress);
+  current_scroll = 0;
+
+  for (w = 0; w < 3; w++)
+    {
+      total_draw = total_cells = total_runs = 0;
+      t1 = [NSDate timeIntervalSinceReferenceDate];
+      for (i = 0; i < 200; i++)
+        {
+          d = benchmark_frame(w, i, sy);
+          dirty.x0 = -1;
+          [tp processBytes:[d bytes] length:[d length]];
+          if (dirty.x0 < 0)
+            continue;
+          draw_all = 0;
+          [self lockFocus];
+          [self drawRect:[self _dirtyRect]];
+          [self unlockFocusNeedsFlush:NO];
+        }
+      t2 = [NSDate timeIntervalSinceReferenceDate] - t1;
+      fprintf(stderr,"%-6s %8.1f frames/s  cells=%i runs=%i total_draw=%i\n",
+              workloads[w], i / t2, total_cells, total_runs, total_draw);
+    }
+
+  free(screen);
+  sb_free(&scrollback);
+  screen = saved_screen;
+  scrollback = saved_scrollback;
+  selection = saved_selection;
+  cursor_x = saved_cursor_x;
+  cursor_y = saved_cursor_y;
+  current_scroll = saved_current_scroll;
+  pending_scroll = 0;
+  [self _updateScroller];
+
+  total_draw = total_cells = total_runs = 0;
+  draw_all = 2;
+  [self setNeedsDisplay:YES];
 }
 
 
@@ -1050,9 +1268,16 @@ static void set_foreground(NSGraphicsContext *gc,
   if (cursor_y < 0) cursor_y = 0;
 }
 
+/* The wrap bit is not shown, so the cell is not marked dirty. */
+- (void)ts_setWrapped:(int)y
+{
+  if (y < 0 || y >= sy) return;
+  SCREEN(sx - 1, y).attr |= 0x20;
+}
+
 - (void)ts_putChar:(screen_char_t)ch count:(int)c at:(int)x :(int)y
 {
-  int i;
+  int i, x0, x1 = 0;
   screen_char_t *s;
 
   NSDebugLLog(@"ts",@"putChar: '%c' %02x %02x count: %i at: %i:%i",
@@ -1067,10 +1292,50 @@ static void set_foreground(NSGraphicsContext *gc,
       x = 0;
     }
   s = &SCREEN(x, y);
-  ch.attr |= 0x80;
-  for (i = 0; i < c; i++)
-    *s ++= ch;
-  ADD_DIRTY(x, y, c, 1);
+  for (i = 0, x0 = -1; i < c; i++, s++)
+    {
+      if (SAME_CELL(*s, ch))
+        continue;
+      if (x0 < 0)
+        x0 = i;
+      x1 = i;
+      *s = ch;
+      s->attr |= 0x80;
+    }
+  if (x0 >= 0)
+    ADD_DIRTY(x + x0, y, x1 - x0 + 1, 1);
+}
+
+- (void)ts_putChars:(screen_char_t *)chars count:(int)c at:(int)x :(int)y
+{
+  int i, x0, x1 = 0;
+  screen_char_t *s;
+
+  NSDebugLLog(@"ts",@"putChars: count: %i at: %i:%i",c,x,y);
+
+  if (y < 0 || y >= sy) return;
+  if (x < 0)
+    {
+      chars -= x;
+      c += x;
+      x = 0;
+    }
+  if (x + c > sx)
+    c = sx - x;
+  if (c <= 0) return;
+  s = &SCREEN(x, y);
+  for (i = 0, x0 = -1; i < c; i++, s++)
+    {
+      if (SAME_CELL(*s, chars[i]))
+        continue;
+      if (x0 < 0)
+        x0 = i;
+      x1 = i;
+      *s = chars[i];
+      s->attr |= 0x80;
+    }
+  if (x0 >= 0)
+    ADD_DIRTY(x + x0, y, x1 - x0 + 1, 1);
 }
 
 - (void)ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs
@@ -1104,33 +1369,16 @@ static void set_foreground(NSGraphicsContext *gc,
 
   if (save && (t == 0) && (b == sy)) /* TODO? */
     {
-      int num;
-      if (nr < max_scrollback)
-        {
-          memmove(sbuf, &sbuf[sx * nr],
-                  sizeof(screen_char_t) * sx * (max_scrollback - nr));
-          num=nr;
-        }
-      else
-        num = max_scrollback;
-
-      if (num < sy)
+      if (nr < sy)
         {
-          memmove(&sbuf[sx * (max_scrollback - num)], screen,
-                  num*sx*sizeof(screen_char_t));
+          sb_append(&scrollback, screen, sx, nr);
         }
       else
         {
-          memmove(&sbuf[sx * (max_scrollback - num)],screen,
-                  sy*sx*sizeof(screen_char_t));
-
+          sb_append(&scrollback, screen, sx, sy);
           /* TODO: should this use video_erase_char? */
-          memset(&sbuf[sx * (max_scrollback - num + sy)], 0,
-                 sx*(num-sy)*sizeof(screen_char_t));
+          sb_append(&scrollback, NULL, sx, nr - sy);
         }
-      sb_length += num;
-      if (sb_length > max_scrollback)
-        sb_length = max_scrollback;
     }
 
   if (t+nr >= b)
@@ -1154,6 +1402,11 @@ static void set_foreground(NSGraphicsContext *gc,
       */
     }
   memmove(d, s, (b-t-nr) * sx * sizeof(screen_char_t));
+  /* The rows scrolled in still hold what was there before, but by the
+     time a deferred scroll is drawn that need not be what they show, so
+     unchanged cells written to them must be drawn too. */
+  for (d = &SCREEN(0, b - nr); d < &SCREEN(0, b); d++)
+    d->attr |= 0x80;
   if (!current_scroll)
     {
       if (t == 0 && b == sy)
@@ -1187,7 +1440,7 @@ static void set_foreground(NSGraphicsContext *gc,
 
 - (void)ts_scrollDown:(int)t :(int)b rows:(int)nr
 {
-  screen_char_t *s;
+  screen_char_t *s, *d;
   unsigned int step;
 
   NSDebugLLog(@"ts",@"scrollDown: %i:%i  rows: %i",
@@ -1205,6 +1458,9 @@ static void set_foreground(NSGraphicsContext *gc,
       draw_cursor = YES;
     }
   memmove(s + step, s, (b-t-nr)*sx*sizeof(screen_char_t));
+  /* see ts_scrollUp:::rows:save: */
+  for (d = s; d < s + step; d++)
+    d->attr |= 0x80;
   if (!current_scroll)
     {
       if (t == 0 && b == sy)
@@ -1372,7 +1628,7 @@ static void set_foreground(NSGraphicsContext *gc,
 // Menu item "Edit > Clear Buffer"
 - (void)clearBuffer:(id)sender
 {
-  sb_length = 0;
+  sb_clear(&scrollback);
   current_scroll = 0;
   [self _updateScroller];
   [self setNeedsDisplay:YES];
@@ -1389,11 +1645,12 @@ static void set_foreground(NSGraphicsContext *gc,
 
 - (void)_updateScroller
 {
-  if (sb_length)
+  if (scrollback.length)
     {
       [scroller setEnabled:YES];
-      [scroller setFloatValue:(current_scroll+sb_length)/(float)(sb_length)
-               knobProportion:sy/(float)(sy+sb_length)];
+      [scroller
+        setFloatValue:(current_scroll+scrollback.length)/(float)(scrollback.length)
+       knobProportion:sy/(float)(sy+scrollback.length)];
     }
   else
     {
@@ -1406,8 +1663,8 @@ static void set_foreground(NSGraphicsContext *gc,
   if (new_scroll > 0)
     new_scroll = 0;
   
-  if (new_scroll < -sb_length)
-    new_scroll = -sb_length;
+  if (new_scroll < -scrollback.length)
+    new_scroll = -scrollback.length;
 
   if (new_scroll == current_scroll)
     return;
@@ -1447,7 +1704,7 @@ static void set_foreground(NSGraphicsContext *gc,
       part == NSScrollerKnobSlot)
     {
       float f = [scroller floatValue];
-      new_scroll = (f - 1.0) * sb_length;
+      new_scroll = (f - 1.0) * scrollback.length;
       update = NO;
     }
   else if (part == NSScrollerDecrementLine)
@@ -1517,6 +1774,7 @@ static void set_foreground(NSGraphicsContext *gc,
   if (master_fd == -1)
     return;
 
+  last_key = [NSDate timeIntervalSinceReferenceDate];
   [tp handleKeyEvent:e];
   
   // unichar ch = [s characterAtIndex:0];
@@ -1552,7 +1810,6 @@ static void set_foreground(NSGraphicsContext *gc,
 
 - (NSString *)_selectionAsString
 {
-  int ofs = max_scrollback * sx;
   NSMutableString *mstr;
   NSString *tmp;
   unichar buf[32];
@@ -1572,7 +1829,7 @@ static void set_foreground(NSGraphicsContext *gc,
       while (1)
         {
           if (i < 0)
-            ch = sbuf[ofs+i].ch;
+            ch = SBUF(i).ch;
           else
             ch = screen[i].ch;
 
@@ -1640,12 +1897,12 @@ static void set_foreground(NSGraphicsContext *gc,
 
 - (void)_setSelection:(struct selection_range)s
 {
-  int i,j,ofs2;
+  int i,j;
 
-  if (s.location < -sb_length * sx)
+  if (s.location < -scrollback.length * sx)
     {
-      s.length += sb_length * sx + s.location;
-      s.location =- sb_length * sx;
+      s.length += scrollback.length * sx + s.location;
+      s.location =- scrollback.length * sx;
     }
   if (s.location + s.length > sx * sy)
     {
@@ -1657,16 +1914,14 @@ static void set_foreground(NSGraphicsContext *gc,
   if (s.length == selection.length && s.location == selection.location)
     return;
 
-  ofs2 = max_scrollback * sx;
-
   j = selection.location + selection.length;
   if (j > s.location)
     j = s.location;
 
   for (i = selection.location;i < j && i < 0;i++)
     {
-      sbuf[ofs2+i].attr &= 0xbf;
-      sbuf[ofs2+i].attr |= 0x80;
+      SBUF(i).attr &= 0xbf;
+      SBUF(i).attr |= 0x80;
     }
   for (;i < j;i++)
     {
@@ -1680,8 +1935,8 @@ static void set_foreground(NSGraphicsContext *gc,
   j = selection.location + selection.length;
   for (;i<j && i<0;i++)
     {
-      sbuf[ofs2+i].attr &= 0xbf;
-      sbuf[ofs2+i].attr |= 0x80;
+      SBUF(i).attr &= 0xbf;
+      SBUF(i).attr |= 0x80;
     }
   for (;i<j;i++)
     {
@@ -1693,8 +1948,8 @@ static void set_foreground(NSGraphicsContext *gc,
   j = s.location+s.length;
   for (;i<j && i<0;i++)
     {
-      if (!(sbuf[ofs2+i].attr & 0x40))
-        sbuf[ofs2+i].attr |= 0xc0;
+      if (!(SBUF(i).attr & 0x40))
+        SBUF(i).attr |= 0xc0;
     }
   for (;i<j;i++)
     {
@@ -1820,8 +2075,8 @@ static void set_foreground(NSGraphicsContext *gc,
 - (void)selectAll:(id)sender
 {
   struct selection_range s;
-  s.location = 0 - (sb_length * sx);
-  s.length = (sx * sy) + (sb_length * sx);
+  s.location = 0 - (scrollback.length * sx);
+  s.length = (sx * sy) + (scrollback.length * sx);
   [self _setSelection:s];
 }
 
@@ -1889,13 +2144,12 @@ static void set_foreground(NSGraphicsContext *gc,
 
   if (g == 2)
     { /* select words */
-      int ofs = max_scrollback * sx;
-      unichar ch,ch2;
+          unichar ch,ch2;
       NSCharacterSet *cs;
       int i,j;
 
       if (pos < 0)
-        ch = sbuf[ofs+pos].ch;
+        ch = SBUF(pos).ch;
       else
         ch = screen[pos].ch;
       if (ch == 0) ch = ' ';
@@ -1925,7 +2179,7 @@ static void set_foreground(NSGraphicsContext *gc,
       for (i = pos-1; i >= j; i--)
         {
           if (i < 0)
-            ch2 = sbuf[ofs+i].ch;
+            ch2 = SBUF(i).ch;
           else
             ch2 = screen[i].ch;
           if (ch2 == 0) ch2 = ' ';
@@ -1940,7 +2194,7 @@ static void set_foreground(NSGraphicsContext *gc,
       for (i = pos+1; i < j; i++)
         {
           if (i < 0)
-            ch2 = sbuf[ofs+i].ch;
+            ch2 = SBUF(i).ch;
           else
             ch2=screen[i].ch;
           if (ch2 == 0) ch2 = ' ';
@@ -2062,17 +2316,85 @@ static void set_foreground(NSGraphicsContext *gc,
   return nil;
 }
 
-- (void)readData
+/* Output read this soon after a key press, and no more than this, is
+   taken to be the echo of what was typed and shown at once. */
+#define ECHO_TIME 0.2
+#define ECHO_BYTES 2048
+
+/* Shows what changed since the last update. */
+- (void)_updateScreen
 {
-  char buf[256];
-  int size,total,i;
+  if (update_timer)
+    {
+      [update_timer invalidate];
+      update_timer = nil;
+    }
+
+  if (cursor_x!=current_x || cursor_y!=current_y)
+    {
+      ADD_DIRTY(current_x,current_y,1,1);
+      SCREEN(current_x,current_y).attr|=0x80;
+      ADD_DIRTY(cursor_x,cursor_y,1,1);
+      draw_cursor=YES;
+    }
+
+  NSDebugLLog(@"term",@"done (%i %i) (%i %i)\n",
+              dirty.x0,dirty.y0,dirty.x1,dirty.y1);
+
+  if (dirty.x0>=0)
+    {
+      NSRect dr;
+
+// NSLog(@"dirty=(%i %i)-(%i %i)\n",dirty.x0,dirty.y0,dirty.x1,dirty.y1);
+      dr = [self _dirtyRect];
+// NSLog(@"-> dirty=(%g %g)+(%g %g)\n",dirty.origin.x,dirty.origin.y,dirty.size.width,dirty.size.height);
+      [self setNeedsLazyDisplayInRect:dr];
+
+      if (current_scroll != 0)
+        { /* TODO */
+          if (scroll_bottom_on_input == YES)
+            {
+              current_scroll = 0;
+            }
+          [self setNeedsDisplay:YES];
+        }
+
+      [self _updateScroller];
+
+      last_update = [NSDate timeIntervalSinceReferenceDate];
+      updates++;
+    }
 
-  total = 0;
   num_scrolls = 0;
   dirty.x0 = -1;
-
   current_x = cursor_x;
   current_y = cursor_y;
+}
+
+- (void)_updateTimerFired:(NSTimer *)t
+{
+  update_timer = nil;
+  [self _updateScreen];
+}
+
+- (void)readData
+{
+  unsigned char buf[16384];
+  int size,total;
+  int start_scroll;
+  BOOL exited = NO;
+  NSTimeInterval now;
+
+  total = 0;
+  start_scroll = pending_scroll;
+  if (!update_timer)
+    {
+      num_scrolls = 0;
+      dirty.x0 = -1;
+
+      current_x = cursor_x;
+      current_y = cursor_y;
+    }
 
   [self _clearSelection]; /* TODO? */
 
@@ -2123,12 +2445,12 @@ static void set_foreground(NSGraphicsContext *gc,
           //   }
           // [self release];
 
+          exited = YES;
           break;
         }
 
 
-      for (i=0;i<size;i++)
-        [tp processByte: buf[i]];
+      [tp processBytes:buf length:size];
 
       total+=size;
       /*
@@ -2137,50 +2459,46 @@ static void set_foreground(NSGraphicsContext *gc,
         throughput. High numbers means more input is processed before the
         screen is updated, leading to higher throughput but also to more
         'jerky' updates. Low numbers would give smoother updating and less
-        latency, but throughput goes down.
-
-        TODO: tweak more? seems pretty good now
+        latency, but throughput goes down. Both are in the preferences
+        (ReadBytesPerUpdate, ReadScrollsPerUpdate).
       */
-      if (total>=8192 || (num_scrolls+abs(pending_scroll))>10)
+      if (total>=read_bytes_per_update
+          || (num_scrolls+abs(pending_scroll-start_scroll))
+             >read_scrolls_per_update)
         break;
     }
+  bytes_parsed += total;
 
-  if (cursor_x!=current_x || cursor_y!=current_y)
+  /*
+    Updating the screen for every read wastes time on frames nobody gets
+    to see when a program writes a lot, so updates are spaced
+    update_interval apart and the output in between is only parsed. An
+    update is never put off by more than that, and the echo of typing is
+    shown at once.
+  */
+  now = [NSDate timeIntervalSinceReferenceDate];
+  if (exited || now - last_update >= update_interval)
     {
-      ADD_DIRTY(current_x,current_y,1,1);
-      SCREEN(current_x,current_y).attr|=0x80;
-      ADD_DIRTY(cursor_x,cursor_y,1,1);
-      draw_cursor=YES;
+      [self _updateScreen];
     }
-
-  NSDebugLLog(@"term",@"done (%i %i) (%i %i)\n",
-              dirty.x0,dirty.y0,dirty.x1,dirty.y1);
-
-  if (dirty.x0>=0)
+  else if (now - last_key < ECHO_TIME && total <= ECHO_BYTES)
     {
-      NSRect dr;
-
-// NSLog(@"dirty=(%i %i)-(%i %i)\n",dirty.x0,dirty.y0,dirty.x1,dirty.y1);
-      dr.origin.x = dirty.x0*fx;
-      dr.origin.y = dirty.y0*fy;
-      dr.size.width = (dirty.x1-dirty.x0)*fx;
-      dr.size.height = (dirty.y1-dirty.y0)*fy;
-      dr.origin.y = fy*sy-(dr.origin.y+dr.size.height);
-// NSLog(@"-> dirty=(%g %g)+(%g %g)\n",dirty.origin.x,dirty.origin.y,dirty.size.width,dirty.size.height);
-      dr.origin.x += border_x;
-      dr.origin.y += border_y;
-      [self setNeedsLazyDisplayInRect:dr];
-
-      if (current_scroll != 0)
-        { /* TODO */
-          if (scroll_bottom_on_input == YES)
-            {
-              current_scroll = 0;
-            }
-          [self setNeedsDisplay:YES];
+      echo_updates++;
+      [self _updateScreen];
+    }
+  else
+    {
+      deferred_reads++;
+      if (!update_timer)
+        {
+          update_timer =
+            [NSTimer
+              scheduledTimerWithTimeInterval:last_update+update_interval-now
+                                      target:self
+                                    selector:@selector(_updateTimerFired:)
+                                    userInfo:nil
+                                     repeats:NO];
         }
-
-      [self _updateScroller];
     }
 }
 
@@ -2516,9 +2834,10 @@ static int handled_mask = (NSDragOperationCopy |
 {
   int nsx,nsy;
   struct winsize ws;
-  screen_char_t *nscreen,*nsbuf;
+  screen_char_t *nscreen;
   int iy,ny;
   int copy_sx;
+  int line_shift;
 
   nsx = (size.width-border_x)/fx;
   nsy = (size.height-border_y)/fy;
@@ -2548,138 +2867,86 @@ static int handled_mask = (NSDragOperationCopy |
 
   [self _clearSelection]; /* TODO? */
 
-  // Prepare new screen and history buffer
+  // Prepare new screen. Its lines are cut or padded, while the logical
+  // lines of the scrollback buffer are flowed again to the new width.
   nscreen=malloc(nsx*nsy*sizeof(screen_char_t));
-  nsbuf=malloc(nsx*max_scrollback*sizeof(screen_char_t));
-  if (!nscreen || !nsbuf)
+  if (!nscreen)
     {
       NSLog(@"Failed to allocate screen buffer!");
-      if (nscreen)
-        free(nscreen);
-      if (nsbuf)
-        free(nsbuf);
       return;
     }
   memset(nscreen, 0, sizeof(screen_char_t) * nsx * nsy);
-  memset(nsbuf, 0, sizeof(screen_char_t) * nsx * max_scrollback);
 
   copy_sx=sx;
   if (copy_sx > nsx)
     copy_sx = nsx;
 
-  //NSLog(@"copy %i+%i %i  (%ix%i)-(%ix%i)\n",start,num,copy_sx,sx,sy,nsx,nsy);
-
-  /* TODO: handle resizing and scrollback improve? */
   // sy,sx - current screen height(lines) and width(chars)
   // nsy,nsx - screen height(lines) and width(chars) after resize 
-  // sb_length - current scroll buffer length
   // cursor_y - vertical position of cursor (starts from 0)
-  
-  // fprintf(stderr,
-  //         "***> sb_length=%i, max_scrollback=%i, sy=%i, nsy=%i cursor_y=%i\n",
-  //         sb_length, max_scrollback, sy, nsy, cursor_y);
 
-  // what amount of lines shifted?
-  // value is positive if gap between last line and view bottom exist
-  // value is negative if resized view overlap bottom lines
-  int line_shift = nsy - (cursor_y+1);
-  // int last_line = (sy > nsy) ? sy-1 : sy-1 + sb_length;
+  // How many lines are shifted down? Positive if lines of the scrollback
+  // buffer are pulled into the enlarged screen, negative if the top lines
+  // of the shrunk screen are pushed into the scrollback buffer. These go
+  // in with the old width, before the buffer is flowed again.
+  line_shift = 0;
+  if (sy > nsy)
+    {
+      // decrease: cut bottom of 'screen' if cursor stays visible
+      if (cursor_y >= nsy)
+        line_shift = nsy - (cursor_y+1);
+      if (line_shift < 0)
+        sb_append(&scrollback, screen, sx, -line_shift);
+    }
 
-  // increase with scrollbuffer
-  if (sy <= nsy && sb_length > 0 && line_shift > sb_length)
-    line_shift = sb_length;
+  sb_set_width(&scrollback, nsx);
 
-  // NOTE: this part of code is not very short, but it's clear and simple.
-  // Leave it as is.
-  for (iy=-sb_length; iy<sy; iy++)
+  if (sy < nsy)
     {
-      screen_char_t *src,*dst;
-
-      // what is direction of resize: increase or descrease?
-      if (sy > nsy)
-        // decrease
+      // increase: fill the gap below the last line from scrollback
+      line_shift = nsy - (cursor_y+1);
+      if (line_shift > scrollback.length)
+        line_shift = scrollback.length;
+      for (iy=-line_shift; iy<0; iy++)
         {
-          // cut bottom of 'screen' or not?
-          if (cursor_y < nsy)
-            // cut
-            {
-              ny = iy;
-            }
-          else
-            // not cut
-            {
-              ny = iy + line_shift;
-            }
-        }
-      else
-        // increase
-        {
-          // do we have scrollback buffer filled?
-          if (sb_length > 0)
-            // YES
-            {
-              // if (line_shift > sb_length) line_shift = sb_length;
-              ny = iy + line_shift;
-            }
-          else
-            // NO
-            {
-              ny = iy;
-            }
+          memcpy(&nscreen[nsx*(iy+line_shift)], sb_line(&scrollback, iy, nsx),
+                 nsx*sizeof(screen_char_t));
         }
-      if (ny >= nsy)
-        break;
-
-      if (ny < -max_scrollback)
-        continue;
-      
-      // fprintf(stderr, "* iy=%i ny=%i\n", iy, ny);
-      
-      if (iy < 0)
-        src = &sbuf[sx*(max_scrollback+iy)];
-      else
-        src = &screen[sx*iy];
-
-      if (ny < 0)
-        dst = &nsbuf[nsx*(max_scrollback+ny)];
-      else
-        dst = &nscreen[nsx*ny];
-
-      memcpy(dst, src, copy_sx*sizeof(screen_char_t));
+      sb_remove_last(&scrollback, line_shift);
     }
 
-  // update cursor y position
-  if ((sy < nsy) && (sb_length > 0))
+  for (iy=(line_shift < 0 ? -line_shift : 0); iy<sy; iy++)
     {
-      cursor_y = cursor_y + line_shift;
+      ny = iy + line_shift;
+      if (ny >= nsy)
+        break;
+      memcpy(&nscreen[nsx*ny], &screen[sx*iy], copy_sx*sizeof(screen_char_t));
+      // a padded line doesn't reach the end of the row any more
+      if (copy_sx < nsx)
+        nscreen[nsx*ny+copy_sx-1].attr &= ~0x20;
     }
 
-  // Calculate new scroll buffer length
-  if (nsy <= cursor_y || sy < nsy)
-    sb_length = sb_length - line_shift;
-  
-  if (sb_length > max_scrollback)
-    sb_length = max_scrollback;
-  if (sb_length < 0)
-    sb_length = 0;
-
-  // fprintf(stderr,
-  //         "***< sb_length=%i, max_scrollback=%i, sy=%i, nsy=%i cursor_y=%i\n",
-  //         sb_length, max_scrollback, sy, nsy, cursor_y);
+  // update cursor y position
+  cursor_y += line_shift;
 
   sx=nsx;
   sy=nsy;
   free(screen);
-  free(sbuf);
   screen=nscreen;
-  sbuf=nsbuf;
 
-  if (cursor_x > sx) cursor_x = sx-1;
-  if (cursor_y > sy) cursor_y = sy-1;
-  
-  // fprintf(stderr,
-  //         "***< sb_length=%i, max_scrollback=%i, sy=%i, nsy=%i cursor_y=%i line_shift=%i\n",
-  //         sb_length, max_scrollback, sy, nsy, cursor_y, line_shift);
+  dirty_rows=realloc(dirty_rows, sy*sizeof(dirty_rows[0]));
+  for (iy=0; iy<sy; iy++)
+    {
+      dirty_rows[iy].x0 = sx;
+      dirty_rows[iy].x1 = 0;
+    }
+
+  if (current_scroll < -scrollback.length)
+    current_scroll = -scrollback.length;
+
+  if (cursor_x >= sx) cursor_x = sx-1;
+  if (cursor_y >= sy) cursor_y = sy-1;
+  if (cursor_y < 0) cursor_y = 0;
 
   [self _updateScroller];
 
@@ -2720,6 +2987,8 @@ static int handled_mask = (NSDragOperationCopy |
 // ---
 - initWithFrame:(NSRect)frame
 {
+  int i;
+
   sx = [defaults windowWidth];
   sy = [defaults windowHeight];
 
@@ -2742,12 +3011,21 @@ static int handled_mask = (NSDragOperationCopy |
 
   screen = malloc(sizeof(screen_char_t)*sx*sy);
   memset(screen,0,sizeof(screen_char_t)*sx*sy);
+  dirty_rows = malloc(sizeof(dirty_rows[0])*sy);
+  for (i = 0; i < sy; i++)
+    {
+      dirty_rows[i].x0 = sx;
+      dirty_rows[i].x1 = 0;
+    }
   draw_all = 2;
 
   max_scrollback = [defaults scrollBackLines];
-  sbuf = malloc(sizeof(screen_char_t)*sx*max_scrollback);
-  memset(sbuf,0,sizeof(screen_char_t)*sx*max_scrollback);
+  sb_init(&scrollback, max_scrollback, [defaults scrollBackCompressed]);
   scroll_bottom_on_input = [defaults scrollBottomOnInput];
+  read_bytes_per_update = [defaults readBytesPerUpdate];
+  read_scrolls_per_update = [defaults readScrollsPerUpdate];
+  if ([defaults updatesPerSecond] > 0)
+    update_interval = 1.0 / [defaults updatesPerSecond];
 
   tp = [[TerminalParser_Linux alloc] initWithTerminalScreen:self
                                                       width:sx
@@ -2794,9 +3072,10 @@ static int handled_mask = (NSDragOperationCopy |
   DESTROY(scroller);
 
   free(screen);
-  free(sbuf);
   screen=NULL;
-  sbuf=NULL;
+  free(dirty_rows);
+  dirty_rows=NULL;
+  sb_free(&scrollback);
 
   DESTROY(additionalWordCharacters);
   DESTROY(font);
@@ -2823,54 +3102,39 @@ static int handled_mask = (NSDragOperationCopy |
 // - (NSString *)stringForRange:(struct selection_range)range
 - (NSString *)stringRepresentation
 {
-  int			ofs = max_scrollback * sx;
-  NSMutableString	*mstr = [[NSMutableString alloc] init];
-  NSString		*tmp;
-  unichar		buf[32];
-  unichar      		ch;
-  int			start_index, end_index;
-  int			len;
-
-  if (sb_length > 0)
-    start_index = -(sb_length * sx);
-  else
-    start_index = 0;
-  
-  end_index = sx * sy;
-  // j = abs(sb_length * sx) + range.length;
-  // range.length = scrollbuffer size + visible area size in terms of chars
-  len = 0;
-  for (int i = start_index; i < end_index; i++)
-    {
-      if (i < 0)
-        ch = sbuf[ofs+i].ch;
-      else
-        ch = screen[i].ch;
-
-      if (i >= end_index)
-        break;
+  NSUInteger	length = [self textLength];
+  unichar	*buf = malloc(length * sizeof(unichar));
 
-      buf[len++] = ch;
-      
-      if (len == 32)
-        {
-          tmp = [[NSString alloc] initWithCharacters:buf length:32];
-          [mstr appendString:tmp];
-          DESTROY(tmp);
-          len = 0;
-        }
-    }
+  [self getCharacters:buf range:NSMakeRange(0, length)];
+  return [[[NSString alloc] initWithCharactersNoCopy:buf
+                                              length:length
+                                        freeWhenDone:YES] autorelease];
+}
+- (NSUInteger)textLength
+{
+  return (NSUInteger)(scrollback.length + sy) * sx;
+}
+- (void)getCharacters:(unichar *)buffer range:(NSRange)range
+{
+  NSUInteger	i = range.location, end = NSMaxRange(range);
+  int		line, x, n;
+  screen_char_t	*ch;
 
-  if (len)
+  while (i < end)
     {
-      tmp = [[NSString alloc] initWithCharacters:buf length:len];
-      [mstr appendString:tmp];
-      DESTROY(tmp);
-    }
+      line = i / sx - scrollback.length;
+      x = i % sx;
+      n = sx - x;
+      if ((NSUInteger)n > end - i)
+        n = end - i;
 
-  NSLog(@"TerminalView stringRepresentation length: %lu", [mstr length]);
-
-  return mstr;
+      if (line < 0)
+        ch = SB_LINE(line) + x;
+      else
+        ch = &SCREEN(x, line);
+      for (i += n; n > 0; n--, ch++)
+        *buffer++ = ch->ch;
+    }
 }
 - (NSRange)selectedRange
 {
@@ -2879,7 +3143,7 @@ static int handled_mask = (NSDragOperationCopy |
   range.length = selection.length;
 
   if (selection.location < 0)
-    range.location = (sb_length * sx) + selection.location;
+    range.location = (scrollback.length * sx) + selection.location;
   else
     range.location = selection.location;
   
@@ -2889,7 +3153,7 @@ static int handled_mask = (NSDragOperationCopy |
 {
   struct selection_range s;
 
-  s.location = range.location - (sb_length * sx);
+  s.location = range.location - (scrollback.length * sx);
   s.length = range.length;
   
   [self _setSelection:s];
@@ -2898,7 +3162,7 @@ static int handled_mask = (NSDragOperationCopy |
 {
   int scroll_to;
   
-  scroll_to = ((range.location/sx) - sb_length); // - sy/2;
+  scroll_to = ((range.location/sx) - scrollback.length); // - sy/2;
   [self _scrollTo:scroll_to update:YES];
 }
 
@@ -2911,6 +3175,26 @@ static int handled_mask = (NSDragOperationCopy |
   ASSIGN(additionalWordCharacters, str);
 }
 
+/* Characters are drawn a run at a time only if every glyph advances by
+   exactly one cell. */
+static BOOL advances_one_cell(NSFont *f, float fx)
+{
+  NSGlyph g;
+
+  if (!f || ![f isFixedPitch])
+    return NO;
+  g = [f glyphWithName:@"M"];
+  if (g == NSNullGlyph)
+    return NO;
+  return [f advancementForGlyph:g].width == fx;
+}
+
+- (void)_updateDrawRuns
+{
+  draw_runs = (advances_one_cell(font, fx)
+               && (!boldFont || advances_one_cell(boldFont, fx)));
+}
+
 - (void)setFont:(NSFont *)aFont
 {
   NSRect r;
@@ -2926,6 +3210,7 @@ static int handled_mask = (NSDragOperationCopy |
   fx0 = -r.origin.x;
   fy0 = -r.origin.y;
   font_encoding = [font mostCompatibleStringEncoding];
+  [self _updateDrawRuns];
   
   NSDebugLLog(@"term", @"Bounding (%g %g)+(%g %g)", -fx0, -fy0, fx, fy);
   NSDebugLLog(@"term", @"Normal font encoding %i", font_encoding);
@@ -2938,6 +3223,7 @@ static int handled_mask = (NSDragOperationCopy |
   ASSIGN(boldFont, bFont);
   
   boldFont_encoding = [boldFont mostCompatibleStringEncoding];
+  [self _updateDrawRuns];
   
   NSDebugLLog(@"term", @"Bold font encoding %i", boldFont_encoding);
     
@@ -2946,7 +3232,7 @@ static int handled_mask = (NSDragOperationCopy |
 
 - (int)scrollBufferLength
 {
-  return sb_length;
+  return scrollback.length;
 }
 
 - (void)setScrollBufferMaxLength:(int)lines
@@ -2954,19 +3240,16 @@ static int handled_mask = (NSDragOperationCopy |
   if (max_scrollback == lines) return;
   
   max_scrollback = lines;
+  sb_set_max_length(&scrollback, max_scrollback);
   
   if (max_scrollback == 0)
     [self clearBuffer:self];
-
-  {// Adopt scrollback buffer to new 'max_scrollback' value
-    screen_char_t *nsbuf;
-    int sby = (max_scrollback > 0) ? max_scrollback : 1;
-
-    nsbuf = malloc(sizeof(screen_char_t) * sx * sby);
-    memset(nsbuf, 0, sizeof(screen_char_t) * sx * sby);
-    free(sbuf);
-    sbuf = nsbuf;
-  }  
+  else
+    {
+      if (current_scroll < -scrollback.length)
+        current_scroll = -scrollback.length;
+      [self _updateScroller];
+    }
 }
 
 - (void)setScrollBottomOnInput:(BOOL)scrollBottom
@@ -3069,7 +3352,7 @@ static int handled_mask = (NSDragOperationCopy |
 {
   NSString *itemTitle = [menuItem title];
 
-  if ([itemTitle isEqualToString:@"Clear Buffer"] && (sb_length <= 0))
+  if ([itemTitle isEqualToString:@"Clear Buffer"] && (scrollback.length <= 0))
     return NO;
   if ([itemTitle isEqualToString:@"Copy"] && (selection.length <= 0))
     return NO;
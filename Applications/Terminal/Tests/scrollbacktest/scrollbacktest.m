@@ -0,0 +1,251 @@
+/*
+  This file is a part of Terminal.app. Terminal.app is free software; you
+  can redistribute it and/or modify it under the terms of the GNU General
+  Public License as published by the Free Software Foundation; version 2
+  of the License. See COPYING or main.m for more information.
+*/
+
+/*
+  Checks the scrollback buffer:
+
+  - wrap: more lines than max_length are added, so the oldest segments
+    are dropped and the ring of segments wraps around; every line left
+    must be the one added at its place.
+  - compression: lines read back from compressed segments, including
+    after more segments were expanded than are kept, must have the
+    characters, colors and attributes they were added with.
+  - reflow: wrapped lines of varying length, added at one width, are
+    read back flowed into a wider width and again into the first one,
+    with and without compression; the lines must be those the screen
+    shows at each width.
+
+  usage: scrollbacktest
+  Exits with 1 if any check fails.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#import "TerminalScrollback.h"
+
+#define WIDTH 80
+
+/* Line n: a word that moves with n, colors and attributes in runs, and a
+   tail of spaces, as compression cuts trailing runs of equal cells. */
+static void make_line(int n, screen_char_t *line, int width)
+{
+  int i, text = 20 + n % 40;
+
+  memset(line, 0, width * sizeof(screen_char_t));
+  for (i = 0; i < width; i++)
+    {
+      line[i].ch = (i < text) ? 'A' + (n + i) % 26 : ' ';
+      line[i].color = (i / 7 + n) % 16;
+      line[i].attr = ((i / 13) & 1) ? 0x04 : 0x01;
+    }
+}
+
+static int check_line(terminal_scrollback_t *sb, int row, int n,
+                      const char *what)
+{
+  screen_char_t expected[WIDTH];
+  screen_char_t *line = sb_line(sb, row, WIDTH);
+
+  make_line(n, expected, WIDTH);
+  if (memcmp(line, expected, sizeof(expected)) != 0)
+    {
+      printf("%s: line %i (row %i) differs\n", what, n, row);
+      return 1;
+    }
+  return 0;
+}
+
+static void append_lines(terminal_scrollback_t *sb, int first, int num)
+{
+  screen_char_t line[WIDTH];
+  int n;
+
+  for (n = first; n < first + num; n++)
+    {
+      make_line(n, line, WIDTH);
+      sb_append(sb, line, WIDTH, 1);
+    }
+}
+
+static int check_wrap(BOOL compress)
+{
+  terminal_scrollback_t sb;
+  int max_length = 3 * SB_SEGMENT_ROWS + 10;
+  int total = 9 * SB_SEGMENT_ROWS + 37;
+  int row, failed = 0;
+
+  sb_init(&sb, max_length, compress);
+  append_lines(&sb, 0, total);
+
+  if (sb.length != max_length)
+    {
+      printf("wrap: %i lines kept, should be %i\n", sb.length, max_length);
+      failed = 1;
+    }
+  /* row -1 is line total - 1 */
+  for (row = -1; row >= -sb.length && !failed; row--)
+    failed |= check_line(&sb, row, total + row, "wrap");
+
+  sb_remove_last(&sb, 5);
+  failed |= check_line(&sb, -1, total - 6, "remove last");
+
+  sb_free(&sb);
+  return failed;
+}
+
+static int check_compression(void)
+{
+  terminal_scrollback_t sb;
+  int total = 20 * SB_SEGMENT_ROWS;
+  int row, failed = 0;
+
+  sb_init(&sb, total, YES);
+  append_lines(&sb, 0, total);
+
+  /* oldest first, so every segment is expanded and most are compressed
+     again before the end */
+  for (row = -sb.length; row < 0 && !failed; row++)
+    failed |= check_line(&sb, row, total + row, "compression");
+  /* and once more from the newest, over segments compressed again */
+  for (row = -1; row >= -sb.length && !failed; row -= 17)
+    failed |= check_line(&sb, row, total + row, "compression again");
+
+  sb_free(&sb);
+  return failed;
+}
+
+/* Logical line n of the reflow check: up to 130 cells of text, then
+   blank cells of the line's own color. If the text filled its last line
+   when it was added, at width added, nothing tells the color of the
+   blanks and empty cells are used. */
+#define MAX_TEXT 130
+#define ADDED_WIDTH 40
+
+static int logical_text(int n, screen_char_t *text, screen_char_t *fill)
+{
+  int i, len = (n * 37) % (MAX_TEXT + 1);
+
+  for (i = 0; i < len; i++)
+    {
+      memset(&text[i], 0, sizeof(screen_char_t));
+      text[i].ch = 'a' + (n * 7 + i) % 26;
+      text[i].color = (n + i / 5) % 16;
+      text[i].attr = 0x01;
+    }
+  memset(fill, 0, sizeof(screen_char_t));
+  if (len == 0 || len % ADDED_WIDTH)
+    {
+      fill->ch = ' ';
+      fill->color = n % 16;
+      fill->attr = 0x01;
+    }
+  return len;
+}
+
+/* Lines logical line n takes at width, as the screen shows them: every
+   line but the last is full and has the wrap bit in its last cell. If
+   lines is not NULL, they are stored there. */
+static int logical_rows(int n, int width, screen_char_t *lines)
+{
+  screen_char_t text[MAX_TEXT], fill, *line;
+  int len = logical_text(n, text, &fill);
+  int rows = len ? (len + width - 1) / width : 1;
+  int r, i;
+
+  for (r = 0; lines && r < rows; r++)
+    {
+      line = lines + r * width;
+      for (i = 0; i < width; i++)
+        line[i] = (r * width + i < len) ? text[r * width + i] : fill;
+      if (r < rows - 1)
+        line[width - 1].attr |= 0x20;
+    }
+  return rows;
+}
+
+static int check_rows(terminal_scrollback_t *sb, int lines, int width,
+                      const char *what)
+{
+  screen_char_t expected[2 * MAX_TEXT];
+  int n, r, rows, row;
+  int length = 0;
+
+  sb_set_width(sb, width);
+  row = -sb->length;
+  for (n = 0; n < lines; n++)
+    length += logical_rows(n, width, NULL);
+  if (sb->length != length)
+    {
+      printf("%s: %i lines at width %i, should be %i\n",
+             what, sb->length, width, length);
+      return 1;
+    }
+
+  for (n = 0; n < lines; n++)
+    {
+      rows = logical_rows(n, width, expected);
+      for (r = 0; r < rows; r++, row++)
+        {
+          if (memcmp(sb_line(sb, row, width), expected + r * width,
+                     width * sizeof(screen_char_t)) != 0)
+            {
+              printf("%s: line %i of logical line %i differs at width %i\n",
+                     what, r, n, width);
+              return 1;
+            }
+        }
+    }
+  return 0;
+}
+
+static int check_reflow(BOOL compress)
+{
+  terminal_scrollback_t sb;
+  screen_char_t lines[2 * MAX_TEXT];
+  int narrow = ADDED_WIDTH, wide = 100;
+  int total = 6 * SB_SEGMENT_ROWS + 11, n, rows, failed = 0;
+
+  sb_init(&sb, 8 * total, compress);
+  for (n = 0; n < total; n++)
+    {
+      rows = logical_rows(n, narrow, lines);
+      sb_append(&sb, lines, narrow, rows);
+    }
+
+  failed |= check_rows(&sb, total, narrow, "reflow");
+  if (!failed)
+    failed |= check_rows(&sb, total, wide, "reflow wider");
+  if (!failed)
+    failed |= check_rows(&sb, total, narrow, "reflow back");
+
+  /* lines added at another width flow with the others (the text of
+     this one doesn't fill its last line at either width) */
+  if (!failed)
+    {
+      rows = logical_rows(total, wide, lines);
+      sb_append(&sb, lines, wide, rows);
+      failed |= check_rows(&sb, total + 1, narrow, "reflow added");
+    }
+
+  sb_free(&sb);
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  int failed = 0;
+
+  failed |= check_wrap(NO);
+  failed |= check_wrap(YES);
+  failed |= check_compression();
+  failed |= check_reflow(NO);
+  failed |= check_reflow(YES);
+
+  printf("scrollback: %s\n", failed ? "FAILED" : "ok");
+  return failed;
+}
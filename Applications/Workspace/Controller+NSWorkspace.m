@@ -46,10 +46,12 @@
 #import "Workspace+WM.h"
 #import "Controller+NSWorkspace.h"
 #import "Controller+WorkspaceCenter.h"
+#import "ThumbnailCache.h"
 
 #define PosixExecutePermission	(0111)
 
 #define FILE_CONTENTS_SCAN_SIZE 100
+#define THUMBNAIL_ICON_SIZE 64.0
 
 static NSArray *wrappers = nil;
 
@@ -73,6 +75,7 @@ static NSImage	*unknownTool = nil;
 - (NSImage*)unknownFiletypeImage;
 - (NSImage*)_saveImageFor:(NSString*)iconPath;
 - (NSString*)_thumbnailForFile:(NSString *)file;
+- (NSImage *)_thumbnailImageForFile:(NSString *)file;
 - (NSImage*)_iconForExtension:(NSString*)ext;
 - (NSImage *)_iconForFileContents:(NSString *)fullPath;
 - (NSImage *)_iconForFileContents:(NSString *)fullPath;
@@ -129,6 +132,7 @@ static NSString		*_rootPath = @"/";
   [_workspaceCenter removeObserver:self];
   
   TEST_RELEASE(_iconMap);
+  TEST_RELEASE(_iconLock);
   TEST_RELEASE(_launched);
   TEST_RELEASE(_workspaceCenter);
 
@@ -209,6 +213,7 @@ static NSString		*_rootPath = @"/";
 
   _workspaceCenter = [WorkspaceCenter new];
   _iconMap = [NSMutableDictionary new];
+  _iconLock = [NSRecursiveLock new];
   _launched = [NSMutableDictionary new];
   if (applications == nil) {
     [self findApplications];
@@ -756,6 +761,7 @@ static NSString		*_rootPath = @"/";
       if (image == nil || image == [self unknownFiletypeImage]) {
         NSString *iconName;
 
+        [_iconLock lock];
         iconName = [folderPathIconDict objectForKey:fullPath];
         if (iconName != nil) {
           NSImage *iconImage;
@@ -775,6 +781,7 @@ static NSString		*_rootPath = @"/";
           }
           image = folderImage;
         }
+        [_iconLock unlock];
       }
     }
   }
@@ -782,16 +789,8 @@ static NSString		*_rootPath = @"/";
     // NSFileTypeRegular, NSFileType
     NSDebugLog(@"pathExtension is '%@'", pathExtension);
 
-    // TODO: Thumbnail of file
-    // if ([[NSUserDefaults standardUserDefaults]
-    //         boolForKey:@"GSUseFreedesktopThumbnails"]) {
-    //   // This image will be 128x128 pixels as oposed to the 48x48 
-    //   // of other GNUstep icons or the 32x32 of the specification
-    //   image = [self _saveImageFor:[self _thumbnailForFile:fullPath]];
-    //   if (image != nil) {
-    //     return image;
-    //   }
-    // }
+    // Thumbnail of image file
+    image = [self _thumbnailImageForFile:fullPath];
 
       // By executable bit
     if (image == nil
@@ -1146,32 +1145,38 @@ static NSString		*_rootPath = @"/";
   return tmp;
 }
 
-/** Returns the freedesktop thumbnail file name for a given file name */
+/** Returns the path of a valid freedesktop thumbnail of the file or nil.
+    Missing thumbnails are made in the background. */
 - (NSString *)_thumbnailForFile:(NSString *)file
 {
-  NSString *absolute;
-  NSString *digest;
-  NSString *thumbnail;
-
-  absolute = [[NSURL fileURLWithPath:[file stringByStandardizingPath]] 
-               absoluteString];
-  /* This compensates for a feature we have in NSURL, that is there to have 
-   * MacOSX compatibility.
-   */
-  if ([absolute hasPrefix:  @"file://localhost/"])
-    {
-      absolute = [@"file:///" stringByAppendingString: 
-		       [absolute substringWithRange: 
-				     NSMakeRange(17, [absolute length] - 17)]];
-    }
+  return [[ThumbnailCache sharedCache] thumbnailForFile:file];
+}
+
+/** Thumbnails are 128 or 256 pixels large as opposed to 64x64 of icons,
+    so the image is drawn scaled down to THUMBNAIL_ICON_SIZE. Returns nil
+    if there is no thumbnail yet. */
+- (NSImage *)_thumbnailImageForFile:(NSString *)file
+{
+  NSString *thumbnailPath = [self _thumbnailForFile:file];
+  NSImage  *image;
+  NSSize   size;
+  CGFloat  scale;
 
-  // FIXME: Not sure which encoding to use here. 
-  digest = [[[[absolute dataUsingEncoding: NSASCIIStringEncoding]
-		 md5Digest] hexadecimalRepresentation] lowercaseString];
-  thumbnail = [@"~/.thumbnails/normal" stringByAppendingPathComponent: 
-		    [digest stringByAppendingPathExtension: @"png"]];
+  if (thumbnailPath == nil ||
+      (image = [self _saveImageFor:thumbnailPath]) == nil) {
+    return nil;
+  }
+
+  size = [image size];
+  if (size.width > THUMBNAIL_ICON_SIZE || size.height > THUMBNAIL_ICON_SIZE) {
+    scale = THUMBNAIL_ICON_SIZE / MAX(size.width, size.height);
+    size.width = floor(size.width * scale);
+    size.height = floor(size.height * scale);
+    [image setScalesWhenResized:YES];
+    [image setSize:size];
+  }
 
-  return [thumbnail stringByStandardizingPath];
+  return image;
 }
 
 - (NSImage *)_iconForExtension:(NSString *)ext
@@ -1185,6 +1190,7 @@ static NSString		*_rootPath = @"/";
    * extensions are case-insensitive - convert to lowercase.
    */
   ext = [ext lowercaseString];
+  [_iconLock lock];
   if ((icon = [_iconMap objectForKey: ext]) == nil)
     {
       NSDictionary	*prefs;
@@ -1269,6 +1275,10 @@ static NSString		*_rootPath = @"/";
 	  [_iconMap setObject:icon forKey:ext];
 	}
     }
+  /* the map may be emptied by another thread once unlocked */
+  AUTORELEASE(RETAIN(icon));
+  [_iconLock unlock];
+
   return icon;
 }
 
@@ -1461,7 +1471,9 @@ static NSString		*_rootPath = @"/";
 	{
 	  dict = [NSDeserializer deserializePropertyListFromData: data
 					       mutableContainers: NO];
+	  [_iconLock lock];
 	  ASSIGN(extPreferences, dict);
+	  [_iconLock unlock];
 	}
     }
 
@@ -1472,13 +1484,17 @@ static NSString		*_rootPath = @"/";
 	{
 	  dict = [NSDeserializer deserializePropertyListFromData: data
 					       mutableContainers: NO];
+	  [_iconLock lock];
 	  ASSIGN(applications, dict);
+	  [_iconLock unlock];
 	}
     }
   /*
    *	Invalidate the cache of icons for file extensions.
    */
+  [_iconLock lock];
   [_iconMap removeAllObjects];
+  [_iconLock unlock];
 }
 
 //-----------------------------------------------------------------------------
@@ -1923,8 +1939,10 @@ static NSString		*_rootPath = @"/";
   }
   [map setObject:inf forKey:ext];
   RELEASE(inf);
+  [_iconLock lock];
   RELEASE(extPreferences);
   extPreferences = map;
+  [_iconLock unlock];
   data = [NSSerializer serializePropertyList:extPreferences];
   if ([data writeToFile:extPrefPath atomically:YES]) {
     [_workspaceCenter postNotificationName:GSWorkspacePreferencesChanged
@@ -1966,8 +1984,10 @@ static NSString		*_rootPath = @"/";
   }
   [map setObject:inf forKey:ext];
   RELEASE(inf);
+  [_iconLock lock];
   RELEASE(extPreferences);
   extPreferences = map;
+  [_iconLock unlock];
   data = [NSSerializer serializePropertyList:extPreferences];
   if ([data writeToFile:extPrefPath atomically:YES]) {
     [_workspaceCenter postNotificationName:GSWorkspacePreferencesChanged
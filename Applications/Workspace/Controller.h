@@ -76,6 +76,7 @@
 
   // NSWorkspace category ivars
   NSMutableDictionary	*_iconMap;
+  NSRecursiveLock	*_iconLock;   // -iconForFile: is called by viewer threads
   NSMutableDictionary	*_launched;
   NSNotificationCenter	*_workspaceCenter;
   BOOL			_fileSystemChanged;
@@ -0,0 +1,97 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2014-2021 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Searches directory trees for files whose name or contents match a regular
+// expression. Directories are read with readdir() and the file type it
+// returns, so most entries are never stat'ed. Several threads take
+// directories from a shared stack; a thread that finds the stack full
+// searches the subdirectory itself.
+//
+// Before the regular expression is run, names and file contents are looked
+// through for a plain string every match must contain, if the expression
+// has one. File contents are read a chunk at a time; the end of a chunk is
+// searched again with the next one, so matches shorter than
+// FIND_CHUNK_OVERLAP bytes are found wherever they are. Files that are not
+// UTF-8 are searched as Latin-1.
+//
+// Name searches that leave hidden files out look up the directories known
+// to FinderIndex there, and read the rest and those changed since the index
+// was built from disk - the ones reported by the file system monitor and
+// the ones whose modification time is newer than the index. Names found in
+// the index are checked with lstat(), as the files may be gone.
+//
+// Results are sent to the Finder with -addResults: in batches.
+
+#import <Foundation/Foundation.h>
+
+@class Finder;
+@class FinderIndexData;
+
+typedef struct {
+  char *path;
+  BOOL skipIndexed;  // subdirectories in the index are searched there
+} FindDirectory;
+
+// ASCII letters in lower case, other characters as they are
+static inline int FindASCIILower(int c)
+{
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Names listed in the .hidden file of the directory open as dfd, or nil.
+// Also used by FinderIndex.
+NSSet *FindHiddenNamesInDirectory(int dfd);
+
+@interface FindWorker : NSOperation
+{
+  Finder              *finder;
+  NSArray             *searchPaths;
+  NSRegularExpression *expression;
+  BOOL                isContentSearch;
+  BOOL                showHidden;
+
+  // String every match contains (lowercase if ignoreCase) or NULL
+  char                *literal;
+  size_t              literalLength;
+  BOOL                ignoreCase;
+
+  // Name index and the directories changed since it was built
+  FinderIndexData     *nameIndex;
+  NSArray             *changedDirectories;
+
+  // Directories waiting to be searched
+  NSCondition         *queueLock;
+  FindDirectory       *dirStack;
+  NSUInteger          dirCount;
+  NSUInteger          busyWorkers;
+
+  // Results not sent to the Finder yet
+  NSLock              *resultsLock;
+  NSMutableArray      *pendingResults;
+  NSTimeInterval      lastDelivery;
+}
+
+- (id)initWithFinder:(Finder *)owner
+               paths:(NSArray *)paths
+          expression:(NSRegularExpression *)regexp
+      searchContents:(BOOL)isContent;
+
+@end
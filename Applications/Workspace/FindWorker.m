@@ -0,0 +1,674 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2014-2021 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <dispatch/dispatch.h>
+
+#import <DesktopKit/NXTFileManager.h>
+
+#import "Finder.h"
+#import "FinderIndex.h"
+#import "FindWorker.h"
+
+#define FIND_MAX_WORKERS     8
+#define FIND_DIR_STACK_SIZE  4096      // directories waiting to be searched
+#define FIND_CHUNK_SIZE      (1024*1024)
+#define FIND_CHUNK_OVERLAP   4096
+#define FIND_RESULTS_BATCH   64        // send results when there are that many
+#define FIND_RESULTS_DELAY   0.1       // or when the last were sent that long ago
+
+//-----------------------------------------------------------------------------
+// Plain string search
+//-----------------------------------------------------------------------------
+
+// ASCII letters that ICU case-insensitive matching, which uses full case
+// folding, also finds in non-ASCII text: the Kelvin sign (k), the long s
+// and sharp s (s, ss), the ligatures U+FB00..U+FB06 (f, i, l, s, t),
+// dotted capital I (i), and the letters with a combining mark or apostrophe
+// that fold into two characters, e.g. U+0149 (n), U+01F0 (j), U+1E96..U+1E9A
+// (h, t, w, y, a).
+#define FIND_FOLDED_LETTERS "afhijklnstwy"
+
+// Returns the longest string that every match of the regular expression
+// contains, or NULL if it can't tell. Only printable ASCII characters are
+// taken, and with ignoreCase none of FIND_FOLDED_LETTERS, which a match
+// may hold as something else.
+static char *requiredLiteral(const char *pattern, BOOL ignoreCase,
+                             size_t *length)
+{
+  char   *run, *best;
+  size_t runLength = 0, bestLength = 0;
+  int    c;
+
+  // alternatives and groups
+  if (strpbrk(pattern, "|()"))
+    return NULL;
+
+  run = malloc(strlen(pattern) + 1);
+  best = malloc(strlen(pattern) + 1);
+
+#define END_RUN()                               \
+  if (runLength > bestLength) {                 \
+    memcpy(best, run, runLength);               \
+    bestLength = runLength;                     \
+  }                                             \
+  runLength = 0
+
+  for (; *pattern; pattern++) {
+    c = (unsigned char)*pattern;
+    switch (c) {
+    case '\\':
+      END_RUN();
+      if (pattern[1])
+        pattern++;
+      break;
+    case '[':
+      END_RUN();
+      pattern++;
+      if (*pattern == '^')
+        pattern++;
+      if (*pattern == ']')
+        pattern++;
+      while (*pattern && *pattern != ']') {
+        if (*pattern == '\\' && pattern[1])
+          pattern++;
+        pattern++;
+      }
+      if (!*pattern) {
+        free(run);
+        free(best);
+        return NULL;
+      }
+      break;
+    case '*':
+    case '?':
+    case '{':
+      // the character before is optional
+      if (runLength > 0)
+        runLength--;
+      END_RUN();
+      if (c == '{') {
+        while (pattern[1] && *pattern != '}')
+          pattern++;
+      }
+      break;
+    case '+':
+    case '.':
+    case '^':
+    case '$':
+    case '}':
+    case ']':
+      END_RUN();
+      break;
+    default:
+      if (c < 0x20 || c > 0x7e
+          || (ignoreCase && strchr(FIND_FOLDED_LETTERS, FindASCIILower(c)))) {
+        END_RUN();
+      }
+      else {
+        run[runLength++] = ignoreCase ? FindASCIILower(c) : c;
+      }
+      break;
+    }
+  }
+  END_RUN();
+#undef END_RUN
+
+  free(run);
+  if (bestLength == 0) {
+    free(best);
+    return NULL;
+  }
+  best[bestLength] = '\0';
+  *length = bestLength;
+  return best;
+}
+
+// memchr() is vectorized in the C library, so look for the first character
+// with it and compare the rest where it is.
+static BOOL containsLiteral(const char *text, size_t length,
+                            const char *literal, size_t literalLength,
+                            BOOL ignoreCase)
+{
+  const char *p = text, *last, *found, *other;
+  int        first, upper;
+  size_t     i;
+
+  if (length < literalLength)
+    return NO;
+
+  last = text + length - literalLength;
+  first = literal[0];
+  upper = (ignoreCase && first >= 'a' && first <= 'z') ? first - ('a' - 'A') : first;
+
+  while (p <= last) {
+    found = memchr(p, first, last - p + 1);
+    if (upper != first) {
+      other = memchr(p, upper, (found ? found : last + 1) - p);
+      if (other)
+        found = other;
+    }
+    if (!found)
+      return NO;
+
+    for (i = 1; i < literalLength; i++) {
+      if ((ignoreCase ? FindASCIILower((unsigned char)found[i]) : found[i]) != literal[i])
+        break;
+    }
+    if (i == literalLength)
+      return YES;
+    p = found + 1;
+  }
+
+  return NO;
+}
+
+// Chunks of a file start and end anywhere, so partial UTF-8 sequences at
+// both ends are left out.
+static NSString *newStringWithText(const char *text, size_t length)
+{
+  const unsigned char *start = (const unsigned char *)text;
+  const unsigned char *end = start + length;
+  const unsigned char *p;
+  NSString            *string;
+  int                 i, need;
+
+  for (i = 0; i < 3 && start < end && (*start & 0xc0) == 0x80; i++)
+    start++;
+
+  // the last sequence if it is not complete
+  for (p = end, i = 0; p > start && i < 4; i++) {
+    p--;
+    if ((*p & 0xc0) != 0x80) {
+      need = (*p >= 0xf0) ? 4 : (*p >= 0xe0) ? 3 : (*p >= 0xc0) ? 2 : 1;
+      if (end - p < need)
+        end = p;
+      break;
+    }
+  }
+
+  string = [[NSString alloc] initWithBytes:start
+                                    length:end - start
+                                  encoding:NSUTF8StringEncoding];
+  if (string == nil) {
+    string = [[NSString alloc] initWithBytes:text
+                                      length:length
+                                    encoding:NSISOLatin1StringEncoding];
+  }
+  return string;
+}
+
+//-----------------------------------------------------------------------------
+// Hidden files
+//-----------------------------------------------------------------------------
+
+NSSet *FindHiddenNamesInDirectory(int dfd)
+{
+  NSString      *contents;
+  NSMutableData *data;
+  char          buf[4096];
+  ssize_t       count;
+  int           fd;
+
+  fd = openat(dfd, ".hidden", O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    return nil;
+
+  data = [NSMutableData data];
+  while ((count = read(fd, buf, sizeof(buf))) > 0) {
+    [data appendBytes:buf length:count];
+  }
+  close(fd);
+
+  contents = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+  if (contents == nil)
+    return nil;
+  [contents autorelease];
+
+  return [NSSet setWithArray:[contents componentsSeparatedByString:@"\n"]];
+}
+
+//-----------------------------------------------------------------------------
+// FindWorker
+//-----------------------------------------------------------------------------
+
+@implementation FindWorker
+
+- (void)dealloc
+{
+  NSLog(@"[FindWorker] -dealloc");
+  [searchPaths release];
+  [expression release];
+  [queueLock release];
+  [resultsLock release];
+  [pendingResults release];
+  [nameIndex release];
+  [changedDirectories release];
+  if (literal)
+    free(literal);
+  if (dirStack)
+    free(dirStack);
+  [super dealloc];
+}
+
+- (id)initWithFinder:(Finder *)owner
+               paths:(NSArray *)paths
+          expression:(NSRegularExpression *)regexp
+      searchContents:(BOOL)isContent
+{
+  [super init];
+
+  if (self != nil) {
+    finder = owner;
+    searchPaths = [[NSArray alloc] initWithArray:paths];
+    expression = regexp;
+    [expression retain];
+    isContentSearch = isContent;
+    showHidden = [[NXTFileManager defaultManager] isShowHiddenFiles];
+
+    // With comments and whitespace allowed the pattern is not what it reads
+    if (expression && !([expression options] & NSRegularExpressionAllowCommentsAndWhitespace)) {
+      ignoreCase = ([expression options] & NSRegularExpressionCaseInsensitive) != 0;
+      literal = requiredLiteral([[expression pattern] UTF8String], ignoreCase,
+                                &literalLength);
+    }
+
+    // Taken now, as the index may be rebuilt while searching
+    if (isContentSearch == NO && showHidden == NO) {
+      nameIndex = [[[FinderIndex sharedIndex] data] retain];
+      changedDirectories = [[[FinderIndex sharedIndex] changedDirectories] retain];
+    }
+
+    queueLock = [[NSCondition alloc] init];
+    dirStack = malloc(FIND_DIR_STACK_SIZE * sizeof(FindDirectory));
+    resultsLock = [[NSLock alloc] init];
+    pendingResults = [[NSMutableArray alloc] init];
+  }
+
+  return self;
+}
+
+// --- Results
+
+- (void)sendResults:(BOOL)all
+{
+  NSArray        *batch = nil;
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+  [resultsLock lock];
+  if ([pendingResults count] > 0 &&
+      (all || [pendingResults count] >= FIND_RESULTS_BATCH ||
+       now - lastDelivery >= FIND_RESULTS_DELAY)) {
+    batch = [pendingResults copy];
+    [pendingResults removeAllObjects];
+    lastDelivery = now;
+  }
+  [resultsLock unlock];
+
+  if (batch) {
+    [finder performSelectorOnMainThread:@selector(addResults:)
+                             withObject:batch
+                          waitUntilDone:NO];
+    [batch release];
+  }
+}
+
+- (void)addResultPath:(const char *)path length:(size_t)length
+{
+  NSString *resultPath;
+
+  resultPath = [[NSFileManager defaultManager]
+                 stringWithFileSystemRepresentation:path
+                                             length:length];
+  // Names not in the file system encoding are still found
+  if (resultPath == nil) {
+    resultPath = [[[NSString alloc] initWithBytes:path
+                                           length:length
+                                         encoding:NSISOLatin1StringEncoding]
+                   autorelease];
+  }
+  if (resultPath == nil)
+    return;
+
+  [resultsLock lock];
+  [pendingResults addObject:resultPath];
+  [resultsLock unlock];
+
+  [self sendResults:NO];
+}
+
+// --- Matching
+
+- (BOOL)isText:(const char *)text length:(size_t)length
+{
+  NSString *string;
+  NSRange  range;
+
+  if (literal && !containsLiteral(text, length, literal, literalLength, ignoreCase))
+    return NO;
+
+  string = newStringWithText(text, length);
+  range = [expression rangeOfFirstMatchInString:string
+                                        options:0
+                                          range:NSMakeRange(0, [string length])];
+  [string release];
+
+  return range.location != NSNotFound;
+}
+
+// buffer has room for FIND_CHUNK_SIZE + FIND_CHUNK_OVERLAP bytes
+- (BOOL)isFileMatched:(int)fd buffer:(char *)buffer
+{
+  size_t  kept = 0, length;
+  ssize_t count;
+
+  while ([self isCancelled] == NO) {
+    count = read(fd, buffer + kept, FIND_CHUNK_SIZE);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      break;
+
+    length = kept + count;
+    if ([self isText:buffer length:length])
+      return YES;
+
+    // Search the end of this chunk again with the next one
+    kept = (length < FIND_CHUNK_OVERLAP) ? length : FIND_CHUNK_OVERLAP;
+    memmove(buffer, buffer + length - kept, kept);
+  }
+
+  return NO;
+}
+
+// --- Directories
+
+// Returns NO if there is no room left; path is owned by the stack otherwise.
+- (BOOL)pushDirectory:(char *)path skipIndexed:(BOOL)skipIndexed
+{
+  BOOL pushed = NO;
+
+  [queueLock lock];
+  if (dirCount < FIND_DIR_STACK_SIZE) {
+    dirStack[dirCount].path = path;
+    dirStack[dirCount].skipIndexed = skipIndexed;
+    dirCount++;
+    pushed = YES;
+    [queueLock signal];
+  }
+  [queueLock unlock];
+
+  return pushed;
+}
+
+- (void)searchDirectory:(const char *)dirPath
+            skipIndexed:(BOOL)skipIndexed
+                 buffer:(char *)buffer
+{
+  DIR           *dir;
+  struct dirent *entry;
+  struct stat   st;
+  NSSet         *hiddenNames = nil;
+  NSString      *name;
+  char          *path;
+  size_t        dirLength, nameLength;
+  unsigned char type;
+  int           dfd, fd;
+
+  dir = opendir(dirPath);
+  if (dir == NULL)
+    return;
+  dfd = dirfd(dir);
+
+  if (showHidden == NO)
+    hiddenNames = FindHiddenNamesInDirectory(dfd);
+
+  dirLength = strlen(dirPath);
+  if (dirLength > 0 && dirPath[dirLength - 1] == '/')
+    dirLength--;
+  path = malloc(dirLength + 1 + NAME_MAX + 1);
+  memcpy(path, dirPath, dirLength);
+  path[dirLength] = '/';
+
+  while ((entry = readdir(dir)) != NULL && [self isCancelled] == NO) {
+    if (entry->d_name[0] == '.' &&
+        (showHidden == NO || entry->d_name[1] == '\0' ||
+         (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+      continue;
+    }
+
+    nameLength = strlen(entry->d_name);
+    if (hiddenNames) {
+      name = [[NSString alloc] initWithBytes:entry->d_name
+                                      length:nameLength
+                                    encoding:NSUTF8StringEncoding];
+      if (name && [hiddenNames containsObject:name]) {
+        [name release];
+        continue;
+      }
+      [name release];
+    }
+
+    type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      if (fstatat(dfd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+        continue;
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG
+        : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+    }
+    // Symbolic links are neither followed nor matched
+    if (type == DT_LNK)
+      continue;
+
+    memcpy(path + dirLength + 1, entry->d_name, nameLength + 1);
+
+    if (isContentSearch == NO) {
+      if ([self isText:entry->d_name length:nameLength])
+        [self addResultPath:path length:dirLength + 1 + nameLength];
+    }
+    else if (type == DT_REG) {
+      fd = openat(dfd, entry->d_name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd >= 0) {
+        if ([self isFileMatched:fd buffer:buffer])
+          [self addResultPath:path length:dirLength + 1 + nameLength];
+        close(fd);
+      }
+    }
+
+    if (type == DT_DIR &&
+        (skipIndexed == NO || [nameIndex containsDirectory:path] == NO)) {
+      char *subdir = strdup(path);
+
+      // New directories are not in the index, nor is anything in them
+      if ([self pushDirectory:subdir skipIndexed:NO] == NO) {
+        [self searchDirectory:subdir skipIndexed:NO buffer:buffer];
+        free(subdir);
+      }
+    }
+  }
+
+  free(path);
+  closedir(dir);
+}
+
+- (void)runSearch
+{
+  char          *buffer = NULL;
+  FindDirectory dir;
+
+  if (isContentSearch)
+    buffer = malloc(FIND_CHUNK_SIZE + FIND_CHUNK_OVERLAP);
+
+  for (;;) {
+    [queueLock lock];
+    while (dirCount == 0 && busyWorkers > 0 && [self isCancelled] == NO) {
+      [queueLock waitUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    }
+    if (dirCount == 0 || [self isCancelled]) {
+      // Nothing left or stopped
+      [queueLock broadcast];
+      [queueLock unlock];
+      break;
+    }
+    dir = dirStack[--dirCount];
+    busyWorkers++;
+    [queueLock unlock];
+
+    @autoreleasepool {
+      [self searchDirectory:dir.path skipIndexed:dir.skipIndexed buffer:buffer];
+    }
+    free(dir.path);
+    [self sendResults:NO];
+
+    [queueLock lock];
+    busyWorkers--;
+    if (busyWorkers == 0 && dirCount == 0) {
+      [queueLock broadcast];
+    }
+    [queueLock unlock];
+  }
+
+  if (buffer)
+    free(buffer);
+}
+
+// Directories changed since the index was built are searched on disk.
+- (void)pushChangedDirectoriesInPath:(NSString *)path
+{
+  NSString *prefix = [path stringByAppendingString:@"/"];
+  char     *dirPath;
+
+  for (NSString *changed in changedDirectories) {
+    if (([changed isEqualToString:path] || [changed hasPrefix:prefix]) &&
+        [nameIndex containsDirectory:[changed fileSystemRepresentation]]) {
+      dirPath = strdup([changed fileSystemRepresentation]);
+      if ([self pushDirectory:dirPath skipIndexed:YES] == NO) {
+        [self searchDirectory:dirPath skipIndexed:YES buffer:NULL];
+        free(dirPath);
+      }
+    }
+  }
+}
+
+- (void)searchIndexInPath:(NSString *)path
+{
+  [nameIndex findInPath:path
+                literal:literal
+                 length:literalLength
+        skipDirectories:changedDirectories
+                  match:^BOOL(const char *name, size_t length) {
+      if ([self isCancelled])
+        return NO;
+      return [self isText:name length:length];
+    }
+                 result:^(const char *resultPath, size_t length) {
+      struct stat st;
+
+      if (lstat(resultPath, &st) == 0)
+        [self addResultPath:resultPath length:length];
+    }];
+}
+
+- (void)main
+{
+  dispatch_group_t group;
+  dispatch_queue_t queue;
+  NSMutableArray   *indexedPaths = [NSMutableArray array];
+  NSUInteger       i, workers;
+  char             *buffer = NULL;
+
+  NSLog(@"[Finder] will search contents: %@", isContentSearch ? @"Yes" : @"No");
+
+  if (expression == nil)
+    return;
+
+  for (NSString *path in searchPaths) {
+    char *dirPath;
+
+    path = [path stringByStandardizingPath];
+    if ([nameIndex containsDirectory:[path fileSystemRepresentation]]) {
+      [indexedPaths addObject:path];
+      continue;
+    }
+    dirPath = strdup([path fileSystemRepresentation]);
+    // The stack is full: search it here, as the workers do
+    if ([self pushDirectory:dirPath skipIndexed:NO] == NO) {
+      if (isContentSearch && buffer == NULL)
+        buffer = malloc(FIND_CHUNK_SIZE + FIND_CHUNK_OVERLAP);
+      [self searchDirectory:dirPath skipIndexed:NO buffer:buffer];
+      free(dirPath);
+    }
+  }
+  free(buffer);
+
+  // Not all directories are watched: those modified since the index was
+  // built are read from disk too
+  if ([indexedPaths count] > 0) {
+    NSMutableSet *changed = [NSMutableSet setWithArray:changedDirectories];
+
+    for (NSString *path in indexedPaths) {
+      [changed addObjectsFromArray:[nameIndex directoriesModifiedInPath:path]];
+    }
+    [changedDirectories release];
+    changedDirectories = [[changed allObjects] retain];
+  }
+  for (NSString *path in indexedPaths) {
+    [self pushChangedDirectoriesInPath:path];
+  }
+
+  workers = [[NSProcessInfo processInfo] activeProcessorCount];
+  if (workers < 1)
+    workers = 1;
+  if (workers > FIND_MAX_WORKERS)
+    workers = FIND_MAX_WORKERS;
+
+  group = dispatch_group_create();
+  queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+  for (i = 0; i < workers; i++) {
+    dispatch_group_async(group, queue, ^{ [self runSearch]; });
+  }
+  // The indexed paths while the workers read the others
+  for (NSString *path in indexedPaths) {
+    [self searchIndexInPath:path];
+  }
+  dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+  dispatch_release(group);
+
+  // Left if cancelled
+  while (dirCount > 0) {
+    free(dirStack[--dirCount].path);
+  }
+
+  [self sendResults:YES];
+}
+
+- (BOOL)isReady
+{
+  return YES;
+}
+
+@end
@@ -56,7 +56,7 @@
 - (void)deactivate;
 - (NSWindow *)window;
 
-- (void)addResult:(NSString *)resultString;
+- (void)addResults:(NSArray *)results;
 - (void)finishFind;
 
 @end
@@ -30,6 +30,8 @@
 #import <Preferences/Shelf/ShelfPrefs.h>
 
 #import "Finder.h"
+#import "FinderIndex.h"
+#import "FindWorker.h"
 
 //=============================================================================
 // Custom text field
@@ -78,156 +80,6 @@
 }
 @end
 
-//=============================================================================
-// NSOperation to perform search asynchronously
-//=============================================================================
-@interface FindWorker : NSOperation
-{
-  Finder *finder;
-  NSArray *searchPaths;
-  NSRegularExpression *expression;
-  BOOL isContentSearch;
-}
-- (id)initWithFinder:(Finder *)onwer
-               paths:(NSArray *)paths
-          expression:(NSRegularExpression *)regexp
-      searchContents:(BOOL)isContent;
-@end
-@implementation FindWorker
-
-- (void)dealloc
-{
-  NSLog(@"[FindWorker] -dealloc");
-  [searchPaths release];
-  [expression release];
-  [super dealloc];
-}
-
-- (id)initWithFinder:(Finder *)owner
-               paths:(NSArray *)paths
-          expression:(NSRegularExpression *)regexp
-      searchContents:(BOOL)isContent
-{
-  [super init];
-  
-  if (self != nil) {
-    finder = owner;
-    searchPaths = [[NSArray alloc] initWithArray:paths];
-    expression = regexp;
-    [expression retain];
-    isContentSearch = isContent;
-  }
-
-  return self;
-}
-
-- (BOOL)isTextMatched:(NSString *)text
-{
-  NSUInteger matches;
-  
-  matches = [expression numberOfMatchesInString:text
-                                        options:0
-                                          range:NSMakeRange(0, [text length])];
-  if (matches > 0) {
-    return YES;
-  }
-
-  return NO;
-}
-
-- (BOOL)isFileMatched:(NSString *)filePath
-{
-  BOOL         isMatched = NO;
-  NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:filePath];
-  NSData       *dataChunk;
-  NSString     *text;
-  // NSUInteger   patternLength = [[expression pattern] length];
-  NSUInteger   offset;
-
-  // NSLog(@"Search for contents in file:%@", filePath);
-
-  dataChunk = [handle readDataOfLength:1024*1024];
-  while ([dataChunk length] > 0) {
-    text = [[NSString alloc] initWithData:dataChunk
-                                 encoding:NSUTF8StringEncoding];
-    [text autorelease];
-    if ([self isTextMatched:text]) {
-      isMatched = YES;
-      break;
-    }
-    // Step down on the pattern length to omit cases when search string
-    // is located across the chunks of data read.
-    // offset = [handle offsetInFile];
-    // if (offset )
-    // [handle seekToFileOffset:offset-patternLength];
-    
-    dataChunk = [handle readDataOfLength:1024*1024];
-  }
-
-  [handle closeFile];
-  return isMatched;
-}
-
-- (void)findInDirectory:(NSString *)dirPath
-{
-  NXTFileManager *fm = [NXTFileManager defaultManager];
-  BOOL           isDir;
-  NSArray        *dirContents;
-  NSString       *itemPath;
-  NSDictionary   *attrs;
-  NSString       *itemFormat;
-
-  // NSLog(@"Processing directory %@...", dirPath);
-
-  dirContents = [fm directoryContentsAtPath:dirPath
-                                    forPath:nil
-                                 showHidden:[fm isShowHiddenFiles]];
-  itemFormat = ([dirPath isEqualToString:@"/"] == NO) ? @"%@/%@" : @"%@%@";
-  
-  for (NSString *item in dirContents) {
-    if ([self isCancelled]) {
-      break;
-    }
-    itemPath = [NSString stringWithFormat:itemFormat, dirPath, item];
-    [fm fileExistsAtPath:itemPath isDirectory:&isDir];
-    attrs = [fm fileAttributesAtPath:itemPath traverseLink:NO];
-
-    if ([[attrs fileType] isEqualToString:NSFileTypeSymbolicLink] == NO) {
-      if ([[attrs fileType] isEqualToString:NSFileTypeDirectory] != NO) {
-        [self findInDirectory:itemPath];
-      }
-      else if (isContentSearch != NO) {
-        if ([self isFileMatched:itemPath]) {
-          [finder performSelectorOnMainThread:@selector(addResult:)
-                                   withObject:itemPath
-                                waitUntilDone:NO];
-        }
-      }
-      if (isContentSearch == NO && [self isTextMatched:item]) {
-        [finder performSelectorOnMainThread:@selector(addResult:)
-                                 withObject:itemPath
-                              waitUntilDone:NO];
-      }
-    }
-  }
-}
-
-- (void)main
-{
-  NSLog(@"[Finder] will search contents: %@", isContentSearch ? @"Yes" : @"No");
-  
-  for (NSString *path in searchPaths) {
-    [self findInDirectory:path];
-  }  
-}
-
-- (BOOL)isReady
-{
-  return YES;
-}
-
-@end
-
 @implementation Finder (Worker)
 
 - (void)runWorkerWithPaths:(NSArray *)searchPaths
@@ -366,6 +218,7 @@
 
 - (void)activateWithString:(NSString *)searchString
 {
+  [[FinderIndex sharedIndex] updateIfNeeded];
   [resultList reloadColumn:0];
 
   if ([searchString length] > 0) {
@@ -459,26 +312,30 @@
   }
 }
 
-- (void)addResult:(NSString *)resultString
+- (void)addResults:(NSArray *)results
 {
-  [variantList addObject:resultString];
+  NSUInteger    firstNew = [variantList count];
+  NSBrowserCell *cell;
+  NSMatrix      *matrix;
+
+  [variantList addObjectsFromArray:results];
   [resultsFound setStringValue:[NSString stringWithFormat:@"%lu found",
                                          [variantList count]]];
-  if ([variantList count] == 1) {
+  if (firstNew == 0) {
     [resultList reloadColumn:0];
+    return;
   }
-  else {
-    NSBrowserCell *cell;
-    NSMatrix      *matrix = [resultList matrixInColumn:0];
-    
+
+  matrix = [resultList matrixInColumn:0];
+  for (NSString *resultString in results) {
     [matrix addRow];
     cell = [matrix cellAtRow:[matrix numberOfRows] - 1 column:0];
     [cell setLeaf:YES];
     [cell setRefusesFirstResponder:YES];
     [cell setTitle:resultString];
     [cell setLoaded:YES];
-    [resultList displayColumn:0];
   }
+  [resultList displayColumn:0];
 }
 
 - (void)finishFind
@@ -0,0 +1,104 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2014-2021 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Index of the file names in the home directory for name searches of the
+// Finder, kept in ~/Library/Workspace/FinderIndex and memory-mapped.
+//
+// The file has the directories sorted by path, the entries of each
+// directory one after another in the same order and, for every three
+// characters (ASCII letters in lower case) found in names, the list of
+// entries whose names have them. A search for names containing "report"
+// only looks at the names that have "rep", "epo", "por" or "ort" -
+// whichever of them is the least common.
+//
+// Hidden files, names listed in .hidden files and symbolic links are not
+// indexed, as FindWorker leaves them out when hidden files are not shown.
+//
+// The index is rebuilt in the background when the Finder is activated and
+// the index is older than FinderIndexUpdateInterval seconds (default 1800),
+// or when many directories have changed. Directories reported changed by
+// OSEFileSystemMonitor since the index was built, and those modified since
+// then (the monitor only watches the directories shown in viewers), are
+// searched on disk instead. FinderIndexEnabled set to NO turns the index
+// off.
+
+#import <Foundation/Foundation.h>
+
+@class FinderIndexData;
+
+@interface FinderIndex : NSObject
+{
+  NSString            *indexPath;
+  NSString            *rootPath;
+  FinderIndexData     *data;
+  NSLock              *lock;
+  BOOL                isBuilding;
+
+  // Path -> date of the last change
+  NSMutableDictionary *changedDirectories;
+}
+
+// Returns nil if the index is turned off.
++ (FinderIndex *)sharedIndex;
+
+// Starts rebuilding the index in the background if it is missing or old.
+- (void)updateIfNeeded;
+- (void)update;
+
+// The index as it is now, or nil if it is not built yet. Retained and
+// autoreleased, so it stays usable while the index is rebuilt.
+- (FinderIndexData *)data;
+
+// Directories changed since the index was built.
+- (NSArray *)changedDirectories;
+
+@end
+
+@interface FinderIndexData : NSObject
+{
+  void   *map;
+  size_t mapSize;
+}
+
+- (id)initWithContentsOfFile:(NSString *)path;
+
+- (NSString *)rootPath;
+- (NSDate *)creationDate;
+
+// Indexed directories at path and below modified since the index was
+// built, checked with stat().
+- (NSArray *)directoriesModifiedInPath:(NSString *)path;
+
+// Whether the directory was indexed. path has no trailing slash.
+- (BOOL)containsDirectory:(const char *)path;
+
+// Calls match with the names in the directory at path and below that may
+// contain literal (NULL for all names), and result with the full paths of
+// those it returns YES for. Names in the directories of skipDirectories
+// (NSStrings) are left out.
+- (void)findInPath:(NSString *)path
+           literal:(const char *)literal
+            length:(size_t)literalLength
+   skipDirectories:(NSArray *)skipDirectories
+             match:(BOOL (^)(const char *name, size_t length))match
+            result:(void (^)(const char *path, size_t length))result;
+
+@end
@@ -0,0 +1,869 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2014-2021 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <dispatch/dispatch.h>
+
+#import <DesktopKit/NXTDefaults.h>
+#import <SystemKit/OSEFileSystemMonitor.h>
+
+#import "FinderIndex.h"
+#import "FindWorker.h"
+
+#define INDEX_FILE            @"Library/Workspace/FinderIndex"
+#define INDEX_MAGIC           0x31584946  // "FIX1"
+#define INDEX_UPDATE_INTERVAL 1800        // seconds
+#define INDEX_MAX_CHANGED     256         // changed directories before rebuild
+#define INDEX_MAX_ENTRIES     (16*1024*1024)
+#define INDEX_MAX_STRINGS     (1024*1024*1024)
+
+// The file is the header followed by the directories, entries, trigrams,
+// postings and strings. Offsets of names and paths are into the strings,
+// which end with '\0'; the first one is the path of the indexed directory.
+typedef struct {
+  uint32_t magic;
+  uint32_t dirCount;
+  uint32_t entryCount;
+  uint32_t trigramCount;
+  uint32_t postingCount;
+  uint32_t stringsSize;
+  int64_t  created;
+} IndexHeader;
+
+// Sorted by path. The entries of a directory follow each other, in the
+// same order as the directories.
+typedef struct {
+  uint32_t path;
+  uint32_t pathLength;
+  uint32_t firstEntry;
+  uint32_t entryCount;
+} IndexDirectory;
+
+typedef struct {
+  uint32_t name;
+  uint32_t nameLength;
+  uint32_t dir;
+} IndexEntry;
+
+// Sorted by key. Postings are the entries that have the trigram in their
+// names, in ascending order.
+typedef struct {
+  uint32_t key;
+  uint32_t firstPosting;
+  uint32_t postingCount;
+} IndexTrigram;
+
+static inline uint32_t trigramKey(const char *text)
+{
+  const unsigned char *p = (const unsigned char *)text;
+
+  return (FindASCIILower(p[0]) << 16) | (FindASCIILower(p[1]) << 8) | FindASCIILower(p[2]);
+}
+
+//-----------------------------------------------------------------------------
+// Building
+//-----------------------------------------------------------------------------
+
+typedef struct {
+  char           *strings;
+  size_t         stringsSize;
+  size_t         stringsCapacity;
+  IndexDirectory *dirs;
+  size_t         dirCount;
+  size_t         dirCapacity;
+  IndexEntry     *entries;
+  size_t         entryCount;
+  size_t         entryCapacity;
+} IndexBuilder;
+
+typedef struct {
+  const char *path;
+  uint32_t   index;
+} DirectoryOrder;
+
+static uint32_t addString(IndexBuilder *b, const char *string, size_t length)
+{
+  uint32_t offset;
+
+  if (b->stringsSize + length + 1 > b->stringsCapacity) {
+    b->stringsCapacity = (b->stringsSize + length + 1) * 2;
+    b->strings = realloc(b->strings, b->stringsCapacity);
+  }
+  offset = b->stringsSize;
+  memcpy(b->strings + offset, string, length);
+  b->strings[offset + length] = '\0';
+  b->stringsSize += length + 1;
+
+  return offset;
+}
+
+static void addDirectory(IndexBuilder *b, const char *path, size_t length)
+{
+  IndexDirectory *dir;
+
+  if (b->dirCount == b->dirCapacity) {
+    b->dirCapacity = b->dirCapacity ? b->dirCapacity * 2 : 1024;
+    b->dirs = realloc(b->dirs, b->dirCapacity * sizeof(IndexDirectory));
+  }
+  dir = &b->dirs[b->dirCount++];
+  dir->path = addString(b, path, length);
+  dir->pathLength = length;
+  dir->firstEntry = 0;
+  dir->entryCount = 0;
+}
+
+static void addEntry(IndexBuilder *b, const char *name, size_t length,
+                     uint32_t dir)
+{
+  IndexEntry *entry;
+
+  if (b->entryCount == b->entryCapacity) {
+    b->entryCapacity = b->entryCapacity ? b->entryCapacity * 2 : 8192;
+    b->entries = realloc(b->entries, b->entryCapacity * sizeof(IndexEntry));
+  }
+  entry = &b->entries[b->entryCount++];
+  entry->name = addString(b, name, length);
+  entry->nameLength = length;
+  entry->dir = dir;
+}
+
+// Adds the entries of the directory and the directories among them.
+static void readDirectory(IndexBuilder *b, uint32_t index)
+{
+  DIR           *dir;
+  struct dirent *entry;
+  struct stat   st;
+  NSSet         *hiddenNames;
+  NSString      *name;
+  char          path[PATH_MAX];
+  size_t        dirLength, nameLength;
+  unsigned char type;
+
+  // The strings move when they grow
+  dirLength = b->dirs[index].pathLength;
+  memcpy(path, b->strings + b->dirs[index].path, dirLength + 1);
+  b->dirs[index].firstEntry = b->entryCount;
+
+  dir = opendir(path);
+  if (dir == NULL)
+    return;
+
+  hiddenNames = FindHiddenNamesInDirectory(dirfd(dir));
+  path[dirLength] = '/';
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+
+    nameLength = strlen(entry->d_name);
+    if (hiddenNames) {
+      name = [[NSString alloc] initWithBytes:entry->d_name
+                                      length:nameLength
+                                    encoding:NSUTF8StringEncoding];
+      if (name && [hiddenNames containsObject:name]) {
+        [name release];
+        continue;
+      }
+      [name release];
+    }
+
+    type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+        continue;
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+    }
+    if (type == DT_LNK)
+      continue;
+
+    addEntry(b, entry->d_name, nameLength, index);
+
+    if (type == DT_DIR && dirLength + 1 + nameLength < PATH_MAX) {
+      memcpy(path + dirLength + 1, entry->d_name, nameLength + 1);
+      addDirectory(b, path, dirLength + 1 + nameLength);
+    }
+  }
+
+  closedir(dir);
+  b->dirs[index].entryCount = b->entryCount - b->dirs[index].firstEntry;
+}
+
+static int compareDirectories(const void *a, const void *b)
+{
+  return strcmp(((const DirectoryOrder *)a)->path,
+                ((const DirectoryOrder *)b)->path);
+}
+
+static int compareTrigrams(const void *a, const void *b)
+{
+  uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+
+  return (ka > kb) - (ka < kb);
+}
+
+// Puts the directories in order of their paths and the entries in the
+// order of the directories.
+static void sortDirectories(IndexBuilder *b)
+{
+  DirectoryOrder *order;
+  IndexDirectory *dirs;
+  IndexEntry     *entries;
+  size_t         i, j, first, count = 0;
+
+  order = malloc(b->dirCount * sizeof(DirectoryOrder));
+  for (i = 0; i < b->dirCount; i++) {
+    order[i].path = b->strings + b->dirs[i].path;
+    order[i].index = i;
+  }
+  qsort(order, b->dirCount, sizeof(DirectoryOrder), compareDirectories);
+
+  dirs = malloc(b->dirCount * sizeof(IndexDirectory));
+  entries = malloc((b->entryCount ? b->entryCount : 1) * sizeof(IndexEntry));
+  for (i = 0; i < b->dirCount; i++) {
+    dirs[i] = b->dirs[order[i].index];
+    first = dirs[i].firstEntry;
+    dirs[i].firstEntry = count;
+    for (j = 0; j < dirs[i].entryCount; j++) {
+      entries[count] = b->entries[first + j];
+      entries[count].dir = i;
+      count++;
+    }
+  }
+
+  free(order);
+  free(b->dirs);
+  free(b->entries);
+  b->dirs = dirs;
+  b->dirCapacity = b->dirCount;
+  b->entries = entries;
+  b->entryCapacity = b->entryCount;
+}
+
+static BOOL writeIndex(IndexBuilder *b, time_t created, const char *path)
+{
+  IndexHeader  header;
+  IndexTrigram *trigrams = NULL;
+  uint32_t     *postings = NULL;
+  uint64_t     *pairs;
+  size_t       pairCount = 0, trigramCount = 0, postingCount = 0;
+  size_t       i, j;
+  const char   *name;
+  FILE         *file;
+  BOOL         written;
+
+  // trigram << 32 | entry, for every trigram of every name
+  for (i = 0; i < b->entryCount; i++) {
+    if (b->entries[i].nameLength >= 3)
+      pairCount += b->entries[i].nameLength - 2;
+  }
+  pairs = malloc((pairCount ? pairCount : 1) * sizeof(uint64_t));
+  for (i = 0, pairCount = 0; i < b->entryCount; i++) {
+    name = b->strings + b->entries[i].name;
+    for (j = 0; j + 3 <= b->entries[i].nameLength; j++) {
+      pairs[pairCount++] = ((uint64_t)trigramKey(name + j) << 32) | i;
+    }
+  }
+  qsort(pairs, pairCount, sizeof(uint64_t), compareTrigrams);
+
+  if (pairCount > 0) {
+    trigrams = malloc(pairCount * sizeof(IndexTrigram));
+    postings = malloc(pairCount * sizeof(uint32_t));
+  }
+  for (i = 0; i < pairCount; i++) {
+    // the same trigram twice in a name
+    if (i > 0 && pairs[i] == pairs[i - 1])
+      continue;
+    if (trigramCount == 0 || trigrams[trigramCount - 1].key != (pairs[i] >> 32)) {
+      trigrams[trigramCount].key = pairs[i] >> 32;
+      trigrams[trigramCount].firstPosting = postingCount;
+      trigrams[trigramCount].postingCount = 0;
+      trigramCount++;
+    }
+    postings[postingCount++] = (uint32_t)pairs[i];
+    trigrams[trigramCount - 1].postingCount++;
+  }
+  free(pairs);
+
+  header.magic = INDEX_MAGIC;
+  header.dirCount = b->dirCount;
+  header.entryCount = b->entryCount;
+  header.trigramCount = trigramCount;
+  header.postingCount = postingCount;
+  header.stringsSize = b->stringsSize;
+  header.created = created;
+
+  file = fopen(path, "w");
+  if (file) {
+    written = (fwrite(&header, sizeof(header), 1, file) == 1
+               && fwrite(b->dirs, sizeof(IndexDirectory), b->dirCount, file) == b->dirCount
+               && fwrite(b->entries, sizeof(IndexEntry), b->entryCount, file) == b->entryCount
+               && fwrite(trigrams, sizeof(IndexTrigram), trigramCount, file) == trigramCount
+               && fwrite(postings, sizeof(uint32_t), postingCount, file) == postingCount
+               && fwrite(b->strings, 1, b->stringsSize, file) == b->stringsSize);
+    if (fclose(file) != 0)
+      written = NO;
+    if (written == NO)
+      unlink(path);
+  }
+  else {
+    written = NO;
+  }
+
+  if (trigrams)
+    free(trigrams);
+  if (postings)
+    free(postings);
+
+  return written;
+}
+
+// Indexes the directory at rootPath into the file at indexPath. The file
+// is replaced when the new one is complete.
+static BOOL buildIndex(NSString *rootPath, NSString *indexPath)
+{
+  IndexBuilder b;
+  NSString     *tempPath;
+  const char   *root = [rootPath fileSystemRepresentation];
+  // Directories modified after this may have changed after they were read
+  time_t       started = time(NULL);
+  size_t       i;
+  BOOL         built = NO;
+
+  memset(&b, 0, sizeof(b));
+  addDirectory(&b, root, strlen(root));
+
+  for (i = 0; i < b.dirCount; i++) {
+    @autoreleasepool {
+      readDirectory(&b, i);
+    }
+    if (b.entryCount > INDEX_MAX_ENTRIES || b.stringsSize > INDEX_MAX_STRINGS) {
+      NSLog(@"[FinderIndex] too many files in %@, not indexed.", rootPath);
+      break;
+    }
+  }
+
+  if (i == b.dirCount) {
+    sortDirectories(&b);
+    tempPath = [indexPath stringByAppendingPathExtension:@"new"];
+    if (writeIndex(&b, started, [tempPath fileSystemRepresentation])) {
+      built = (rename([tempPath fileSystemRepresentation],
+                      [indexPath fileSystemRepresentation]) == 0);
+    }
+  }
+
+  free(b.strings);
+  free(b.dirs);
+  free(b.entries);
+
+  return built;
+}
+
+//-----------------------------------------------------------------------------
+// FinderIndexData
+//-----------------------------------------------------------------------------
+
+#define HEADER   ((IndexHeader *)map)
+#define DIRS     ((IndexDirectory *)(HEADER + 1))
+#define ENTRIES  ((IndexEntry *)(DIRS + HEADER->dirCount))
+#define TRIGRAMS ((IndexTrigram *)(ENTRIES + HEADER->entryCount))
+#define POSTINGS ((uint32_t *)(TRIGRAMS + HEADER->trigramCount))
+#define STRINGS  ((const char *)(POSTINGS + HEADER->postingCount))
+
+@implementation FinderIndexData
+
+- (void)dealloc
+{
+  if (map)
+    munmap(map, mapSize);
+  [super dealloc];
+}
+
+// Offsets and counts are checked once here, so that a damaged file is not
+// read outside of the mapping later.
+- (BOOL)isValid
+{
+  IndexDirectory *dir;
+  IndexEntry     *entry;
+  IndexTrigram   *trigram;
+  uint64_t       size;
+  uint32_t       i;
+
+  if (mapSize < sizeof(IndexHeader) || HEADER->magic != INDEX_MAGIC)
+    return NO;
+
+  size = (sizeof(IndexHeader)
+          + (uint64_t)HEADER->dirCount * sizeof(IndexDirectory)
+          + (uint64_t)HEADER->entryCount * sizeof(IndexEntry)
+          + (uint64_t)HEADER->trigramCount * sizeof(IndexTrigram)
+          + (uint64_t)HEADER->postingCount * sizeof(uint32_t)
+          + HEADER->stringsSize);
+  if (size != mapSize || HEADER->dirCount == 0 || HEADER->stringsSize == 0
+      || STRINGS[HEADER->stringsSize - 1] != '\0') {
+    return NO;
+  }
+
+  for (i = 0, dir = DIRS; i < HEADER->dirCount; i++, dir++) {
+    if ((uint64_t)dir->path + dir->pathLength >= HEADER->stringsSize
+        || (uint64_t)dir->firstEntry + dir->entryCount > HEADER->entryCount) {
+      return NO;
+    }
+  }
+  for (i = 0, entry = ENTRIES; i < HEADER->entryCount; i++, entry++) {
+    if ((uint64_t)entry->name + entry->nameLength >= HEADER->stringsSize
+        || entry->dir >= HEADER->dirCount) {
+      return NO;
+    }
+  }
+  for (i = 0, trigram = TRIGRAMS; i < HEADER->trigramCount; i++, trigram++) {
+    if ((uint64_t)trigram->firstPosting + trigram->postingCount > HEADER->postingCount)
+      return NO;
+  }
+  for (i = 0; i < HEADER->postingCount; i++) {
+    if (POSTINGS[i] >= HEADER->entryCount)
+      return NO;
+  }
+
+  return YES;
+}
+
+- (id)initWithContentsOfFile:(NSString *)path
+{
+  struct stat st;
+  int         fd;
+
+  [super init];
+
+  fd = open([path fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    [self release];
+    return nil;
+  }
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+      map = NULL;
+    else
+      mapSize = st.st_size;
+  }
+  close(fd);
+
+  if (map == NULL || [self isValid] == NO) {
+    NSLog(@"[FinderIndex] %@ can't be used.", path);
+    [self release];
+    return nil;
+  }
+
+  return self;
+}
+
+- (NSString *)rootPath
+{
+  return [[NSFileManager defaultManager]
+           stringWithFileSystemRepresentation:STRINGS
+                                       length:strlen(STRINGS)];
+}
+
+- (NSDate *)creationDate
+{
+  return [NSDate dateWithTimeIntervalSince1970:HEADER->created];
+}
+
+// First directory whose path is not less than path.
+- (uint32_t)lowerBound:(const char *)path
+{
+  uint32_t lo = 0, hi = HEADER->dirCount, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (strcmp(STRINGS + DIRS[mid].path, path) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Index of the directory or -1.
+- (NSInteger)indexOfDirectory:(const char *)path
+{
+  uint32_t i = [self lowerBound:path];
+
+  if (i < HEADER->dirCount && strcmp(STRINGS + DIRS[i].path, path) == 0)
+    return i;
+  return -1;
+}
+
+- (BOOL)containsDirectory:(const char *)path
+{
+  return [self indexOfDirectory:path] >= 0;
+}
+
+- (NSArray *)directoriesModifiedInPath:(NSString *)path
+{
+  NSMutableArray *modified = [NSMutableArray array];
+  NSFileManager  *fm = [NSFileManager defaultManager];
+  const char     *fsPath = [path fileSystemRepresentation];
+  const char     *dirPath;
+  char           *prefix;
+  size_t         length = strlen(fsPath);
+  NSInteger      dirIndex;
+  uint32_t       lo, hi, i;
+  struct stat    st;
+
+  dirIndex = [self indexOfDirectory:fsPath];
+  if (dirIndex < 0)
+    return modified;
+
+  prefix = malloc(length + 2);
+  memcpy(prefix, fsPath, length);
+  prefix[length] = '/';
+  prefix[length + 1] = '\0';
+  lo = [self lowerBound:prefix];
+  prefix[length] = '/' + 1;
+  hi = [self lowerBound:prefix];
+  free(prefix);
+
+  // The directory itself, then those below
+  for (i = dirIndex; i < hi; i = (i < lo) ? lo : i + 1) {
+    dirPath = STRINGS + DIRS[i].path;
+    if (stat(dirPath, &st) == 0 && st.st_mtime >= HEADER->created) {
+      [modified addObject:[fm stringWithFileSystemRepresentation:dirPath
+                                                          length:strlen(dirPath)]];
+    }
+  }
+
+  return modified;
+}
+
+- (void)findInPath:(NSString *)path
+           literal:(const char *)literal
+            length:(size_t)literalLength
+   skipDirectories:(NSArray *)skipDirectories
+             match:(BOOL (^)(const char *name, size_t length))match
+            result:(void (^)(const char *path, size_t length))result
+{
+  const char     *fsPath = [path fileSystemRepresentation];
+  char           *prefix, *resultPath;
+  size_t         length = strlen(fsPath), resultLength;
+  unsigned char  *skip = NULL;
+  uint32_t       ranges[2][2];  // entries of the directory and those below
+  uint32_t       first = 0, count, i, r, e;
+  IndexTrigram   *trigram, *rarest = NULL;
+  IndexDirectory *dir;
+  IndexEntry     *entry;
+  NSInteger      dirIndex, skipIndex;
+  uint32_t       lo, hi;
+
+  dirIndex = [self indexOfDirectory:fsPath];
+  if (dirIndex < 0)
+    return;
+
+  dir = &DIRS[dirIndex];
+  ranges[0][0] = dir->firstEntry;
+  ranges[0][1] = dir->firstEntry + dir->entryCount;
+
+  // Paths below sort from "path/" up to "path0"
+  prefix = malloc(length + 2);
+  memcpy(prefix, fsPath, length);
+  prefix[length] = '/';
+  prefix[length + 1] = '\0';
+  lo = [self lowerBound:prefix];
+  prefix[length] = '/' + 1;
+  hi = [self lowerBound:prefix];
+  free(prefix);
+  if (hi > lo) {
+    ranges[1][0] = DIRS[lo].firstEntry;
+    ranges[1][1] = DIRS[hi - 1].firstEntry + DIRS[hi - 1].entryCount;
+  }
+  else {
+    ranges[1][0] = ranges[1][1] = 0;
+  }
+
+  if ([skipDirectories count] > 0) {
+    skip = calloc(HEADER->dirCount, 1);
+    for (NSString *skipPath in skipDirectories) {
+      skipIndex = [self indexOfDirectory:[skipPath fileSystemRepresentation]];
+      if (skipIndex >= 0)
+        skip[skipIndex] = 1;
+    }
+  }
+
+  // Only names with the least common trigram of the literal can have it
+  if (literal && literalLength >= 3) {
+    for (i = 0; i + 3 <= literalLength; i++) {
+      uint32_t key = trigramKey(literal + i);
+      uint32_t tlo = 0, thi = HEADER->trigramCount, mid;
+
+      while (tlo < thi) {
+        mid = tlo + (thi - tlo) / 2;
+        if (TRIGRAMS[mid].key < key)
+          tlo = mid + 1;
+        else
+          thi = mid;
+      }
+      trigram = (tlo < HEADER->trigramCount && TRIGRAMS[tlo].key == key) ? &TRIGRAMS[tlo] : NULL;
+      if (trigram == NULL) {
+        // no name has it
+        if (skip)
+          free(skip);
+        return;
+      }
+      if (rarest == NULL || trigram->postingCount < rarest->postingCount)
+        rarest = trigram;
+    }
+    first = rarest->firstPosting;
+    count = rarest->postingCount;
+  }
+  else {
+    count = (ranges[0][1] - ranges[0][0]) + (ranges[1][1] - ranges[1][0]);
+  }
+
+  resultPath = malloc(PATH_MAX * 2);
+
+  for (i = 0; i < count; i++) {
+    if (rarest) {
+      e = POSTINGS[first + i];
+      for (r = 0; r < 2; r++) {
+        if (e >= ranges[r][0] && e < ranges[r][1])
+          break;
+      }
+      if (r == 2)
+        continue;
+    }
+    else if (i < ranges[0][1] - ranges[0][0]) {
+      e = ranges[0][0] + i;
+    }
+    else {
+      e = ranges[1][0] + i - (ranges[0][1] - ranges[0][0]);
+    }
+
+    entry = &ENTRIES[e];
+    if (skip && skip[entry->dir])
+      continue;
+    if (match(STRINGS + entry->name, entry->nameLength) == NO)
+      continue;
+
+    dir = &DIRS[entry->dir];
+    resultLength = dir->pathLength + 1 + entry->nameLength;
+    if (resultLength >= PATH_MAX * 2)
+      continue;
+    memcpy(resultPath, STRINGS + dir->path, dir->pathLength);
+    resultPath[dir->pathLength] = '/';
+    memcpy(resultPath + dir->pathLength + 1, STRINGS + entry->name,
+           entry->nameLength + 1);
+    result(resultPath, resultLength);
+  }
+
+  free(resultPath);
+  if (skip)
+    free(skip);
+}
+
+@end
+
+#undef HEADER
+#undef DIRS
+#undef ENTRIES
+#undef TRIGRAMS
+#undef POSTINGS
+#undef STRINGS
+
+//-----------------------------------------------------------------------------
+// FinderIndex
+//-----------------------------------------------------------------------------
+
+static FinderIndex *sharedIndex = nil;
+
+@implementation FinderIndex
+
++ (FinderIndex *)sharedIndex
+{
+  NXTDefaults *df;
+
+  if (sharedIndex == nil) {
+    df = [NXTDefaults userDefaults];
+    if ([df objectForKey:@"FinderIndexEnabled"] &&
+        [df boolForKey:@"FinderIndexEnabled"] == NO) {
+      return nil;
+    }
+    sharedIndex = [[FinderIndex alloc] init];
+  }
+
+  return sharedIndex;
+}
+
+- (void)dealloc
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [indexPath release];
+  [rootPath release];
+  [data release];
+  [lock release];
+  [changedDirectories release];
+  [super dealloc];
+}
+
+- (id)init
+{
+  [super init];
+
+  rootPath = [NSHomeDirectory() copy];
+  indexPath = [[rootPath stringByAppendingPathComponent:INDEX_FILE] retain];
+  lock = [[NSLock alloc] init];
+  changedDirectories = [[NSMutableDictionary alloc] init];
+
+  data = [[FinderIndexData alloc] initWithContentsOfFile:indexPath];
+  if (data && [[data rootPath] isEqualToString:rootPath] == NO) {
+    [data release];
+    data = nil;
+  }
+
+  [[NSNotificationCenter defaultCenter]
+    addObserver:self
+       selector:@selector(fileSystemChangedAtPath:)
+           name:OSEFileSystemChangedAtPath
+         object:nil];
+
+  return self;
+}
+
+- (void)fileSystemChangedAtPath:(NSNotification *)notif
+{
+  NSString   *changedPath;
+  NSUInteger count;
+
+  changedPath = [[[notif userInfo] objectForKey:@"ChangedPath"]
+                  stringByStandardizingPath];
+  if (changedPath == nil ||
+      ([changedPath isEqualToString:rootPath] == NO &&
+       [changedPath hasPrefix:[rootPath stringByAppendingString:@"/"]] == NO)) {
+    return;
+  }
+
+  [lock lock];
+  [changedDirectories setObject:[NSDate date] forKey:changedPath];
+  count = [changedDirectories count];
+  [lock unlock];
+
+  if (count > INDEX_MAX_CHANGED)
+    [self update];
+}
+
+- (NSTimeInterval)updateInterval
+{
+  NSInteger interval;
+
+  interval = [[NXTDefaults userDefaults] integerForKey:@"FinderIndexUpdateInterval"];
+  return (interval < 0) ? INDEX_UPDATE_INTERVAL : interval;
+}
+
+- (void)updateIfNeeded
+{
+  FinderIndexData *current = [self data];
+
+  if (current == nil ||
+      -[[current creationDate] timeIntervalSinceNow] > [self updateInterval]) {
+    [self update];
+  }
+}
+
+- (void)update
+{
+  [lock lock];
+  if (isBuilding) {
+    [lock unlock];
+    return;
+  }
+  isBuilding = YES;
+  [lock unlock];
+
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+      [self build];
+    });
+}
+
+- (void)build
+{
+  @autoreleasepool {
+    NSDate          *started = [NSDate date];
+    FinderIndexData *newData = nil;
+
+    [[NSFileManager defaultManager]
+      createDirectoryAtPath:[indexPath stringByDeletingLastPathComponent]
+      withIntermediateDirectories:YES
+                 attributes:nil
+                      error:NULL];
+
+    if (buildIndex(rootPath, indexPath))
+      newData = [[FinderIndexData alloc] initWithContentsOfFile:indexPath];
+
+    [lock lock];
+    if (newData) {
+      [data release];
+      data = newData;
+      // Changes made while the index was built may be missing from it
+      for (NSString *path in [changedDirectories allKeys]) {
+        if ([[changedDirectories objectForKey:path] compare:started] == NSOrderedAscending)
+          [changedDirectories removeObjectForKey:path];
+      }
+    }
+    isBuilding = NO;
+    [lock unlock];
+
+    NSLog(@"[FinderIndex] %@ %@ in %.2f seconds.", rootPath,
+          newData ? @"indexed" : @"was not indexed",
+          -[started timeIntervalSinceNow]);
+  }
+}
+
+- (FinderIndexData *)data
+{
+  FinderIndexData *current;
+
+  [lock lock];
+  current = [data retain];
+  [lock unlock];
+
+  return [current autorelease];
+}
+
+- (NSArray *)changedDirectories
+{
+  NSArray *paths;
+
+  [lock lock];
+  paths = [changedDirectories allKeys];
+  [lock unlock];
+
+  return paths;
+}
+
+@end
@@ -250,7 +250,13 @@
 
   if (diff < 0) { // remove WS
     for (int i = wsCount; i > wsQuantity; i--) {
-      wWorkspaceDelete(wDefaultScreen(), i);
+      // wWorkspaceDelete() takes 0-based index and refuses workspaces
+      // that still have windows
+      if (!wWorkspaceDelete(wDefaultScreen(), i - 1)) {
+        wsQuantity = i;
+        [sender selectItemWithTag:wsQuantity];
+        break;
+      }
       [[wsReps objectAtIndex:i-1] removeFromSuperview];
     }
   }
@@ -0,0 +1,63 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2014-2021 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Thumbnails of image files kept as other desktops keep them (freedesktop.org
+// Thumbnail Managing Standard): PNG files named after the MD5 digest of the
+// file URI in the "normal" (128x128) and "large" (256x256) directories of
+// $XDG_CACHE_HOME/thumbnails, or of ~/.thumbnails used before. A thumbnail
+// is valid if its Thumb::URI and Thumb::MTime match the file.
+//
+// Missing thumbnails are made in the background, at most THUMBNAIL_WORKERS
+// at a time. Images are decoded already reduced to the thumbnail size by
+// libwraster. Thumbnails are written to a temporary file that is renamed.
+// Files that could not be read get an entry in the "fail" directory and
+// are not tried again until they change. When a thumbnail is made,
+// ThumbnailCacheDidMakeThumbnailNotification is posted on the main thread
+// with the path of the file as the object.
+//
+// Thumbnails are turned off with UseThumbnails set to NO (read at start).
+
+#import <Foundation/Foundation.h>
+
+extern NSString *ThumbnailCacheDidMakeThumbnailNotification;
+
+@interface ThumbnailCache : NSObject
+{
+  NSString         *cachePath;
+  NSString         *oldCachePath;
+  NSString         *failPath;
+
+  NSOperationQueue *queue;
+  NSMutableSet     *pendingFiles;
+  NSLock           *lock;
+}
+
+// Returns nil if thumbnails are turned off.
++ (ThumbnailCache *)sharedCache;
+
+// Whether the file is an image a thumbnail can be made of, by its extension.
+- (BOOL)isImageFile:(NSString *)path;
+
+// Returns the path of a valid thumbnail of the file, or nil. If there is
+// none, it is made in the background. May be called from any thread.
+- (NSString *)thumbnailForFile:(NSString *)path;
+
+@end
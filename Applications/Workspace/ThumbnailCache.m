@@ -0,0 +1,400 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2014-2021 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#import <DesktopKit/NXTDefaults.h>
+
+#import "Workspace+WM.h"
+#import "ThumbnailCache.h"
+
+#define THUMBNAIL_WORKERS 2     // thumbnails made at the same time
+#define NORMAL_SIZE       128
+#define FAIL_DIRECTORY    @"fail/Workspace-0.8"
+
+NSString *ThumbnailCacheDidMakeThumbnailNotification =
+  @"ThumbnailCacheDidMakeThumbnailNotification";
+
+static NSSet *imageExtensions = nil;
+
+//-----------------------------------------------------------------------------
+// Thumbnail files
+//-----------------------------------------------------------------------------
+
+static NSString *FileURI(NSString *path)
+{
+  NSString *uri;
+
+  uri = [[NSURL fileURLWithPath:[path stringByStandardizingPath]]
+          absoluteString];
+  // This compensates for a feature we have in NSURL, that is there to have
+  // MacOSX compatibility.
+  if ([uri hasPrefix:@"file://localhost/"]) {
+    uri = [@"file:///" stringByAppendingString:[uri substringFromIndex:17]];
+  }
+
+  return uri;
+}
+
+static NSString *ThumbnailName(NSString *uri)
+{
+  NSString *digest;
+
+  digest = [[[[uri dataUsingEncoding:NSUTF8StringEncoding] md5Digest]
+              hexadecimalRepresentation] lowercaseString];
+
+  return [digest stringByAppendingPathExtension:@"png"];
+}
+
+// Whether the PNG file at path is a thumbnail of the file with uri as it
+// was at mtime. Only the chunks before the image data are read.
+static BOOL ThumbnailIsValid(const char *path, const char *uri, time_t mtime)
+{
+  FILE        *fp;
+  png_structp png;
+  png_infop   info;
+  png_textp   text;
+  int         i, count;
+  BOOL        isURIValid = NO, isMTimeValid = NO;
+
+  if ((fp = fopen(path, "rb")) == NULL) {
+    return NO;
+  }
+
+  png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  info = (png != NULL) ? png_create_info_struct(png) : NULL;
+  if (info == NULL) {
+    png_destroy_read_struct(&png, NULL, NULL);
+    fclose(fp);
+    return NO;
+  }
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(fp);
+    return NO;
+  }
+
+  png_init_io(png, fp);
+  png_read_info(png, info);
+  if (png_get_text(png, info, &text, &count) > 0) {
+    for (i = 0; i < count; i++) {
+      if (strcmp(text[i].key, "Thumb::URI") == 0) {
+        isURIValid = (strcmp(text[i].text, uri) == 0);
+      }
+      else if (strcmp(text[i].key, "Thumb::MTime") == 0) {
+        isMTimeValid = (strtoll(text[i].text, NULL, 10) == (long long)mtime);
+      }
+    }
+  }
+
+  png_destroy_read_struct(&png, &info, NULL);
+  fclose(fp);
+
+  return (isURIValid && isMTimeValid);
+}
+
+// Writes image to path as a thumbnail of the file with uri, mtime and size.
+// The PNG is written to a temporary file in the same directory which is
+// renamed when complete, so other programs never see a part of it.
+static BOOL WriteThumbnail(RImage *image, const char *path,
+                           const char *uri, time_t mtime, off_t size)
+{
+  char        *tmpPath;
+  int         fd;
+  FILE        *fp;
+  png_structp png;
+  png_infop   info;
+  png_text    text[4];
+  char        mtimeString[32], sizeString[32];
+  int         channels = (image->format == RRGBAFormat) ? 4 : 3;
+  unsigned    y;
+  BOOL        isWritten;
+
+  tmpPath = malloc(strlen(path) + 8);
+  if (tmpPath == NULL) {
+    return NO;
+  }
+  sprintf(tmpPath, "%s.XXXXXX", path);
+  // Created with 0600 permissions as the standard asks
+  if ((fd = mkstemp(tmpPath)) < 0) {
+    free(tmpPath);
+    return NO;
+  }
+  if ((fp = fdopen(fd, "wb")) == NULL) {
+    close(fd);
+    unlink(tmpPath);
+    free(tmpPath);
+    return NO;
+  }
+
+  png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  info = (png != NULL) ? png_create_info_struct(png) : NULL;
+  if (info == NULL || setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &info);
+    fclose(fp);
+    unlink(tmpPath);
+    free(tmpPath);
+    return NO;
+  }
+
+  png_init_io(png, fp);
+  png_set_IHDR(png, info, image->width, image->height, 8,
+               (channels == 4) ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+
+  snprintf(mtimeString, sizeof(mtimeString), "%lld", (long long)mtime);
+  snprintf(sizeString, sizeof(sizeString), "%lld", (long long)size);
+  memset(text, 0, sizeof(text));
+  text[0].key = "Thumb::URI";
+  text[0].text = (char *)uri;
+  text[1].key = "Thumb::MTime";
+  text[1].text = mtimeString;
+  text[2].key = "Thumb::Size";
+  text[2].text = sizeString;
+  text[3].key = "Software";
+  text[3].text = "NEXTSPACE Workspace";
+  for (y = 0; y < 4; y++) {
+    text[y].compression = PNG_TEXT_COMPRESSION_NONE;
+  }
+  png_set_text(png, info, text, 4);
+
+  png_write_info(png, info);
+  for (y = 0; y < image->height; y++) {
+    png_write_row(png, image->data + y * image->width * channels);
+  }
+  png_write_end(png, info);
+  png_destroy_write_struct(&png, &info);
+
+  isWritten = (fclose(fp) == 0 && rename(tmpPath, path) == 0);
+  if (isWritten == NO) {
+    unlink(tmpPath);
+  }
+  free(tmpPath);
+
+  return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+// ThumbnailCache
+//-----------------------------------------------------------------------------
+
+static ThumbnailCache *sharedCache = nil;
+
+@implementation ThumbnailCache
+
+// Made here, as the first caller may be on any thread
++ (void)initialize
+{
+  NXTDefaults *df;
+
+  if (self == [ThumbnailCache class]) {
+    imageExtensions = [[NSSet alloc] initWithObjects:
+                                       @"jpg", @"jpeg", @"png", @"tif",
+                                     @"tiff", @"gif", @"webp", @"xpm",
+                                     @"ppm", @"pgm", @"pbm", @"pnm", nil];
+    df = [NXTDefaults userDefaults];
+    if ([df objectForKey:@"UseThumbnails"] == nil ||
+        [df boolForKey:@"UseThumbnails"] != NO) {
+      sharedCache = [[ThumbnailCache alloc] init];
+    }
+  }
+}
+
++ (ThumbnailCache *)sharedCache
+{
+  return sharedCache;
+}
+
+- (void)dealloc
+{
+  [queue cancelAllOperations];
+  [queue release];
+  [cachePath release];
+  [oldCachePath release];
+  [failPath release];
+  [pendingFiles release];
+  [lock release];
+  [super dealloc];
+}
+
+- (id)init
+{
+  NSString *cacheHome;
+
+  [super init];
+
+  cacheHome = [[[NSProcessInfo processInfo] environment]
+                objectForKey:@"XDG_CACHE_HOME"];
+  if ([cacheHome isAbsolutePath] == NO) {
+    cacheHome = [NSHomeDirectory() stringByAppendingPathComponent:@".cache"];
+  }
+  cachePath = [[cacheHome stringByAppendingPathComponent:@"thumbnails"]
+                retain];
+  oldCachePath = [[NSHomeDirectory()
+                    stringByAppendingPathComponent:@".thumbnails"] retain];
+  failPath = [[cachePath stringByAppendingPathComponent:FAIL_DIRECTORY]
+               retain];
+
+  queue = [[NSOperationQueue alloc] init];
+  [queue setMaxConcurrentOperationCount:THUMBNAIL_WORKERS];
+  pendingFiles = [[NSMutableSet alloc] init];
+  lock = [[NSLock alloc] init];
+
+  return self;
+}
+
+- (BOOL)isImageFile:(NSString *)path
+{
+  return [imageExtensions containsObject:[[path pathExtension]
+                                           lowercaseString]];
+}
+
+- (NSString *)thumbnailForFile:(NSString *)path
+{
+  NSString              *uri, *name, *thumbnail;
+  const char            *cURI;
+  struct stat           st;
+  NSInvocationOperation *operation;
+
+  // Thumbnails of thumbnails are not made
+  if ([self isImageFile:path] == NO ||
+      [path hasPrefix:cachePath] || [path hasPrefix:oldCachePath]) {
+    return nil;
+  }
+  if (stat([path fileSystemRepresentation], &st) != 0 ||
+      S_ISREG(st.st_mode) == 0) {
+    return nil;
+  }
+
+  uri = FileURI(path);
+  cURI = [uri UTF8String];
+  name = ThumbnailName(uri);
+
+  for (NSString *dir in @[cachePath, oldCachePath]) {
+    for (NSString *size in @[@"normal", @"large"]) {
+      thumbnail = [[dir stringByAppendingPathComponent:size]
+                    stringByAppendingPathComponent:name];
+      if (ThumbnailIsValid([thumbnail fileSystemRepresentation],
+                           cURI, st.st_mtime)) {
+        return thumbnail;
+      }
+    }
+  }
+
+  // Could not be read the last time and has not changed since
+  thumbnail = [failPath stringByAppendingPathComponent:name];
+  if (ThumbnailIsValid([thumbnail fileSystemRepresentation],
+                       cURI, st.st_mtime)) {
+    return nil;
+  }
+
+  [lock lock];
+  if ([pendingFiles containsObject:path] == NO) {
+    [pendingFiles addObject:path];
+    operation = [[NSInvocationOperation alloc]
+                  initWithTarget:self
+                        selector:@selector(_makeThumbnailForFile:)
+                          object:path];
+    [queue addOperation:operation];
+    [operation release];
+  }
+  [lock unlock];
+
+  return nil;
+}
+
+//-----------------------------------------------------------------------------
+// Workers
+//-----------------------------------------------------------------------------
+
+- (BOOL)_createDirectory:(NSString *)path
+{
+  NSDictionary *attributes;
+
+  attributes = @{NSFilePosixPermissions:[NSNumber numberWithShort:0700]};
+
+  return [[NSFileManager defaultManager] createDirectoryAtPath:path
+                                   withIntermediateDirectories:YES
+                                                    attributes:attributes
+                                                         error:NULL];
+}
+
+- (void)_makeThumbnailForFile:(NSString *)path
+{
+  NSString    *uri, *directory;
+  RImage      *image;
+  struct stat st;
+  BOOL        isFailed = NO, isMade = NO;
+
+  if (stat([path fileSystemRepresentation], &st) == 0) {
+    uri = FileURI(path);
+    image = RLoadImageAtSize(wDefaultScreen()->rcontext,
+                             [path fileSystemRepresentation], 0,
+                             NORMAL_SIZE, NORMAL_SIZE);
+    if (image != NULL) {
+      directory = [cachePath stringByAppendingPathComponent:@"normal"];
+    }
+    else {
+      // An empty image to remember the file could not be read
+      directory = failPath;
+      isFailed = YES;
+      if ((image = RCreateImage(1, 1, True)) != NULL) {
+        memset(image->data, 0, 4);
+      }
+    }
+
+    if (image != NULL) {
+      if ([self _createDirectory:directory]) {
+        isMade = WriteThumbnail(image,
+                                [[directory stringByAppendingPathComponent:
+                                              ThumbnailName(uri)]
+                                  fileSystemRepresentation],
+                                [uri UTF8String], st.st_mtime, st.st_size);
+      }
+      RReleaseImage(image);
+    }
+  }
+
+  [lock lock];
+  [pendingFiles removeObject:path];
+  [lock unlock];
+
+  if (isMade != NO && isFailed == NO) {
+    [self performSelectorOnMainThread:@selector(_thumbnailDidMake:)
+                           withObject:path
+                        waitUntilDone:NO];
+  }
+}
+
+- (void)_thumbnailDidMake:(NSString *)path
+{
+  [[NSNotificationCenter defaultCenter]
+    postNotificationName:ThumbnailCacheDidMakeThumbnailNotification
+                  object:path];
+}
+
+@end
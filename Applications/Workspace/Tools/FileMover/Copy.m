@@ -20,11 +20,26 @@
 // Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
 //
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             // copy_file_range()
+#endif
+
 #import "Copy.h"
 #import "NSStringAdditions.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>           // FICLONE
+
+#define COPY_CHUNK_SIZE   (8 * 1024 * 1024) // per copy_file_range()/sendfile()
+#define COPY_BUFFER_SIZE  (1024 * 1024)     // for read()/write()
+#define PROGRESS_INTERVAL 0.1               // seconds between progress reports
 
 // --- Copy
 
@@ -138,16 +153,220 @@ BOOL CopyDirectory(NSString *sourceDir,
   return YES;
 }
 
+// --- Regular file contents
+
+typedef enum {
+  CopyFileRange,
+  SendFile,
+  ReadWrite
+} CopyMethod;
+
+// Progress of the file being copied. It is sent to the Workspace at most
+// every PROGRESS_INTERVAL seconds, not for every block.
+typedef struct {
+  NSString           *filename;
+  NSString           *sourceDir;
+  NSString           *targetDir;
+  OperationType      opType;
+  unsigned long long done;
+  unsigned long long pending;
+  NSTimeInterval     lastReport;
+} CopyProgress;
+
+static void AdvanceProgress(CopyProgress *progress,
+                            unsigned long long bytes,
+                            BOOL force)
+{
+  NSTimeInterval now;
+
+  progress->done += bytes;
+  progress->pending += bytes;
+  if (progress->pending == 0)
+    return;
+
+  now = [NSDate timeIntervalSinceReferenceDate];
+  if (force || now - progress->lastReport >= PROGRESS_INTERVAL) {
+    [[Communicator shared] showProcessingFilename:progress->filename
+                                     sourcePrefix:progress->sourceDir
+                                     targetPrefix:progress->targetDir
+                                    bytesAdvanced:progress->pending
+                                    operationType:progress->opType];
+    progress->pending = 0;
+    progress->lastReport = now;
+  }
+}
+
+// write() may write less than asked
+static BOOL WriteAll(int fd, const char *buf, size_t length, off_t offset)
+{
+  ssize_t written;
+
+  while (length > 0) {
+    written = pwrite(fd, buf, length, offset);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return NO;
+    }
+    buf += written;
+    offset += written;
+    length -= written;
+  }
+  return YES;
+}
+
+// Copies length bytes at offset with the fastest method that works for
+// these files: copy_file_range() lets the file system copy on its own (or
+// share the blocks), sendfile() copies inside the kernel, read() and
+// write() are left if both fail or stop short.
+static BOOL CopyRange(int in, int out, off_t offset, off_t length,
+                      CopyMethod *method, char **buffer,
+                      CopyProgress *progress, ProblemType *problem)
+{
+  ssize_t count;
+  size_t  chunk;
+  loff_t  inOffset, outOffset;
+  off_t   sendOffset;
+
+  while (length > 0 && !isStopped) {
+    chunk = (length < COPY_CHUNK_SIZE) ? length : COPY_CHUNK_SIZE;
+
+    if (*method == CopyFileRange) {
+      inOffset = outOffset = offset;
+      count = copy_file_range(in, &inOffset, out, &outOffset, chunk, 0);
+      if (count < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                        errno == EOPNOTSUPP || errno == EBADF)) {
+        *method = SendFile;
+        continue;
+      }
+    }
+    else if (*method == SendFile) {
+      sendOffset = offset;
+      if (lseek(out, offset, SEEK_SET) < 0) {
+        *problem = WriteError;
+        return NO;
+      }
+      count = sendfile(out, in, &sendOffset, chunk);
+      if (count < 0 && (errno == EINVAL || errno == ENOSYS)) {
+        *method = ReadWrite;
+        continue;
+      }
+    }
+    else {
+      if (*buffer == NULL && posix_memalign((void **)buffer, 4096,
+                                            COPY_BUFFER_SIZE) != 0) {
+        *buffer = NULL;
+        *problem = ReadError;
+        return NO;
+      }
+      if (chunk > COPY_BUFFER_SIZE)
+        chunk = COPY_BUFFER_SIZE;
+      count = pread(in, *buffer, chunk, offset);
+      if (count > 0 && WriteAll(out, *buffer, count, offset) == NO) {
+        *problem = WriteError;
+        return NO;
+      }
+    }
+
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      *problem = (*method == ReadWrite) ? ReadError : WriteError;
+      return NO;
+    }
+    if (count == 0) {
+      // Some file systems (FUSE, NFS, CIFS on some kernels) and files
+      // like those of /proc return 0 from copy_file_range() and
+      // sendfile() before the end. Only read() tells the source ended.
+      if (*method != ReadWrite) {
+        *method = ReadWrite;
+        continue;
+      }
+      break; // source got shorter
+    }
+
+    offset += count;
+    length -= count;
+    AdvanceProgress(progress, count, NO);
+  }
+
+  return YES;
+}
+
+// Copies the contents of in to out, which is empty. Holes of sparse
+// files are not written, so they stay holes.
+static BOOL CopyContents(int in, int out, struct stat *st,
+                         CopyProgress *progress, ProblemType *problem)
+{
+  CopyMethod method = CopyFileRange;
+  char       *buffer = NULL;
+  off_t      size = st->st_size;
+  off_t      offset = 0, data, hole;
+  BOOL       isCopied = YES;
+
+#ifdef FICLONE
+  // Both files share the blocks on file systems that can do it
+  if (ioctl(out, FICLONE, in) == 0) {
+    AdvanceProgress(progress, size, NO);
+    return YES;
+  }
+#endif
+
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  if ((off_t)st->st_blocks * 512 < size) {
+    while (isCopied && offset < size && !isStopped) {
+      data = lseek(in, offset, SEEK_DATA);
+      if (data < 0) {
+        if (errno == ENXIO) // only a hole is left
+          break;
+        // no SEEK_DATA here: copy the rest as it is
+        isCopied = CopyRange(in, out, offset, size - offset,
+                             &method, &buffer, progress, problem);
+        offset = size;
+        break;
+      }
+      hole = lseek(in, data, SEEK_HOLE);
+      if (hole < 0 || hole > size)
+        hole = size;
+
+      AdvanceProgress(progress, data - offset, NO);
+      isCopied = CopyRange(in, out, data, hole - data,
+                           &method, &buffer, progress, problem);
+      offset = hole;
+    }
+    if (isCopied && offset < size)
+      AdvanceProgress(progress, size - offset, NO);
+    // the hole at the end
+    if (isCopied && !isStopped && ftruncate(out, size) < 0) {
+      *problem = WriteError;
+      isCopied = NO;
+    }
+  }
+  else {
+    isCopied = CopyRange(in, out, 0, size, &method, &buffer, progress, problem);
+  }
+
+  if (buffer)
+    free(buffer);
+
+  return isCopied;
+}
+
 BOOL CopyRegular(NSString *sourceFile,
 		 NSString *targetFile,
 		 NSDictionary *fileAttributes,
                  OperationType opType)
 {
-  NSUInteger	doneSize = 0;
   NSString	*sourceDir = [sourceFile stringByDeletingLastPathComponent];
   NSString	*targetDir = [targetFile stringByDeletingLastPathComponent];
   NSFileManager	*fm = [NSFileManager defaultManager];
   Communicator	*comm = [Communicator shared];
+  CopyProgress  progress;
+  ProblemType   problem = WriteError;
+  struct stat   st;
+  int           read_fd, write_fd;
+  BOOL          isCopied;
   
   if ([fm fileExistsAtPath:targetFile]) {
     ProblemSolution sol = [comm howToHandleProblem:FileExists];
@@ -161,71 +380,55 @@ BOOL CopyRegular(NSString *sourceFile,
     }
   }
 
-  if (![fm createFileAtPath:targetFile contents:nil attributes:nil]) {
-    [comm howToHandleProblem:WriteError];
+  read_fd = open([sourceFile fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+  if (read_fd < 0 || fstat(read_fd, &st) < 0) {
+    [comm howToHandleProblem:ReadError argument:[NSString errnoDescription]];
+    if (read_fd >= 0)
+      close(read_fd);
     return NO;
   }
-
-  if ([fm fileExistsAtPath:targetFile] == NO) {
-    if ([fm createFileAtPath:targetFile contents:nil attributes:nil] == NO) {
-      return NO;
-    }
+  // Permissions are set when the contents are copied
+  write_fd = open([targetFile fileSystemRepresentation],
+                  O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (write_fd < 0) {
+    [comm howToHandleProblem:WriteError argument:[NSString errnoDescription]];
+    close(read_fd);
+    return NO;
   }
 
-  {
-    int		read_fd, write_fd;
-    ssize_t	bytes_read = 1;
-    size_t	block_size = 64 * 1024;
-    void	*buf;
-
-    read_fd = open([sourceFile cString], O_RDONLY);
-    if (read_fd < 0) {
-      [comm howToHandleProblem:ReadError];
-      return NO;
-    }
-    write_fd = open([targetFile cString], O_WRONLY);
-    if (write_fd < 0) {
-      [comm howToHandleProblem:WriteError];
-      close(read_fd);
-      return NO;
-    }
-    buf = malloc(64 * 1024);
-
-    while (!isStopped && bytes_read) {
-      bytes_read = read(read_fd, buf, block_size);
-      if (bytes_read > 0) {
-        write(write_fd, buf, bytes_read);
-      }
-      doneSize += bytes_read;
-      [comm showProcessingFilename:[sourceFile lastPathComponent]
-                      sourcePrefix:sourceDir
-                      targetPrefix:targetDir
-                     bytesAdvanced:(NSUInteger)bytes_read
-                     operationType:opType];
-    }
-    close(read_fd);
-    close(write_fd);
-    free(buf);
+  progress.filename = [sourceFile lastPathComponent];
+  progress.sourceDir = sourceDir;
+  progress.targetDir = targetDir;
+  progress.opType = opType;
+  progress.done = 0;
+  progress.pending = 0;
+  progress.lastReport = [NSDate timeIntervalSinceReferenceDate];
+
+  isCopied = CopyContents(read_fd, write_fd, &st, &progress, &problem);
+  if (isCopied == NO && !isStopped) {
+    [comm howToHandleProblem:problem argument:[NSString errnoDescription]];
+  }
+  close(read_fd);
+  if (close(write_fd) < 0 && isCopied && !isStopped) {
+    [comm howToHandleProblem:WriteError argument:[NSString errnoDescription]];
+    isCopied = NO;
   }
 
   if (!isStopped) {
-    int result = chmod([targetFile cString],
+    int result = chmod([targetFile fileSystemRepresentation],
                        [fileAttributes filePosixPermissions]);
     if (result == -1) {
       [comm howToHandleProblem:AttributesUnchangeable
                       argument:[NSString errnoDescription]];
     }
 
-    if (doneSize < [fileAttributes fileSize]) {
-      [comm showProcessingFilename:[sourceFile lastPathComponent]
-                      sourcePrefix:sourceDir
-                      targetPrefix:targetDir
-                     bytesAdvanced:[fileAttributes fileSize] - doneSize
-                     operationType:opType];
+    if (progress.done < [fileAttributes fileSize]) {
+      AdvanceProgress(&progress, [fileAttributes fileSize] - progress.done, NO);
     }
   }
+  AdvanceProgress(&progress, 0, YES);
 
-  return YES;
+  return isCopied;
 }
 
 BOOL CopySymbolicLink(NSString *sourceFile,
@@ -26,7 +26,7 @@
 #import <Viewers/FileViewer.h>
 #import <Viewers/Viewer.h>
 
-@class NXTIconView, NXTIcon, NXTIconLabel;
+@class NXTIconView, NXTIcon, NXTIconItem, NXTIconLabel;
 
 @interface WMIconView : NXTIconView
 {
@@ -36,14 +36,30 @@
 - (BOOL)isAnimating;
 @end
 
+// Adds items of directory contents to the icon view with placeholder images,
+// the real ones are loaded later by IconImageLoader. On update only items of
+// new files are added and items of the files that are gone are removed.
+// Files are told apart by name, and changed files by their inode and ctime
+// saved at the last load (stamps). Stamps of the added and unchanged files
+// are saved to the viewer stamps with each page of icons, so a loader
+// replaced before it has finished does not leave them behind.
 @interface ViewerItemsLoader : NSOperation
 {
-  WMIconView     *iconView;
-  NSString       *directoryPath;
-  NSMutableArray *directoryContents;
-  NSArray        *selectedFiles;
-  BOOL           isUpdate;
-  BOOL           isAnimate;
+  WMIconView          *iconView;
+  NSString            *directoryPath;
+  NSArray             *directoryContents;
+  NSArray             *selectedFiles;
+  BOOL                isUpdate;
+  BOOL                isAnimate;
+
+  NSArray             *currentIcons;
+  NSDictionary        *oldStamps;
+  NSMutableDictionary *viewerStamps;
+
+  NSMutableDictionary *stamps;
+  NSMutableDictionary *pageStamps;
+  NSMutableArray      *changedIcons;
+  NSMutableArray      *changedPlaceholders;
 }
 
 - (id)initWithIconView:(NXTIconView *)view
@@ -51,8 +67,30 @@
               contents:(NSArray *)dirContents
              selection:(NSArray *)filenames
                 update:(BOOL)toUpdate
+                 items:(NSArray *)items
+                stamps:(NSMutableDictionary *)itemStamps
                animate:(BOOL)isDrawAnimation;
 
+// Valid after the operation has finished
+- (NSDictionary *)stamps;
+- (NSArray *)changedIcons;
+- (NSArray *)changedPlaceholders;
+
+@end
+
+// Gets the image of the file of an icon item with -iconForFile: and sets it
+// on the main thread. The path of the file is the represented object of
+// the item.
+@interface IconImageLoader : NSOperation
+{
+  NXTIconItem  *item;
+  NSString     *path;
+  NSMutableSet *pendingIcons;
+}
+
+- (id)initWithItem:(NXTIconItem *)anItem
+      pendingIcons:(NSMutableSet *)pending;
+
 @end
 
 @interface IconViewer : NSObject <Viewer>
@@ -71,6 +109,12 @@
   // Items loader
   NSOperationQueue	*operationQ;
   ViewerItemsLoader	*itemsLoader;
+  NSMutableDictionary   *itemStamps;
+
+  // Icon images loader
+  NSOperationQueue      *iconQueue;
+  NSMutableSet          *pendingIcons;
+  NSMutableArray        *shownIcons;
   
   // Dragging
   id         _dragSource;
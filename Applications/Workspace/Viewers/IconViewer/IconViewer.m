@@ -21,6 +21,11 @@
 // Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
 //
 
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #import <DesktopKit/DesktopKit.h>
 
 #import <DesktopKit/NXTDefaults.h>
@@ -31,6 +36,42 @@
 #import <Viewers/PathView.h>
 #import "IconViewer.h"
 
+// Number of icon images loaded at the same time
+#define ICON_LOADERS 2
+
+// Images of icons not loaded yet. These are copies, so they are never
+// mistaken for the images -iconForFile: returns.
+static NSImage *folderPlaceholder = nil;
+static NSImage *filePlaceholder = nil;
+
+// Returns what tells that a file has changed since the last load: its inode
+// and the time its contents or attributes were last changed.
+static NSData *FileStamp(int dirFD, const char *name, BOOL *isDirectory)
+{
+  struct {
+    dev_t  dev;
+    ino_t  ino;
+    time_t sec;
+    long   nsec;
+  } stamp;
+  struct stat st;
+
+  memset(&stamp, 0, sizeof(stamp));
+  *isDirectory = NO;
+
+  if (dirFD >= 0 &&
+      (fstatat(dirFD, name, &st, 0) == 0 ||
+       fstatat(dirFD, name, &st, AT_SYMLINK_NOFOLLOW) == 0)) {
+    stamp.dev = st.st_dev;
+    stamp.ino = st.st_ino;
+    stamp.sec = st.st_ctim.tv_sec;
+    stamp.nsec = st.st_ctim.tv_nsec;
+    *isDirectory = S_ISDIR(st.st_mode) ? YES : NO;
+  }
+
+  return [NSData dataWithBytes:&stamp length:sizeof(stamp)];
+}
+
 //=============================================================================
 // ViewerItemLoader implementation
 //=============================================================================
@@ -41,6 +82,8 @@
               contents:(NSArray *)dirContents
              selection:(NSArray *)filenames
                 update:(BOOL)toUpdate
+                 items:(NSArray *)items
+                stamps:(NSMutableDictionary *)itemStamps
                animate:(BOOL)isDrawAnimation
 {
   [super init];
@@ -48,51 +91,97 @@
   if (self != nil) {
     iconView = view;
     directoryPath = [[NSString alloc] initWithString:dirPath];
-    directoryContents = [dirContents mutableCopy];
+    directoryContents = [dirContents copy];
     selectedFiles = [[NSArray alloc] initWithArray:filenames];
     isUpdate = toUpdate;
     isAnimate = isDrawAnimation;
+
+    if (isUpdate != NO) {
+      currentIcons = [items copy];
+      oldStamps = [itemStamps copy];
+    }
+    viewerStamps = [itemStamps retain];
+
+    stamps = [[NSMutableDictionary alloc]
+               initWithCapacity:[directoryContents count]];
+    pageStamps = [NSMutableDictionary new];
+    changedIcons = [NSMutableArray new];
+    changedPlaceholders = [NSMutableArray new];
   }
 
   return self;
 }
 
-- (void)_updateItems:(NSMutableArray *)items
-            fileView:(WMIconView *)view
+- (void)dealloc
 {
-  NXTIcon         *icon;
-  NSMutableArray *itemsCopy = [items mutableCopy];
-  NSArray        *iconsCopy = [[view icons] copy];
+  [directoryPath release];
+  [directoryContents release];
+  [selectedFiles release];
+  TEST_RELEASE(currentIcons);
+  TEST_RELEASE(oldStamps);
+  [viewerStamps release];
+  [stamps release];
+  [pageStamps release];
+  [changedIcons release];
+  [changedPlaceholders release];
 
-  // NSLog(@"_updateItems: %lu", [items count]);
-  
-  // Remove non-existing items
-  for (NXTIcon *icon in iconsCopy) {
-    if ([items indexOfObject:[[icon label] text]] == NSNotFound) {
-      [view performSelectorOnMainThread:@selector(removeIcon:)
-                             withObject:icon
-                          waitUntilDone:YES];
+  [super dealloc];
+}
+
+// Removes items of the files that are gone. Returns the rest by name.
+- (NSDictionary *)_removeOldIcons
+{
+  NSSet               *names = [NSSet setWithArray:directoryContents];
+  NSMutableDictionary *items;
+  NSMutableArray      *itemsToRemove = [NSMutableArray array];
+  NSString            *label;
+
+  items = [NSMutableDictionary dictionaryWithCapacity:[currentIcons count]];
+  for (NXTIconItem *item in currentIcons) {
+    label = [item labelString];
+    if (label != nil && [names containsObject:label]) {
+      [items setObject:item forKey:label];
+    }
+    else {
+      [itemsToRemove addObject:item];
     }
   }
 
-  // Leave in `items` array items to add.
-  for (NSString *filename in itemsCopy) {
-    icon = [view iconWithLabelString:filename];
-    if (icon) {
-      [items removeObject:filename];
-    }
+  if ([itemsToRemove count] > 0) {
+    [iconView performSelectorOnMainThread:@selector(removeItems:)
+                               withObject:itemsToRemove
+                            waitUntilDone:YES];
   }
-  [itemsCopy release];
-  [iconsCopy release];
+
+  return items;
+}
+
+// Called on the main thread, where the loader is cancelled: items and
+// stamps of a cancelled loader are dropped.
+- (void)_addIcons:(NSArray *)items
+{
+  if ([self isCancelled] != NO) {
+    return;
+  }
+  if ([items count] > 0) {
+    [iconView addItems:items];
+  }
+  [viewerStamps addEntriesFromDictionary:pageStamps];
 }
 
 - (void)main
 {
   NSString       *path;
-  PathIcon       *anIcon;
-  NSUInteger     x, y, slotsWide, slotsTallVisible;
+  NXTIconItem    *anItem;
+  NSData         *stamp;
+  NSImage        *placeholder;
+  NSDictionary   *oldIcons = nil;
+  NSSet          *selectedNames = [NSSet setWithArray:selectedFiles];
   NSMutableSet   *selectedIcons = [NSMutableSet new];
   NSMutableArray *iconsToAdd = [NSMutableArray new];
+  NSUInteger     pageSize;
+  BOOL           isDirectory;
+  int            dirFD;
 
   if (isAnimate != NO) {
     [iconView performSelectorOnMainThread:@selector(drawOpenAnimation)
@@ -102,74 +191,86 @@
 
   NSLog(@"IconView: Begin path loading... %@ [%@]", directoryPath, selectedFiles);
 
-  x = y = 0;
-  slotsWide = [iconView slotsWide];
-  slotsTallVisible = [iconView slotsTallVisible];
+  pageSize = [iconView slotsWide] * [iconView slotsTallVisible];
+  if (pageSize < [iconView slotsWide]) {
+    pageSize = [iconView slotsWide];
+  }
 
   if (isUpdate != NO) {
-    [self _updateItems:directoryContents fileView:iconView];
+    oldIcons = [self _removeOldIcons];
   }
-  
-  selectedIcons = [NSMutableSet new];
-  iconsToAdd = [NSMutableArray new];
-  
+
+  dirFD = open([directoryPath fileSystemRepresentation],
+               O_RDONLY | O_DIRECTORY);
+
   for (NSString *filename in directoryContents) {
-    path = [directoryPath stringByAppendingPathComponent:filename];
+    if ([self isCancelled] != NO) {
+      break;
+    }
 
-    anIcon = [[PathIcon alloc] init];
-    [anIcon setLabelString:filename];
-    [anIcon setIconImage:[[NSApp delegate] iconForFile:path]];
-    [anIcon setPaths:[NSArray arrayWithObject:path]];
+    stamp = FileStamp(dirFD, [filename fileSystemRepresentation],
+                      &isDirectory);
+    [stamps setObject:stamp forKey:filename];
+    placeholder = isDirectory ? folderPlaceholder : filePlaceholder;
+
+    anItem = [oldIcons objectForKey:filename];
+    if (anItem != nil) {
+      if ([stamp isEqualToData:[oldStamps objectForKey:filename]] == NO) {
+        // Stamp is saved when the image is reset at the end of loading
+        [changedIcons addObject:anItem];
+        [changedPlaceholders addObject:placeholder];
+      }
+      else {
+        [pageStamps setObject:stamp forKey:filename];
+      }
+    }
+    else {
+      path = [directoryPath stringByAppendingPathComponent:filename];
+
+      anItem = [[NXTIconItem alloc] initWithLabelString:filename
+                                              iconImage:placeholder];
+      [anItem setRepresentedObject:path];
 
-    [iconsToAdd addObject:anIcon];
-    if ([selectedFiles containsObject:filename]) {
-      [selectedIcons addObject:anIcon];
+      [iconsToAdd addObject:anItem];
+      [pageStamps setObject:stamp forKey:filename];
+      [anItem release];
     }
-    [anIcon release];
 
-    x++;
-    if (x == slotsWide) {
-      y++;
-      x = 0;
+    if ([selectedNames containsObject:filename]) {
+      [selectedIcons addObject:anItem];
     }
+
     // Add icons on per page basis
-    if (y == slotsTallVisible && [iconView isAnimating] == NO) {
-      [iconView performSelectorOnMainThread:@selector(addIcons:)
-                                 withObject:iconsToAdd
-                              waitUntilDone:YES];
+    if ([iconsToAdd count] >= pageSize && [iconView isAnimating] == NO) {
+      [self performSelectorOnMainThread:@selector(_addIcons:)
+                             withObject:iconsToAdd
+                          waitUntilDone:YES];
       [iconsToAdd removeAllObjects];
-      x = y = 0;
+      [pageStamps removeAllObjects];
     }
   }
 
-  if ([iconsToAdd count] > 0) {
-    [iconView performSelectorOnMainThread:@selector(addIcons:)
-                               withObject:iconsToAdd
-                            waitUntilDone:YES];
+  if (dirFD >= 0) {
+    close(dirFD);
+  }
+
+  if ([iconsToAdd count] > 0 || [pageStamps count] > 0) {
+    [self performSelectorOnMainThread:@selector(_addIcons:)
+                           withObject:iconsToAdd
+                        waitUntilDone:YES];
     [iconsToAdd removeAllObjects];
+    [pageStamps removeAllObjects];
   }
   
-  if ((isUpdate != NO) &&
-      selectedFiles &&
-      ([selectedFiles count] != [selectedIcons count])) {
-    NXTIcon *icon;
-    for (NSString *filename in selectedFiles) {
-      if ((icon = [iconView iconWithLabelString:filename])) {
-        [selectedIcons addObject:icon];
-      }
-    }
+  if ([self isCancelled] == NO) {
+    [iconView performSelectorOnMainThread:@selector(selectItems:)
+                               withObject:selectedIcons
+                            waitUntilDone:YES];
   }
-  [iconView performSelectorOnMainThread:@selector(selectIcons:)
-                             withObject:selectedIcons
-                          waitUntilDone:YES];
   
   NSLog(@"IconView: End path loading...");
   [selectedIcons release];
   [iconsToAdd release];
-  
-  [directoryPath release];
-  [directoryContents release];
-  [selectedFiles release];
 }
 
 - (BOOL)isReady
@@ -177,6 +278,73 @@
   return YES;
 }
 
+- (NSDictionary *)stamps
+{
+  return stamps;
+}
+
+- (NSArray *)changedIcons
+{
+  return changedIcons;
+}
+
+- (NSArray *)changedPlaceholders
+{
+  return changedPlaceholders;
+}
+
+@end
+
+//=============================================================================
+// IconImageLoader implementation
+//=============================================================================
+@implementation IconImageLoader
+
+- (id)initWithItem:(NXTIconItem *)anItem
+      pendingIcons:(NSMutableSet *)pending
+{
+  [super init];
+
+  if (self != nil) {
+    item = [anItem retain];
+    path = [[anItem representedObject] copy];
+    pendingIcons = [pending retain];
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  [item release];
+  [path release];
+  [pendingIcons release];
+
+  [super dealloc];
+}
+
+- (void)main
+{
+  NSImage *image;
+
+  if ([self isCancelled] != NO) {
+    return;
+  }
+
+  image = [[NSApp delegate] iconForFile:path];
+  [self performSelectorOnMainThread:@selector(_setIconImage:)
+                         withObject:image
+                      waitUntilDone:NO];
+}
+
+- (void)_setIconImage:(NSImage *)image
+{
+  [pendingIcons removeObject:item];
+  if ([self isCancelled] == NO && image != nil) {
+    [item setIconImage:image];
+  }
+}
+
 @end
 
 //=============================================================================
@@ -272,17 +440,40 @@ static NSRect viewFrame;
 //=============================================================================
 // IconViewer implementation
 //=============================================================================
+@interface IconViewer (Private)
+- (void)_itemsLoaderDidFinish:(ViewerItemsLoader *)loader;
+- (void)_loadImageOfItem:(NXTIconItem *)item
+               isVisible:(BOOL)isVisible;
+- (void)_loadShownIcons;
+@end
+
 @implementation IconViewer
 
++ (void)initialize
+{
+  if (self == [IconViewer class]) {
+    folderPlaceholder = [[NSImage imageNamed:@"NXFolder"] copy];
+    filePlaceholder = [[NSImage imageNamed:@"NXUnknown"] copy];
+  }
+}
+
 - (void)dealloc
 {
   NSLog(@"[IconViewer](%@) -dealloc", rootPath);
   [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
 
   if (itemsLoader != nil) {
+    [itemsLoader removeObserver:self forKeyPath:@"isFinished"];
     [itemsLoader cancel];
     [itemsLoader release];
   }
+  [itemStamps release];
+
+  [iconQueue cancelAllOperations];
+  [iconQueue release];
+  [pendingIcons release];
+  [shownIcons release];
   
   TEST_RELEASE(_owner);
   TEST_RELEASE(rootPath);
@@ -310,6 +501,8 @@ static NSRect viewFrame;
   [iconView setSendsDoubleActionOnReturn:YES];
   [iconView setDoubleAction:@selector(open:)];
   [iconView setAutoAdjustsToFitIcons:YES];
+  [iconView setVirtualized:YES];
+  [iconView setIconClass:[PathIcon class]];
   iconSize = [NXTIconView defaultSlotSize];
   if ([[NXTDefaults userDefaults] objectForKey:@"IconSlotWidth"]) {
     iconSize.width = [[NXTDefaults userDefaults] floatForKey:@"IconSlotWidth"]; 
@@ -330,13 +523,24 @@ static NSRect viewFrame;
   // Operation
   operationQ = [[NSOperationQueue alloc] init];
   itemsLoader = nil;
+  itemStamps = [NSMutableDictionary new];
   doAnimation = NO;
+
+  iconQueue = [[NSOperationQueue alloc] init];
+  [iconQueue setMaxConcurrentOperationCount:ICON_LOADERS];
+  pendingIcons = [NSMutableSet new];
+  shownIcons = [NSMutableArray new];
   
   [[NSNotificationCenter defaultCenter]
           addObserver:self
              selector:@selector(iconWidthDidChange:)
                  name:@"IconSlotWidthDidChangeNotification"
                object:nil];
+  [[NSNotificationCenter defaultCenter]
+          addObserver:self
+             selector:@selector(thumbnailDidMake:)
+                 name:@"ThumbnailCacheDidMakeThumbnailNotification"
+               object:nil];
   
   currentPath = nil;
   selection = nil;
@@ -456,6 +660,7 @@ static NSRect viewFrame;
   ASSIGN(selection, filenames);
 
   if (itemsLoader != nil) {
+    [itemsLoader removeObserver:self forKeyPath:@"isFinished"];
     [itemsLoader cancel];
     [itemsLoader release];
   }
@@ -465,6 +670,10 @@ static NSRect viewFrame;
         rootPath, dirPath, updateOnDisplay);
 
   if (updateOnDisplay == NO) {
+    [iconQueue cancelAllOperations];
+    [pendingIcons removeAllObjects];
+    [shownIcons removeAllObjects];
+    [itemStamps removeAllObjects];
     [iconView removeAllIcons];
     // [iconView display];
   }
@@ -474,6 +683,8 @@ static NSRect viewFrame;
                                                    contents:dirContents
                                                   selection:filenames
                                                      update:updateOnDisplay
+                                                      items:[iconView items]
+                                                     stamps:itemStamps
                                                     animate:doAnimation];
   [itemsLoader addObserver:self
                 forKeyPath:@"isFinished"
@@ -505,7 +716,7 @@ static NSRect viewFrame;
 }
 - (void)open:sender
 {
-  NSSet    *selected = [iconView selectedIcons];
+  NSSet    *selected = [iconView selectedItems];
   NSString *path, *fullPath;
   NSString *appName, *fileType;
 
@@ -524,7 +735,7 @@ static NSRect viewFrame;
     if ([fileType isEqualToString:NSDirectoryFileType] ||
         [fileType isEqualToString:NSFilesystemFileType]) {
       doAnimation = YES;
-      boxRect = [[[iconView selectedIcons] anyObject] frame];
+      boxRect = [iconView frameOfItem:[[iconView selectedItems] anyObject]];
       [self displayPath:path selection:nil];
       [_owner displayPath:path selection:nil sender:self];
     }
@@ -546,12 +757,14 @@ static NSRect viewFrame;
 // --- Events
 - (void)currentSelectionRenamedTo:(NSString *)newName
 {
-  PathIcon *icon = [[iconView selectedIcons] anyObject];
-  NSString *path;
+  NXTIconItem *item = [[iconView selectedItems] anyObject];
+  NSString    *path;
 
-  [icon setLabelString:[newName lastPathComponent]];
   path = [rootPath stringByAppendingPathComponent:newName];
-  [icon setIconImage:[[NSApp delegate] iconForFile:path]];
+  [item setRepresentedObject:path];
+  [(PathIcon *)[iconView iconOfItem:item] setPaths:@[path]];
+  [item setLabelString:[newName lastPathComponent]];
+  [item setIconImage:[[NSApp delegate] iconForFile:path]];
 }
 
 // -- Notifications
@@ -564,37 +777,124 @@ static NSRect viewFrame;
   [iconView setSlotSize:slotSize];
 }
 
+// Image of the file was asked for before its thumbnail was made
+- (void)thumbnailDidMake:(NSNotification *)notification
+{
+  NSString    *path = [notification object];
+  NXTIconItem *item;
+
+  if ([[path stringByDeletingLastPathComponent]
+        isEqualToString:[self fullPath]] == NO) {
+    return;
+  }
+
+  item = [iconView itemWithLabelString:[path lastPathComponent]];
+  if (item == nil) {
+    return;
+  }
+
+  if ([iconView iconOfItem:item] != nil) {
+    [pendingIcons removeObject:item];
+    [self _loadImageOfItem:item
+                 isVisible:NSIntersectsRect([iconView frameOfItem:item],
+                                            [iconView visibleRect])];
+  }
+  else {
+    [item setIconImage:filePlaceholder];
+  }
+}
+
 // -- NSOperation
 - (void)observeValueForKeyPath:(NSString *)keyPath
                       ofObject:(id)object
                         change:(NSDictionary *)change
                        context:(void *)context
 {
-  NXTIconLabel *iconLabel;
-  
   NSLog(@"IconView: Observer `%@` of '%@' was called.", [self className], keyPath);
-  for (NXTIcon *icon in [iconView icons]) {
-    [icon setEditable:YES];
-    [icon setDelegate:self];
-    [icon setTarget:self];
-    [icon setDoubleAction:@selector(open:)];
-    [icon setDragAction:@selector(iconDragged:withEvent:)];
-    [icon registerForDraggedTypes:@[NSFilenamesPboardType]];
-    iconLabel = [icon label];
-    [iconLabel setNextKeyView:iconView];
-    [iconLabel setIconLabelDelegate:_owner];
+  // Sent on the thread of the operation
+  [self performSelectorOnMainThread:@selector(_itemsLoaderDidFinish:)
+                         withObject:object
+                      waitUntilDone:NO];
+}
+
+// -- Icon images
+- (void)_loadImageOfItem:(NXTIconItem *)item
+               isVisible:(BOOL)isVisible
+{
+  IconImageLoader *loader;
+
+  if ([pendingIcons containsObject:item]) {
+    return;
+  }
+
+  loader = [[IconImageLoader alloc] initWithItem:item
+                                    pendingIcons:pendingIcons];
+  [loader setQueuePriority:(isVisible ? NSOperationQueuePriorityHigh
+                                      : NSOperationQueuePriorityLow)];
+  [pendingIcons addObject:item];
+  [iconQueue addOperation:loader];
+  [loader release];
+}
+
+- (void)_itemsLoaderDidFinish:(ViewerItemsLoader *)loader
+{
+  NSArray     *changedIcons = [loader changedIcons];
+  NSArray     *placeholders = [loader changedPlaceholders];
+  NSRect      visibleRect = [iconView visibleRect];
+  NXTIconItem *item;
+  NSUInteger  i;
+
+  // Loader was cancelled by -displayPath:selection:
+  if (loader != itemsLoader) {
+    return;
+  }
+  [itemsLoader removeObserver:self forKeyPath:@"isFinished"];
+
+  // Shown items of changed files get their images again, the others when
+  // they are shown.
+  for (i = 0; i < [changedIcons count]; i++) {
+    item = [changedIcons objectAtIndex:i];
+    if ([iconView iconOfItem:item] != nil) {
+      [self _loadImageOfItem:item
+                   isVisible:NSIntersectsRect([iconView frameOfItem:item],
+                                              visibleRect)];
+    }
+    else {
+      [item setIconImage:[placeholders objectAtIndex:i]];
+    }
   }
+  [itemStamps setDictionary:[loader stamps]];
+  DESTROY(itemsLoader);
 
   // [iconView scrollPoint:NSZeroPoint];
-  [iconView performSelectorOnMainThread:@selector(adjustToFitIcons)
-                             withObject:nil
-                          waitUntilDone:YES];
+  [iconView adjustToFitIcons];
   [[view window] makeFirstResponder:iconView];
   [_owner setWindowEdited:NO];
   updateOnDisplay = NO;
   doAnimation = NO;
 }
 
+// Items with placeholder images shown since the last call. Images of the
+// items in the visible rectangle are loaded first, those shown around it
+// after them.
+- (void)_loadShownIcons
+{
+  NSRect  visibleRect = [iconView visibleRect];
+  NSImage *image;
+
+  for (NXTIconItem *item in shownIcons) {
+    image = [item iconImage];
+    if ([iconView iconOfItem:item] == nil ||
+        (image != folderPlaceholder && image != filePlaceholder)) {
+      continue;
+    }
+    [self _loadImageOfItem:item
+                 isVisible:NSIntersectsRect([iconView frameOfItem:item],
+                                            visibleRect)];
+  }
+  [shownIcons removeAllObjects];
+}
+
 //=============================================================================
 // Local
 //=============================================================================
@@ -612,9 +912,9 @@ static NSRect viewFrame;
 
   NSLog(@"IconViewer(%@): selection did change.", rootPath);
 
-  for (NXTIcon *icon in selectedIcons) {
-    [icon setShowsExpandedLabelWhenSelected:showsExpanded];
-    [selected addObject:[icon labelString]];
+  for (NXTIconItem *item in selectedIcons) {
+    [[iconView iconOfItem:item] setShowsExpandedLabelWhenSelected:showsExpanded];
+    [selected addObject:[item labelString]];
   }
 
   ASSIGN(selection, [[selected copy] autorelease]);
@@ -622,6 +922,41 @@ static NSRect viewFrame;
   [_owner displayPath:currentPath selection:selection sender:self];
 }
 
+- (void)iconView:(NXTIconView *)anIconView
+    willShowIcon:(NXTIcon *)anIcon
+         forItem:(NXTIconItem *)anItem
+{
+  NXTIconLabel *iconLabel = [anIcon label];
+  NSImage      *image = [anItem iconImage];
+
+  [(PathIcon *)anIcon setPaths:@[[anItem representedObject]]];
+  [anIcon setShowsExpandedLabelWhenSelected:([selection count] == 1)];
+
+  // Icons are made by the icon view without being set up
+  if ([anIcon delegate] != self) {
+    [anIcon setEditable:YES];
+    [anIcon setDelegate:self];
+    [anIcon setTarget:self];
+    [anIcon setDoubleAction:@selector(open:)];
+    [anIcon setDragAction:@selector(iconDragged:withEvent:)];
+    [anIcon registerForDraggedTypes:@[NSFilenamesPboardType]];
+  }
+
+  [iconLabel setNextKeyView:iconView];
+  [iconLabel setIconLabelDelegate:_owner];
+
+  if ((image == folderPlaceholder || image == filePlaceholder) &&
+      [pendingIcons containsObject:anItem] == NO) {
+    // Icon has no frame yet: its image is asked for when it is in the view
+    if ([shownIcons count] == 0) {
+      [self performSelector:@selector(_loadShownIcons)
+                 withObject:nil
+                 afterDelay:0];
+    }
+    [shownIcons addObject:anItem];
+  }
+}
+
 - (void)keyDown:(NSEvent *)ev
 {
   NSString   *characters = [ev characters];
@@ -774,8 +1109,9 @@ static NSRect viewFrame;
   iconLocation.x = iconFrame.origin.x + 8;
   iconLocation.y = iconFrame.origin.y + (iconFrame.size.width - 16);
 
-  [_dragIcon setSelected:NO];
-  [_dragIcon setDimmed:YES];
+  // Set on the item, so the icon keeps it when the item changes
+  [[iconView itemOfIcon:_dragIcon] setSelected:NO];
+  [[iconView itemOfIcon:_dragIcon] setDimmed:YES];
 
   paths = [_dragIcon paths];
   _dragMask = [_owner draggingSourceOperationMaskForPaths:paths];
@@ -802,8 +1138,8 @@ static NSRect viewFrame;
              endedAt:(NSPoint)screenPoint
            deposited:(BOOL)didDeposit
 {
-  [_dragIcon setSelected:YES];
-  [_dragIcon setDimmed:NO];
+  [[iconView itemOfIcon:_dragIcon] setSelected:YES];
+  [[iconView itemOfIcon:_dragIcon] setDimmed:NO];
 }
 
 @end
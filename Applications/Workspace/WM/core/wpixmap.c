@@ -158,7 +158,7 @@ WMPixmap *WMCreatePixmapFromFile(WMScreen *scrPtr, const char *fileName)
   WMPixmap *pixPtr;
   RImage *image;
 
-  image = RLoadImage(scrPtr->rcontext, fileName, 0);
+  image = RLoadSharedImage(scrPtr->rcontext, fileName, 0);
   if (!image)
     return NULL;
 
@@ -220,7 +220,10 @@ WMPixmap *WMCreateScaledBlendedPixmapFromFile(WMScreen *scrPtr, const char *file
   WMPixmap *pixPtr;
   RImage *image;
 
-  image = RLoadImage(scrPtr->rcontext, fileName, 0);
+  if ((width > 0) && (height > 0))
+    image = RLoadImageAtSize(scrPtr->rcontext, fileName, 0, width, height);
+  else
+    image = RLoadImage(scrPtr->rcontext, fileName, 0);
   if (!image)
     return NULL;
 
@@ -0,0 +1,275 @@
+/*  Sum of the areas of rectangles covering a rectangle
+ *
+ *  Workspace window manager
+ *  Copyright (c) 2015-2021 Sergii Stoian
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+
+#include <core/util.h>
+
+#include "coverage.h"
+
+struct WCoverage {
+  int x1, y1, x2, y2;
+
+  int *rects;                   /* x, y, width, height of each */
+  int rect_count;
+  int rect_size;
+  int dirty;
+
+  /* sorted distinct edges of the rectangles */
+  int *xs, *ys;
+  int nx, ny;
+
+  /* for each coordinate from x1 to x2 (y1 to y2), the index of the last
+     edge at or before it */
+  int *x_index, *y_index;
+
+  /* Indexed [i * ny + j]. cover is the number of rectangles on the cell
+     from xs[i],ys[j] to xs[i+1],ys[j+1]. sum is the covered area from
+     xs[0],ys[0] to xs[i],ys[j]; column is the covered length of column
+     i from ys[0] to ys[j], row that of row j from xs[0] to xs[i]. */
+  int *cover;
+  long long *sum, *column, *row;
+};
+
+static int compare_int(const void *a, const void *b)
+{
+  int ia = *(const int *)a, ib = *(const int *)b;
+
+  return (ia > ib) - (ia < ib);
+}
+
+/* Sorts the n values and drops duplicates. Returns the number left. */
+static int sort_edges(int *v, int n)
+{
+  int i, k;
+
+  if (n == 0)
+    return 0;
+
+  qsort(v, n, sizeof(int), compare_int);
+  for (i = k = 1; i < n; i++) {
+    if (v[i] != v[k - 1])
+      v[k++] = v[i];
+  }
+  return k;
+}
+
+/* Index of the edge v is in edges, which must be there. */
+static int find_edge(const int *edges, int n, int v)
+{
+  int lo = 0, hi = n - 1, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (edges[mid] <= v)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+static void fill_index(int *index, int from, int to, const int *edges, int n)
+{
+  int c, i = 0;
+
+  for (c = from; c <= to; c++) {
+    while (i + 1 < n && edges[i + 1] <= c)
+      i++;
+    index[c - from] = i;
+  }
+}
+
+static void free_table(WCoverage *cov)
+{
+  if (cov->xs) wfree(cov->xs);
+  if (cov->ys) wfree(cov->ys);
+  if (cov->x_index) wfree(cov->x_index);
+  if (cov->y_index) wfree(cov->y_index);
+  if (cov->cover) wfree(cov->cover);
+  if (cov->sum) wfree(cov->sum);
+  if (cov->column) wfree(cov->column);
+  if (cov->row) wfree(cov->row);
+  cov->xs = cov->ys = cov->x_index = cov->y_index = cov->cover = NULL;
+  cov->sum = cov->column = cov->row = NULL;
+  cov->nx = cov->ny = 0;
+}
+
+static void build_table(WCoverage *cov)
+{
+  int nx, ny, i, j, k;
+  int *r;
+  int *cover;
+  long long *sum, *column, *row;
+  long long dx, dy;
+
+  free_table(cov);
+  cov->dirty = 0;
+  if (cov->rect_count == 0)
+    return;
+
+  cov->xs = wmalloc(2 * cov->rect_count * sizeof(int));
+  cov->ys = wmalloc(2 * cov->rect_count * sizeof(int));
+  for (k = 0, r = cov->rects; k < cov->rect_count; k++, r += 4) {
+    cov->xs[2 * k] = r[0];
+    cov->xs[2 * k + 1] = r[0] + r[2];
+    cov->ys[2 * k] = r[1];
+    cov->ys[2 * k + 1] = r[1] + r[3];
+  }
+  nx = cov->nx = sort_edges(cov->xs, 2 * cov->rect_count);
+  ny = cov->ny = sort_edges(cov->ys, 2 * cov->rect_count);
+
+  /* corners of the rectangles, then summed up to the coverage of cells */
+  cover = cov->cover = wmalloc(nx * ny * sizeof(int));
+  for (k = 0, r = cov->rects; k < cov->rect_count; k++, r += 4) {
+    int i0 = find_edge(cov->xs, nx, r[0]);
+    int i1 = find_edge(cov->xs, nx, r[0] + r[2]);
+    int j0 = find_edge(cov->ys, ny, r[1]);
+    int j1 = find_edge(cov->ys, ny, r[1] + r[3]);
+
+    cover[i0 * ny + j0]++;
+    cover[i1 * ny + j0]--;
+    cover[i0 * ny + j1]--;
+    cover[i1 * ny + j1]++;
+  }
+  for (i = 0; i < nx; i++) {
+    for (j = 0; j < ny; j++) {
+      if (i > 0)
+        cover[i * ny + j] += cover[(i - 1) * ny + j];
+      if (j > 0)
+        cover[i * ny + j] += cover[i * ny + j - 1];
+      if (i > 0 && j > 0)
+        cover[i * ny + j] -= cover[(i - 1) * ny + j - 1];
+    }
+  }
+
+  sum = cov->sum = wmalloc(nx * ny * sizeof(long long));
+  column = cov->column = wmalloc(nx * ny * sizeof(long long));
+  row = cov->row = wmalloc(nx * ny * sizeof(long long));
+  for (i = 0; i < nx; i++) {
+    for (j = 0; j < ny; j++) {
+      if (j > 0) {
+        dy = cov->ys[j] - cov->ys[j - 1];
+        column[i * ny + j] = column[i * ny + j - 1] + cover[i * ny + j - 1] * dy;
+      }
+      if (i > 0) {
+        dx = cov->xs[i] - cov->xs[i - 1];
+        row[i * ny + j] = row[(i - 1) * ny + j] + cover[(i - 1) * ny + j] * dx;
+      }
+      if (i > 0 && j > 0) {
+        sum[i * ny + j] = (sum[(i - 1) * ny + j] + sum[i * ny + j - 1]
+                           - sum[(i - 1) * ny + j - 1]
+                           + cover[(i - 1) * ny + j - 1] * dx * dy);
+      }
+    }
+  }
+
+  cov->x_index = wmalloc((cov->x2 - cov->x1 + 1) * sizeof(int));
+  cov->y_index = wmalloc((cov->y2 - cov->y1 + 1) * sizeof(int));
+  fill_index(cov->x_index, cov->x1, cov->x2, cov->xs, nx);
+  fill_index(cov->y_index, cov->y1, cov->y2, cov->ys, ny);
+}
+
+/* Covered area from xs[0],ys[0] to x,y. */
+static long long covered_area(WCoverage *cov, int x, int y)
+{
+  int i, j;
+  long long ax, ay, area;
+
+  if (x <= cov->xs[0] || y <= cov->ys[0])
+    return 0;
+  if (x > cov->xs[cov->nx - 1])
+    x = cov->xs[cov->nx - 1];
+  if (y > cov->ys[cov->ny - 1])
+    y = cov->ys[cov->ny - 1];
+
+  if (x >= cov->x1 && x <= cov->x2)
+    i = cov->x_index[x - cov->x1];
+  else
+    i = find_edge(cov->xs, cov->nx, x);
+  if (y >= cov->y1 && y <= cov->y2)
+    j = cov->y_index[y - cov->y1];
+  else
+    j = find_edge(cov->ys, cov->ny, y);
+
+  ax = x - cov->xs[i];
+  ay = y - cov->ys[j];
+  area = cov->sum[i * cov->ny + j];
+  if (ax)
+    area += ax * cov->column[i * cov->ny + j];
+  if (ay)
+    area += ay * cov->row[i * cov->ny + j];
+  if (ax && ay)
+    area += ax * ay * cov->cover[i * cov->ny + j];
+
+  return area;
+}
+
+WCoverage *wCoverageCreate(int x1, int y1, int x2, int y2)
+{
+  WCoverage *cov = wmalloc(sizeof(WCoverage));
+
+  cov->x1 = x1;
+  cov->y1 = y1;
+  cov->x2 = x2 > x1 ? x2 : x1;
+  cov->y2 = y2 > y1 ? y2 : y1;
+
+  return cov;
+}
+
+void wCoverageDestroy(WCoverage *cov)
+{
+  free_table(cov);
+  if (cov->rects)
+    wfree(cov->rects);
+  wfree(cov);
+}
+
+void wCoverageAddRect(WCoverage *cov, int x, int y, int width, int height)
+{
+  int *r;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  if (cov->rect_count == cov->rect_size) {
+    cov->rect_size = cov->rect_size ? cov->rect_size * 2 : 32;
+    cov->rects = wrealloc(cov->rects, cov->rect_size * 4 * sizeof(int));
+  }
+  r = cov->rects + 4 * cov->rect_count++;
+  r[0] = x;
+  r[1] = y;
+  r[2] = width;
+  r[3] = height;
+  cov->dirty = 1;
+}
+
+long long wCoverageSum(WCoverage *cov, int x, int y, int width, int height)
+{
+  if (cov->dirty)
+    build_table(cov);
+  if (cov->nx == 0 || width <= 0 || height <= 0)
+    return 0;
+
+  return (covered_area(cov, x + width, y + height)
+          - covered_area(cov, x, y + height)
+          - covered_area(cov, x + width, y)
+          + covered_area(cov, x, y));
+}
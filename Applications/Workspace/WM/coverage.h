@@ -0,0 +1,44 @@
+/*  Sum of the areas of rectangles covering a rectangle
+ *
+ *  Workspace window manager
+ *  Copyright (c) 2015-2021 Sergii Stoian
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The edges of the rectangles split the plane into cells covered by the same
+ * number of rectangles. A summed-area table over these cells gives the sum
+ * of the areas in which all rectangles intersect any other rectangle in
+ * constant time, however many rectangles there are. The table is rebuilt
+ * on the first query after rectangles were added.
+ */
+
+#ifndef __WORKSPACE_WM_COVERAGE__
+#define __WORKSPACE_WM_COVERAGE__
+
+typedef struct WCoverage WCoverage;
+
+/* Coordinates from x1,y1 to x2,y2 are looked up without a search. */
+WCoverage *wCoverageCreate(int x1, int y1, int x2, int y2);
+void wCoverageDestroy(WCoverage *cov);
+
+void wCoverageAddRect(WCoverage *cov, int x, int y, int width, int height);
+
+/* Returns the sum of the intersecting areas of the rectangles with this
+ * one, as adding up calcIntersectionArea() for each of them would. */
+long long wCoverageSum(WCoverage *cov, int x, int y, int width, int height);
+
+#endif /* __WORKSPACE_WM_COVERAGE__ */
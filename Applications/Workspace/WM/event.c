@@ -320,6 +320,7 @@ static void _runLoopHandleEvent(CFFileDescriptorRef fdref, CFOptionFlags callBac
     WMHandleEvent(&event);
   }
   /* WMLogError("2. _processXEvent() - %i", XPending(dpy)); */
+  wNETWMFlushUpdates(wDefaultScreen());
   CFFileDescriptorEnableCallBacks(fdref, kCFFileDescriptorReadCallBack);
 }
 
@@ -330,6 +331,8 @@ void WMRunLoop_V0()
   while (wm_runloop == NULL) {
     WMNextEvent(dpy, &event);
     WMHandleEvent(&event);
+    if (XPending(dpy) == 0)
+      wNETWMFlushUpdates(wDefaultScreen());
   }
   WMLogError("WMRunLoop_V0: run loop V1 is ready.");
   
@@ -183,10 +183,10 @@ void wFrameWindowUpdateBorders(WFrameWindow * fwin, int flags)
     else {
       /* we had a titlebar, but now we don't need it anymore */
       for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-        FREE_PIXMAP(fwin->title_back[i]);
+        RELEASE_PIXMAP(fwin->title_back[i]);
         if (wPreferences.titlebar_style == TS_NEW) {
-          FREE_PIXMAP(fwin->lbutton_back[i]);
-          FREE_PIXMAP(fwin->rbutton_back[i]);
+          RELEASE_PIXMAP(fwin->lbutton_back[i]);
+          RELEASE_PIXMAP(fwin->rbutton_back[i]);
         }
       }
       if (fwin->left_button)
@@ -400,12 +400,13 @@ void wFrameWindowDestroy(WFrameWindow * fwin)
     wfree(fwin->title);
 
   for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-    FREE_PIXMAP(fwin->title_back[i]);
+    RELEASE_PIXMAP(fwin->title_back[i]);
     if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[i]);
-      FREE_PIXMAP(fwin->rbutton_back[i]);
+      RELEASE_PIXMAP(fwin->lbutton_back[i]);
+      RELEASE_PIXMAP(fwin->rbutton_back[i]);
     }
   }
+  RELEASE_PIXMAP(fwin->resizebar_back[0]);
 
   wfree(fwin);
 }
@@ -635,6 +636,73 @@ static void renderResizebarTexture(WScreen * scr, WTexture * texture, int width,
   RReleaseImage(img);
 }
 
+/*
+ * Same as renderTexture() and renderResizebarTexture(), but windows with
+ * the same decoration share the pixmaps through the texture cache
+ */
+static void getTitlebarTexture(WScreen *scr, WTexture *texture, int width, int height,
+                               int left, int right, Pixmap *title,
+                               Pixmap *lbutton, Pixmap *rbutton)
+{
+  WTextureKey key;
+  Pixmap pmap, lpmap, rpmap;
+
+  if (wPreferences.titlebar_style != TS_NEW)
+    left = right = 0;
+
+  memset(&key, 0, sizeof(key));
+  key.texture = texture;
+  key.style = wPreferences.titlebar_style;
+  key.width = width;
+  key.height = height;
+  key.param1 = left;
+  key.param2 = right;
+
+  key.kind = WTC_TITLEBAR;
+  *title = wTextureCacheGet(&key);
+  key.kind = WTC_LBUTTON;
+  *lbutton = left ? wTextureCacheGet(&key) : None;
+  key.kind = WTC_RBUTTON;
+  *rbutton = right ? wTextureCacheGet(&key) : None;
+
+  if (*title && (!left || *lbutton) && (!right || *rbutton))
+    return;
+
+  RELEASE_PIXMAP(*title);
+  RELEASE_PIXMAP(*lbutton);
+  RELEASE_PIXMAP(*rbutton);
+
+  renderTexture(scr, texture, width, height, height, height, left, right,
+                &pmap, &lpmap, &rpmap);
+
+  key.kind = WTC_TITLEBAR;
+  *title = wTextureCachePut(&key, pmap);
+  key.kind = WTC_LBUTTON;
+  *lbutton = wTextureCachePut(&key, lpmap);
+  key.kind = WTC_RBUTTON;
+  *rbutton = wTextureCachePut(&key, rpmap);
+}
+
+static void getResizebarTexture(WScreen *scr, WTexture *texture, int width, int height,
+                                int cwidth, Pixmap *pmap)
+{
+  WTextureKey key;
+
+  memset(&key, 0, sizeof(key));
+  key.texture = texture;
+  key.kind = WTC_RESIZEBAR;
+  key.width = width;
+  key.height = height;
+  key.param1 = cwidth;
+
+  *pmap = wTextureCacheGet(&key);
+  if (*pmap)
+    return;
+
+  renderResizebarTexture(scr, texture, width, height, cwidth, pmap);
+  *pmap = wTextureCachePut(&key, *pmap);
+}
+
 static void updateTexture(WFrameWindow * fwin)
 {
   int i;
@@ -681,10 +749,10 @@ static void remakeTexture(WFrameWindow * fwin, int state)
   Pixmap pmap, lpmap, rpmap;
 
   if (fwin->title_texture[state] && fwin->titlebar) {
-    FREE_PIXMAP(fwin->title_back[state]);
+    RELEASE_PIXMAP(fwin->title_back[state]);
     if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[state]);
-      FREE_PIXMAP(fwin->rbutton_back[state]);
+      RELEASE_PIXMAP(fwin->lbutton_back[state]);
+      RELEASE_PIXMAP(fwin->rbutton_back[state]);
     }
 
     if (fwin->title_texture[state]->any.type != WTEX_SOLID) {
@@ -697,10 +765,9 @@ static void remakeTexture(WFrameWindow * fwin, int state)
 
       width = fwin->core->width + 1;
 
-      renderTexture(fwin->screen_ptr, fwin->title_texture[state],
-                    width, fwin->titlebar->height,
-                    fwin->titlebar->height, fwin->titlebar->height,
-                    left, right, &pmap, &lpmap, &rpmap);
+      getTitlebarTexture(fwin->screen_ptr, fwin->title_texture[state],
+                         width, fwin->titlebar->height,
+                         left, right, &pmap, &lpmap, &rpmap);
 
       fwin->title_back[state] = pmap;
       if (wPreferences.titlebar_style == TS_NEW) {
@@ -712,14 +779,14 @@ static void remakeTexture(WFrameWindow * fwin, int state)
   if (fwin->resizebar_texture && fwin->resizebar_texture[0]
       && fwin->resizebar && state == 0) {
 
-    FREE_PIXMAP(fwin->resizebar_back[0]);
+    RELEASE_PIXMAP(fwin->resizebar_back[0]);
 
     if (fwin->resizebar_texture[0]->any.type != WTEX_SOLID) {
 
-      renderResizebarTexture(fwin->screen_ptr,
-                             fwin->resizebar_texture[0],
-                             fwin->resizebar->width,
-                             fwin->resizebar->height, fwin->resizebar_corner_width, &pmap);
+      getResizebarTexture(fwin->screen_ptr,
+                          fwin->resizebar_texture[0],
+                          fwin->resizebar->width,
+                          fwin->resizebar->height, fwin->resizebar_corner_width, &pmap);
 
       fwin->resizebar_back[0] = pmap;
     }
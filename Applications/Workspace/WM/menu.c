@@ -432,7 +432,7 @@ void wMenuRemoveItem(WMenu * menu, int index)
 static Pixmap renderTexture(WMenu * menu)
 {
   RImage *img;
-  Pixmap pix;
+  Pixmap pix = None;
   int i;
   RColor light;
   RColor dark;
@@ -480,6 +480,34 @@ static Pixmap renderTexture(WMenu * menu)
   return pix;
 }
 
+/* renderTexture() through the texture cache: menus that render the same pixmap share it */
+static Pixmap getTexture(WMenu * menu)
+{
+  WScreen *scr = menu->menu->screen_ptr;
+  WTextureKey key;
+  Pixmap pix;
+
+  memset(&key, 0, sizeof(key));
+  key.texture = scr->menu_item_texture;
+  key.kind = WTC_MENU;
+  key.style = wPreferences.menu_style;
+  key.width = menu->menu->width;
+  /* the height renderTexture() renders, which the cache sizes entries by */
+  if (wPreferences.menu_style == MS_NORMAL)
+    key.height = menu->entry_height;
+  else
+    key.height = menu->menu->height + 1;
+  key.param1 = menu->entry_height;
+  if (wPreferences.menu_style == MS_SINGLE_TEXTURE)
+    key.param2 = menu->entry_no;
+
+  pix = wTextureCacheGet(&key);
+  if (pix == None)
+    pix = wTextureCachePut(&key, renderTexture(menu));
+
+  return pix;
+}
+
 static void updateTexture(WMenu * menu)
 {
   WScreen *scr = menu->menu->screen_ptr;
@@ -487,9 +515,9 @@ static void updateTexture(WMenu * menu)
   /* setup background texture */
   if (scr->menu_item_texture->any.type != WTEX_SOLID) {
     if (!menu->flags.brother) {
-      FREE_PIXMAP(menu->menu_texture_data);
+      RELEASE_PIXMAP(menu->menu_texture_data);
 
-      menu->menu_texture_data = renderTexture(menu);
+      menu->menu_texture_data = getTexture(menu);
 
       XSetWindowBackgroundPixmap(dpy, menu->menu->window, menu->menu_texture_data);
       XClearWindow(dpy, menu->menu->window);
@@ -635,7 +663,7 @@ void wMenuDestroy(WMenu *menu, int recurse)
 
   }
 
-  FREE_PIXMAP(menu->menu_texture_data);
+  RELEASE_PIXMAP(menu->menu_texture_data);
 
   if (menu->cascades)
     wfree(menu->cascades);
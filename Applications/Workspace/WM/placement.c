@@ -46,6 +46,7 @@
 #include "application.h"
 #include "dock.h"
 #include "xrandr.h"
+#include "coverage.h"
 #include "placement.h"
 
 /*
@@ -267,11 +268,15 @@ int calcIntersectionArea(int x1, int y1, int w1, int h1, int x2, int y2, int w2,
     * calcIntersectionLength(y1, h1, y2, h2);
 }
 
-static int calcSumOfCoveredAreas(WWindow *wwin, int x, int y, int w, int h)
+/* Windows smart placement tries not to cover: normal level and above,
+   mapped or shaded on the current workspace. */
+static WCoverage *coveredAreas(WWindow *wwin, WArea usableArea)
 {
-  int sum_isect = 0;
+  WCoverage *coverage;
   WWindow *test_window;
-  int tw, tx, ty, th;
+
+  coverage = wCoverageCreate(usableArea.x1, usableArea.y1,
+                             usableArea.x2, usableArea.y2);
 
   test_window = wwin->screen_ptr->focused_window;
   for (; test_window != NULL && test_window->prev != NULL;)
@@ -282,19 +287,16 @@ static int calcSumOfCoveredAreas(WWindow *wwin, int x, int y, int w, int h)
       continue;
     }
 
-    tw = test_window->frame->core->width;
-    th = test_window->frame->core->height;
-    tx = test_window->frame_x;
-    ty = test_window->frame_y;
-
     if (test_window->flags.mapped || (test_window->flags.shaded &&
                                       test_window->frame->workspace == wwin->screen_ptr->current_workspace &&
                                       !(test_window->flags.miniaturized || test_window->flags.hidden))) {
-      sum_isect += calcIntersectionArea(tx, ty, tw, th, x, y, w, h);
+      wCoverageAddRect(coverage, test_window->frame_x, test_window->frame_y,
+                       test_window->frame->core->width,
+                       test_window->frame->core->height);
     }
   }
 
-  return sum_isect;
+  return coverage;
 }
 
 static void set_width_height(WWindow *wwin, unsigned int *width, unsigned int *height)
@@ -367,20 +369,22 @@ smartPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret, unsigned int width,
   int test_x = 0, test_y = Y_ORIGIN;
   int from_x, to_x, from_y, to_y;
   int sx;
-  int min_isect, min_isect_x, min_isect_y;
-  int sum_isect;
+  int min_isect_x, min_isect_y;
+  long long min_isect, sum_isect;
+  WCoverage *coverage;
 
   set_width_height(wwin, &width, &height);
+  coverage = coveredAreas(wwin, usableArea);
 
   sx = X_ORIGIN;
-  min_isect = INT_MAX;
+  min_isect = LLONG_MAX;
   min_isect_x = sx;
   min_isect_y = test_y;
 
   while (((test_y + height) < usableArea.y2)) {
     test_x = sx;
     while ((test_x + width) < usableArea.x2) {
-      sum_isect = calcSumOfCoveredAreas(wwin, test_x, test_y, width, height);
+      sum_isect = wCoverageSum(coverage, test_x, test_y, width, height);
 
       if (sum_isect < min_isect) {
         min_isect = sum_isect;
@@ -407,7 +411,7 @@ smartPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret, unsigned int width,
 
   for (test_x = from_x; test_x < to_x; test_x++) {
     for (test_y = from_y; test_y < to_y; test_y++) {
-      sum_isect = calcSumOfCoveredAreas(wwin, test_x, test_y, width, height);
+      sum_isect = wCoverageSum(coverage, test_x, test_y, width, height);
 
       if (sum_isect < min_isect) {
         min_isect = sum_isect;
@@ -417,6 +421,8 @@ smartPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret, unsigned int width,
     }
   }
 
+  wCoverageDestroy(coverage);
+
   *x_ret = min_isect_x;
   *y_ret = min_isect_y;
 }
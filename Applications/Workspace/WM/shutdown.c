@@ -38,11 +38,25 @@
 #include "session.h"
 #include "wmspec.h"
 #include "colormap.h"
+#include "texture.h"
 #include "shutdown.h"
 
 
 static void _wipeDesktop(WScreen *scr);
 
+static void _logTextureCacheStats(void)
+{
+  WTextureCacheStats stats;
+
+  wTextureCacheGetStats(&stats);
+  WMLogInfo("Texture cache: %lu hits, %lu misses, %lu evictions; "
+            "%d pixmaps (%lu bytes), %d unused (%lu of %lu bytes)",
+            stats.hits, stats.misses, stats.evictions,
+            stats.count, (unsigned long)stats.bytes,
+            stats.unused, (unsigned long)stats.unused_bytes,
+            (unsigned long)stats.max_unused_bytes);
+}
+
 /*
  *----------------------------------------------------------------------
  * Shutdown-
@@ -74,6 +88,8 @@ void wShutdown(WMShutdownMode mode)
     return;
   }
 
+  _logTextureCacheStats();
+
   switch (mode) {
   case WMExitMode:
     wScreenSaveState(scr);
@@ -0,0 +1,266 @@
+/*
+ *  Workspace window manager
+ *  Copyright (c) 2015-2021 Sergii Stoian
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Replays window layouts through the smart placement search, once adding
+ * up the intersections with every window for each position as the window
+ * manager used to and once with coverage.c, and checks that both find the
+ * same places.
+ *
+ * usage: placebench layout...
+ *
+ * A layout file has lines
+ *   area x1 y1 x2 y2      usable area of the screen
+ *   window x y w h        a window on the workspace
+ *   place w h             place a window of this size, then add it
+ * and comments starting with #.
+ *
+ * Exits with 1 if any result differs.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../coverage.h"
+
+/* the same as placement.c */
+#define PLACETEST_HSTEP	        8
+#define PLACETEST_VSTEP	        8
+
+void *wmalloc(size_t size)
+{
+  return calloc(1, size);
+}
+
+void *wrealloc(void *ptr, size_t newsize)
+{
+  return realloc(ptr, newsize);
+}
+
+void wfree(void *ptr)
+{
+  free(ptr);
+}
+
+typedef struct {
+  int x, y, w, h;
+} rect_t;
+
+static rect_t windows[4096];
+static int window_count;
+static WCoverage *coverage;
+
+static int intersection_length(int p1, int l1, int p2, int l2)
+{
+  int tmp;
+
+  if (p1 > p2) {
+    tmp = p1; p1 = p2; p2 = tmp;
+    tmp = l1; l1 = l2; l2 = tmp;
+  }
+  if (p1 + l1 < p2)
+    return 0;
+  else if (p2 + l2 < p1 + l1)
+    return l2;
+  return p1 + l1 - p2;
+}
+
+static long long naive_sum(int x, int y, int w, int h)
+{
+  long long sum = 0;
+  int i;
+
+  for (i = 0; i < window_count; i++)
+    sum += (long long)intersection_length(windows[i].x, windows[i].w, x, w)
+      * intersection_length(windows[i].y, windows[i].h, y, h);
+  return sum;
+}
+
+static long long coverage_sum(int x, int y, int w, int h)
+{
+  return wCoverageSum(coverage, x, y, w, h);
+}
+
+/* smartPlaceWindow() */
+static void place(long long (*sum)(int, int, int, int), rect_t area,
+                  int width, int height, int *x_ret, int *y_ret)
+{
+  int test_x, test_y = area.y;
+  int from_x, to_x, from_y, to_y;
+  int min_x = area.x, min_y = area.y;
+  long long min_isect = LLONG_MAX, isect;
+
+  while (test_y + height < area.h) {
+    for (test_x = area.x; test_x + width < area.w; test_x += PLACETEST_HSTEP) {
+      isect = sum(test_x, test_y, width, height);
+      if (isect < min_isect) {
+        min_isect = isect;
+        min_x = test_x;
+        min_y = test_y;
+      }
+    }
+    test_y += PLACETEST_VSTEP;
+  }
+
+  from_x = min_x - PLACETEST_HSTEP + 1;
+  if (from_x < area.x)
+    from_x = area.x;
+  to_x = min_x + PLACETEST_HSTEP;
+  if (to_x + width > area.w)
+    to_x = area.w - width;
+  from_y = min_y - PLACETEST_VSTEP + 1;
+  if (from_y < area.y)
+    from_y = area.y;
+  to_y = min_y + PLACETEST_VSTEP;
+  if (to_y + height > area.h)
+    to_y = area.h - height;
+
+  for (test_x = from_x; test_x < to_x; test_x++) {
+    for (test_y = from_y; test_y < to_y; test_y++) {
+      isect = sum(test_x, test_y, width, height);
+      if (isect < min_isect) {
+        min_isect = isect;
+        min_x = test_x;
+        min_y = test_y;
+      }
+    }
+  }
+
+  *x_ret = min_x;
+  *y_ret = min_y;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0E9;
+}
+
+static void add_window(int x, int y, int w, int h)
+{
+  if (window_count == sizeof(windows) / sizeof(windows[0]))
+    return;
+  windows[window_count].x = x;
+  windows[window_count].y = y;
+  windows[window_count].w = w;
+  windows[window_count].h = h;
+  window_count++;
+  wCoverageAddRect(coverage, x, y, w, h);
+}
+
+/* compares the sums for random rectangles, some outside the area */
+static int check_sums(rect_t area)
+{
+  int i, x, y, w, h;
+  int aw = area.w - area.x, ah = area.h - area.y;
+
+  for (i = 0; i < 2000; i++) {
+    x = area.x - aw / 8 + random() % (aw + aw / 4);
+    y = area.y - ah / 8 + random() % (ah + ah / 4);
+    w = random() % aw;
+    h = random() % ah;
+    if (naive_sum(x, y, w, h) != coverage_sum(x, y, w, h)) {
+      printf("  sum of %i,%i %ix%i is %lli, should be %lli\n", x, y, w, h,
+             coverage_sum(x, y, w, h), naive_sum(x, y, w, h));
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int replay(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  char line[256];
+  rect_t area = {0, 0, 1920, 1080}; /* x1, y1, x2, y2 */
+  int x, y, w, h, nx, ny, cx, cy;
+  int places = 0, failed = 0;
+  double t0, t_naive = 0, t_coverage = 0;
+
+  if (!f) {
+    perror(path);
+    return 0;
+  }
+
+  window_count = 0;
+  coverage = NULL;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "area %i %i %i %i", &x, &y, &w, &h) == 4) {
+      area.x = x; area.y = y; area.w = w; area.h = h;
+    } else if (sscanf(line, "window %i %i %i %i", &x, &y, &w, &h) == 4) {
+      if (!coverage)
+        coverage = wCoverageCreate(area.x, area.y, area.w, area.h);
+      add_window(x, y, w, h);
+    } else if (sscanf(line, "place %i %i", &w, &h) == 2) {
+      if (!coverage)
+        coverage = wCoverageCreate(area.x, area.y, area.w, area.h);
+
+      t0 = now();
+      place(naive_sum, area, w, h, &nx, &ny);
+      t_naive += now() - t0;
+
+      t0 = now();
+      place(coverage_sum, area, w, h, &cx, &cy);
+      t_coverage += now() - t0;
+
+      if (nx != cx || ny != cy || !check_sums(area)) {
+        printf("  %ix%i with %i windows placed at %i,%i, should be %i,%i\n",
+               w, h, window_count, cx, cy, nx, ny);
+        failed = 1;
+      }
+      add_window(nx, ny, w, h);
+      places++;
+    }
+  }
+  fclose(f);
+
+  printf("%-28s %4i %4i %12.3f %12.3f\n",
+         path, window_count, places,
+         places ? t_naive * 1000 / places : 0,
+         places ? t_coverage * 1000 / places : 0);
+
+  if (coverage)
+    wCoverageDestroy(coverage);
+  return !failed;
+}
+
+int main(int argc, char **argv)
+{
+  int i, failed = 0;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s layout...\n", argv[0]);
+    return 2;
+  }
+
+  srandom(1);
+  printf("%-28s %4s %4s %12s %12s\n", "layout", "wins", "new",
+         "all wins ms", "coverage ms");
+  for (i = 1; i < argc; i++) {
+    if (!replay(argv[i]))
+      failed = 1;
+  }
+
+  return failed;
+}
@@ -133,6 +133,8 @@ void wTextureDestroy(WScreen * scr, WTexture * texture)
    * some stupid servers don't like white or black being freed...
    */
 #define CANFREE(c) (c!=scr->black_pixel && c!=scr->white_pixel && c!=0)
+  wTextureCacheFlush(texture);
+
   switch (texture->any.type) {
   case WTEX_SOLID:
     XFreeGC(dpy, texture->solid.light_gc);
@@ -585,3 +587,245 @@ void wDrawBevel(Drawable d, unsigned width, unsigned height, WTexSolid * texture
     break;
   }
 }
+
+/*
+ * Texture pixmap cache
+ *
+ * Entries are found by key for lookups and by pixmap for releases. Entries
+ * nobody uses anymore are kept in a list, most recently used first, and
+ * the oldest ones are freed when they take too much server memory. Entries
+ * of a destroyed texture can not be found by key anymore and are freed
+ * with their last reference.
+ */
+#define TEXTURE_CACHE_HASH_SIZE         256	/* must be a power of 2 */
+#define TEXTURE_CACHE_MAX_UNUSED_BYTES  (8 * 1024 * 1024)
+
+typedef struct TextureCacheEntry {
+  WTextureKey key;
+  unsigned int hash;
+  Pixmap pixmap;
+  int refCount;
+  int orphan;
+  size_t size;
+
+  struct TextureCacheEntry *knext;	/* next in key hash bucket */
+  struct TextureCacheEntry *pnext;	/* next in pixmap hash bucket */
+  struct TextureCacheEntry *prev;	/* unused list, toward most recent */
+  struct TextureCacheEntry *next;	/* unused list, toward least recent */
+} TextureCacheEntry;
+
+static struct {
+  TextureCacheEntry *by_key[TEXTURE_CACHE_HASH_SIZE];
+  TextureCacheEntry *by_pixmap[TEXTURE_CACHE_HASH_SIZE];
+  TextureCacheEntry *unused_first;
+  TextureCacheEntry *unused_last;
+  WTextureCacheStats stats;
+} textureCache;
+
+static unsigned int hashKey(const WTextureKey *key)
+{
+  unsigned int values[7], hash = 2166136261u;
+  int i;
+
+  values[0] = (unsigned int)(unsigned long)key->texture;
+  values[1] = key->kind;
+  values[2] = key->style;
+  values[3] = key->width;
+  values[4] = key->height;
+  values[5] = key->param1;
+  values[6] = key->param2;
+
+  /* FNV-1a */
+  for (i = 0; i < 7; i++) {
+    hash ^= values[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static Bool sameKey(const WTextureKey *a, const WTextureKey *b)
+{
+  return (a->texture == b->texture && a->kind == b->kind && a->style == b->style
+          && a->width == b->width && a->height == b->height
+          && a->param1 == b->param1 && a->param2 == b->param2);
+}
+
+#define PIXMAP_BUCKET(p) (((p) ^ ((p) >> 8)) & (TEXTURE_CACHE_HASH_SIZE - 1))
+
+static TextureCacheEntry *findKey(const WTextureKey *key, unsigned int hash)
+{
+  TextureCacheEntry *entry;
+
+  for (entry = textureCache.by_key[hash & (TEXTURE_CACHE_HASH_SIZE - 1)]; entry; entry = entry->knext) {
+    if (entry->hash == hash && sameKey(&entry->key, key))
+      return entry;
+  }
+  return NULL;
+}
+
+static void unlinkUnused(TextureCacheEntry *entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    textureCache.unused_first = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    textureCache.unused_last = entry->prev;
+  entry->prev = entry->next = NULL;
+
+  textureCache.stats.unused--;
+  textureCache.stats.unused_bytes -= entry->size;
+}
+
+static void unlinkKey(TextureCacheEntry *entry)
+{
+  TextureCacheEntry **link;
+
+  link = &textureCache.by_key[entry->hash & (TEXTURE_CACHE_HASH_SIZE - 1)];
+  while (*link != entry)
+    link = &(*link)->knext;
+  *link = entry->knext;
+}
+
+static void destroyEntry(TextureCacheEntry *entry)
+{
+  TextureCacheEntry **link;
+
+  if (!entry->orphan)
+    unlinkKey(entry);
+
+  link = &textureCache.by_pixmap[PIXMAP_BUCKET(entry->pixmap)];
+  while (*link != entry)
+    link = &(*link)->pnext;
+  *link = entry->pnext;
+
+  if (entry->refCount == 0 && !entry->orphan)
+    unlinkUnused(entry);
+
+  textureCache.stats.count--;
+  textureCache.stats.bytes -= entry->size;
+
+  XFreePixmap(dpy, entry->pixmap);
+  wfree(entry);
+}
+
+Pixmap wTextureCacheGet(const WTextureKey *key)
+{
+  TextureCacheEntry *entry;
+
+  entry = findKey(key, hashKey(key));
+  if (!entry) {
+    textureCache.stats.misses++;
+    return None;
+  }
+
+  textureCache.stats.hits++;
+  if (entry->refCount == 0)
+    unlinkUnused(entry);
+  entry->refCount++;
+
+  return entry->pixmap;
+}
+
+Pixmap wTextureCachePut(const WTextureKey *key, Pixmap pixmap)
+{
+  TextureCacheEntry *entry;
+  unsigned int hash;
+
+  if (pixmap == None)
+    return None;
+
+  hash = hashKey(key);
+  entry = findKey(key, hash);
+  if (entry) {
+    XFreePixmap(dpy, pixmap);
+    if (entry->refCount == 0)
+      unlinkUnused(entry);
+    entry->refCount++;
+    return entry->pixmap;
+  }
+
+  entry = wmalloc(sizeof(TextureCacheEntry));
+  entry->key = *key;
+  entry->hash = hash;
+  entry->pixmap = pixmap;
+  entry->refCount = 1;
+  entry->size = (size_t)key->width * key->height * 4;
+
+  entry->knext = textureCache.by_key[hash & (TEXTURE_CACHE_HASH_SIZE - 1)];
+  textureCache.by_key[hash & (TEXTURE_CACHE_HASH_SIZE - 1)] = entry;
+  entry->pnext = textureCache.by_pixmap[PIXMAP_BUCKET(pixmap)];
+  textureCache.by_pixmap[PIXMAP_BUCKET(pixmap)] = entry;
+
+  textureCache.stats.count++;
+  textureCache.stats.bytes += entry->size;
+
+  return pixmap;
+}
+
+void wTextureCacheRelease(Pixmap pixmap)
+{
+  TextureCacheEntry *entry;
+
+  for (entry = textureCache.by_pixmap[PIXMAP_BUCKET(pixmap)]; entry; entry = entry->pnext) {
+    if (entry->pixmap == pixmap)
+      break;
+  }
+  if (!entry) {
+    XFreePixmap(dpy, pixmap);
+    return;
+  }
+
+  if (--entry->refCount > 0)
+    return;
+
+  if (entry->orphan) {
+    destroyEntry(entry);
+    return;
+  }
+
+  entry->prev = NULL;
+  entry->next = textureCache.unused_first;
+  if (textureCache.unused_first)
+    textureCache.unused_first->prev = entry;
+  else
+    textureCache.unused_last = entry;
+  textureCache.unused_first = entry;
+  textureCache.stats.unused++;
+  textureCache.stats.unused_bytes += entry->size;
+
+  while (textureCache.stats.unused_bytes > TEXTURE_CACHE_MAX_UNUSED_BYTES) {
+    destroyEntry(textureCache.unused_last);
+    textureCache.stats.evictions++;
+  }
+}
+
+void wTextureCacheFlush(WTexture *texture)
+{
+  TextureCacheEntry *entry, *next;
+  int i;
+
+  for (i = 0; i < TEXTURE_CACHE_HASH_SIZE; i++) {
+    for (entry = textureCache.by_key[i]; entry; entry = next) {
+      next = entry->knext;
+      if (entry->key.texture != texture)
+        continue;
+
+      if (entry->refCount == 0) {
+        destroyEntry(entry);
+      } else {
+        unlinkKey(entry);
+        entry->orphan = 1;
+      }
+    }
+  }
+}
+
+void wTextureCacheGetStats(WTextureCacheStats *stats)
+{
+  *stats = textureCache.stats;
+  stats->max_unused_bytes = TEXTURE_CACHE_MAX_UNUSED_BYTES;
+}
@@ -174,6 +174,54 @@ void wTexturePaintTitlebar(struct WWindow *wwin, WTexture *texture, Pixmap *tdat
 
 #define FREE_PIXMAP(p) if ((p)!=None) XFreePixmap(dpy, (p)), (p)=None
 
+/*
+ * Cache of pixmaps rendered from textures, shared by all the windows and
+ * menus that need the same decoration. Cached pixmaps are reference
+ * counted: release them with RELEASE_PIXMAP() instead of FREE_PIXMAP().
+ */
+
+/* what the pixmap is used for */
+#define WTC_TITLEBAR	0
+#define WTC_LBUTTON	1
+#define WTC_RBUTTON	2
+#define WTC_RESIZEBAR	3
+#define WTC_MENU	4
+
+typedef struct WTextureKey {
+  WTexture *texture;
+  short kind;                  /* WTC_* */
+  short style;                 /* titlebar or menu style */
+  int width;
+  int height;
+  int param1;                  /* kind specific rendering parameters */
+  int param2;
+} WTextureKey;
+
+typedef struct WTextureCacheStats {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  int count;                   /* pixmaps in the cache */
+  int unused;                  /* pixmaps kept for later use */
+  size_t bytes;                /* estimated server memory of all pixmaps */
+  size_t unused_bytes;
+  size_t max_unused_bytes;
+} WTextureCacheStats;
+
+/* Returns a new reference on the cached pixmap for key, or None */
+Pixmap wTextureCacheGet(const WTextureKey *key);
+/* Store the pixmap rendered for key and return a reference on it. If the
+   key is already in the cache, the pixmap is freed and the cached one is
+   returned. */
+Pixmap wTextureCachePut(const WTextureKey *key, Pixmap pixmap);
+/* Release a reference: pixmaps not in the cache are freed */
+void wTextureCacheRelease(Pixmap pixmap);
+/* Forget all the pixmaps rendered from texture */
+void wTextureCacheFlush(WTexture *texture);
+void wTextureCacheGetStats(WTextureCacheStats *stats);
+
+#define RELEASE_PIXMAP(p) if ((p)!=None) wTextureCacheRelease(p), (p)=None
+
 void wDrawBevel(Drawable d, unsigned width, unsigned height,
                 WTexSolid *texture, int relief);
 
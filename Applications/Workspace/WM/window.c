@@ -1281,6 +1281,7 @@ WWindow *wManageWindow(WScreen *scr, Window window)
     wwin->next = tmp;
     wwin->prev = NULL;
   }
+  wWorkspaceAddWindow(scr, wwin);
 
   /* raise is set to true if we un-hid the app when this window was born.
    * we raise, else old windows of this app will be above this new one. */
@@ -1458,6 +1459,7 @@ WWindow *wManageInternalWindow(WScreen *scr, Window window, Window owner,
     wwin->next = tmp;
     wwin->prev = NULL;
   }
+  wWorkspaceAddWindow(scr, wwin);
 
   if (wwin->flags.is_gnustep == 0)
     wFrameWindowChangeState(wwin->frame, WS_UNFOCUSED);
@@ -1548,6 +1550,8 @@ void wUnmanageWindow(WWindow *wwin, Bool restore, Bool destroyed)
 
   wasFocused = wwin->flags.focused;
 
+  wWorkspaceRemoveWindow(scr, wwin);
+
   /* remove from window focus list */
   if (!wwin->prev && !wwin->next) {
     /* was the only window */
@@ -2025,7 +2029,7 @@ void wWindowChangeWorkspace(WWindow *wwin, int workspace)
     CFRelease(workspaceNumber);
     CFRelease(info);
     
-    wwin->frame->workspace = workspace;
+    wWorkspaceMoveWindow(wwin, workspace);
   }
 
   if (unmap)
@@ -435,7 +435,12 @@ RImage *get_rimage_from_file(WScreen *scr, const char *file_name, int max_size)
   if (!file_name)
     return NULL;
 
-  image = RLoadImage(scr->rcontext, file_name, 0);
+  /* Large pictures are reduced while loading; wIconValidateIconSize()
+     still does the final scaling so icons get the same size as before */
+  if (max_size > 0)
+    image = RLoadImageAtSize(scr->rcontext, file_name, 0, 2 * max_size, 2 * max_size);
+  else
+    image = RLoadImage(scr->rcontext, file_name, 0);
   if (!image)
     WMLogWarning(_("error loading image file \"%s\": %s"), file_name,
              RMessageForError(RErrorCode));
@@ -55,6 +55,11 @@
 #include "properties.h"
 #include "misc.h"
 
+#ifdef NEXTSPACE
+#include <CoreFoundation/CFRunLoop.h>
+#include <Workspace+WM.h>
+#endif
+
 
 /* Root Window Properties */
 static Atom net_supported;
@@ -264,20 +269,53 @@ static void workspaceObserver(CFNotificationCenterRef center, void *observer,
                               CFNotificationName name, const void *screen,
                               CFDictionaryRef userInfo);
 
+static void publishProperty(WScreen *scr, int index, Atom property, Atom type,
+                            int format, const void *value, int count);
 static void updateClientList(WScreen *scr);
-static void updateClientListStacking(WScreen *scr, WWindow *);
+static void updateClientListStacking(WScreen *scr);
 
 static void updateWorkspaceNames(WScreen *scr);
 static void updateCurrentWorkspace(WScreen *scr);
 static void updateWorkspaceCount(WScreen *scr);
 static void wNETWMShowingDesktop(WScreen *scr, Bool show);
 
+/* Root window properties written by wNETWMFlushUpdates() */
+enum {
+  NET_PUBLISH_CLIENT_LIST,
+  NET_PUBLISH_CLIENT_LIST_STACKING,
+  NET_PUBLISH_NUMBER_OF_DESKTOPS,
+  NET_PUBLISH_CURRENT_DESKTOP,
+  NET_PUBLISH_DESKTOP_NAMES,
+  NET_PUBLISH_ACTIVE_WINDOW,
+  NET_PUBLISH_WORKAREA,
+  NET_PUBLISH_COUNT
+};
+
 typedef struct NetData {
   WScreen *scr;
   WReservedArea *strut;
   WWindow **show_desktop;
+
+  /* 1 << NET_PUBLISH_* of the properties to write. Marked by observers on
+     any thread (Workspace calls WM code from its main thread), taken by
+     wNETWMFlushUpdates() on the WM thread, so it is changed atomically. */
+  unsigned int changed;
+  /* last value written of each property, WM thread only */
+  unsigned char *published[NET_PUBLISH_COUNT];
+  int published_length[NET_PUBLISH_COUNT];
+  /* for the client lists */
+  Window *windows;
+  int windows_size;
+
+  unsigned long requests;   /* changes reported */
+  unsigned long coalesced;  /* ...of properties that were already to write */
+  unsigned long unchanged;  /* writes skipped because the value was the same */
+  unsigned long writes;     /* XChangeProperty() calls */
 } NetData;
 
+static void publishLater(NetData *data, unsigned int properties);
+static void updateWorkarea(WScreen *scr);
+
 static void setSupportedHints(WScreen *scr)
 {
   Atom atom[wlengthof(atomNames)];
@@ -681,7 +719,7 @@ void wNETWMInitStuff(WScreen *scr)
                                   CFNotificationSuspensionBehaviorDeliverImmediately);
 
   updateClientList(scr);
-  updateClientListStacking(scr, NULL);
+  updateClientListStacking(scr);
   updateWorkspaceCount(scr);
   updateWorkspaceNames(scr);
   updateShowDesktop(scr, False);
@@ -693,6 +731,22 @@ void wNETWMCleanup(WScreen *scr)
 {
   int i;
 
+  if (scr->netdata) {
+    NetData *data = scr->netdata;
+    WMLogInfo("_NET_* root window properties: %lu changes, %lu coalesced,"
+              " %lu unchanged, %lu written",
+              data->requests, data->coalesced, data->unchanged, data->writes);
+
+    for (i = 0; i < NET_PUBLISH_COUNT; i++) {
+      wfree(data->published[i]);
+      data->published[i] = NULL;
+      data->published_length[i] = 0;
+    }
+    wfree(data->windows);
+    data->windows = NULL;
+    data->windows_size = 0;
+  }
+
   for (i = 0; i < wlengthof(atomNames); i++)
     XDeleteProperty(dpy, scr->root_win, *atomNames[i].atom);
 }
@@ -745,14 +799,19 @@ void wNETWMUpdateActions(WWindow *wwin, Bool del)
 
 void wNETWMUpdateWorkarea(WScreen *scr)
 {
-  WArea total_usable;
-  int nb_workspace;
-
   if (!scr->netdata) {
     /* If the _NET_xxx were not initialised, it not necessary to do anything */
     return;
   }
 
+  publishLater(scr->netdata, (1 << NET_PUBLISH_WORKAREA));
+}
+
+static void updateWorkarea(WScreen *scr)
+{
+  WArea total_usable;
+  int nb_workspace;
+
   if (!scr->usableArea) {
     /* If we don't have any info, we fall back on using the complete screen area */
     total_usable.x1 = 0;
@@ -803,8 +862,8 @@ void wNETWMUpdateWorkarea(WScreen *scr)
       property_value[4 * i + 3] = total_usable.y2 - total_usable.y1;
     }
 
-    XChangeProperty(dpy, scr->root_win, net_workarea, XA_CARDINAL, 32, PropModeReplace,
-                    (unsigned char *) property_value, nb_workspace * 4);
+    publishProperty(scr, NET_PUBLISH_WORKAREA, net_workarea, XA_CARDINAL, 32,
+                    property_value, nb_workspace * 4);
   }
 }
 
@@ -845,64 +904,137 @@ Bool wNETWMGetUsableArea(WScreen *scr, int head, WArea *area)
   return True;
 }
 
+/* Writes the property unless it has the value it got last time. */
+static void publishProperty(WScreen *scr, int index, Atom property, Atom type,
+                            int format, const void *value, int count)
+{
+  NetData *data = scr->netdata;
+  int length;
+
+  /* format 32 properties are passed as longs */
+  length = count * (format == 32 ? sizeof(long) : format / 8);
+
+  if (data->published[index] && data->published_length[index] == length
+      && memcmp(data->published[index], value, length) == 0) {
+    data->unchanged++;
+    return;
+  }
+
+  XChangeProperty(dpy, scr->root_win, property, type, format, PropModeReplace,
+                  (unsigned char *)value, count);
+  data->writes++;
+
+  data->published[index] = wrealloc(data->published[index], length + 1);
+  memcpy(data->published[index], value, length);
+  data->published_length[index] = length;
+}
+
+/* Marks the properties as changed. They are written on the next
+   wNETWMFlushUpdates(). */
+static void publishLater(NetData *data, unsigned int properties)
+{
+  unsigned int changed;
+  int i;
+
+  changed = __atomic_fetch_or(&data->changed, properties, __ATOMIC_ACQ_REL);
+
+  for (i = 0; i < NET_PUBLISH_COUNT; i++) {
+    if (properties & (1 << i)) {
+      __atomic_add_fetch(&data->requests, 1, __ATOMIC_RELAXED);
+      if (changed & (1 << i))
+        __atomic_add_fetch(&data->coalesced, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+#ifdef NEXTSPACE
+  /* Changes made from Workspace menus and panels are not followed by X event
+     handling: flush on the next pass of the WM run loop. */
+  if (!changed && properties && wm_runloop != NULL) {
+    WScreen *scr = data->scr;
+
+    CFRunLoopPerformBlock(wm_runloop, kCFRunLoopDefaultMode, ^{
+        wNETWMFlushUpdates(scr);
+      });
+    CFRunLoopWakeUp(wm_runloop);
+  }
+#endif
+}
+
+static Window *clientListBuffer(WScreen *scr)
+{
+  NetData *data = scr->netdata;
+
+  if (data->windows_size < scr->window_count + 1) {
+    data->windows_size = scr->window_count + 16;
+    data->windows = wrealloc(data->windows, sizeof(Window) * data->windows_size);
+  }
+  return data->windows;
+}
+
 static void updateClientList(WScreen *scr)
 {
   WWindow *wwin;
   Window *windows;
   int count;
 
-  windows = (Window *) wmalloc(sizeof(Window) * (scr->window_count + 1));
+  windows = clientListBuffer(scr);
 
   count = 0;
   wwin = scr->focused_window;
-  while (wwin) {
+  while (wwin && count < scr->netdata->windows_size) {
     windows[count++] = wwin->client_win;
     wwin = wwin->prev;
   }
-  XChangeProperty(dpy, scr->root_win, net_client_list, XA_WINDOW, 32,
-                  PropModeReplace, (unsigned char *)windows, count);
+  publishProperty(scr, NET_PUBLISH_CLIENT_LIST, net_client_list, XA_WINDOW, 32,
+                  windows, count);
+}
 
-  wfree(windows);
-  XFlush(dpy);
+/* wWindowFor() without the context lookup */
+static WWindow *windowForCore(WCoreWindow *core)
+{
+  WFrameWindow *frame;
+
+  if (core->descriptor.parent_type == WCLASS_WINDOW)
+    return core->descriptor.parent;
+
+  if (core->descriptor.parent_type == WCLASS_FRAME) {
+    frame = (WFrameWindow *)core->descriptor.parent;
+    if (frame->flags.is_client_window_frame)
+      return frame->child;
+  }
+
+  return NULL;
 }
 
-static void updateClientListStacking(WScreen *scr, WWindow *wwin_excl)
+static void updateClientListStacking(WScreen *scr)
 {
   WWindow *wwin;
-  Window *client_list, *client_list_reverse;
+  Window *client_list, w;
   int client_count, i;
   WCoreWindow *tmp;
   WMBagIterator iter;
 
-  /* update client list */
-  i = scr->window_count + 1;
-  client_list = (Window *) wmalloc(sizeof(Window) * i);
-  client_list_reverse = (Window *) wmalloc(sizeof(Window) * i);
+  client_list = clientListBuffer(scr);
 
   client_count = 0;
   WM_ETARETI_BAG(scr->stacking_list, tmp, iter) {
-    while (tmp) {
-      wwin = wWindowFor(tmp->window);
-      /* wwin_excl is a window to exclude from the list
-         (e.g. it's now unmanaged) */
-      if (wwin && (wwin != wwin_excl))
+    while (tmp && client_count < scr->netdata->windows_size) {
+      wwin = windowForCore(tmp);
+      if (wwin)
         client_list[client_count++] = wwin->client_win;
       tmp = tmp->stacking->under;
     }
   }
 
-  for (i = 0; i < client_count; i++) {
-    Window w = client_list[client_count - i - 1];
-    client_list_reverse[i] = w;
+  /* bottom to top */
+  for (i = 0; i < client_count / 2; i++) {
+    w = client_list[i];
+    client_list[i] = client_list[client_count - i - 1];
+    client_list[client_count - i - 1] = w;
   }
 
-  XChangeProperty(dpy, scr->root_win, net_client_list_stacking, XA_WINDOW, 32,
-                  PropModeReplace, (unsigned char *)client_list_reverse, client_count);
-
-  wfree(client_list);
-  wfree(client_list_reverse);
-
-  XFlush(dpy);
+  publishProperty(scr, NET_PUBLISH_CLIENT_LIST_STACKING, net_client_list_stacking,
+                  XA_WINDOW, 32, client_list, client_count);
 }
 
 static void updateWorkspaceCount(WScreen *scr)
@@ -911,8 +1043,8 @@ static void updateWorkspaceCount(WScreen *scr)
 
   count = scr->workspace_count;
 
-  XChangeProperty(dpy, scr->root_win, net_number_of_desktops, XA_CARDINAL,
-                  32, PropModeReplace, (unsigned char *)&count, 1);
+  publishProperty(scr, NET_PUBLISH_NUMBER_OF_DESKTOPS, net_number_of_desktops,
+                  XA_CARDINAL, 32, &count, 1);
 }
 
 static void updateCurrentWorkspace(WScreen *scr)
@@ -921,8 +1053,8 @@ static void updateCurrentWorkspace(WScreen *scr)
 
   count = scr->current_workspace;
 
-  XChangeProperty(dpy, scr->root_win, net_current_desktop, XA_CARDINAL, 32,
-                  PropModeReplace, (unsigned char *)&count, 1);
+  publishProperty(scr, NET_PUBLISH_CURRENT_DESKTOP, net_current_desktop,
+                  XA_CARDINAL, 32, &count, 1);
 }
 
 static void updateWorkspaceNames(WScreen *scr)
@@ -939,8 +1071,8 @@ static void updateWorkspaceNames(WScreen *scr)
     len += (curr_size + 1);
   }
 
-  XChangeProperty(dpy, scr->root_win, net_desktop_names, utf8_string, 8,
-                  PropModeReplace, (unsigned char *)buf, len);
+  publishProperty(scr, NET_PUBLISH_DESKTOP_NAMES, net_desktop_names, utf8_string, 8,
+                  buf, len);
 }
 
 static void updateFocusHint(WScreen *scr)
@@ -952,8 +1084,48 @@ static void updateFocusHint(WScreen *scr)
   else
     window = scr->focused_window->client_win;
 
-  XChangeProperty(dpy, scr->root_win, net_active_window, XA_WINDOW, 32,
-                  PropModeReplace, (unsigned char *)&window, 1);
+  publishProperty(scr, NET_PUBLISH_ACTIVE_WINDOW, net_active_window, XA_WINDOW, 32,
+                  &window, 1);
+}
+
+/* Windows are managed, unmanaged, restacked and focused many at a time (at
+   startup, on workspace changes, when an application comes up), and every
+   write of a root window property wakes up all pagers and panels. So the
+   observers only mark what changed and the properties are written once
+   after the run loop has handled the pending events, or on its next pass
+   if nothing was pending. Properties are only written here, on the WM
+   thread. */
+void wNETWMFlushUpdates(WScreen *scr)
+{
+  NetData *data = scr ? scr->netdata : NULL;
+  unsigned long writes;
+  unsigned int changed;
+
+  if (!data)
+    return;
+
+  changed = __atomic_exchange_n(&data->changed, 0, __ATOMIC_ACQ_REL);
+  if (!changed)
+    return;
+  writes = data->writes;
+
+  if (changed & (1 << NET_PUBLISH_NUMBER_OF_DESKTOPS))
+    updateWorkspaceCount(scr);
+  if (changed & (1 << NET_PUBLISH_DESKTOP_NAMES))
+    updateWorkspaceNames(scr);
+  if (changed & (1 << NET_PUBLISH_WORKAREA))
+    updateWorkarea(scr);
+  if (changed & (1 << NET_PUBLISH_CURRENT_DESKTOP))
+    updateCurrentWorkspace(scr);
+  if (changed & (1 << NET_PUBLISH_CLIENT_LIST))
+    updateClientList(scr);
+  if (changed & (1 << NET_PUBLISH_CLIENT_LIST_STACKING))
+    updateClientListStacking(scr);
+  if (changed & (1 << NET_PUBLISH_ACTIVE_WINDOW))
+    updateFocusHint(scr);
+
+  if (data->writes != writes)
+    XFlush(dpy);
 }
 
 static void updateWorkspaceHint(WWindow *wwin, Bool fake, Bool del)
@@ -1940,8 +2112,8 @@ static void windowObserver(CFNotificationCenterRef center, void *netData,
     return;
 
   if (CFStringCompare(name, WMDidManageWindowNotification, 0) == 0) {
-    updateClientList(wwin->screen_ptr);
-    updateClientListStacking(wwin->screen_ptr, NULL);
+    publishLater(ndata, ((1 << NET_PUBLISH_CLIENT_LIST)
+                         | (1 << NET_PUBLISH_CLIENT_LIST_STACKING)));
     updateStateHint(wwin, True, False);
     
     updateStrut(wwin->screen_ptr, wwin->client_win, False);
@@ -1949,8 +2121,8 @@ static void windowObserver(CFNotificationCenterRef center, void *netData,
     wScreenUpdateUsableArea(wwin->screen_ptr);
   }
   else if (CFStringCompare(name, WMDidUnmanageWindowNotification, 0) == 0) {
-    updateClientList(wwin->screen_ptr);
-    updateClientListStacking(wwin->screen_ptr, wwin);
+    publishLater(ndata, ((1 << NET_PUBLISH_CLIENT_LIST)
+                         | (1 << NET_PUBLISH_CLIENT_LIST_STACKING)));
     updateWorkspaceHint(wwin, False, True);
     updateStateHint(wwin, False, True);
     wNETWMUpdateActions(wwin, True);
@@ -1959,15 +2131,15 @@ static void windowObserver(CFNotificationCenterRef center, void *netData,
     wScreenUpdateUsableArea(wwin->screen_ptr);
   }
   else if (CFStringCompare(name, WMDidResetWindowStackingNotification, 0) == 0) {
-    updateClientListStacking(wwin->screen_ptr, NULL);
+    publishLater(ndata, (1 << NET_PUBLISH_CLIENT_LIST_STACKING));
     updateStateHint(wwin, False, False);
   }
   else if (CFStringCompare(name, WMDidChangeWindowStackingNotification, 0) == 0) {
-    updateClientListStacking(wwin->screen_ptr, NULL);
+    publishLater(ndata, (1 << NET_PUBLISH_CLIENT_LIST_STACKING));
     updateStateHint(wwin, False, False);
   }
   else if (CFStringCompare(name, WMDidChangeWindowFocusNotification, 0) == 0) {
-    updateFocusHint(ndata->scr);
+    publishLater(ndata, (1 << NET_PUBLISH_ACTIVE_WINDOW));
   }
   else if (CFStringCompare(name, WMDidChangeWindowWorkspaceNotification, 0) == 0) {
     updateWorkspaceHint(wwin, False, False);
@@ -1983,23 +2155,21 @@ static void workspaceObserver(CFNotificationCenterRef center, void *netData,
                               CFNotificationName name, const void *screen,
                               CFDictionaryRef userInfo)
 {
-  WScreen *scr = (WScreen *)screen;
+  NetData *ndata = (NetData *)netData;
 
-  if (CFStringCompare(name, WMDidCreateWorkspaceNotification, 0) == 0) {
-    updateWorkspaceCount(scr);
-    updateWorkspaceNames(scr);
-    wNETWMUpdateWorkarea(scr);
-  }
-  else if (CFStringCompare(name, WMDidDestroyWorkspaceNotification, 0) == 0) {
-    updateWorkspaceCount(scr);
-    updateWorkspaceNames(scr);
-    wNETWMUpdateWorkarea(scr);
+  /* `screen` is not used: WMDidChangeWorkspaceNotification is also posted
+     for windows by wWindowChangeWorkspace(). */
+  if (CFStringCompare(name, WMDidCreateWorkspaceNotification, 0) == 0 ||
+      CFStringCompare(name, WMDidDestroyWorkspaceNotification, 0) == 0) {
+    publishLater(ndata, ((1 << NET_PUBLISH_NUMBER_OF_DESKTOPS)
+                         | (1 << NET_PUBLISH_DESKTOP_NAMES)
+                         | (1 << NET_PUBLISH_WORKAREA)));
   }
   else if (CFStringCompare(name, WMDidChangeWorkspaceNotification, 0) == 0) {
-    updateCurrentWorkspace(scr);
+    publishLater(ndata, (1 << NET_PUBLISH_CURRENT_DESKTOP));
   }
   else if (CFStringCompare(name, WMDidChangeWorkspaceNameNotification, 0) == 0) {
-    updateWorkspaceNames(scr);
+    publishLater(ndata, (1 << NET_PUBLISH_DESKTOP_NAMES));
   }
 }
 
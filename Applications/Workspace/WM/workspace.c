@@ -408,6 +408,9 @@ int wWorkspaceNew(WScreen *scr)
     wspace->name = NULL;
     wspace->clip = NULL;
     wspace->focused_window = NULL;
+    wspace->windows = NULL;
+    wspace->window_count = 0;
+    wspace->window_size = 0;
 
     if (!wspace->name) {
       static const char *new_name = NULL;
@@ -449,19 +452,24 @@ int wWorkspaceNew(WScreen *scr)
 
 Bool wWorkspaceDelete(WScreen *scr, int workspace)
 {
-  WWindow *tmp;
-  WWorkspace **list;
+  WWorkspace *wspace, **list;
   int i, j;
 
-  if (workspace <= 0)
+  if (workspace <= 0 || workspace >= scr->workspace_count)
     return False;
 
   /* verify if workspace is in use by some window */
-  tmp = scr->focused_window;
-  while (tmp) {
-    if (!IS_OMNIPRESENT(tmp) && tmp->frame->workspace == workspace)
+  wspace = scr->workspaces[workspace];
+  for (i = 0; i < wspace->window_count; i++) {
+    if (!IS_OMNIPRESENT(wspace->windows[i]))
       return False;
-    tmp = tmp->prev;
+  }
+
+  /* omnipresent windows go where they will be shown */
+  for (i = wspace->window_count - 1; i >= 0; i--) {
+    wWorkspaceMoveWindow(wspace->windows[i],
+                         (scr->current_workspace < workspace
+                          ? scr->current_workspace : workspace - 1));
   }
 
   if (!wPreferences.flags.noclip) {
@@ -472,13 +480,15 @@ Bool wWorkspaceDelete(WScreen *scr, int workspace)
   list = wmalloc(sizeof(WWorkspace *) * (scr->workspace_count - 1));
   j = 0;
   for (i = 0; i < scr->workspace_count; i++) {
-    if (i != workspace-1) {
+    if (i != workspace) {
       list[j++] = scr->workspaces[i];
     } else {
       if (scr->workspaces[i]->name)
         wfree(scr->workspaces[i]->name);
       if (scr->workspaces[i]->map)
         RReleaseImage(scr->workspaces[i]->map);
+      if (scr->workspaces[i]->windows)
+        wfree(scr->workspaces[i]->windows);
       wfree(scr->workspaces[i]);
     }
   }
@@ -587,6 +597,47 @@ void wWorkspaceSaveFocusedWindow(WScreen *scr, int workspace, WWindow *wwin)
   }
 }
 
+void wWorkspaceAddWindow(WScreen *scr, WWindow *wwin)
+{
+  WWorkspace *wspace;
+
+  if (wwin->frame->workspace < 0 || wwin->frame->workspace >= scr->workspace_count)
+    return;
+
+  wspace = scr->workspaces[wwin->frame->workspace];
+  if (wspace->window_count == wspace->window_size) {
+    wspace->window_size = wspace->window_size ? wspace->window_size * 2 : 16;
+    wspace->windows = wrealloc(wspace->windows, wspace->window_size * sizeof(WWindow *));
+  }
+  wspace->windows[wspace->window_count++] = wwin;
+}
+
+void wWorkspaceRemoveWindow(WScreen *scr, WWindow *wwin)
+{
+  WWorkspace *wspace;
+  int i;
+
+  if (wwin->frame->workspace < 0 || wwin->frame->workspace >= scr->workspace_count)
+    return;
+
+  wspace = scr->workspaces[wwin->frame->workspace];
+  for (i = 0; i < wspace->window_count; i++) {
+    if (wspace->windows[i] == wwin) {
+      wspace->windows[i] = wspace->windows[--wspace->window_count];
+      return;
+    }
+  }
+}
+
+/* Changes the workspace the window belongs to. Doesn't map or unmap anything,
+   see wWindowChangeWorkspace() for that. */
+void wWorkspaceMoveWindow(WWindow *wwin, int workspace)
+{
+  wWorkspaceRemoveWindow(wwin->screen_ptr, wwin);
+  wwin->frame->workspace = workspace;
+  wWorkspaceAddWindow(wwin->screen_ptr, wwin);
+}
+
 void wWorkspaceForceChange(WScreen * scr, int workspace, WWindow *focus_win)
 {
   WWindow *tmp, *foc = NULL;
@@ -613,89 +664,88 @@ void wWorkspaceForceChange(WScreen * scr, int workspace, WWindow *focus_win)
   scr->last_workspace = scr->current_workspace;
   scr->current_workspace = workspace;
 
-  tmp = scr->focused_window;
-  if (tmp != NULL) {
-    WWindow **toUnmap;
-    int toUnmapSize, toUnmapCount;
-    WWindow **toMap;
-    int toMapSize, toMapCount;
+  if (scr->focused_window != NULL) {
+    WWorkspace *old_ws = NULL, *new_ws = scr->workspaces[workspace];
+    WWindow **toUnmap, **toMap;
+    int toUnmapCount = 0, toMapCount = 0;
+    int i;
+
+    /* Only the windows of the workspaces we leave and enter, omnipresent
+     * windows (listed in the workspace they were last shown on) and
+     * selected windows may change their state. */
+    if (scr->last_workspace < scr->workspace_count)
+      old_ws = scr->workspaces[scr->last_workspace];
+
+    toUnmap = wmalloc(sizeof(WWindow *) * ((old_ws ? old_ws->window_count : 0) + 1));
+    toMap = wmalloc(sizeof(WWindow *) * (new_ws->window_count + 1));
+
+    for (i = 0; old_ws && i < old_ws->window_count; i++) {
+      tmp = old_ws->windows[i];
+      if (tmp->flags.selected || IS_OMNIPRESENT(tmp))
+        continue;
+      /* unmap windows not on this workspace */
+      if ((tmp->flags.mapped || tmp->flags.shaded) && !tmp->flags.changing_workspace) {
+        toUnmap[toUnmapCount++] = tmp;
+      }
+      /* unmap miniwindows not on this workspace */
+      if (!wPreferences.sticky_icons && tmp->flags.miniaturized && tmp->icon) {
+        XUnmapWindow(dpy, tmp->icon->core->window);
+        tmp->icon->mapped = 0;
+      }
+    }
 
-    toUnmapSize = 16;
-    toUnmapCount = 0;
-    toUnmap = wmalloc(toUnmapSize * sizeof(WWindow *));
+    for (i = 0; i < new_ws->window_count; i++) {
+      tmp = new_ws->windows[i];
+      if (tmp->flags.selected || tmp->flags.hidden)
+        continue;
+      if (!(tmp->flags.mapped || tmp->flags.miniaturized)) {
+        /* remap windows that are on this workspace */
+        toMap[toMapCount++] = tmp;
+      }
+      /* Also map miniwindow if not omnipresent */
+      if (!wPreferences.sticky_icons &&
+          tmp->flags.miniaturized && !IS_OMNIPRESENT(tmp) && tmp->icon) {
+        tmp->icon->mapped = 1;
+        XMapWindow(dpy, tmp->icon->core->window);
+      }
+    }
 
-    toMapSize = 16;
-    toMapCount = 0;
-    toMap = wmalloc(toMapSize * sizeof(WWindow *));
-    
-    while (tmp) {
-      if (tmp->frame->workspace != workspace && !tmp->flags.selected) /* Unmap */ {
-        /* manage unmap list */
-        if (toUnmapCount == toUnmapSize) {
-          toUnmapSize *= 2;
-          toUnmap = wrealloc(toUnmap, toUnmapSize * sizeof(WWindow *));
-        }
-        
-        /* unmap windows not on this workspace */
-        if (!IS_OMNIPRESENT(tmp)) {
-          if ((tmp->flags.mapped || tmp->flags.shaded) && !tmp->flags.changing_workspace) {
-            toUnmap[toUnmapCount++] = tmp;
-          }
-        }
-        else { // OMNIPRESENT
-          /* update current workspace of omnipresent windows */
-          WApplication *wapp = wApplicationOf(tmp->main_window);
-          tmp->frame->workspace = workspace;
-          if (wapp && WINDOW_LEVEL(tmp) != NSMainMenuWindowLevel) {
-            wapp->last_workspace = workspace;
-          }
-        }
-        /* unmap miniwindows not on this workspace */
-        if (!wPreferences.sticky_icons && tmp->flags.miniaturized &&
-            tmp->icon && !IS_OMNIPRESENT(tmp)) {
-          XUnmapWindow(dpy, tmp->icon->core->window);
-          tmp->icon->mapped = 0;
+    /* update current workspace of omnipresent windows */
+    for (i = old_ws ? old_ws->window_count - 1 : -1; i >= 0; i--) {
+      tmp = old_ws->windows[i];
+      if (IS_OMNIPRESENT(tmp) && !tmp->flags.selected) {
+        WApplication *wapp = wApplicationOf(tmp->main_window);
+        wWorkspaceMoveWindow(tmp, workspace);
+        if (wapp && WINDOW_LEVEL(tmp) != NSMainMenuWindowLevel) {
+          wapp->last_workspace = workspace;
         }
       }
-      else /* Map */ {
-        /* manage map list */
-        if (toMapCount == toMapSize) {
-          toMapSize *= 2;
-          toMap = wrealloc(toMap, toMapSize * sizeof(WWindow *));
-        }
-        
-        /* change selected windows' workspace */
-        if (tmp->flags.selected) {
-          wWindowChangeWorkspace(tmp, workspace);
-          if (!tmp->flags.miniaturized && !foc) {
-            foc = tmp;
-          }
-        }
-        else {
-          if (!tmp->flags.hidden) {
-            if (!(tmp->flags.mapped || tmp->flags.miniaturized)) {
-              /* remap windows that are on this workspace */
-              toMap[toMapCount++] = tmp;
-            }
-            /* Also map miniwindow if not omnipresent */
-            if (!wPreferences.sticky_icons &&
-                tmp->flags.miniaturized && !IS_OMNIPRESENT(tmp) && tmp->icon) {
-              tmp->icon->mapped = 1;
-              XMapWindow(dpy, tmp->icon->core->window);
-            }
-          }
+    }
+
+    /* change selected windows' workspace */
+    if (scr->selected_windows) {
+      for (i = 0; i < CFArrayGetCount(scr->selected_windows); i++) {
+        tmp = (WWindow *)CFArrayGetValueAtIndex(scr->selected_windows, i);
+        wWindowChangeWorkspace(tmp, workspace);
+        if (!tmp->flags.miniaturized && !foc) {
+          foc = tmp;
         }
       }
-      tmp = tmp->prev;
     }
 
+    /* Send the whole batch in one go so that the server doesn't
+     * redraw the screen between the windows. */
     WMLogInfo("[workspace.c] windows to map: %i to unmap: %i\n", toMapCount, toUnmapCount);
+    XGrabServer(dpy);
     while (toUnmapCount > 0) {
       wWindowUnmap(toUnmap[--toUnmapCount]);
     }
     while (toMapCount > 0) {
       wWindowMap(toMap[--toMapCount]);
     }
+    XUngrabServer(dpy);
+    wfree(toUnmap);
+    wfree(toMap);
     
     /* Gobble up events unleashed by our mapping & unmapping.
      * These may trigger various grab-initiated focus &
@@ -726,14 +776,13 @@ void wWorkspaceForceChange(WScreen * scr, int workspace, WWindow *focus_win)
      * the workspace change, this happening during our 'ProcessPendingEvents' loop.
      */
     if (foc != NULL) {
-      WWindow *parse;
       Bool found;
 
       found = False;
-      for (parse = scr->focused_window; parse != NULL; parse = parse->prev) {
-        if (parse->client_win == foc->client_win) {
+      for (i = 0; i < new_ws->window_count; i++) {
+        if (new_ws->windows[i]->client_win == foc->client_win) {
           found = True;
-          foc = parse;
+          foc = new_ws->windows[i];
           break;
         }
       }
@@ -751,9 +800,6 @@ void wWorkspaceForceChange(WScreen * scr, int workspace, WWindow *focus_win)
       }
     }
     wSetFocusTo(scr, foc);
-      
-    wfree(toUnmap);
-    wfree(toMap);
   }
 
   /* We need to always arrange icons when changing workspace, even if
@@ -30,6 +30,11 @@ typedef struct WWorkspace {
   struct WDock *clip;
   RImage *map;
   WWindow *focused_window;
+
+  /* managed windows with frame->workspace set to this workspace */
+  WWindow **windows;
+  int window_count;
+  int window_size;
 } WWorkspace;
 
 void wWorkspaceMake(WScreen *scr, int count);
@@ -39,6 +44,9 @@ Bool wWorkspaceDelete(WScreen *scr, int workspace);
 void wWorkspaceChange(WScreen *scr, int workspace, WWindow *focus_win);
 void wWorkspaceSaveFocusedWindow(WScreen *scr, int workspace, WWindow *wwin);
 void wWorkspaceForceChange(WScreen *scr, int workspace, WWindow *focus_win);
+void wWorkspaceAddWindow(WScreen *scr, WWindow *wwin);
+void wWorkspaceRemoveWindow(WScreen *scr, WWindow *wwin);
+void wWorkspaceMoveWindow(WWindow *wwin, int workspace);
 WMenu *wWorkspaceMenuMake(WScreen *scr, Bool titled);
 void wWorkspaceMenuUpdate(WScreen *scr, WMenu *menu);
 void wWorkspaceMenuEdit(WScreen *scr);
@@ -24,6 +24,7 @@
 
 #import <DesktopKit/NXTAlert.h>
 #import <DesktopKit/NXTIcon.h>
+#import <DesktopKit/NXTIconItem.h>
 #import <DesktopKit/NXTIconLabel.h>
 #import <DesktopKit/NXTIconView.h>
 #import <DesktopKit/NXTIconView.h>
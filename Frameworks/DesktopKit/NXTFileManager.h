@@ -69,9 +69,11 @@ extern NSString *NXTShowHiddenFiles;
 - (NSString *)absolutePathForPath:(NSString *)path;
 - (BOOL)directoryExistsAtPath:(NSString *)path;
 
-// libmagic
+// libmagic. Results are cached until the file changes.
 - (NSString *)mimeTypeForFile:(NSString *)fullPath;
 - (NSString *)mimeEncodingForFile:(NSString *)fullPath;
 - (NSString *)descriptionForFile:(NSString *)fullPath;
+- (NSUInteger)magicCacheHits;
+- (NSUInteger)magicCacheMisses;
 
 @end
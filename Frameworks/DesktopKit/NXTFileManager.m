@@ -23,12 +23,20 @@
 //
 
 #include <magic.h> // libmagic
+#include <dirent.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSUserDefaults.h>
 #import <Foundation/NSFileManager.h>
 #import <Foundation/NSArray.h>
+#import <Foundation/NSData.h>
 #import <Foundation/NSDebug.h>
+#import <Foundation/NSLock.h>
 
 #import "NXTDefaults.h"
 #import "NXTFileManager.h"
@@ -37,7 +45,53 @@ NSString *NXTSortFilesBy = @"SortFilesBy";
 NSString *NXTShowHiddenFiles = @"ShowHiddenFiles";
 
 static NXTFileManager *sharedManager;
-static NSString      *dirPath;
+
+// Loading the magic database takes long, so cookies are loaded once and
+// reused. A thread takes one from the pool for a call and puts it back.
+// Results are kept for files that have not changed since.
+#define MAGIC_POOL_SIZE  4
+#define MAGIC_CACHE_SIZE 16384
+
+typedef enum {
+  MagicMimeType = 0,
+  MagicMimeEncoding = 1,
+  MagicDescription = 2
+} MagicQuery;
+
+static const int magicFlags[] = {MAGIC_MIME_TYPE, MAGIC_MIME_ENCODING, MAGIC_NONE};
+
+typedef struct {
+  dev_t           device;
+  ino_t           inode;
+  struct timespec mtime;
+  off_t           size;
+} MagicCacheKey;
+
+@interface NXTMagicCacheEntry : NSObject
+{
+@public
+  NSString *values[3]; // MagicQuery
+}
+@end
+@implementation NXTMagicCacheEntry
+- (void)dealloc
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    [values[i] release];
+  }
+  [super dealloc];
+}
+@end
+
+static NSLock              *magicLock;
+static magic_t             magicPool[MAGIC_POOL_SIZE];
+static NSUInteger          magicPoolCount;
+static NSMutableDictionary *magicCache;      // NSData (MagicCacheKey) -> entry
+static NSMutableArray      *magicCacheKeys;  // oldest first
+static NSUInteger          magicCacheHits;
+static NSUInteger          magicCacheMisses;
 
 NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 {
@@ -68,73 +122,84 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
   return subPath;
 }
 
-@implementation NSString (Sorting)
-
-- (NSComparisonResult)byTypeCompare:(NSString *)string
+// What a directory entry is sorted by. Entries are stat'ed once, when the
+// directory is read, and only if the sort needs it.
+typedef struct {
+  NSString        *name;
+  NSString        *extension;   // NXTSortByType
+  NSString        *owner;       // NXTSortByOwner
+  uid_t           uid;
+  BOOL            isDirectory;  // symbolic links to directories too
+  struct timespec date;         // the earlier of change and modification
+  off_t           size;
+} NXTSortRecord;
+
+static int compareNames(const void *a, const void *b)
 {
-  NSString *ext1 = [self pathExtension];
-  NSString *ext2 = [string pathExtension];
-  
-  return [ext1 localizedCompare:ext2];
+  return [((const NXTSortRecord *)a)->name
+           localizedCompare:((const NXTSortRecord *)b)->name];
 }
 
-- (NSComparisonResult)byDateCompare:(NSString *)string
+static int compareTypes(const void *a, const void *b)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString      *path1 = [dirPath stringByAppendingPathComponent:self];
-  NSDate        *date1 = [[fm fileAttributesAtPath:path1 traverseLink:NO]
-                           fileCreationDate];
-  
-  NSString      *path2 = [dirPath stringByAppendingPathComponent:string];
-  NSDate        *date2 = [[fm fileAttributesAtPath:path2 traverseLink:NO]
-                           fileCreationDate];
-  
-  return [date1 compare:date2];
+  int result = [((const NXTSortRecord *)a)->extension
+                 localizedCompare:((const NXTSortRecord *)b)->extension];
+
+  return result ? result : compareNames(a, b);
 }
 
-- (NSComparisonResult)bySizeCompare:(NSString *)string
+static int compareDates(const void *a, const void *b)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString           *path1 = [dirPath stringByAppendingPathComponent:self];
-  unsigned long long size1;
-  NSString           *path2 = [dirPath stringByAppendingPathComponent:string];
-  unsigned long long size2;
-
-  size1 = [[fm fileAttributesAtPath:path1 traverseLink:NO] fileSize];
-  size2 = [[fm fileAttributesAtPath:path2 traverseLink:NO] fileSize];
+  const struct timespec *d1 = &((const NXTSortRecord *)a)->date;
+  const struct timespec *d2 = &((const NXTSortRecord *)b)->date;
+
+  if (d1->tv_sec != d2->tv_sec)
+    return (d1->tv_sec < d2->tv_sec) ? -1 : 1;
+  if (d1->tv_nsec != d2->tv_nsec)
+    return (d1->tv_nsec < d2->tv_nsec) ? -1 : 1;
+  return compareNames(a, b);
+}
 
-  if (size1 == size2)
-    return NSOrderedSame;
+static int compareSizes(const void *a, const void *b)
+{
+  off_t size1 = ((const NXTSortRecord *)a)->size;
+  off_t size2 = ((const NXTSortRecord *)b)->size;
 
-  if (size1 > size2)
-    return NSOrderedDescending;
+  if (size1 != size2)
+    return (size1 < size2) ? -1 : 1;
+  return compareNames(a, b);
+}
 
-  if (size1 < size2)
-    return NSOrderedAscending;
+static int compareOwners(const void *a, const void *b)
+{
+  int result = [((const NXTSortRecord *)a)->owner
+                 localizedCompare:((const NXTSortRecord *)b)->owner];
 
-  return NSOrderedSame;
+  return result ? result : compareNames(a, b);
 }
 
-- (NSComparisonResult)byOwnerCompare:(NSString *)string
+static NSString *ownerName(uid_t uid)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString *path1 = [dirPath stringByAppendingPathComponent:self];
-  NSString *owner1 = [[fm fileAttributesAtPath:path1 traverseLink:NO]
-                       fileOwnerAccountName];
-  NSString *path2 = [dirPath stringByAppendingPathComponent:string];
-  NSString *owner2 = [[fm fileAttributesAtPath:path2 traverseLink:NO]
-                       fileOwnerAccountName];
-  
-  return [owner1 localizedCompare:owner2];
-}
+  struct passwd pw, *result = NULL;
+  char          buf[1024];
 
-@end
+  if (getpwuid_r(uid, &pw, buf, sizeof(buf), &result) == 0 && result) {
+    return [NSString stringWithCString:pw.pw_name];
+  }
+  return [NSString stringWithFormat:@"%u", (unsigned)uid];
+}
 
 @implementation NXTFileManager
 
++ (void)initialize
+{
+  if (self == [NXTFileManager class]) {
+    magicLock = [[NSLock alloc] init];
+    magicCache = [[NSMutableDictionary alloc] init];
+    magicCacheKeys = [[NSMutableArray alloc] init];
+  }
+}
+
 + (NXTFileManager *)defaultManager
 {
   if (sharedManager == nil) {
@@ -200,44 +265,36 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
                              forPath:(NSString *)targetPath
                           showHidden:(BOOL)showHidden
 {
-  NSFileManager  *fm = [NSFileManager defaultManager];
-  NSMutableArray *dirContents;
+  return [self directoryContentsAtPath:path
+                               forPath:targetPath
+                              sortedBy:NXTSortByName
+                            showHidden:showHidden];
+}
 
-  dirContents = [[fm directoryContentsAtPath:path] mutableCopy];
+// Names listed in the .hidden file of the directory, except those on the
+// way to targetPath.
+- (NSSet *)_hiddenNamesAtPath:(NSString *)path
+                      forPath:(NSString *)targetPath
+{
+  NSString     *hiddenFilename;
+  NSString     *h;
+  NSMutableSet *hiddenNames;
 
-  if (showHidden == NO) {
-    NSString *hiddenFilename;
-    unsigned i, n;
-    NSString *filename;
-    NSString *pathIntersection = NXTIntersectionPath(path, targetPath);
-
-    hiddenFilename = [path stringByAppendingPathComponent:@".hidden"];
-    if ([fm fileExistsAtPath:hiddenFilename])	{
-      NSString     *h = [NSString stringWithContentsOfFile:hiddenFilename];
-      NSArray      *hidden = [h componentsSeparatedByString:@"\n"];
-      NSEnumerator *e = [hidden objectEnumerator];
-
-      while ((filename = [e nextObject]) != nil) {
-        if (![targetPath
-                     hasPrefix:[path stringByAppendingPathComponent:filename]]) {
-          [dirContents removeObject:filename];
-        }
-      }
-    }
-    for (i = 0, n = [dirContents count]; i < n; i++) {
-      NSString *filename = [dirContents objectAtIndex:i];
+  hiddenFilename = [path stringByAppendingPathComponent:@".hidden"];
+  h = [NSString stringWithContentsOfFile:hiddenFilename];
+  if (h == nil) {
+    return nil;
+  }
 
-      if ([filename length] <= 0 || [filename hasPrefix:@"."]) {
-        [dirContents removeObjectAtIndex:i];
-        n--;
-        i--;
-      }
+  hiddenNames = [NSMutableSet setWithArray:[h componentsSeparatedByString:@"\n"]];
+  for (NSString *filename in [hiddenNames allObjects]) {
+    if ([targetPath
+          hasPrefix:[path stringByAppendingPathComponent:filename]]) {
+      [hiddenNames removeObject:filename];
     }
   }
 
-  [dirContents sortUsingSelector:@selector(localizedCompare:)];
-
-  return [dirContents autorelease];
+  return hiddenNames;
 }
 
 - (NSArray *)directoryContentsAtPath:(NSString *)path
@@ -245,86 +302,152 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
                             sortedBy:(NXTSortType)sortType
                           showHidden:(BOOL)showHidden
 {
-  
-  NSFileManager  *fm = [NSFileManager defaultManager];
-  NSMutableArray *dirContents;
-  SEL            compareSelector = 0;
-  BOOL           foldersFirst = NO;
+  DIR                 *dir;
+  struct dirent       *entry;
+  struct stat         st;
+  NSSet               *hiddenNames = nil;
+  NSMutableDictionary *owners = nil;
+  NSMutableArray      *dirContents;
+  NSString            *name;
+  NSNumber            *uid;
+  NXTSortRecord       *records = NULL, *newRecords, *r, tmp;
+  size_t              count = 0, capacity = 0, dirCount = 0, i, length;
+  int                 (*compare)(const void *, const void *) = compareNames;
+  BOOL                foldersFirst = NO;
+  BOOL                needsStat = NO;
 
-  dirPath = path;
-  
   switch (sortType)
     {
     case NXTSortByName:  // = 0
-      compareSelector = @selector(localizedCompare:);
       break;
     case NXTSortByKind:  // = 1
-      compareSelector = @selector(localizedCompare:);
       foldersFirst = YES;
       break;
     case NXTSortByType:  // = 2
-      compareSelector = @selector(byTypeCompare:);
+      compare = compareTypes;
       foldersFirst = YES;
       break;
     case NXTSortByDate:  // = 3
-      compareSelector = @selector(byDateCompare:);
+      compare = compareDates;
+      needsStat = YES;
       break;
     case NXTSortBySize:  // = 4
-      compareSelector = @selector(bySizeCompare:);
+      compare = compareSizes;
+      needsStat = YES;
       break;
     case NXTSortByOwner: // = 5
-      compareSelector = @selector(byOwnerCompare:);
+      compare = compareOwners;
+      needsStat = YES;
+      owners = [NSMutableDictionary dictionary];
       break;
     }
 
-  dirContents = [[self directoryContentsAtPath:path
-                                       forPath:targetPath
-                                    showHidden:showHidden] mutableCopy];
-  if (!dirContents)
+  dir = opendir([path fileSystemRepresentation]);
+  if (dir == NULL)
     return nil;
-  
-  if (foldersFirst) {
-    NSEnumerator   *e = [dirContents objectEnumerator];
-    NSMutableArray *dirs = [[NSMutableArray alloc] init];
-    NSMutableArray *files = [[NSMutableArray alloc] init];
-    NSString       *entry = nil;
-    NSDictionary   *fattrs;
-    BOOL           isDir;
-    NSString       *fp;
-
-    while ((entry = [e nextObject]) != nil) {
-      fp = [path stringByAppendingPathComponent:entry];
-      fattrs = [fm fileAttributesAtPath:fp traverseLink:YES];
-
-      if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory]) {
-        [dirs addObject:entry];
+
+  if (showHidden == NO) {
+    hiddenNames = [self _hiddenNamesAtPath:path forPath:targetPath];
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.' &&
+        (showHidden == NO || entry->d_name[1] == '\0' ||
+         (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+      continue;
+    }
+    length = strlen(entry->d_name);
+    name = [self stringWithFileSystemRepresentation:entry->d_name
+                                             length:length];
+    // Names not in the file system encoding are still listed
+    if (name == nil) {
+      name = [[[NSString alloc] initWithBytes:entry->d_name
+                                       length:length
+                                     encoding:NSISOLatin1StringEncoding]
+               autorelease];
+    }
+    if (name == nil || [hiddenNames containsObject:name]) {
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      newRecords = realloc(records, capacity * sizeof(NXTSortRecord));
+      if (newRecords == NULL) {
+        NSLog(@"[NXTFileManager] out of memory listing %@", path);
+        free(records);
+        closedir(dir);
+        return nil;
+      }
+      records = newRecords;
+    }
+    r = &records[count++];
+    memset(r, 0, sizeof(NXTSortRecord));
+    r->name = name;
+
+    if (needsStat &&
+        fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+      r->size = st.st_size;
+      r->uid = st.st_uid;
+      // As -[NSDictionary fileCreationDate] does
+      if (st.st_ctim.tv_sec < st.st_mtim.tv_sec ||
+          (st.st_ctim.tv_sec == st.st_mtim.tv_sec &&
+           st.st_ctim.tv_nsec < st.st_mtim.tv_nsec)) {
+        r->date = st.st_ctim;
       }
       else {
-        [files addObject:entry];
+        r->date = st.st_mtim;
       }
     }
+    if (foldersFirst) {
+      if (entry->d_type == DT_DIR) {
+        r->isDirectory = YES;
+      }
+      else if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+        r->isDirectory = (fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 &&
+                          S_ISDIR(st.st_mode));
+      }
+    }
+    if (sortType == NXTSortByType) {
+      r->extension = [name pathExtension];
+    }
+    if (owners) {
+      uid = [NSNumber numberWithUnsignedInt:r->uid];
+      r->owner = [owners objectForKey:uid];
+      if (r->owner == nil) {
+        r->owner = ownerName(r->uid);
+        [owners setObject:r->owner forKey:uid];
+      }
+    }
+  }
+  closedir(dir);
 
-    // Empty dirContents
-    [dirContents removeAllObjects];
-
-    // Add sorted directories
-    [dirs sortUsingSelector:compareSelector];
-    [dirContents addObjectsFromArray:dirs];
-    [dirs release];
-
-    // Add sorted files
-    [files sortUsingSelector:compareSelector];
-    [dirContents addObjectsFromArray:files];
-    [files release];
+  // Folders go first, each part sorted on its own
+  if (foldersFirst) {
+    for (i = 0; i < count; i++) {
+      if (records[i].isDirectory) {
+        tmp = records[dirCount];
+        records[dirCount++] = records[i];
+        records[i] = tmp;
+      }
+    }
+    qsort(records, dirCount, sizeof(NXTSortRecord), compare);
+    qsort(records + dirCount, count - dirCount, sizeof(NXTSortRecord), compare);
   }
   else {
-    [dirContents sortUsingSelector:compareSelector];
+    qsort(records, count, sizeof(NXTSortRecord), compare);
+  }
+
+  dirContents = [NSMutableArray arrayWithCapacity:count];
+  for (i = 0; i < count; i++) {
+    [dirContents addObject:records[i].name];
   }
+  if (records)
+    free(records);
 
-  return AUTORELEASE(dirContents);
+  return dirContents;
 }
 
-// --- Search path
 - (NSArray *)executablesForSubstring:(NSString *)substring
 {
   NSString       *envPath;
@@ -424,58 +547,131 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 }
 
 // --- Files (libmagic)
-- (NSString *)mimeTypeForFile:(NSString *)fullPath
+
+- (NSString *)_magic:(MagicQuery)query forFile:(NSString *)fullPath
 {
-  magic_t    cookie;
-  const char *mime_type;
-  NSString   *mimeType;
-  
-  cookie = magic_open(MAGIC_MIME_TYPE);
-  magic_load(cookie, NULL);
+  const char         *path = [fullPath fileSystemRepresentation];
+  struct stat        st;
+  MagicCacheKey      key;
+  NSData             *keyData = nil;
+  NXTMagicCacheEntry *entry;
+  NSString           *value = nil;
+  magic_t            cookie = NULL;
+  const char         *result;
+
+  // libmagic doesn't follow symbolic links
+  if (lstat(path, &st) == 0) {
+    memset(&key, 0, sizeof(key));
+    key.device = st.st_dev;
+    key.inode = st.st_ino;
+    key.mtime = st.st_mtim;
+    key.size = st.st_size;
+    keyData = [NSData dataWithBytes:&key length:sizeof(key)];
+
+    [magicLock lock];
+    entry = [magicCache objectForKey:keyData];
+    if (entry && entry->values[query]) {
+      value = [[entry->values[query] retain] autorelease];
+      magicCacheHits++;
+    }
+    else {
+      magicCacheMisses++;
+    }
+    [magicLock unlock];
 
-  mime_type = magic_file(cookie, [fullPath cString]);
-  
-  mimeType = [NSString stringWithCString:mime_type];
+    if (value) {
+      return value;
+    }
+  }
 
-  magic_close(cookie);
+  [magicLock lock];
+  if (magicPoolCount > 0) {
+    cookie = magicPool[--magicPoolCount];
+  }
+  [magicLock unlock];
 
-  return mimeType;
+  if (cookie == NULL) {
+    cookie = magic_open(MAGIC_NONE);
+    if (cookie == NULL) {
+      return nil;
+    }
+    if (magic_load(cookie, NULL) != 0) {
+      NSDebugLLog(@"NXTFileManager", @"libmagic: %s", magic_error(cookie));
+      magic_close(cookie);
+      return nil;
+    }
+  }
+
+  magic_setflags(cookie, magicFlags[query]);
+  result = magic_file(cookie, path);
+  if (result != NULL) {
+    value = [NSString stringWithCString:result];
+  }
+
+  [magicLock lock];
+  if (magicPoolCount < MAGIC_POOL_SIZE) {
+    magicPool[magicPoolCount++] = cookie;
+    cookie = NULL;
+  }
+  if (value && keyData) {
+    entry = [magicCache objectForKey:keyData];
+    if (entry == nil) {
+      if ([magicCacheKeys count] >= MAGIC_CACHE_SIZE) {
+        [magicCache removeObjectForKey:[magicCacheKeys objectAtIndex:0]];
+        [magicCacheKeys removeObjectAtIndex:0];
+      }
+      entry = [NXTMagicCacheEntry new];
+      [magicCache setObject:entry forKey:keyData];
+      [magicCacheKeys addObject:keyData];
+      [entry release];
+    }
+    ASSIGN(entry->values[query], value);
+  }
+  [magicLock unlock];
+
+  // The pool is full
+  if (cookie) {
+    magic_close(cookie);
+  }
+
+  return value;
+}
+
+- (NSString *)mimeTypeForFile:(NSString *)fullPath
+{
+  return [self _magic:MagicMimeType forFile:fullPath];
 }
 
 - (NSString *)mimeEncodingForFile:(NSString *)fullPath
 {
-  magic_t    cookie;
-  const char *mime_enc;
-  NSString   *mimeEncoding;
-  
-  cookie = magic_open(MAGIC_MIME_ENCODING);
-  magic_load(cookie, NULL);
+  return [self _magic:MagicMimeEncoding forFile:fullPath];
+}
 
-  mime_enc = magic_file(cookie, [fullPath cString]);
-  
-  mimeEncoding = [NSString stringWithCString:mime_enc];
+- (NSString *)descriptionForFile:(NSString *)fullPath
+{
+  return [self _magic:MagicDescription forFile:fullPath];
+}
+
+- (NSUInteger)magicCacheHits
+{
+  NSUInteger hits;
 
-  magic_close(cookie);
+  [magicLock lock];
+  hits = magicCacheHits;
+  [magicLock unlock];
 
-  return mimeEncoding;
+  return hits;
 }
 
-- (NSString *)descriptionForFile:(NSString *)fullPath
+- (NSUInteger)magicCacheMisses
 {
-  magic_t    cookie;
-  const char *description;
-  NSString   *fileDescription;
-  
-  cookie = magic_open(MAGIC_NONE);
-  magic_load(cookie, NULL);
+  NSUInteger misses;
 
-  description = magic_file(cookie, [fullPath cString]);
-  
-  fileDescription = [NSString stringWithCString:description];
-  
-  magic_close(cookie);
+  [magicLock lock];
+  misses = magicCacheMisses;
+  [magicLock unlock];
 
-  return fileDescription;
+  return misses;
 }
 
 @end
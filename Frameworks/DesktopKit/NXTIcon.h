@@ -49,7 +49,7 @@ static inline float absolute_value(float v)
     return v;
 }
 
-@class NXTIconLabel, NSImage, NSEvent, NSString, NSColor;
+@class NXTIconLabel, NXTIconView, NSImage, NSEvent, NSString, NSColor;
 
 @protocol NSDraggingInfo;
 
@@ -80,6 +80,8 @@ static inline float absolute_value(float v)
   unsigned dragEnteredResult;
 
   NSColor *bgColor;
+
+  NXTIconView *iconView; // The icon view the receiver is in, not retained.
 }
 
 /** Sets the default maximum collapsed label width.
@@ -112,6 +114,12 @@ static inline float absolute_value(float v)
 /** Returns the receiver's short label view. */
 - (NXTIconLabel *)shortLabel;
 
+/** Sets the icon view the receiver was put into with -[NXTIconView addIcon:]
+    or -[NXTIconView putIcon:intoSlot:]. The icon view is told when the
+    label string of the receiver changes. */
+- (void)setIconView:(NXTIconView *)aView;
+- (NXTIconView *)iconView;
+
 /** Sets the image the receiver is to display. */
 - (void)setIconImage:(NSImage *)newImage;
 - (NSImage *)iconImage;
@@ -25,6 +25,7 @@
 
 #import "NXTIcon.h"
 #import "NXTIconLabel.h"
+#import "NXTIconView.h"
 #import "Utilities.h"
 
 @interface NXTIcon (Private)
@@ -35,6 +36,18 @@
 */
 - (void)rebuildCollapsedLabelString;
 
+/*
+   Makes the short and long labels. Icons of large icon views are never
+   shown all at once, so the labels are not made before they are needed.
+*/
+- (void)makeLabels;
+
+/*
+   Sets the receiver's state - strings, colors, editability - to the labels
+   just made.
+*/
+- (void)configureLabels;
+
 @end
 
 @implementation NXTIcon
@@ -68,73 +81,13 @@ static float defaultMaximumCollapsedLabelWidth = 100;
 
 - initWithFrame:(NSRect)frame
 {
-  NSUserDefaults *df = [NSUserDefaults standardUserDefaults];
-  NSDictionary   *colorDict;
-  NSDictionary   *fontDict;
-  NSRect         labelFrame;
-
   [super initWithFrame:frame];
 
-  shortLabel = [[NXTIconLabel alloc] initWithFrame:NSMakeRect(0, 0, 10, 15)
-                                              icon:self];
-  longLabel = [[NXTIconLabel alloc] initWithFrame:NSMakeRect(0, 0, 10, 15)
-                                             icon:self];
-
   ASSIGN(bgColor, [NSColor highlightColor]);
 
-  [shortLabel setDrawsBackground:NO];
-  [shortLabel setEditable:NO];
-  [shortLabel setSelectable:NO];
-
-  if ((fontDict = [df objectForKey:@"NXTIconLabelFont"])
-      && [fontDict isKindOfClass:[NSDictionary class]]) {
-    float    size = 0.0;
-    NSString *name = [fontDict objectForKey:@"Name"];
-
-    if ([fontDict objectForKey: @"Size"]) {
-      size = [[fontDict objectForKey:@"Size"] floatValue];
-    }
-
-    if (name) {
-      [shortLabel setFont:[NSFont fontWithName:name size:size]];
-    }
-    else {
-      [shortLabel setFont:[NSFont systemFontOfSize:size]];
-    }
-  }
-
-  [longLabel setDrawsBackground:YES];
-  [longLabel setBackgroundColor:bgColor];
-
-  if ((fontDict = [df objectForKey:@"NXLongIconLabelFont"])
-      && [fontDict isKindOfClass:[NSDictionary class]]) {
-    float    size = 0.0;
-    NSString *name = [fontDict objectForKey:@"Name"];
-    
-    if ([fontDict objectForKey: @"Size"]) {
-      size = [[fontDict objectForKey: @"Size"] floatValue];
-    }
-
-    if (name) {
-      [longLabel setFont:[NSFont fontWithName:name size:size]];
-    }
-    else {
-      [longLabel setFont:[NSFont systemFontOfSize:size]];
-    }
-  }
-
   maximumCollapsedLabelWidth = defaultMaximumCollapsedLabelWidth;
   showsExpandedLabelWhenSelected = YES;
 
-  // readjust the real heights
-  labelFrame = [shortLabel frame];
-  labelFrame.size.height = [[shortLabel font] defaultLineHeightForFont];
-  [shortLabel setFrame:labelFrame];
-
-  labelFrame = [longLabel frame];
-  labelFrame.size.height = [[longLabel font] defaultLineHeightForFont];
-  [longLabel setFrame:labelFrame];
-
   isEditable = YES;
   isSelectable = YES;
 
@@ -204,6 +157,10 @@ static float defaultMaximumCollapsedLabelWidth = 100;
   NSRect frame;
   NSRect labelFrame;
 
+  if (shortLabel == nil) {
+    [self makeLabels];
+  }
+
   frame = [self frame];
   labelFrame = [shortLabel frame];
 
@@ -232,14 +189,30 @@ static float defaultMaximumCollapsedLabelWidth = 100;
 
 - (NXTIconLabel *)label
 {
+  if (longLabel == nil) {
+    [self makeLabels];
+  }
   return longLabel;
 }
 
 - (NXTIconLabel *)shortLabel
 {
+  if (shortLabel == nil) {
+    [self makeLabels];
+  }
   return shortLabel;
 }
 
+- (void)setIconView:(NXTIconView *)aView
+{
+  iconView = aView;
+}
+
+- (NXTIconView *)iconView
+{
+  return iconView;
+}
+
 - (void)setIconImage:(NSImage *)newImage
 {
   ASSIGN(iconImage, newImage);
@@ -254,6 +227,7 @@ static float defaultMaximumCollapsedLabelWidth = 100;
 - (void)setLabelString:(NSString *)aLabel
 {
   ASSIGN(labelString, aLabel);
+  [iconView iconLabelDidChange:self];
 
   [longLabel setString:labelString];
   [longLabel adjustFrame];
@@ -287,8 +261,10 @@ static float defaultMaximumCollapsedLabelWidth = 100;
     [longLabel removeFromSuperview];
     [[self superview] addSubview:shortLabel];
     
-    if (![[longLabel string] isEqualToString:labelString]) {
+    if (longLabel != nil &&
+        ![[longLabel string] isEqualToString:labelString]) {
       ASSIGN(labelString, [[[longLabel string] copy] autorelease]);
+      [iconView iconLabelDidChange:self];
       [self rebuildCollapsedLabelString];
     } 
     else {
@@ -624,13 +600,106 @@ static float defaultMaximumCollapsedLabelWidth = 100;
 
 - (void)rebuildCollapsedLabelString
 {
-  NSString *str = NXTShortenString(labelString,
-                                   maximumCollapsedLabelWidth,
-                                   [shortLabel font],
-                                   NXSymbolElement,
-                                   NXTDotsAtRight);
+  NSString *str;
+
+  if (shortLabel == nil) {
+    return;
+  }
+
+  str = NXTShortenString(labelString,
+                         maximumCollapsedLabelWidth,
+                         [shortLabel font],
+                         NXSymbolElement,
+                         NXTDotsAtRight);
   [shortLabel setString:str];
   [shortLabel adjustFrame];
 }
 
+- (void)makeLabels
+{
+  NSUserDefaults *df = [NSUserDefaults standardUserDefaults];
+  NSDictionary   *fontDict;
+  NSRect         labelFrame;
+
+  shortLabel = [[NXTIconLabel alloc] initWithFrame:NSMakeRect(0, 0, 10, 15)
+                                              icon:self];
+  longLabel = [[NXTIconLabel alloc] initWithFrame:NSMakeRect(0, 0, 10, 15)
+                                             icon:self];
+
+  [shortLabel setDrawsBackground:NO];
+  [shortLabel setEditable:NO];
+  [shortLabel setSelectable:NO];
+
+  if ((fontDict = [df objectForKey:@"NXTIconLabelFont"])
+      && [fontDict isKindOfClass:[NSDictionary class]]) {
+    float    size = 0.0;
+    NSString *name = [fontDict objectForKey:@"Name"];
+
+    if ([fontDict objectForKey: @"Size"]) {
+      size = [[fontDict objectForKey:@"Size"] floatValue];
+    }
+
+    if (name) {
+      [shortLabel setFont:[NSFont fontWithName:name size:size]];
+    }
+    else {
+      [shortLabel setFont:[NSFont systemFontOfSize:size]];
+    }
+  }
+
+  [longLabel setDrawsBackground:YES];
+
+  if ((fontDict = [df objectForKey:@"NXLongIconLabelFont"])
+      && [fontDict isKindOfClass:[NSDictionary class]]) {
+    float    size = 0.0;
+    NSString *name = [fontDict objectForKey:@"Name"];
+    
+    if ([fontDict objectForKey: @"Size"]) {
+      size = [[fontDict objectForKey: @"Size"] floatValue];
+    }
+
+    if (name) {
+      [longLabel setFont:[NSFont fontWithName:name size:size]];
+    }
+    else {
+      [longLabel setFont:[NSFont systemFontOfSize:size]];
+    }
+  }
+
+  // readjust the real heights
+  labelFrame = [shortLabel frame];
+  labelFrame.size.height = [[shortLabel font] defaultLineHeightForFont];
+  [shortLabel setFrame:labelFrame];
+
+  labelFrame = [longLabel frame];
+  labelFrame.size.height = [[longLabel font] defaultLineHeightForFont];
+  [longLabel setFrame:labelFrame];
+
+  [self configureLabels];
+}
+
+- (void)configureLabels
+{
+  NSColor *textColor;
+
+  if (isDimmed == YES)
+    textColor = [NSColor darkGrayColor];
+  else
+    textColor = [NSColor blackColor];
+  [shortLabel setTextColor:textColor];
+  [longLabel setTextColor:textColor];
+
+  [longLabel setEditable:isEditable];
+  [longLabel setSelectable:isSelectable];
+  if (isEditable) {
+    [longLabel setBackgroundColor:bgColor];
+  }
+  else {
+    [longLabel setBackgroundColor:[NSColor windowBackgroundColor]];
+  }
+
+  [longLabel setString:(labelString != nil) ? labelString : @""];
+  [self rebuildCollapsedLabelString];
+}
+
 @end
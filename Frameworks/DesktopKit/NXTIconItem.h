@@ -0,0 +1,79 @@
+/* -*- mode: objc -*- */
+//
+// Project: NEXTSPACE - DesktopKit framework
+//
+// Copyright (C) 2014-2019 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+/** @class NXTIconItem
+    @brief What a virtualized icon view knows about one of its icons.
+
+    A virtualized NXTIconView (see -[NXTIconView setVirtualized:]) holds an
+    item for every entry and makes NXTIcon views only for the slots it
+    shows. When an item scrolls into view it gets a view from the pool of
+    the icon view, which is set up with the label, image and state of the
+    item. Changes made to a shown item go to its view.
+
+    Items are plain objects, so they can be made and filled off the main
+    thread before they are added to an icon view.
+*/
+
+#import <Foundation/NSObject.h>
+
+@class NSString, NSImage, NXTIconView;
+
+@interface NXTIconItem : NSObject
+{
+  NSString    *labelString;
+  NSImage     *iconImage;
+  id          representedObject;
+
+  BOOL        isSelected;
+  BOOL        isDimmed;
+
+  NXTIconView *iconView; // The icon view the receiver is in, not retained.
+}
+
+- (id)initWithLabelString:(NSString *)aLabel
+                iconImage:(NSImage *)anImage;
+
+/** The label and image the icon of the receiver shows. */
+- (void)setLabelString:(NSString *)aLabel;
+- (NSString *)labelString;
+- (void)setIconImage:(NSImage *)anImage;
+- (NSImage *)iconImage;
+
+/** An object the owner of the icon view keeps with the receiver, e.g.
+    the path of a file. Retained. */
+- (void)setRepresentedObject:(id)anObject;
+- (id)representedObject;
+
+/** Selection is kept by the icon view, which sets it here so that the
+    icon of the receiver is selected when it is shown. */
+- (void)setSelected:(BOOL)flag;
+- (BOOL)isSelected;
+- (void)select:(id)sender;
+- (void)deselect:(id)sender;
+
+- (void)setDimmed:(BOOL)flag;
+- (BOOL)isDimmed;
+
+/** Set by the icon view the receiver is added to. */
+- (void)setIconView:(NXTIconView *)aView;
+- (NXTIconView *)iconView;
+
+@end
@@ -0,0 +1,130 @@
+/* -*- mode: objc -*- */
+//
+// Project: NEXTSPACE - DesktopKit framework
+//
+// Copyright (C) 2014-2019 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#import <AppKit/AppKit.h>
+
+#import "NXTIconItem.h"
+#import "NXTIconView.h"
+
+@implementation NXTIconItem
+
+- (id)initWithLabelString:(NSString *)aLabel
+                iconImage:(NSImage *)anImage
+{
+  [super init];
+
+  labelString = [aLabel copy];
+  iconImage = [anImage retain];
+
+  return self;
+}
+
+- (void)dealloc
+{
+  TEST_RELEASE(labelString);
+  TEST_RELEASE(iconImage);
+  TEST_RELEASE(representedObject);
+
+  [super dealloc];
+}
+
+- (void)setLabelString:(NSString *)aLabel
+{
+  ASSIGNCOPY(labelString, aLabel);
+  [iconView iconLabelDidChange:(id)self];
+  [iconView itemDidChange:self];
+}
+
+- (NSString *)labelString
+{
+  return labelString;
+}
+
+- (void)setIconImage:(NSImage *)anImage
+{
+  ASSIGN(iconImage, anImage);
+  [iconView itemDidChange:self];
+}
+
+- (NSImage *)iconImage
+{
+  return iconImage;
+}
+
+- (void)setRepresentedObject:(id)anObject
+{
+  ASSIGN(representedObject, anObject);
+}
+
+- (id)representedObject
+{
+  return representedObject;
+}
+
+- (void)setSelected:(BOOL)flag
+{
+  if (isSelected == flag) {
+    return;
+  }
+  isSelected = flag;
+  [iconView itemDidChange:self];
+}
+
+- (BOOL)isSelected
+{
+  return isSelected;
+}
+
+- (void)select:(id)sender
+{
+  [self setSelected:YES];
+}
+
+- (void)deselect:(id)sender
+{
+  [self setSelected:NO];
+}
+
+- (void)setDimmed:(BOOL)flag
+{
+  if (isDimmed == flag) {
+    return;
+  }
+  isDimmed = flag;
+  [iconView itemDidChange:self];
+}
+
+- (BOOL)isDimmed
+{
+  return isDimmed;
+}
+
+- (void)setIconView:(NXTIconView *)aView
+{
+  iconView = aView;
+}
+
+- (NXTIconView *)iconView
+{
+  return iconView;
+}
+
+@end
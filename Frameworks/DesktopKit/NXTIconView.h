@@ -33,13 +33,20 @@
    The layout starts at the upper left corner (slot 0x0) and continues
    to the right-bottom.
 
+   A virtualized icon view (see -setVirtualized:) holds NXTIconItems
+   instead of icons and makes icons only for the slots of the rows it
+   shows and of one page above and below them. Icons of items scrolled
+   away are reused for those scrolled in. Use it for directories of many
+   thousands of files.
+
    @author Saso Kiselkov, Sergii Stoian
 */
 
+#import <Foundation/NSRange.h>
 #import <AppKit/NSView.h>
 #import <AppKit/NSDragging.h>
 
-@class NSMutableArray, NXTIcon;
+@class NSMutableArray, NSMapTable, NXTIcon, NXTIconItem;
 @protocol NSDraggingInfo;
 
 /** @struct NXTIconSlot
@@ -140,6 +147,30 @@ static inline NXTIconSlot NXTMakeIconSlot(NSUInteger x, NSUInteger y)
   /** Selected slot with maximum x and y - bottom right*/
   NXTIconSlot maxSelectedIconSlot;
 
+  /** Index in `icons' (plus one) of every icon and of the first icon with
+    a label string. Rebuilt when removal of an icon shifts the others. */
+  NSMapTable *iconIndexes;
+  NSMapTable *labelIndexes;
+  BOOL       isIndexValid;
+  BOOL       hasSameLabels;
+
+  /** There are no holes in `icons' before this index. */
+  NSUInteger firstHole;
+
+  BOOL           isVirtualized;
+  /** Indexes of the slots whose items are shown if virtualized. */
+  NSRange        shownSlots;
+  /** Icons of the items shown, and the items of those icons. */
+  NSMapTable     *itemIcons;
+  NSMapTable     *iconItems;
+  /** Icons of items scrolled away, to be given to items scrolled in. */
+  NSMutableArray *iconPool;
+  Class          iconClass;
+  /** Icon and label height of the icons shown, to find where the others
+    would be. */
+  NSSize         shownIconSize;
+  CGFloat        labelHeight;
+
   NSString *lastAlphaString;
   NSDate   *lastHitDate;
 
@@ -217,6 +248,46 @@ static inline NXTIconSlot NXTMakeIconSlot(NSUInteger x, NSUInteger y)
 
 - (NXTIcon *)iconWithLabelString:(NSString *)label;
 
+/** Invoked by icons in the receiver when their label string changes. */
+- (void)iconLabelDidChange:(NXTIcon *)anIcon;
+
+/** Sets whether the receiver holds NXTIconItems and shows them with icons
+    made for the slots it shows (and those of one page above and below)
+    instead of holding icons. Set it while the receiver is empty. The
+    delegate is sent -iconView:willShowIcon:forItem: before an item is
+    shown.
+
+    The methods for icons take and return items in a virtualized view:
+    -selectedIcons, -iconInSlot: and the delegate methods for selection
+    deal with items. Icons the receiver made are taken for their items
+    by -selectIcons: and the click actions. */
+- (void)setVirtualized:(BOOL)flag;
+- (BOOL)isVirtualized;
+
+/** The class of the icons a virtualized receiver makes, NXTIcon by
+    default. */
+- (void)setIconClass:(Class)aClass;
+- (Class)iconClass;
+
+/** Items of a virtualized receiver. */
+- (NSArray *)items;
+- (void)addItems:(NSArray *)someItems;
+- (void)removeItems:(NSArray *)someItems;
+- (NXTIconItem *)itemWithLabelString:(NSString *)label;
+- (NSSet *)selectedItems;
+- (void)selectItems:(NSSet *)someItems;
+
+/** The icon that shows anItem, or nil if it is not shown. */
+- (NXTIcon *)iconOfItem:(NXTIconItem *)anItem;
+/** The item anIcon shows, or nil if the receiver didn't make anIcon. */
+- (NXTIconItem *)itemOfIcon:(NXTIcon *)anIcon;
+/** The frame the icon of anItem has or would have when shown. */
+- (NSRect)frameOfItem:(NXTIconItem *)anItem;
+
+/** Invoked by items in the receiver when their label, image or state
+    changes, to update the icon that shows them. */
+- (void)itemDidChange:(NXTIconItem *)anItem;
+
 /** Sets a new slot size in the receiver and repositions all
     icons accordingly. */
 - (void)setSlotSize:(NSSize)newSlotSize;
@@ -375,6 +446,13 @@ static inline NXTIconSlot NXTMakeIconSlot(NSUInteger x, NSUInteger y)
 - (void)     iconView:(NXTIconView*)anIconView
  didChangeSelectionTo:(NSSet *)selectedIcons;
 
+/** Sent by a virtualized icon view when an item scrolls into view. The
+    icon was just made or has shown another item before; its label, image
+    and selection are those of anItem, set up the rest here. */
+- (void)iconView:(NXTIconView *)anIconView
+    willShowIcon:(NXTIcon *)anIcon
+         forItem:(NXTIconItem *)anItem;
+
 @end
 
 /** This protocol lists methods an icon view delegate should implement
@@ -26,8 +26,12 @@
 #import <AppKit/AppKit.h>
 
 #import "NXTIcon.h"
+#import "NXTIconItem.h"
 #import "NXTIconLabel.h"
 
+// Icons kept for items scrolled into a virtualized icon view
+#define ICON_POOL_SIZE 256
+
 static NSSize defaultSlotSize = {100, 80};
 static int useDottedRect = -1;
 static float defaultMaximumCollapsedLabelWidthSpace = 20;
@@ -95,6 +99,38 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 - (void)updateSelectionWithIcons:(NSSet *)someIcons
                    modifierFlags:(unsigned)flags;
 
+/* Maps every entry (icon or item) to its index in `icons' and label
+   strings to the index of the first entry with it. */
+- (void)rebuildIndex;
+- (void)indexLabelOfIcon:(id)anIcon
+                 atIndex:(NSUInteger)index;
+- (NSUInteger)indexOfIcon:(id)anIcon;
+
+/* Returns the frame the icon of an entry has or would have if it was put
+   into the receiver. */
+- (NSRect)frameOfIcon:(id)anIcon
+               inSlot:(NXTIconSlot)aSlot;
+
+/* The entry of `icons' an icon stands for: the item it shows if the
+   receiver is virtualized, the icon itself otherwise. */
+- (id)entryOfIcon:(id)anIcon;
+/* The icon in the receiver that shows an entry, or nil. */
+- (NXTIcon *)shownIconOfEntry:(id)anEntry;
+
+/* Virtualized icon view: shows the items in the rows it shows and those
+   of a page above and below with icons, and hides the others. Icons of
+   the items hidden are given to the items shown. */
+- (NSRange)slotsToShow;
+- (void)tileIcons;
+- (void)showIconAtIndex:(NSUInteger)index;
+- (void)hideIcon:(id)anEntry;
+- (void)hideIconsInRange:(NSRange)range
+                exceptIn:(NSRange)keepRange;
+- (void)setUpIcon:(NXTIcon *)anIcon
+         withItem:(NXTIconItem *)anItem;
+- (void)observeClipView:(NSView *)aView;
+- (void)clipViewBoundsDidChange:(NSNotification *)aNotif;
+
 @end
 
 @implementation NXTIconView
@@ -129,6 +165,14 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
   icons = [NSMutableArray new];
   selectedIcons = [NSMutableSet new];
 
+  iconIndexes = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                 NSIntegerMapValueCallBacks, 0);
+  labelIndexes = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                                  NSIntegerMapValueCallBacks, 0);
+  isIndexValid = YES;
+
+  iconClass = [NXTIcon class];
+
   autoAdjustsToFitIcons = YES;
   adjustsToFillEnclosingScrollView = YES;
   fillWithHoleWhenRemovingIcon = YES;
@@ -166,8 +210,22 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 
 - (void)dealloc
 {
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+
+  for (NXTIcon *icon in icons) {
+    if (![icon isKindOfClass:[NSNull class]]) {
+      [icon setIconView:nil];
+    }
+  }
   TEST_RELEASE(icons);
   TEST_RELEASE(selectedIcons);
+  TEST_RELEASE(iconPool);
+  NSFreeMapTable(iconIndexes);
+  NSFreeMapTable(labelIndexes);
+  if (itemIcons != NULL) {
+    NSFreeMapTable(itemIcons);
+    NSFreeMapTable(iconItems);
+  }
 
   [super dealloc];
 }
@@ -219,7 +277,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     // find a free spot - there _must_ be something, because
     // we remember to have some holes somewhere
     // NSLog(@"[NXTIconView] icons: %@", icons);
-    for (i = 0, n = [icons count]; i < n; i++) {
+    for (i = firstHole, n = [icons count]; i < n; i++) {
       if ([[icons objectAtIndex:i] isKindOfClass:[NSNull class]]) {
         slot = SlotFromIndex(slotsWide, i);
         break;
@@ -232,6 +290,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
                            @"none were found (even though "
                            @"I thought there were!)")];
     }
+    firstHole = i + 1;
     // NSLog(@"[NXTIconView] found hole at index: %lu", i);
   }
   else {
@@ -274,6 +333,9 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     unsigned i;
 
     slotsTall = aSlot.y + 1;
+    if (firstHole > [icons count]) {
+      firstHole = [icons count];
+    }
     for (i = [icons count]; i < index; i++) {
       [icons addObject:[NSNull null]];
       numHoles++;
@@ -292,17 +354,33 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
       numHoles--;
     }
     else {
-      [oldIcon removeFromSuperview];
+      [self hideIcon:oldIcon];
+      [oldIcon setIconView:nil];
+      isIndexValid = NO;
     }
 
     [icons replaceObjectAtIndex:index withObject:anIcon];
   }
 
+  [anIcon setIconView:self];
+  if (isIndexValid) {
+    NSMapInsert(iconIndexes, anIcon, (void *)(NSUInteger)(index + 1));
+    [self indexLabelOfIcon:anIcon atIndex:index];
+  }
+
+  // An item gets an icon when it is shown
+  if (isVirtualized) {
+    if (NSLocationInRange(index, shownSlots)) {
+      [self showIconAtIndex:index];
+    }
+    return;
+  }
+
   [anIcon setTarget:self];
   [anIcon setAction:@selector(iconClicked:)];
   [anIcon setDragAction:@selector(iconDragged:event:)];
   [anIcon setDoubleAction:@selector(iconDoubleClicked:)];
-  
+
   [anIcon putIntoView:self
               atPoint:PointForSlot(slotSize, aSlot)];
   [anIcon setMaximumCollapsedLabelWidth:
@@ -320,20 +398,40 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 //      NSLog(@"+ %@", [[icons objectAtIndex:i] labelString]);
 //    }
 
-  i = [icons indexOfObjectIdenticalTo:anIcon];
+  i = [self indexOfIcon:anIcon];
   if (i == NSNotFound) {
     NSLog(@"[NXTIconView] failed to remove icon: icon not found!");
     return;
   }
 
   [selectedIcons removeObject:anIcon];
-  [anIcon removeFromSuperview];
+  [self hideIcon:anIcon];
+  [anIcon setIconView:nil];
+  if (i < firstHole) {
+    firstHole = i;
+  }
   if (fillWithHoleWhenRemovingIcon) {
+    NSMapRemove(iconIndexes, anIcon);
+    if (hasSameLabels) {
+      isIndexValid = NO;
+    }
+    else if ([anIcon labelString] != nil) {
+      NSMapRemove(labelIndexes, [anIcon labelString]);
+    }
     [icons replaceObjectAtIndex:i withObject:[NSNull null]];
     numHoles++;
   }
   else {
+    // The icons that follow move one slot back
+    if (isVirtualized) {
+      [self hideIconsInRange:shownSlots exceptIn:NSMakeRange(0, 0)];
+      shownSlots = NSMakeRange(0, 0);
+    }
     [icons removeObjectAtIndex:i];
+    isIndexValid = NO;
+    if (isVirtualized) {
+      [self tileIcons];
+    }
   }
 
   // [self checkWrapDown];
@@ -374,7 +472,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 
   icon = [icons objectAtIndex:i];
 
-  if (![icon isKindOfClass:[NXTIcon class]]) {
+  if ([icon isKindOfClass:[NSNull class]]) {
     return;
   }
 
@@ -385,12 +483,19 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 {
   for (NXTIcon *icon in icons) {
     if (icon && ![icon isKindOfClass:[NSNull class]]) {
-      [icon removeFromSuperview];
+      [self hideIcon:icon];
+      [icon setIconView:nil];
     }
   }
   [icons removeAllObjects];
   [selectedIcons removeAllObjects];
 
+  NSResetMapTable(iconIndexes);
+  NSResetMapTable(labelIndexes);
+  isIndexValid = YES;
+  hasSameLabels = NO;
+  firstHole = 0;
+
   slotsTall = 0;
   numHoles = 0;
   lastIcon = NXTMakeIconSlot(-1, 0);
@@ -421,10 +526,10 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
   NSMutableArray *array = [NSMutableArray array];
   NSEnumerator   *e = [icons objectEnumerator];
   NXTIcon        *icon;
-  Class          iconClass = [NXTIcon class];
+  Class          nullClass = [NSNull class];
 
   while ((icon = [e nextObject]) != nil) {
-    if ([icon isKindOfClass:iconClass]) {
+    if (![icon isKindOfClass:nullClass]) {
       [array addObject:icon];
     }
   }
@@ -457,7 +562,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 
 - (NXTIconSlot)slotForIcon:(NXTIcon *)anIcon
 {
-  NSUInteger i = [icons indexOfObjectIdenticalTo:anIcon];
+  NSUInteger i = [self indexOfIcon:anIcon];
 
   if (i == NSNotFound) {
     return NXTMakeIconSlot(-1, -1);
@@ -469,17 +574,156 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 
 - (NXTIcon *)iconWithLabelString:(NSString *)label
 {
-  NXTIcon *iconFound = nil;
-  
-  for (NXTIcon *icon in icons) {
-    if (icon && ![icon isKindOfClass:[NSNull class]]
-        && [[icon labelString] isEqualToString:label]) {
-      iconFound = icon;
-      break;
-    }
+  NSUInteger i;
+
+  if (label == nil) {
+    return nil;
+  }
+  if (isIndexValid == NO) {
+    [self rebuildIndex];
+  }
+
+  i = (NSUInteger)NSMapGet(labelIndexes, label);
+
+  return (i == 0) ? nil : [icons objectAtIndex:i - 1];
+}
+
+- (void)iconLabelDidChange:(NXTIcon *)anIcon
+{
+  isIndexValid = NO;
+}
+
+//------------------------------------------------------------------------------
+// Virtualization
+//------------------------------------------------------------------------------
+- (void)setVirtualized:(BOOL)flag
+{
+  if (isVirtualized == flag) {
+    return;
+  }
+
+  // Icons and items don't mix
+  if ([icons count] > 0) {
+    [self removeAllIcons];
+  }
+
+  isVirtualized = flag;
+  if (isVirtualized) {
+    itemIcons = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                 NSObjectMapValueCallBacks, 0);
+    iconItems = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                 NSNonOwnedPointerMapValueCallBacks, 0);
+    iconPool = [NSMutableArray new];
+    shownSlots = NSMakeRange(0, 0);
+  }
+  else {
+    NSFreeMapTable(itemIcons);
+    NSFreeMapTable(iconItems);
+    itemIcons = iconItems = NULL;
+    DESTROY(iconPool);
+  }
+  [self observeClipView:[self superview]];
+  [self relayoutIcons];
+}
+
+- (BOOL)isVirtualized
+{
+  return isVirtualized;
+}
+
+- (void)setIconClass:(Class)aClass
+{
+  iconClass = aClass;
+  [iconPool removeAllObjects];
+}
+
+- (Class)iconClass
+{
+  return iconClass;
+}
+
+//------------------------------------------------------------------------------
+// Items
+//------------------------------------------------------------------------------
+- (NSArray *)items
+{
+  return [self icons];
+}
+
+- (void)addItems:(NSArray *)someItems
+{
+  [self addIcons:someItems];
+}
+
+- (void)removeItems:(NSArray *)someItems
+{
+  [self removeIcons:someItems];
+}
+
+- (NXTIconItem *)itemWithLabelString:(NSString *)label
+{
+  return (id)[self iconWithLabelString:label];
+}
+
+- (NSSet *)selectedItems
+{
+  return [self selectedIcons];
+}
+
+- (void)selectItems:(NSSet *)someItems
+{
+  [self selectIcons:someItems];
+}
+
+- (NXTIcon *)iconOfItem:(NXTIconItem *)anItem
+{
+  if (isVirtualized == NO || anItem == nil) {
+    return nil;
   }
+  return NSMapGet(itemIcons, anItem);
+}
 
-  return iconFound;
+- (NXTIconItem *)itemOfIcon:(NXTIcon *)anIcon
+{
+  if (isVirtualized == NO || anIcon == nil) {
+    return nil;
+  }
+  return NSMapGet(iconItems, anIcon);
+}
+
+- (NSRect)frameOfItem:(NXTIconItem *)anItem
+{
+  NSUInteger i = [self indexOfIcon:anItem];
+
+  if (i == NSNotFound) {
+    return NSZeroRect;
+  }
+  return [self frameOfIcon:anItem inSlot:SlotFromIndex(slotsWide, i)];
+}
+
+- (void)itemDidChange:(NXTIconItem *)anItem
+{
+  NXTIcon *icon = [self iconOfItem:anItem];
+
+  if (icon != nil) {
+    [self setUpIcon:icon withItem:anItem];
+  }
+}
+
+// Override of NSView method.
+- (void)viewWillMoveToSuperview:(NSView *)newSuperview
+{
+  [super viewWillMoveToSuperview:newSuperview];
+  [self observeClipView:newSuperview];
+}
+
+// Override of NSView method.
+- (void)viewDidMoveToWindow
+{
+  [super viewDidMoveToWindow];
+  if (isVirtualized) {
+    [self tileIcons];
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -525,6 +769,12 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
                 slotSize.width - maximumCollapsedLabelWidthSpace];
       }
     }
+    if (isVirtualized) {
+      for (icon in NSAllMapTableValues(itemIcons)) {
+        [icon setMaximumCollapsedLabelWidth:
+                slotSize.width - maximumCollapsedLabelWidthSpace];
+      }
+    }
   }
 }
 
@@ -551,6 +801,12 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
       [icon setMaximumCollapsedLabelWidth:newWidth];
     }
   }
+  // Pooled icons get it when they are shown
+  if (isVirtualized) {
+    for (icon in NSAllMapTableValues(itemIcons)) {
+      [icon setMaximumCollapsedLabelWidth:newWidth];
+    }
+  }
 }
 
 - (float)maximumCollapsedLabelWidthSpace
@@ -882,16 +1138,35 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     selectionRect.origin.y -= selectionRect.size.height;
   }
 
+  // Look at the rows the rectangle covers, and a row above and below
+  // for icons larger than their slots.
   sel = [[NSMutableSet new] autorelease];
-  for (NXTIcon *icon in icons) {
-    if (!icon || [icon isKindOfClass:[NSNull class]])
-      continue;
-    
-    intersect = NSIntersectionRect(selectionRect, [icon frame]);
-    if (intersect.size.width == 0)
-      continue;
-    
-    [sel addObject:icon];
+  {
+    NSRect     r = PositiveRect(selectionRect);
+    NSUInteger firstRow = 0, lastRow = 0;
+    NSUInteger i, n;
+
+    if (NSMinY(r) > slotSize.height) {
+      firstRow = floorf(NSMinY(r) / slotSize.height) - 1;
+    }
+    if (NSMaxY(r) > 0) {
+      lastRow = floorf(NSMaxY(r) / slotSize.height) + 1;
+    }
+    n = MIN((lastRow + 1) * slotsWide, [icons count]);
+    for (i = firstRow * slotsWide; i < n; i++) {
+      NXTIcon *icon = [icons objectAtIndex:i];
+
+      if ([icon isKindOfClass:[NSNull class]])
+        continue;
+
+      intersect = NSIntersectionRect(selectionRect,
+                                     [self frameOfIcon:icon
+                                                inSlot:SlotFromIndex(slotsWide, i)]);
+      if (intersect.size.width == 0)
+        continue;
+
+      [sel addObject:icon];
+    }
   }
 
   if ([sel count] > 0 || allowsEmptySelection == YES) {
@@ -1196,9 +1471,11 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 
 - (void)iconClicked:sender
 {
-  if (selectable) {
-    selectedIconSlot = [self slotForIcon:sender];
-    [self updateSelectionWithIcon:sender modifierFlags:[sender modifierFlags]];
+  id entry = [self entryOfIcon:sender];
+
+  if (selectable && entry != nil) {
+    selectedIconSlot = [self slotForIcon:entry];
+    [self updateSelectionWithIcon:entry modifierFlags:[sender modifierFlags]];
   }
   
   if (action != NULL && target != nil) {
@@ -1210,9 +1487,16 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 
 - (void)iconDoubleClicked:sender
 {
-  if (selectable) {
-    selectedIconSlot = [self slotForIcon:sender];
-    [self updateSelectionWithIcon:sender modifierFlags:[sender modifierFlags]];
+  id       entry = [self entryOfIcon:sender];
+  unsigned flags = 0;
+
+  // Items come from -keyDown:
+  if ([sender isKindOfClass:[NXTIcon class]]) {
+    flags = [sender modifierFlags];
+  }
+  if (selectable && entry != nil) {
+    selectedIconSlot = [self slotForIcon:entry];
+    [self updateSelectionWithIcon:entry modifierFlags:flags];
   }
   
   if (doubleAction != NULL && target != nil) {
@@ -1383,6 +1667,13 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     return;
   }
 
+  if (isVirtualized) {
+    [self hideIconsInRange:shownSlots exceptIn:NSMakeRange(0, 0)];
+    shownSlots = NSMakeRange(0, 0);
+    [self tileIcons];
+    return;
+  }
+
   for (i = 0, n = [icons count]; i<n; i++) {
     NXTIcon     *icon = [icons objectAtIndex:i];
     NXTIconSlot slot;
@@ -1453,6 +1744,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 {
   NXTIconSelectionMode mode;
   SEL                 shouldSelectIconsSEL;
+  NXTIcon             *shownIcon;
 
   // if passed a nil argument, assume as if it were an empty set
   if (someIcons == nil) {
@@ -1460,6 +1752,18 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     selectedIconSlot.x = -1;
     selectedIconSlot.y = -1;
   }
+  // Icons the receiver made stand for their items
+  else if (isVirtualized) {
+    NSMutableSet *entries = [NSMutableSet setWithCapacity:[someIcons count]];
+    id           entry;
+
+    for (id icon in someIcons) {
+      if ((entry = [self entryOfIcon:icon]) != nil) {
+        [entries addObject:entry];
+      }
+    }
+    someIcons = entries;
+  }
 
   if (flags & NSShiftKeyMask) {
     mode = NXTIconSelectionAdditiveMode;
@@ -1495,14 +1799,14 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     }
     else {
       for (NXTIcon *icon in selectedIcons) {
-        if (icon && [icon isKindOfClass:[NXTIcon class]]) {
+        if (icon && ![icon isKindOfClass:[NSNull class]]) {
           [icon deselect:self];
         }
       }
       [selectedIcons removeAllObjects];
       
       for (NXTIcon *icon in someIcons) {
-        if (icon && [icon isKindOfClass:[NXTIcon class]]) {
+        if (icon && ![icon isKindOfClass:[NSNull class]]) {
           [icon select:self];
           [selectedIcons addObject:icon];
         }
@@ -1511,7 +1815,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
   }
   else {
     for (NXTIcon *icon in selectedIcons) {
-      if (icon && [icon isKindOfClass:[NXTIcon class]]) {
+      if (icon && ![icon isKindOfClass:[NSNull class]]) {
         [icon deselect:nil];
       }
     }
@@ -1519,7 +1823,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
 
     if ([someIcons count] == 1) {
       NXTIcon *icon = [someIcons anyObject];
-      if (icon && [icon isKindOfClass:[NXTIcon class]]) {
+      if (icon && ![icon isKindOfClass:[NSNull class]]) {
         [icon select:nil];
         [selectedIcons addObject:icon];
       }
@@ -1541,7 +1845,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     minSelectedIconSlot = NXTMakeIconSlot(INT_MAX,INT_MAX);
     maxSelectedIconSlot = NXTMakeIconSlot(0,0);
     for (NXTIcon *icon in selectedIcons) {
-      if (icon && [icon isKindOfClass:[NXTIcon class]]) {
+      if (icon && ![icon isKindOfClass:[NSNull class]]) {
         newSlot = [self slotForIcon:icon];
         if (newSlot.y < lastSlot.y || newSlot.x < lastSlot.x) {
           selectedIconSlot = newSlot;
@@ -1558,7 +1862,10 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
         else if (newSlot.y == minSelectedIconSlot.y && newSlot.x < minSelectedIconSlot.x) {
           minSelectedIconSlot = newSlot;
         }
-        r = NSUnionRect(r, NSUnionRect([icon frame], [[icon label] frame]));
+        r = NSUnionRect(r, [self frameOfIcon:icon inSlot:newSlot]);
+        if ((shownIcon = [self shownIconOfEntry:icon]) != nil) {
+          r = NSUnionRect(r, [[shownIcon label] frame]);
+        }
       }
     }
     // NSLog(@"[NXTIconView] top left slot: (%i, %i) bottom right: (%i, %i)",
@@ -1569,7 +1876,8 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     if (minOldSlot.y >= minSelectedIconSlot.y) { // Shift+UpArrow or UpArrow
       // NSLog(@"===>>> Up");
       if (r.size.height > f.size.height) {
-        r.origin.y = [[self iconInSlot:minSelectedIconSlot] frame].origin.y;
+        r.origin.y = [self frameOfIcon:[self iconInSlot:minSelectedIconSlot]
+                                inSlot:minSelectedIconSlot].origin.y;
         r.size.height = f.size.height;
       }
       if (r.origin.y < slotSize.height) { // first row
@@ -1580,7 +1888,7 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
       // NSLog(@"===>>> Down");
       if (maxSelectedIconSlot.y == slotsTall-1) {
         NXTIcon *icon = [self iconInSlot:maxSelectedIconSlot];
-        r.origin.y = [icon frame].origin.y;
+        r.origin.y = [self frameOfIcon:icon inSlot:maxSelectedIconSlot].origin.y;
         r.size.height = slotSize.height + 5;
       }
       if (r.size.height > f.size.height) {
@@ -1589,7 +1897,8 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
     }
     else { // single icon click, End - last row
       // NSLog(@"===>>> Single Icon");
-      r.origin.y = [[self iconInSlot:maxSelectedIconSlot] frame].origin.y;
+      r.origin.y = [self frameOfIcon:[self iconInSlot:maxSelectedIconSlot]
+                              inSlot:maxSelectedIconSlot].origin.y;
       r.size.height = slotSize.height;
     }
     
@@ -1607,5 +1916,274 @@ static inline NXTIconSlot SlotFromIndex(unsigned slotsWide, unsigned i)
   }
 }
 
+- (void)rebuildIndex
+{
+  Class      nullClass = [NSNull class];
+  NSUInteger i, n;
+
+  NSResetMapTable(iconIndexes);
+  NSResetMapTable(labelIndexes);
+  hasSameLabels = NO;
+
+  for (i = 0, n = [icons count]; i < n; i++) {
+    NXTIcon *icon = [icons objectAtIndex:i];
+
+    if ([icon isKindOfClass:nullClass]) {
+      continue;
+    }
+    NSMapInsert(iconIndexes, icon, (void *)(i + 1));
+    [self indexLabelOfIcon:icon atIndex:i];
+  }
+
+  isIndexValid = YES;
+}
+
+- (void)indexLabelOfIcon:(id)anIcon
+                 atIndex:(NSUInteger)index
+{
+  NSString   *label = [anIcon labelString];
+  NSUInteger other;
+
+  if (label == nil) {
+    return;
+  }
+
+  other = (NSUInteger)NSMapGet(labelIndexes, label);
+  if (other == 0 || other > index + 1) {
+    NSMapInsert(labelIndexes, label, (void *)(index + 1));
+  }
+  if (other != 0 && other != index + 1) {
+    hasSameLabels = YES;
+  }
+}
+
+- (NSUInteger)indexOfIcon:(id)anIcon
+{
+  NSUInteger i;
+
+  if (anIcon == nil) {
+    return NSNotFound;
+  }
+  if (isIndexValid == NO) {
+    [self rebuildIndex];
+  }
+
+  i = (NSUInteger)NSMapGet(iconIndexes, anIcon);
+
+  return (i == 0) ? NSNotFound : i - 1;
+}
+
+- (NSRect)frameOfIcon:(id)anIcon
+               inSlot:(NXTIconSlot)aSlot
+{
+  NXTIcon *shownIcon;
+  NSRect  frame;
+  NSPoint p;
+
+  if (anIcon == nil) {
+    return NSZeroRect;
+  }
+  if ((shownIcon = [self shownIconOfEntry:anIcon]) != nil) {
+    return [shownIcon frame];
+  }
+
+  // As -[NXTIcon putIntoView:atPoint:] would place it
+  p = PointForSlot(slotSize, aSlot);
+  frame.size = isVirtualized ? shownIconSize : [anIcon iconSize];
+  frame.origin.x = p.x - roundf(frame.size.width / 2);
+  frame.origin.y = p.y - roundf((frame.size.height + labelHeight) / 2);
+
+  return frame;
+}
+
+- (id)entryOfIcon:(id)anIcon
+{
+  if (isVirtualized && [anIcon isKindOfClass:[NXTIcon class]]) {
+    return NSMapGet(iconItems, anIcon);
+  }
+  return anIcon;
+}
+
+- (NXTIcon *)shownIconOfEntry:(id)anEntry
+{
+  if (isVirtualized) {
+    return NSMapGet(itemIcons, anEntry);
+  }
+  return ([anEntry superview] == self) ? anEntry : nil;
+}
+
+- (NSRange)slotsToShow
+{
+  NSRect     r;
+  NSUInteger firstRow, lastRow;
+
+  if (slotsWide == 0 || slotSize.height <= 0) {
+    return NSMakeRange(0, 0);
+  }
+
+  if ([self enclosingScrollView] != nil) {
+    r = [self visibleRect];
+  }
+  else {
+    r = [self bounds];
+  }
+  // A page above and below
+  r = NSInsetRect(r, 0, -r.size.height);
+
+  firstRow = (NSMinY(r) > 0) ? floorf(NSMinY(r) / slotSize.height) : 0;
+  lastRow = (NSMaxY(r) > 0) ? ceilf(NSMaxY(r) / slotSize.height) : 0;
+  if (lastRow <= firstRow) {
+    return NSMakeRange(0, 0);
+  }
+
+  return NSMakeRange(firstRow * slotsWide, (lastRow - firstRow) * slotsWide);
+}
+
+- (void)tileIcons
+{
+  NSRange    slots = [self slotsToShow];
+  NSUInteger i, n;
+
+  [self hideIconsInRange:shownSlots exceptIn:slots];
+
+  n = MIN(NSMaxRange(slots), [icons count]);
+  for (i = slots.location; i < n; i++) {
+    if (!NSLocationInRange(i, shownSlots)) {
+      [self showIconAtIndex:i];
+    }
+  }
+
+  shownSlots = slots;
+}
+
+- (void)showIconAtIndex:(NSUInteger)index
+{
+  NXTIconItem *item = [icons objectAtIndex:index];
+  NXTIcon     *icon;
+
+  if ([item isKindOfClass:[NSNull class]] ||
+      NSMapGet(itemIcons, item) != NULL) {
+    return;
+  }
+
+  if ([iconPool count] > 0) {
+    icon = [[iconPool lastObject] retain];
+    [iconPool removeLastObject];
+  }
+  else {
+    icon = [[iconClass alloc] init];
+    [icon setTarget:self];
+    [icon setAction:@selector(iconClicked:)];
+    [icon setDragAction:@selector(iconDragged:event:)];
+    [icon setDoubleAction:@selector(iconDoubleClicked:)];
+  }
+  NSMapInsert(itemIcons, item, icon);
+  NSMapInsert(iconItems, icon, item);
+  [icon release];
+
+  [icon setMaximumCollapsedLabelWidth:
+          slotSize.width - maximumCollapsedLabelWidthSpace];
+  [self setUpIcon:icon withItem:item];
+  if ([delegate respondsToSelector:@selector(iconView:willShowIcon:forItem:)]) {
+    [delegate iconView:self willShowIcon:icon forItem:item];
+  }
+
+  [icon putIntoView:self
+            atPoint:PointForSlot(slotSize, SlotFromIndex(slotsWide, index))];
+  shownIconSize = [icon iconSize];
+  labelHeight = [[icon shortLabel] frame].size.height;
+}
+
+- (void)hideIcon:(id)anEntry
+{
+  NXTIcon *icon;
+
+  if (isVirtualized == NO) {
+    [anEntry removeFromSuperview];
+    return;
+  }
+
+  icon = NSMapGet(itemIcons, anEntry);
+  if (icon == nil) {
+    return;
+  }
+
+  [icon retain];
+  NSMapRemove(itemIcons, anEntry);
+  NSMapRemove(iconItems, icon);
+  [icon removeFromSuperview];
+  if ([iconPool count] < ICON_POOL_SIZE) {
+    [iconPool addObject:icon];
+  }
+  [icon release];
+}
+
+- (void)hideIconsInRange:(NSRange)range
+                exceptIn:(NSRange)keepRange
+{
+  NSResponder *responder = [[self window] firstResponder];
+  Class       nullClass = [NSNull class];
+  NSUInteger  i, n;
+
+  n = MIN(NSMaxRange(range), [icons count]);
+  for (i = range.location; i < n; i++) {
+    NXTIconItem *item;
+    NXTIcon     *icon;
+
+    if (NSLocationInRange(i, keepRange)) {
+      continue;
+    }
+    item = [icons objectAtIndex:i];
+    if ([item isKindOfClass:nullClass] ||
+        (icon = NSMapGet(itemIcons, item)) == nil) {
+      continue;
+    }
+    // Leave the icon being renamed alone
+    if (responder != nil && responder == (NSResponder *)[icon label]) {
+      continue;
+    }
+    [self hideIcon:item];
+  }
+}
+
+- (void)setUpIcon:(NXTIcon *)anIcon
+         withItem:(NXTIconItem *)anItem
+{
+  if (![[anIcon labelString] isEqualToString:[anItem labelString]]) {
+    [anIcon setLabelString:[anItem labelString]];
+  }
+  if ([anIcon iconImage] != [anItem iconImage]) {
+    [anIcon setIconImage:[anItem iconImage]];
+  }
+  if ([anIcon isSelected] != [anItem isSelected]) {
+    [anIcon setSelected:[anItem isSelected]];
+  }
+  if ([anIcon isDimmed] != [anItem isDimmed]) {
+    [anIcon setDimmed:[anItem isDimmed]];
+  }
+}
+
+- (void)observeClipView:(NSView *)aView
+{
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+
+  [nc removeObserver:self
+                name:NSViewBoundsDidChangeNotification
+              object:nil];
+
+  if (isVirtualized && [aView isKindOfClass:[NSClipView class]]) {
+    [aView setPostsBoundsChangedNotifications:YES];
+    [nc addObserver:self
+           selector:@selector(clipViewBoundsDidChange:)
+               name:NSViewBoundsDidChangeNotification
+             object:aView];
+  }
+}
+
+- (void)clipViewBoundsDidChange:(NSNotification *)aNotif
+{
+  [self tileIcons];
+}
+
 @end
 
@@ -0,0 +1,293 @@
+/* -*- mode: objc -*- */
+//
+// Project: NEXTSPACE - DesktopKit framework
+//
+// Copyright (C) 2014-2019 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Fills an icon view in a scroll view with icons and scrolls it from top
+// to bottom a page at a time, once with every icon in the view and once
+// virtualized with items, then looks every icon or item up by its label.
+// At every page the icons the virtualized view shows for its items are
+// compared with those of the other view: they must be at the same place.
+//
+// The view with every icon in it gets at most PLAIN_COUNT icons, the
+// virtualized view gets [icon count] items (50000 by default).
+//
+// usage: iconviewbench [icon count]
+//
+// Exits with 1 if any result differs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#import <AppKit/AppKit.h>
+#import <DesktopKit/NXTIcon.h>
+#import <DesktopKit/NXTIconItem.h>
+#import <DesktopKit/NXTIconView.h>
+
+#define PLAIN_COUNT 5000  // icons put into the view all at once
+
+typedef struct {
+  double fill;
+  double scroll;
+  double lookup;
+  int    pages;
+  int    maxSubviews;
+} Times;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0E9;
+}
+
+static NSArray *makeIcons(int count)
+{
+  NSMutableArray *icons = [NSMutableArray arrayWithCapacity:count];
+  NXTIcon        *icon;
+  int            i;
+
+  for (i = 0; i < count; i++) {
+    icon = [[NXTIcon alloc] initWithFrame:NSMakeRect(0, 0, 64, 64)];
+    [icon setLabelString:[NSString stringWithFormat:@"file%05i.jpg", i]];
+    [icons addObject:icon];
+    [icon release];
+  }
+
+  return icons;
+}
+
+static NSArray *makeItems(int count)
+{
+  NSMutableArray *items = [NSMutableArray arrayWithCapacity:count];
+  NXTIconItem    *item;
+  int            i;
+
+  for (i = 0; i < count; i++) {
+    item = [[NXTIconItem alloc]
+             initWithLabelString:[NSString stringWithFormat:@"file%05i.jpg", i]
+                       iconImage:nil];
+    [items addObject:item];
+    [item release];
+  }
+
+  return items;
+}
+
+static NXTIconView *makeIconView(NSWindow *window, BOOL isVirtualized)
+{
+  NSScrollView *scrollView;
+  NXTIconView  *iconView;
+
+  scrollView = [[NSScrollView alloc]
+                 initWithFrame:[[window contentView] bounds]];
+  [scrollView setHasVerticalScroller:YES];
+  [scrollView setHasHorizontalScroller:NO];
+  [window setContentView:scrollView];
+  [scrollView release];
+
+  iconView = [[NXTIconView alloc] initSlotsWide:5];
+  [iconView setVirtualized:isVirtualized];
+  [iconView setAutoAdjustsToFitIcons:YES];
+  [scrollView setDocumentView:iconView];
+  [iconView setFrame:NSMakeRect(0, 0,
+                                [[scrollView contentView] frame].size.width,
+                                0)];
+  [iconView setAutoresizingMask:(NSViewWidthSizable|NSViewHeightSizable)];
+  [iconView release];
+
+  return iconView;
+}
+
+static void scrollTo(NXTIconView *iconView, CGFloat y)
+{
+  NSScrollView *scrollView = [iconView enclosingScrollView];
+  NSClipView   *clipView = [scrollView contentView];
+
+  [clipView scrollToPoint:[clipView constrainScrollPoint:NSMakePoint(0, y)]];
+  [scrollView reflectScrolledClipView:clipView];
+}
+
+// Icons of `plainView' seen at its visible rectangle must be shown by
+// items of `iconView' with the same frames.
+static int compareVisibleIcons(NXTIconView *plainView, NXTIconView *iconView)
+{
+  NSRect      visibleRect = [plainView visibleRect];
+  NSArray     *plainIcons = [plainView icons];
+  NSArray     *items = [iconView items];
+  NXTIcon     *plainIcon, *icon;
+  NXTIconItem *item;
+  int         failed = 0;
+  NSUInteger  i;
+
+  for (i = 0; i < [plainIcons count] && i < [items count]; i++) {
+    plainIcon = [plainIcons objectAtIndex:i];
+    if (!NSIntersectsRect([plainIcon frame], visibleRect))
+      continue;
+
+    item = [items objectAtIndex:i];
+    icon = [iconView iconOfItem:item];
+    if (icon == nil || [icon superview] != iconView) {
+      printf("  %s is not shown at y=%.0f\n",
+             [[item labelString] cString], visibleRect.origin.y);
+      failed = 1;
+    }
+    else if (!NSEqualRects([icon frame], [plainIcon frame])) {
+      printf("  %s is at %s, should be at %s\n",
+             [[icon labelString] cString],
+             [NSStringFromRect([icon frame]) cString],
+             [NSStringFromRect([plainIcon frame]) cString]);
+      failed = 1;
+    }
+  }
+
+  return failed;
+}
+
+// Icons or items, whichever the view holds
+static int lookUpIcons(NXTIconView *iconView, NSArray *icons)
+{
+  id          icon;
+  NXTIconSlot slot;
+  unsigned    slotsWide = [iconView slotsWide];
+  int         failed = 0;
+  NSUInteger  i;
+
+  for (i = 0; i < [icons count]; i++) {
+    icon = [icons objectAtIndex:i];
+    if ([iconView iconWithLabelString:[icon labelString]] != icon) {
+      printf("  %s not found by its label\n", [[icon labelString] cString]);
+      failed = 1;
+    }
+    slot = [iconView slotForIcon:icon];
+    if (slot.x != (int)(i % slotsWide) || slot.y != (int)(i / slotsWide)) {
+      printf("  %s is in slot %i.%i\n",
+             [[icon labelString] cString], slot.x, slot.y);
+      failed = 1;
+    }
+  }
+
+  return failed;
+}
+
+static int run(NSWindow *window, NSArray *icons, BOOL isVirtualized,
+               NXTIconView *plainView, Times *times)
+{
+  NXTIconView *iconView;
+  CGFloat     pageHeight, y;
+  double      t0;
+  int         failed = 0;
+
+  memset(times, 0, sizeof(Times));
+
+  iconView = makeIconView(window, isVirtualized);
+  pageHeight = [[iconView enclosingScrollView] documentVisibleRect].size.height;
+
+  t0 = now();
+  if (isVirtualized) {
+    [iconView addItems:icons];
+  }
+  else {
+    [iconView addIcons:icons];
+  }
+  times->fill = now() - t0;
+
+  t0 = now();
+  for (y = 0; y < [iconView frame].size.height; y += pageHeight) {
+    scrollTo(iconView, y);
+    times->pages++;
+    if ((int)[[iconView subviews] count] > times->maxSubviews) {
+      times->maxSubviews = [[iconView subviews] count];
+    }
+    if (plainView != nil) {
+      scrollTo(plainView, y);
+      failed |= compareVisibleIcons(plainView, iconView);
+    }
+  }
+  times->scroll = now() - t0;
+
+  t0 = now();
+  failed |= lookUpIcons(iconView, icons);
+  times->lookup = now() - t0;
+
+  return failed;
+}
+
+static void printTimes(const char *name, int count, Times *times)
+{
+  printf("%-20s %8i %10.3f %10.3f %10.2f %10i\n", name, count,
+         times->fill * 1000 / count,
+         times->scroll * 1000 / times->pages,
+         times->lookup * 1.0E6 / count,
+         times->maxSubviews);
+}
+
+int main(int argc, char **argv)
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NSWindow          *plainWindow, *window;
+  NXTIconView       *plainView;
+  NSArray           *icons;
+  Times             plainTimes, sameTimes, times;
+  int               count = (argc > 1) ? atoi(argv[1]) : 50000;
+  int               plainCount, failed = 0;
+  NSRect            frame = NSMakeRect(0, 0, 560, 480);
+
+  if (count <= 0) {
+    fprintf(stderr, "usage: %s [icon count]\n", argv[0]);
+    return 2;
+  }
+  plainCount = (count < PLAIN_COUNT) ? count : PLAIN_COUNT;
+
+  [NSApplication sharedApplication];
+  plainWindow = [[NSWindow alloc] initWithContentRect:frame
+                                            styleMask:NSTitledWindowMask
+                                              backing:NSBackingStoreBuffered
+                                                defer:YES];
+  window = [[NSWindow alloc] initWithContentRect:frame
+                                       styleMask:NSTitledWindowMask
+                                         backing:NSBackingStoreBuffered
+                                           defer:YES];
+
+  // Every icon in the view
+  icons = makeIcons(plainCount);
+  failed |= run(plainWindow, icons, NO, nil, &plainTimes);
+  plainView = [[plainWindow contentView] documentView];
+
+  // Virtualized with items of the same labels, compared page by page
+  failed |= run(window, makeItems(plainCount), YES, plainView, &sameTimes);
+
+  // Virtualized with all the items
+  failed |= run(window, makeItems(count), YES, nil, &times);
+
+  printf("%-20s %8s %10s %10s %10s %10s\n", "", "icons",
+         "ms/icon", "ms/page", "us/lookup", "subviews");
+  printTimes("all icons in view", plainCount, &plainTimes);
+  printTimes("virtualized", plainCount, &sameTimes);
+  printTimes("virtualized", count, &times);
+
+  [window release];
+  [plainWindow release];
+  [pool release];
+
+  return failed;
+}
@@ -0,0 +1,173 @@
+/* -*- mode: objc -*- */
+//
+// Project: NEXTSPACE - DesktopKit framework
+//
+// Copyright (C) 2014-2019 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Makes a directory of files without extensions - text, scripts, images,
+// archives, executables, empty and random ones - and asks NXTFileManager
+// for their MIME types twice, then compares the results with those of a
+// magic cookie opened for every file as NXTFileManager used to.
+//
+// usage: magicbench [file count]
+//
+// Exits with 1 if any result differs.
+
+#include <magic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#import <Foundation/Foundation.h>
+#import <DesktopKit/NXTFileManager.h>
+
+#define UNCACHED_COUNT 200  // files looked at the old way
+
+#define SAMPLE(s) {s, sizeof(s) - 1}
+
+static const struct {
+  const char *bytes;
+  size_t     length;
+} samples[] = {
+  SAMPLE("Plain text in a file with no extension.\n"),
+  SAMPLE("#!/bin/sh\necho hello\n"),
+  SAMPLE("\x89PNG\r\n\x1a\n\0\0\0\rIHDR\0\0\0\x01\0\0\0\x01\x08\x06\0\0\0"),
+  SAMPLE("\x1f\x8b\x08\0\0\0\0\0\0\x03"),
+  SAMPLE("\x7f" "ELF\x02\x01\x01\0\0\0\0\0\0\0\0\0\x02\0\x3e\0"),
+  SAMPLE("%PDF-1.4\n%\xe2\xe3\xcf\xd3\n"),
+  SAMPLE("<?xml version=\"1.0\"?>\n<plist version=\"1.0\"><dict/></plist>\n"),
+  SAMPLE(""),
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0E9;
+}
+
+static NSArray *makeFiles(NSString *dir, int count)
+{
+  NSMutableArray *files = [NSMutableArray arrayWithCapacity:count];
+  NSString       *path;
+  NSMutableData  *data;
+  unsigned char  *bytes;
+  int            i, j, kind;
+  int            sampleCount = sizeof(samples) / sizeof(samples[0]);
+
+  for (i = 0; i < count; i++) {
+    path = [dir stringByAppendingPathComponent:
+                  [NSString stringWithFormat:@"file%05i", i]];
+    kind = i % (sampleCount + 1);
+    if (kind < sampleCount) {
+      data = [NSMutableData dataWithBytes:samples[kind].bytes
+                                   length:samples[kind].length];
+    }
+    else {
+      data = [NSMutableData dataWithLength:512];
+      bytes = [data mutableBytes];
+      for (j = 0; j < 512; j++)
+        bytes[j] = random();
+    }
+    [data writeToFile:path atomically:NO];
+    [files addObject:path];
+  }
+
+  return files;
+}
+
+int main(int argc, char **argv)
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NXTFileManager    *fm = [NXTFileManager defaultManager];
+  NSString          *dir;
+  NSArray           *files;
+  NSMutableArray    *types;
+  NSString          *type;
+  magic_t           cookie;
+  const char        *result;
+  int               count = (argc > 1) ? atoi(argv[1]) : 10000;
+  int               i, uncached, failed = 0;
+  double            t0, tUncached, tFirst, tSecond;
+
+  srandom(1);
+  if (count <= 0) {
+    fprintf(stderr, "usage: %s [file count]\n", argv[0]);
+    return 2;
+  }
+
+  dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+          [NSString stringWithFormat:@"magicbench-%i", getpid()]];
+  [fm createDirectoryAtPath:dir
+      withIntermediateDirectories:YES
+                 attributes:nil
+                      error:NULL];
+  files = makeFiles(dir, count);
+  uncached = (count < UNCACHED_COUNT) ? count : UNCACHED_COUNT;
+
+  // A cookie for every file
+  types = [NSMutableArray array];
+  t0 = now();
+  for (i = 0; i < uncached; i++) {
+    cookie = magic_open(MAGIC_MIME_TYPE);
+    magic_load(cookie, NULL);
+    result = magic_file(cookie, [[files objectAtIndex:i] fileSystemRepresentation]);
+    [types addObject:result ? [NSString stringWithCString:result] : @""];
+    magic_close(cookie);
+  }
+  tUncached = now() - t0;
+
+  t0 = now();
+  for (i = 0; i < count; i++) {
+    @autoreleasepool {
+      type = [fm mimeTypeForFile:[files objectAtIndex:i]];
+      if (i < uncached && ![type isEqualToString:[types objectAtIndex:i]]) {
+        printf("  %s is %s, should be %s\n",
+               [[files objectAtIndex:i] fileSystemRepresentation],
+               [type cString], [[types objectAtIndex:i] cString]);
+        failed = 1;
+      }
+    }
+  }
+  tFirst = now() - t0;
+
+  t0 = now();
+  for (i = 0; i < count; i++) {
+    @autoreleasepool {
+      [fm mimeTypeForFile:[files objectAtIndex:i]];
+    }
+  }
+  tSecond = now() - t0;
+
+  printf("%-24s %8s %12s\n", "", "files", "ms per file");
+  printf("%-24s %8i %12.3f\n", "cookie per file", uncached,
+         tUncached * 1000 / uncached);
+  printf("%-24s %8i %12.3f\n", "NXTFileManager, first", count,
+         tFirst * 1000 / count);
+  printf("%-24s %8i %12.3f\n", "NXTFileManager, again", count,
+         tSecond * 1000 / count);
+  printf("cache hits %lu, misses %lu\n",
+         (unsigned long)[fm magicCacheHits],
+         (unsigned long)[fm magicCacheMisses]);
+
+  [fm removeItemAtPath:dir error:NULL];
+  [pool release];
+
+  return failed;
+}
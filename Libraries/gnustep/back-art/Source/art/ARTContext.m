@@ -51,6 +51,9 @@
   gamma = [[NSUserDefaults standardUserDefaults]
               floatForKey: @"back-art-text-gamma"];
   artcontext_setup_gamma(gamma);
+
+  artcontext_setup_simd([[[NSUserDefaults standardUserDefaults]
+                           stringForKey: @"back-art-simd"] UTF8String]);
 }
 
 + (Class) GStateClass
@@ -451,6 +451,8 @@ void artcontext_setup_draw_info(draw_info_t *di,
 	    @"Better: implement it and send a patch.)");
       exit(1);
     }
+
+  artcontext_setup_simd_draw_info(di);
 }
 
 void artcontext_setup_gamma(float gamma)
@@ -0,0 +1,257 @@
+/*
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNUstep.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <string.h>
+
+#include <Foundation/NSDebug.h>
+#include <Foundation/NSString.h>
+
+#include "blit.h"
+
+/*
+The composite functions of the 32-bit formats are replaced by the vector
+versions from blit-simd.m when the CPU has them. The functions of blit.m
+stay the reference, and are still used for the other formats and the
+operators that have no vector version.
+
+The back-art-simd default (none, sse2, avx2) lowers the level used.
+*/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && defined(__SSE2__)
+#define HAVE_BLIT_SIMD
+#include <immintrin.h>
+#endif
+
+static const char *level_names[] = {"none", "sse2", "avx2"};
+#define LEVEL_NONE 0
+#define LEVEL_SSE2 1
+#define LEVEL_AVX2 2
+
+static int simd_level = -1; /* not set up yet */
+
+
+#ifdef HAVE_BLIT_SIMD
+
+#define NPRE(r, pre) pre##_##r
+#define M2PRE(a, b) NPRE(a, b)
+#define SPRE(r) M2PRE(r, SIMD_INSTANCE)
+
+
+/* SSE2, 4 pixels at a time */
+#define SIMD_TARGET
+#define V __m128i
+#define V_WIDTH 4
+#define V_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define V_STORE(p,v) _mm_storeu_si128((__m128i *)(p), v)
+#define V_ZERO _mm_setzero_si128()
+#define V_ONES _mm_set1_epi32(-1)
+#define V_SET8(x) _mm_set1_epi8((char)(x))
+#define V_SET16(x) _mm_set1_epi16(x)
+#define V_SET32(x) _mm_set1_epi32(x)
+#define V_AND(a,b) _mm_and_si128(a, b)
+#define V_ANDNOT(a,b) _mm_andnot_si128(a, b)
+#define V_OR(a,b) _mm_or_si128(a, b)
+#define V_XOR(a,b) _mm_xor_si128(a, b)
+#define V_CMPEQ32(a,b) _mm_cmpeq_epi32(a, b)
+#define V_ADD8(a,b) _mm_add_epi8(a, b)
+#define V_ADDS8(a,b) _mm_adds_epu8(a, b)
+#define V_SUBS8(a,b) _mm_subs_epu8(a, b)
+#define V_ADD16(a,b) _mm_add_epi16(a, b)
+#define V_MUL16(a,b) _mm_mullo_epi16(a, b)
+#define V_SRL16(a,n) _mm_srli_epi16(a, n)
+#define V_SLL32(a,n) _mm_slli_epi32(a, n)
+#define V_SRL32(a,n) _mm_srli_epi32(a, n)
+#define V_UNPACKLO8(a,b) _mm_unpacklo_epi8(a, b)
+#define V_UNPACKHI8(a,b) _mm_unpackhi_epi8(a, b)
+#define V_PACKUS16(a,b) _mm_packus_epi16(a, b)
+
+#define SIMD_INSTANCE sse2_a0
+#define ALPHA_SHIFT 0
+#include "blit-simd.m"
+#undef SIMD_INSTANCE
+
+#define SIMD_INSTANCE sse2_a3
+#define ALPHA_SHIFT 24
+#include "blit-simd.m"
+#undef SIMD_INSTANCE
+
+#undef SIMD_TARGET
+#undef V
+#undef V_WIDTH
+#undef V_LOAD
+#undef V_STORE
+#undef V_ZERO
+#undef V_ONES
+#undef V_SET8
+#undef V_SET16
+#undef V_SET32
+#undef V_AND
+#undef V_ANDNOT
+#undef V_OR
+#undef V_XOR
+#undef V_CMPEQ32
+#undef V_ADD8
+#undef V_ADDS8
+#undef V_SUBS8
+#undef V_ADD16
+#undef V_MUL16
+#undef V_SRL16
+#undef V_SLL32
+#undef V_SRL32
+#undef V_UNPACKLO8
+#undef V_UNPACKHI8
+#undef V_PACKUS16
+
+
+/*
+AVX2, 8 pixels at a time. Unpacking and packing work within each 128-bit
+half, so they still give the pixels back in order.
+*/
+#define SIMD_TARGET __attribute__((target("avx2")))
+#define V __m256i
+#define V_WIDTH 8
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define V_STORE(p,v) _mm256_storeu_si256((__m256i *)(p), v)
+#define V_ZERO _mm256_setzero_si256()
+#define V_ONES _mm256_set1_epi32(-1)
+#define V_SET8(x) _mm256_set1_epi8((char)(x))
+#define V_SET16(x) _mm256_set1_epi16(x)
+#define V_SET32(x) _mm256_set1_epi32(x)
+#define V_AND(a,b) _mm256_and_si256(a, b)
+#define V_ANDNOT(a,b) _mm256_andnot_si256(a, b)
+#define V_OR(a,b) _mm256_or_si256(a, b)
+#define V_XOR(a,b) _mm256_xor_si256(a, b)
+#define V_CMPEQ32(a,b) _mm256_cmpeq_epi32(a, b)
+#define V_ADD8(a,b) _mm256_add_epi8(a, b)
+#define V_ADDS8(a,b) _mm256_adds_epu8(a, b)
+#define V_SUBS8(a,b) _mm256_subs_epu8(a, b)
+#define V_ADD16(a,b) _mm256_add_epi16(a, b)
+#define V_MUL16(a,b) _mm256_mullo_epi16(a, b)
+#define V_SRL16(a,n) _mm256_srli_epi16(a, n)
+#define V_SLL32(a,n) _mm256_slli_epi32(a, n)
+#define V_SRL32(a,n) _mm256_srli_epi32(a, n)
+#define V_UNPACKLO8(a,b) _mm256_unpacklo_epi8(a, b)
+#define V_UNPACKHI8(a,b) _mm256_unpackhi_epi8(a, b)
+#define V_PACKUS16(a,b) _mm256_packus_epi16(a, b)
+
+#define SIMD_INSTANCE avx2_a0
+#define ALPHA_SHIFT 0
+#include "blit-simd.m"
+#undef SIMD_INSTANCE
+
+#define SIMD_INSTANCE avx2_a3
+#define ALPHA_SHIFT 24
+#include "blit-simd.m"
+#undef SIMD_INSTANCE
+
+
+#define SET_FUNCS(di,x) \
+  di->composite_sover_aa = NPRE(sover_aa,x); \
+  di->composite_sover_ao = NPRE(sover_ao,x); \
+  di->composite_sin_aa = NPRE(sin_aa,x); \
+  di->composite_din_aa = NPRE(din_aa,x); \
+  di->composite_dout_aa = NPRE(dout_aa,x); \
+  di->composite_dover_aa = NPRE(dover_aa,x); \
+  di->composite_plusl_aa = NPRE(plusl_aa,x); \
+  di->composite_plusl_oa = NPRE(plusl_oa,x); \
+  di->composite_plusl_ao = NPRE(plusl_ao_oo,x); \
+  di->composite_plusl_oo = NPRE(plusl_ao_oo,x); \
+  di->composite_plusd_aa = NPRE(plusd_aa,x); \
+  di->composite_plusd_oa = NPRE(plusd_oa,x); \
+  di->composite_plusd_ao = NPRE(plusd_ao_oo,x); \
+  di->composite_plusd_oo = NPRE(plusd_ao_oo,x); \
+  di->dissolve_aa = NPRE(dissolve_aa,x); \
+  di->dissolve_ao = NPRE(dissolve_ao,x); \
+  di->dissolve_oa = NPRE(dissolve_oa,x); \
+  di->dissolve_oo = NPRE(dissolve_oo,x);
+
+#endif /* HAVE_BLIT_SIMD */
+
+
+static int cpu_level(void)
+{
+#ifdef HAVE_BLIT_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return LEVEL_AVX2;
+  return LEVEL_SSE2;
+#else
+  return LEVEL_NONE;
+#endif
+}
+
+void artcontext_setup_simd(const char *level)
+{
+  int i;
+
+  simd_level = cpu_level();
+  if (level)
+    {
+      for (i = 0; i < (int)(sizeof(level_names) / sizeof(level_names[0])); i++)
+	{
+	  if (!strcmp(level, level_names[i]))
+	    {
+	      if (i < simd_level)
+		simd_level = i;
+	      break;
+	    }
+	}
+    }
+
+  NSDebugLLog(@"back-art", @"composite functions: %s",
+	      level_names[simd_level]);
+}
+
+void artcontext_setup_simd_draw_info(draw_info_t *di)
+{
+  if (simd_level < 0)
+    artcontext_setup_simd(NULL);
+
+  if (di->bytes_per_pixel != 4 || !di->inline_alpha)
+    return;
+
+#ifdef HAVE_BLIT_SIMD
+  if (simd_level == LEVEL_AVX2)
+    {
+      if (di->inline_alpha_ofs == 0)
+	{
+	  SET_FUNCS(di, avx2_a0)
+	}
+      else
+	{
+	  SET_FUNCS(di, avx2_a3)
+	}
+    }
+  else if (simd_level == LEVEL_SSE2)
+    {
+      if (di->inline_alpha_ofs == 0)
+	{
+	  SET_FUNCS(di, sse2_a0)
+	}
+      else
+	{
+	  SET_FUNCS(di, sse2_a3)
+	}
+    }
+#endif
+}
@@ -0,0 +1,234 @@
+/*
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNUstep.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+Vector versions of the composite run functions in blit.m for the 32-bit
+formats. This file is included by blit-simd-main.m once for each
+instruction set and position of the alpha byte.
+
+Apart from alpha, all channels of a pixel go through the same formula, so
+the order of red, green and blue doesn't matter and one instance handles
+e.g. both rgba and bgra. Each function computes exactly what its blit.m
+counterpart computes, including the special cases for alpha 0 and 255 and
+the wrap around of out of range (not premultiplied) values, so results are
+bit for bit identical. tests/blitcheck.m checks this.
+
+Expected from the includer:
+  SIMD_INSTANCE, SIMD_TARGET, ALPHA_SHIFT (0 or 24), V, V_WIDTH (pixels
+  per vector) and the V_* operations on vectors.
+*/
+
+
+#define A_MASK V_SET32((int)(0xffu << ALPHA_SHIFT))
+
+
+/* the alpha of each pixel copied to all four bytes of the pixel */
+static inline SIMD_TARGET V SPRE(alpha) (V p)
+{
+  V a = V_SRL32(V_SLL32(p, 24 - ALPHA_SHIFT), 24);
+
+  a = V_OR(a, V_SLL32(a, 8));
+  return V_OR(a, V_SLL32(a, 16));
+}
+
+/* (a * b + round) >> 8 for each byte */
+static inline SIMD_TARGET V SPRE(mul) (V a, V b, int round)
+{
+  V z = V_ZERO, r = V_SET16(round);
+  V lo, hi;
+
+  lo = V_MUL16(V_UNPACKLO8(a, z), V_UNPACKLO8(b, z));
+  hi = V_MUL16(V_UNPACKHI8(a, z), V_UNPACKHI8(b, z));
+  lo = V_SRL16(V_ADD16(lo, r), 8);
+  hi = V_SRL16(V_ADD16(hi, r), 8);
+  return V_PACKUS16(lo, hi);
+}
+
+/* m ? a : b, m being all ones or all zeroes in each pixel */
+static inline SIMD_TARGET V SPRE(select) (V m, V a, V b)
+{
+  return V_OR(V_AND(m, a), V_ANDNOT(m, b));
+}
+
+/* the colors of c with the alpha of a */
+static inline SIMD_TARGET V SPRE(keep_alpha) (V c, V a)
+{
+  return SPRE(select)(A_MASK, a, c);
+}
+
+static inline SIMD_TARGET V SPRE(alpha_is) (V p, int value)
+{
+  return V_CMPEQ32(V_AND(p, A_MASK), V_SET32((int)((unsigned)value << ALPHA_SHIFT)));
+}
+
+
+/* 1 : 1 - srca */
+static inline SIMD_TARGET V SPRE(sover_aa_px) (V s, V d, V f)
+{
+  V r = V_ADD8(s, SPRE(mul)(d, V_XOR(SPRE(alpha)(s), V_ONES), 0xff));
+
+  return SPRE(select)(SPRE(alpha_is)(s, 0), d, r);
+}
+
+static inline SIMD_TARGET V SPRE(sover_ao_px) (V s, V d, V f)
+{
+  return SPRE(keep_alpha)(SPRE(sover_aa_px)(s, d, f), d);
+}
+
+/* dsta : 0 */
+static inline SIMD_TARGET V SPRE(sin_aa_px) (V s, V d, V f)
+{
+  return SPRE(mul)(s, SPRE(alpha)(d), 0xff);
+}
+
+/* 0 : srca */
+static inline SIMD_TARGET V SPRE(din_aa_px) (V s, V d, V f)
+{
+  V r = SPRE(mul)(d, SPRE(alpha)(s), 0x80);
+
+  return SPRE(select)(SPRE(alpha_is)(s, 255), d, r);
+}
+
+/* 0 : 1 - srca */
+static inline SIMD_TARGET V SPRE(dout_aa_px) (V s, V d, V f)
+{
+  V r = SPRE(mul)(d, V_XOR(SPRE(alpha)(s), V_ONES), 0x80);
+
+  return SPRE(select)(SPRE(alpha_is)(s, 0), d, r);
+}
+
+/* 1 - dsta : 1 */
+static inline SIMD_TARGET V SPRE(dover_aa_px) (V s, V d, V f)
+{
+  V r = V_ADD8(d, SPRE(mul)(s, V_XOR(SPRE(alpha)(d), V_ONES), 0x80));
+
+  r = SPRE(select)(SPRE(alpha_is)(d, 255), d, r);
+  return SPRE(select)(SPRE(alpha_is)(d, 0), s, r);
+}
+
+
+static inline SIMD_TARGET V SPRE(plusl_aa_px) (V s, V d, V f)
+{
+  return V_ADDS8(d, s);
+}
+
+static inline SIMD_TARGET V SPRE(plusl_oa_px) (V s, V d, V f)
+{
+  return V_OR(V_ADDS8(d, s), A_MASK);
+}
+
+static inline SIMD_TARGET V SPRE(plusl_ao_oo_px) (V s, V d, V f)
+{
+  return SPRE(keep_alpha)(V_ADDS8(d, s), d);
+}
+
+/* dst + src - 255 == dst - (255 - src) */
+static inline SIMD_TARGET V SPRE(plusd_aa_px) (V s, V d, V f)
+{
+  return SPRE(keep_alpha)(V_SUBS8(d, V_XOR(s, V_ONES)), V_ADDS8(d, s));
+}
+
+static inline SIMD_TARGET V SPRE(plusd_oa_px) (V s, V d, V f)
+{
+  return V_OR(V_SUBS8(d, V_XOR(s, V_ONES)), A_MASK);
+}
+
+static inline SIMD_TARGET V SPRE(plusd_ao_oo_px) (V s, V d, V f)
+{
+  return SPRE(keep_alpha)(V_SUBS8(d, V_XOR(s, V_ONES)), d);
+}
+
+
+/* f has the fraction in every byte */
+static inline SIMD_TARGET V SPRE(dissolve_aa_px) (V s, V d, V f)
+{
+  s = SPRE(mul)(s, f, 0xff);
+  return V_ADD8(s, SPRE(mul)(d, V_XOR(SPRE(alpha)(s), V_ONES), 0xff));
+}
+
+static inline SIMD_TARGET V SPRE(dissolve_ao_px) (V s, V d, V f)
+{
+  return SPRE(keep_alpha)(SPRE(dissolve_aa_px)(s, d, f), d);
+}
+
+/* an opaque source dissolved has the fraction as alpha */
+static inline SIMD_TARGET V SPRE(dissolve_oa_px) (V s, V d, V f)
+{
+  s = SPRE(keep_alpha)(SPRE(mul)(s, f, 0xff), f);
+  return V_ADD8(s, SPRE(mul)(d, V_XOR(f, V_ONES), 0xff));
+}
+
+static inline SIMD_TARGET V SPRE(dissolve_oo_px) (V s, V d, V f)
+{
+  return SPRE(keep_alpha)(SPRE(dissolve_oa_px)(s, d, f), d);
+}
+
+
+/*
+The run functions. Whole vectors are done in place; the last few pixels
+are copied to a buffer with room for a full vector.
+*/
+#define RUN(name) \
+static SIMD_TARGET void SPRE(name) (composite_run_t *c, int num) \
+{ \
+  unsigned char *s = c->src, *d = c->dst; \
+  V f = V_SET8(c->fraction); \
+\
+  for (; num >= V_WIDTH; num -= V_WIDTH) \
+    { \
+      V_STORE(d, SPRE(name##_px)(V_LOAD(s), V_LOAD(d), f)); \
+      s += V_WIDTH * 4; \
+      d += V_WIDTH * 4; \
+    } \
+  if (num) \
+    { \
+      unsigned char ts[V_WIDTH * 4], td[V_WIDTH * 4]; \
+\
+      memset(ts, 0, sizeof(ts)); \
+      memset(td, 0, sizeof(td)); \
+      memcpy(ts, s, num * 4); \
+      memcpy(td, d, num * 4); \
+      V_STORE(td, SPRE(name##_px)(V_LOAD(ts), V_LOAD(td), f)); \
+      memcpy(d, td, num * 4); \
+    } \
+}
+
+RUN(sover_aa)
+RUN(sover_ao)
+RUN(sin_aa)
+RUN(din_aa)
+RUN(dout_aa)
+RUN(dover_aa)
+RUN(plusl_aa)
+RUN(plusl_oa)
+RUN(plusl_ao_oo)
+RUN(plusd_aa)
+RUN(plusd_oa)
+RUN(plusd_ao_oo)
+RUN(dissolve_aa)
+RUN(dissolve_ao)
+RUN(dissolve_oa)
+RUN(dissolve_oo)
+
+#undef RUN
+#undef A_MASK
+#undef ALPHA_SHIFT
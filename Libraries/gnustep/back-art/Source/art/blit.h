@@ -162,5 +162,9 @@ void artcontext_setup_draw_info(draw_info_t *di,
 	int bpp);
 void artcontext_setup_gamma(float gamma);
 
+/* level is "none", "sse2" or "avx2", or NULL for the best the CPU has */
+void artcontext_setup_simd(const char *level);
+void artcontext_setup_simd_draw_info(draw_info_t *di);
+
 #endif
 
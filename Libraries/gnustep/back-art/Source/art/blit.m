@@ -40,6 +40,9 @@ than 0.5, and that's the best I can get with finite precision'. :)
 (However, should probably check whether the results here always match the
 correctly rounded correct result.)
 
+The vector versions of the 32-bit functions in blit-simd.m must give
+exactly the same results as the ones here; tests/blitcheck compares them.
+
 TODO: (optional?) proper gamma handling?
 
 
@@ -99,6 +99,10 @@
   unsigned int cachedGlyph[CACHE_SIZE];
   NSSize cachedSize[CACHE_SIZE];
 
+  /* Copies of the glyphs drawn through the sbit cache, and the text runs
+     drawn with them. Created on the first draw. */
+  struct ft_glyph_atlas_s *atlas;
+
   CGFloat lineHeight;
 }
 @end
@@ -23,6 +23,8 @@
 */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #import <Foundation/NSObject.h>
 #import <Foundation/NSArray.h>
@@ -79,6 +81,493 @@ static FTC_ImageCache ftc_imagecache;
 static FTC_SBitCache ftc_sbitcache;
 static FTC_CMapCache ftc_cmapcache;
 
+
+/*
+Glyph atlas and run cache.
+
+In the sbit path (screen fonts drawn unscaled and unrotated) glyphs are
+drawn from the atlas of the font: a copy of their coverage mask and
+metrics, packed in pages, made the first time each glyph is drawn. Drawing
+a glyph again costs a hash lookup instead of an FTC_SBitCache_Lookup(), and
+the cache manager can't flush the masks from under us.
+
+Text drawn without deltas is also kept as a run: the atlas entries of its
+glyphs and their offsets, so drawing the same text again skips utf8
+decoding and cmap lookups and is just a loop of blits. Glyph images in the
+sbit path don't depend on the transform, so a run is found by the font
+(each font has its own runs) and the text.
+
+The atlas of a font is emptied, runs included, when it would grow over
+ATLAS_MAX_BYTES. The back-art-glyph-cache-statistics default logs hit
+rates every 1000 draws.
+*/
+
+#define ATLAS_PAGE_SIZE 65536
+#define ATLAS_MAX_BYTES (1024 * 1024)
+#define RUN_CACHE_SIZE 64
+#define RUN_MAX_KEY 1024
+
+#define RUN_STRING 1
+#define RUN_GLYPHS 2
+
+typedef struct
+{
+  unsigned int glyph;
+  short left, top;
+  unsigned short width, height, pitch;
+  short xadvance;
+  unsigned char format; /* 0 for glyphs without an image */
+  unsigned char *buffer;
+} atlas_glyph_t;
+
+typedef struct
+{
+  int entry;
+  int x;
+} run_glyph_t;
+
+typedef struct
+{
+  unsigned int hash;
+  int kind;
+  int key_length;
+  unsigned char *key; /* NULL for an unused slot */
+  int count;
+  run_glyph_t *glyphs;
+} glyph_run_t;
+
+struct ft_glyph_atlas_s
+{
+  atlas_glyph_t *entries;
+  int num_entries, max_entries;
+
+  int *table; /* entry index + 1, 0 for a free slot */
+  int table_size;
+
+  unsigned char **pages;
+  int num_pages;
+  unsigned char *free_ptr;
+  int page_free;
+  size_t bytes;
+  unsigned int generation; /* incremented when emptied */
+
+  glyph_run_t runs[RUN_CACHE_SIZE];
+};
+typedef struct ft_glyph_atlas_s ft_glyph_atlas_t;
+
+/* the run of the text being drawn */
+typedef struct
+{
+  int recording;
+  unsigned int generation;
+  int count, max;
+  run_glyph_t *glyphs;
+} run_builder_t;
+
+static BOOL glyph_cache_statistics;
+
+static struct
+{
+  unsigned long draws;
+  unsigned long glyph_lookups, glyph_hits;
+  unsigned long run_lookups, run_hits;
+  unsigned long flushes;
+} glyph_cache_stats;
+
+
+static void atlas_empty(ft_glyph_atlas_t *atlas)
+{
+  int i;
+
+  for (i = 0; i < atlas->num_pages; i++)
+    free(atlas->pages[i]);
+  free(atlas->pages);
+  atlas->pages = NULL;
+  atlas->num_pages = 0;
+  atlas->free_ptr = NULL;
+  atlas->page_free = 0;
+  atlas->bytes = 0;
+
+  atlas->num_entries = 0;
+  if (atlas->table)
+    memset(atlas->table, 0, atlas->table_size * sizeof(int));
+
+  for (i = 0; i < RUN_CACHE_SIZE; i++)
+    {
+      free(atlas->runs[i].key);
+      free(atlas->runs[i].glyphs);
+    }
+  memset(atlas->runs, 0, sizeof(atlas->runs));
+
+  atlas->generation++;
+}
+
+static void atlas_destroy(ft_glyph_atlas_t *atlas)
+{
+  if (!atlas)
+    return;
+
+  atlas_empty(atlas);
+  free(atlas->entries);
+  free(atlas->table);
+  free(atlas);
+}
+
+static unsigned char *atlas_alloc(ft_glyph_atlas_t *atlas, int size)
+{
+  unsigned char **pages, *p;
+  int page_size;
+
+  if (size <= atlas->page_free)
+    {
+      p = atlas->free_ptr;
+      atlas->free_ptr += size;
+      atlas->page_free -= size;
+      return p;
+    }
+
+  pages = realloc(atlas->pages, (atlas->num_pages + 1) * sizeof(unsigned char *));
+  if (!pages)
+    return NULL;
+  atlas->pages = pages;
+
+  /* a glyph larger than a page gets its own */
+  page_size = size > ATLAS_PAGE_SIZE ? size : ATLAS_PAGE_SIZE;
+  p = malloc(page_size);
+  if (!p)
+    return NULL;
+  atlas->pages[atlas->num_pages++] = p;
+  atlas->bytes += page_size;
+
+  if (page_size == ATLAS_PAGE_SIZE)
+    {
+      atlas->free_ptr = p + size;
+      atlas->page_free = ATLAS_PAGE_SIZE - size;
+    }
+  return p;
+}
+
+static inline unsigned int glyph_hash(unsigned int glyph)
+{
+  return glyph * 2654435761u;
+}
+
+static BOOL atlas_grow_table(ft_glyph_atlas_t *atlas)
+{
+  int size = atlas->table_size ? atlas->table_size * 2 : 256;
+  int *table;
+  int i, j;
+
+  table = calloc(size, sizeof(int));
+  if (!table)
+    return NO;
+
+  for (i = 0; i < atlas->num_entries; i++)
+    {
+      j = glyph_hash(atlas->entries[i].glyph) & (size - 1);
+      while (table[j])
+        j = (j + 1) & (size - 1);
+      table[j] = i + 1;
+    }
+
+  free(atlas->table);
+  atlas->table = table;
+  atlas->table_size = size;
+  return YES;
+}
+
+/*
+Returns the index of the glyph in the atlas, adding it if needed, or -1
+with *error set. Adding a glyph may empty the atlas.
+*/
+static int atlas_lookup(ft_glyph_atlas_t *atlas, FTC_ImageType type,
+                        unsigned int glyph, FT_Error *error)
+{
+  FTC_SBit sbit;
+  atlas_glyph_t *e;
+  int i, j, size, y;
+
+  glyph_cache_stats.glyph_lookups++;
+  if (atlas->table_size)
+    {
+      for (j = glyph_hash(glyph) & (atlas->table_size - 1); atlas->table[j];
+           j = (j + 1) & (atlas->table_size - 1))
+        {
+          i = atlas->table[j] - 1;
+          if (atlas->entries[i].glyph == glyph)
+            {
+              glyph_cache_stats.glyph_hits++;
+              return i;
+            }
+        }
+    }
+
+  if ((*error = FTC_SBitCache_Lookup(ftc_sbitcache, type, glyph, &sbit, NULL)))
+    return -1;
+
+  size = sbit->buffer ? abs(sbit->pitch) * sbit->height : 0;
+  if (atlas->bytes + size > ATLAS_MAX_BYTES)
+    {
+      atlas_empty(atlas);
+      glyph_cache_stats.flushes++;
+    }
+
+  if ((atlas->num_entries + 1) * 2 > atlas->table_size
+      && !atlas_grow_table(atlas))
+    goto no_memory;
+
+  if (atlas->num_entries == atlas->max_entries)
+    {
+      int max = atlas->max_entries ? atlas->max_entries * 2 : 128;
+      atlas_glyph_t *entries;
+
+      entries = realloc(atlas->entries, max * sizeof(atlas_glyph_t));
+      if (!entries)
+        goto no_memory;
+      atlas->entries = entries;
+      atlas->max_entries = max;
+    }
+
+  i = atlas->num_entries;
+  e = &atlas->entries[i];
+  e->glyph = glyph;
+  e->left = sbit->left;
+  e->top = sbit->top;
+  e->width = sbit->width;
+  e->height = sbit->height;
+  e->pitch = abs(sbit->pitch);
+  e->xadvance = sbit->xadvance;
+  e->format = 0;
+  e->buffer = NULL;
+
+  if (size)
+    {
+      e->buffer = atlas_alloc(atlas, size);
+      if (!e->buffer)
+        goto no_memory;
+      for (y = 0; y < sbit->height; y++)
+        memcpy(e->buffer + y * e->pitch, sbit->buffer + y * sbit->pitch,
+               e->pitch);
+      e->format = sbit->format;
+    }
+
+  for (j = glyph_hash(glyph) & (atlas->table_size - 1); atlas->table[j];
+       j = (j + 1) & (atlas->table_size - 1))
+    ;
+  atlas->table[j] = i + 1;
+  atlas->num_entries++;
+  return i;
+
+no_memory:
+  *error = FT_Err_Out_Of_Memory;
+  return -1;
+}
+
+static void atlas_blit(atlas_glyph_t *e, int x, int y, int x1, int y1,
+                       unsigned char *buf, int bpl,
+                       unsigned char *abuf, int abpl,
+                       unsigned char r, unsigned char g, unsigned char b,
+                       unsigned char alpha, draw_info_t *di)
+{
+  int gx = x + e->left, gy = y - e->top;
+  int sbpl = e->pitch;
+  int sx = e->width, sy = e->height;
+  const unsigned char *src = e->buffer;
+  unsigned char *dst = buf;
+  unsigned char *adst = abuf;
+  int src_ofs = 0;
+
+  if (gy < 0)
+    {
+      sy += gy;
+      src -= sbpl * gy;
+      gy = 0;
+    }
+  else if (gy > 0)
+    {
+      dst += bpl * gy;
+      if (adst)
+        adst += abpl * gy;
+    }
+
+  sy += gy;
+  if (sy > y1)
+    sy = y1;
+
+  if (gx < 0)
+    {
+      sx += gx;
+      if (e->format == ft_pixel_mode_mono)
+        {
+          src -= gx / 8;
+          src_ofs = (-gx) & 7;
+        }
+      else
+        {
+          src -= gx;
+        }
+      gx = 0;
+    }
+  else if (gx > 0)
+    {
+      dst += DI.bytes_per_pixel * gx;
+      if (adst)
+        adst += gx;
+    }
+
+  sx += gx;
+  if (sx > x1)
+    sx = x1;
+  sx -= gx;
+
+  if (sx <= 0)
+    return;
+
+  if (e->format == ft_pixel_mode_grays)
+    {
+      if (adst)
+        for (; gy < sy; gy++, src += sbpl, dst += bpl, adst += abpl)
+          RENDER_BLIT_ALPHA_A(dst, adst, src, r, g, b, alpha, sx);
+      else if (alpha >= 255)
+        for (; gy < sy; gy++, src += sbpl, dst += bpl)
+          RENDER_BLIT_ALPHA_OPAQUE(dst, src, r, g, b, sx);
+      else
+        for (; gy < sy; gy++, src += sbpl, dst += bpl)
+          RENDER_BLIT_ALPHA(dst, src, r, g, b, alpha, sx);
+    }
+  else if (e->format == ft_pixel_mode_mono)
+    {
+      if (adst)
+        for (; gy < sy; gy++, src += sbpl, dst += bpl, adst += abpl)
+          RENDER_BLIT_MONO_A(dst, adst, src, src_ofs, r, g, b, alpha, sx);
+      else if (alpha >= 255)
+        for (; gy < sy; gy++, src += sbpl, dst += bpl)
+          RENDER_BLIT_MONO_OPAQUE(dst, src, src_ofs, r, g, b, sx);
+      else
+        for (; gy < sy; gy++, src += sbpl, dst += bpl)
+          RENDER_BLIT_MONO(dst, src, src_ofs, r, g, b, alpha, sx);
+    }
+  else
+    {
+      NSLog(@"unhandled font bitmap format %i", e->format);
+    }
+}
+
+static unsigned int run_hash(int kind, const unsigned char *key, int length)
+{
+  unsigned int h = 2166136261u ^ kind;
+
+  for (; length; length--, key++)
+    h = (h ^ *key) * 16777619u;
+  return h;
+}
+
+static glyph_run_t *atlas_find_run(ft_glyph_atlas_t *atlas, int kind,
+                                   const unsigned char *key, int length,
+                                   unsigned int hash)
+{
+  glyph_run_t *run = &atlas->runs[hash % RUN_CACHE_SIZE];
+
+  glyph_cache_stats.run_lookups++;
+  if (run->key && run->hash == hash && run->kind == kind
+      && run->key_length == length && !memcmp(run->key, key, length))
+    {
+      glyph_cache_stats.run_hits++;
+      return run;
+    }
+  return NULL;
+}
+
+static void atlas_draw_run(ft_glyph_atlas_t *atlas, glyph_run_t *run,
+                           int x, int y, int x1, int y1,
+                           unsigned char *buf, int bpl,
+                           unsigned char *abuf, int abpl,
+                           unsigned char r, unsigned char g, unsigned char b,
+                           unsigned char alpha, draw_info_t *di)
+{
+  run_glyph_t *rg = run->glyphs;
+  int i;
+
+  for (i = 0; i < run->count; i++, rg++)
+    atlas_blit(&atlas->entries[rg->entry], x + rg->x, y, x1, y1,
+               buf, bpl, abuf, abpl, r, g, b, alpha, di);
+}
+
+static void run_builder_start(run_builder_t *rb, ft_glyph_atlas_t *atlas,
+                              BOOL record, int key_length)
+{
+  rb->recording = record && key_length <= RUN_MAX_KEY;
+  rb->generation = atlas->generation;
+  rb->count = rb->max = 0;
+  rb->glyphs = NULL;
+}
+
+static void run_builder_add(run_builder_t *rb, int entry, int x)
+{
+  if (!rb->recording)
+    return;
+
+  if (rb->count == rb->max)
+    {
+      int max = rb->max ? rb->max * 2 : 32;
+      run_glyph_t *glyphs;
+
+      glyphs = realloc(rb->glyphs, max * sizeof(run_glyph_t));
+      if (!glyphs)
+        {
+          rb->recording = 0;
+          return;
+        }
+      rb->glyphs = glyphs;
+      rb->max = max;
+    }
+  rb->glyphs[rb->count].entry = entry;
+  rb->glyphs[rb->count].x = x;
+  rb->count++;
+}
+
+/* keeps the recorded run, unless the atlas was emptied while drawing it */
+static void run_builder_finish(run_builder_t *rb, ft_glyph_atlas_t *atlas,
+                               int kind, const unsigned char *key, int length,
+                               unsigned int hash)
+{
+  glyph_run_t *run = &atlas->runs[hash % RUN_CACHE_SIZE];
+  unsigned char *k;
+
+  if (rb->recording && rb->generation == atlas->generation
+      && (k = malloc(length + 1)))
+    {
+      memcpy(k, key, length);
+      free(run->key);
+      free(run->glyphs);
+      run->hash = hash;
+      run->kind = kind;
+      run->key_length = length;
+      run->key = k;
+      run->count = rb->count;
+      run->glyphs = rb->glyphs;
+      rb->glyphs = NULL;
+    }
+  free(rb->glyphs);
+}
+
+static void glyph_cache_note_draw(void)
+{
+  if (!glyph_cache_statistics || ++glyph_cache_stats.draws % 1000)
+    return;
+
+  NSLog(@"glyph cache: %lu draws, glyphs %lu/%lu (%.1f%%), "
+        @"runs %lu/%lu (%.1f%%), %lu flushes",
+        glyph_cache_stats.draws,
+        glyph_cache_stats.glyph_hits, glyph_cache_stats.glyph_lookups,
+        glyph_cache_stats.glyph_lookups ? 100.0 * glyph_cache_stats.glyph_hits
+          / glyph_cache_stats.glyph_lookups : 0.0,
+        glyph_cache_stats.run_hits, glyph_cache_stats.run_lookups,
+        glyph_cache_stats.run_lookups ? 100.0 * glyph_cache_stats.run_hits
+          / glyph_cache_stats.run_lookups : 0.0,
+        glyph_cache_stats.flushes);
+}
+
 /*
  * Helper method used inside of FTC_Manager to create an FT_FACE.
  */
@@ -303,6 +792,12 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
   return self;
 }
 
+- (void) dealloc
+{
+  atlas_destroy(atlas);
+  [super dealloc];
+}
+
 - (NSString*) displayName
 {
   return face_info->displayName;
@@ -418,7 +913,12 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
 
   int use_sbit;
 
-  FTC_SBit sbit;
+  int entry;
+  glyph_run_t *run;
+  run_builder_t rb;
+  const unsigned char *key = NULL;
+  int key_length = 0, x_start = 0;
+  unsigned int hash = 0;
 
   FT_Matrix ftmatrix;
   FT_Vector ftdelta;
@@ -499,6 +999,26 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
 
 /*        NSLog(@"drawString: '%s' at: %i:%i  to: %i:%i:%i:%i:%p",
                 s, x, y, x0, y0, x1, y1, buf);*/
+  if (use_sbit)
+    {
+      if (!atlas && !(atlas = calloc(1, sizeof(ft_glyph_atlas_t))))
+        return;
+
+      glyph_cache_note_draw();
+      key = (const unsigned char *)s;
+      key_length = strlen(s);
+      hash = run_hash(RUN_STRING, key, key_length);
+      if (!delta_flags
+          && (run = atlas_find_run(atlas, RUN_STRING, key, key_length, hash)))
+        {
+          atlas_draw_run(atlas, run, x, y, x1, y1, buf, bpl, NULL, 0,
+                         r, g, b, alpha, di);
+          return;
+        }
+      run_builder_start(&rb, atlas, !delta_flags, key_length);
+      x_start = x;
+    }
+
   d=0;
   for (c = (const unsigned char *)s; *c; c++)
     {
@@ -561,8 +1081,7 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
 
       if (use_sbit)
         {
-          if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, &imageType,
-            glyph, &sbit, NULL)))
+          if ((entry = atlas_lookup(atlas, &imageType, glyph, &error)) < 0)
             {
               NSLog(@"FTC_SBitCache_Lookup() failed with error %08x "
                 @"(%08x, %08x, %ix%i, %08x)",
@@ -571,156 +1090,16 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
               continue;
             }
 
-          if (!sbit->buffer)
-            {
-              if (!delta_flags)
-                {
-                  x += sbit->xadvance;
-                }
-              else
-                {
-                  if (delta_flags & 0x1)
-                    x += delta_data[d++];
-                  if (delta_flags & 0x2)
-                    y += (ts.m22 < 0) ?
-                      delta_data[d++] : -delta_data[d++];
-                  if (delta_flags & 0x4)
-                    {
-                      x += sbit->xadvance + delta_data[0];
-                      y += /*sbit->yadvance +*/ (ts.m22 < 0) ?
-                        delta_data[1] : -delta_data[1];
-                      if ((delta_flags & 0x8) && (uch == wch))
-                        {
-                          x += delta_data[2];
-                          y += (ts.m22 < 0) ?  delta_data[3] : -delta_data[3];
-                        }
-                    }
-                  else if (delta_flags & 0x8)
-                    {
-                      if (uch == wch)
-                        {
-                          x += sbit->xadvance + delta_data[0];
-                          y += /*sbit->yadvance +*/ (ts.m22 < 0) ?
-                            delta_data[1] : -delta_data[1];
-                        }
-                      else
-                        {
-                          x += sbit->xadvance;
-                          /*y += sbit->yadvance;*/
-                        }
-                    }
-                }
-              continue;
-            }
-
-          if (sbit->format == ft_pixel_mode_grays)
+          if (atlas->entries[entry].format)
             {
-              int gx = x + sbit->left, gy = y - sbit->top;
-              int sbpl = sbit->pitch;
-              int sx = sbit->width, sy = sbit->height;
-              const unsigned char *src = sbit->buffer;
-              unsigned char *dst = buf;
-
-              if (gy < 0)
-                {
-                  sy += gy;
-                  src -= sbpl * gy;
-                  gy = 0;
-                }
-              else if (gy > 0)
-                {
-                  dst += bpl * gy;
-                }
-
-              sy += gy;
-              if (sy > y1)
-                sy = y1;
-
-              if (gx < 0)
-                {
-                  sx += gx;
-                  src -= gx;
-                  gx = 0;
-                }
-              else if (gx > 0)
-                {
-                  dst += DI.bytes_per_pixel * gx;
-                }
-
-              sx += gx;
-              if (sx > x1)
-                sx = x1;
-              sx -= gx;
-
-              if (sx > 0)
-                {
-                  if (alpha >= 255)
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_ALPHA_OPAQUE(dst, src, r, g, b, sx);
-                  else
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_ALPHA(dst, src, r, g, b, alpha, sx);
-                }
-            }
-          else if (sbit->format == ft_pixel_mode_mono)
-            {
-              int gx = x + sbit->left, gy = y - sbit->top;
-              int sbpl = sbit->pitch;
-              int sx = sbit->width, sy = sbit->height;
-              const unsigned char *src = sbit->buffer;
-              unsigned char *dst = buf;
-              int src_ofs = 0;
-
-              if (gy < 0)
-                {
-                  sy += gy;
-                  src -= sbpl * gy;
-                  gy = 0;
-                }
-              else if (gy > 0)
-                {
-                  dst += bpl * gy;
-                }
-
-              sy += gy;
-              if (sy > y1)
-                sy = y1;
-
-              if (gx < 0)
-                {
-                  sx += gx;
-                  src -= gx / 8;
-                  src_ofs = (-gx) & 7;
-                  gx = 0;
-                }
-              else if (gx > 0)
-                {
-                  dst += DI.bytes_per_pixel * gx;
-                }
-
-              sx += gx;
-              if (sx > x1)
-                sx = x1;
-              sx -= gx;
-
-              if (sx > 0)
-                {
-                  if (alpha >= 255)
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_MONO_OPAQUE(dst, src, src_ofs, r, g, b, sx);
-                  else
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_MONO(dst, src, src_ofs, r, g, b, alpha, sx);
-                }
-            }
-          else
-            {
-              NSLog(@"unhandled font bitmap format %i", sbit->format);
+              atlas_blit(&atlas->entries[entry], x, y, x1, y1, buf, bpl,
+                         NULL, 0, r, g, b, alpha, di);
+              run_builder_add(&rb, entry, x - x_start);
             }
 
           if (!delta_flags)
             {
-              x += sbit->xadvance;
+              x += atlas->entries[entry].xadvance;
             }
           else
             {
@@ -730,7 +1109,7 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
                   y += (ts.m22 < 0) ?  delta_data[d++] : -delta_data[d++];
               if (delta_flags & 0x4)
                 {
-                  x += sbit->xadvance + delta_data[0];
+                  x += atlas->entries[entry].xadvance + delta_data[0];
                   y += /*sbit->yadvance +*/ (ts.m22 < 0) ?
                           delta_data[1] : -delta_data[1];
                   if ((delta_flags & 0x8) && (uch == wch))
@@ -743,13 +1122,13 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
                 {
                   if (uch == wch)
                     {
-                      x += sbit->xadvance + delta_data[0];
+                      x += atlas->entries[entry].xadvance + delta_data[0];
                       y += /*sbit->yadvance +*/ (ts.m22 < 0) ?
                           delta_data[1] : -delta_data[1];
                     }
                   else
                     {
-                      x += sbit->xadvance;
+                      x += atlas->entries[entry].xadvance;
                       /*y += sbit->yadvance;*/
                     }
                 }
@@ -899,6 +1278,9 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
           FT_Done_Glyph(gl);
         }
     }
+
+  if (use_sbit)
+    run_builder_finish(&rb, atlas, RUN_STRING, key, key_length, hash);
 }
 
 
@@ -915,7 +1297,12 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
 
   int use_sbit;
 
-  FTC_SBit sbit;
+  int entry;
+  glyph_run_t *run;
+  run_builder_t rb;
+  const unsigned char *key = NULL;
+  int key_length = 0, x_start = 0;
+  unsigned int hash = 0;
 
   FT_Matrix ftmatrix;
   FT_Vector ftdelta;
@@ -985,14 +1372,32 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
 /*        NSLog(@"drawGlyphs: '%p' at: %i:%i  to: %i:%i:%i:%i:%p",
                 glyphs, x, y, x0, y0, x1, y1, buf);*/
 
+  if (use_sbit)
+    {
+      if (!atlas && !(atlas = calloc(1, sizeof(ft_glyph_atlas_t))))
+        return;
+
+      glyph_cache_note_draw();
+      key = (const unsigned char *)glyphs;
+      key_length = length * sizeof(NSGlyph);
+      hash = run_hash(RUN_GLYPHS, key, key_length);
+      if ((run = atlas_find_run(atlas, RUN_GLYPHS, key, key_length, hash)))
+        {
+          atlas_draw_run(atlas, run, x, y, x1, y1, buf, bpl, NULL, 0,
+                         r, g, b, alpha, di);
+          return;
+        }
+      run_builder_start(&rb, atlas, YES, key_length);
+      x_start = x;
+    }
+
   for (; length; length--, glyphs++)
     {
       glyph = *glyphs - 1;
 
       if (use_sbit)
         {
-          if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, &imageType,
-            glyph, &sbit, NULL)))
+          if ((entry = atlas_lookup(atlas, &imageType, glyph, &error)) < 0)
             {
               NSLog(@"FTC_SBitCache_Lookup() failed with error %08x "
                 @"(%08x, %08x, %ix%i, %08x)",
@@ -1002,118 +1407,14 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
               continue;
             }
 
-          if (!sbit->buffer)
-            {
-              x += sbit->xadvance;
-              continue;
-            }
-
-          if (sbit->format == ft_pixel_mode_grays)
+          if (atlas->entries[entry].format)
             {
-              int gx = x + sbit->left, gy = y - sbit->top;
-              int sbpl = sbit->pitch;
-              int sx = sbit->width, sy = sbit->height;
-              const unsigned char *src = sbit->buffer;
-              unsigned char *dst = buf;
-
-              if (gy < 0)
-                {
-                  sy += gy;
-                  src -= sbpl * gy;
-                  gy = 0;
-                }
-              else if (gy > 0)
-                {
-                  dst += bpl * gy;
-                }
-
-              sy += gy;
-              if (sy > y1)
-                sy = y1;
-
-              if (gx < 0)
-                {
-                  sx += gx;
-                  src -= gx;
-                  gx = 0;
-                }
-              else if (gx > 0)
-                {
-                  dst += DI.bytes_per_pixel * gx;
-                }
-
-              sx += gx;
-              if (sx > x1)
-                sx = x1;
-              sx -= gx;
-
-              if (sx > 0)
-                {
-                  if (alpha >= 255)
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_ALPHA_OPAQUE(dst, src, r, g, b, sx);
-                  else
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_ALPHA(dst, src, r, g, b, alpha, sx);
-                }
+              atlas_blit(&atlas->entries[entry], x, y, x1, y1, buf, bpl,
+                         NULL, 0, r, g, b, alpha, di);
+              run_builder_add(&rb, entry, x - x_start);
             }
-          else if (sbit->format == ft_pixel_mode_mono)
-            {
-              int gx = x + sbit->left, gy = y - sbit->top;
-              int sbpl = sbit->pitch;
-              int sx = sbit->width, sy = sbit->height;
-              const unsigned char *src = sbit->buffer;
-              unsigned char *dst = buf;
-              int src_ofs = 0;
-
-              if (gy < 0)
-                {
-                  sy += gy;
-                  src -= sbpl * gy;
-                  gy = 0;
-                }
-              else if (gy > 0)
-                {
-                  dst += bpl * gy;
-                }
-
-              sy += gy;
-              if (sy > y1)
-                sy = y1;
-
-              if (gx < 0)
-                {
-                  sx += gx;
-                  src -= gx / 8;
-                  src_ofs = (-gx) & 7;
-                  gx = 0;
-                }
-              else if (gx > 0)
-                {
-                  dst += DI.bytes_per_pixel * gx;
-                }
-
-              sx += gx;
-              if (sx > x1)
-                sx = x1;
-              sx -= gx;
 
-              if (sx > 0)
-                {
-                  if (alpha >= 255)
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_MONO_OPAQUE(dst, src, src_ofs, r, g, b, sx);
-                  else
-                    for (; gy < sy; gy++, src += sbpl, dst += bpl)
-                      RENDER_BLIT_MONO(dst, src, src_ofs, r, g, b, alpha, sx);
-                }
-            }
-          else
-            {
-              NSLog(@"unhandled font bitmap format %i", sbit->format);
-            }
-
-          x += sbit->xadvance;
+          x += atlas->entries[entry].xadvance;
         }
       else
         {
@@ -1220,6 +1521,9 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
           FT_Done_Glyph(gl);
         }
     }
+
+  if (use_sbit)
+    run_builder_finish(&rb, atlas, RUN_GLYPHS, key, key_length, hash);
 }
 
 - (void) drawGlyphs: (const NSGlyph *)glyphs : (int)length
@@ -1236,7 +1540,12 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
 
   int use_sbit;
 
-  FTC_SBit sbit;
+  int entry;
+  glyph_run_t *run;
+  run_builder_t rb;
+  const unsigned char *key = NULL;
+  int key_length = 0, x_start = 0;
+  unsigned int hash = 0;
 
   FT_Matrix ftmatrix;
   FT_Vector ftdelta;
@@ -1306,13 +1615,32 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
 /*        NSLog(@"drawString: '%s' at: %i:%i  to: %i:%i:%i:%i:%p",
                 s, x, y, x0, y0, x1, y1, buf);*/
 
+  if (use_sbit)
+    {
+      if (!atlas && !(atlas = calloc(1, sizeof(ft_glyph_atlas_t))))
+        return;
+
+      glyph_cache_note_draw();
+      key = (const unsigned char *)glyphs;
+      key_length = length * sizeof(NSGlyph);
+      hash = run_hash(RUN_GLYPHS, key, key_length);
+      if ((run = atlas_find_run(atlas, RUN_GLYPHS, key, key_length, hash)))
+        {
+          atlas_draw_run(atlas, run, x, y, x1, y1, buf, bpl, abuf, abpl,
+                         r, g, b, alpha, di);
+          return;
+        }
+      run_builder_start(&rb, atlas, YES, key_length);
+      x_start = x;
+    }
+
   for (; length; length--, glyphs++)
     {
       glyph = *glyphs - 1;
 
       if (use_sbit)
         {
-          if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, &imageType, glyph, &sbit, NULL)))
+          if ((entry = atlas_lookup(atlas, &imageType, glyph, &error)) < 0)
             {
               if (glyph != 0xffffffff)
                 NSLog(@"FTC_SBitCache_Lookup() failed with error %08x (%08x, %08x, %ix%i, %08x)",
@@ -1322,116 +1650,14 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
               continue;
             }
 
-          if (!sbit->buffer)
+          if (atlas->entries[entry].format)
             {
-              x += sbit->xadvance;
-              continue;
+              atlas_blit(&atlas->entries[entry], x, y, x1, y1, buf, bpl,
+                         abuf, abpl, r, g, b, alpha, di);
+              run_builder_add(&rb, entry, x - x_start);
             }
 
-          if (sbit->format == ft_pixel_mode_grays)
-            {
-              int gx = x + sbit->left, gy = y - sbit->top;
-              int sbpl = sbit->pitch;
-              int sx = sbit->width, sy = sbit->height;
-              const unsigned char *src = sbit->buffer;
-              unsigned char *dst = buf;
-              unsigned char *adst = abuf;
-
-              if (gy < 0)
-                {
-                  sy += gy;
-                  src -= sbpl * gy;
-                  gy = 0;
-                }
-              else if (gy > 0)
-                {
-                  dst += bpl * gy;
-                  adst += abpl * gy;
-                }
-
-              sy += gy;
-              if (sy > y1)
-                sy = y1;
-
-              if (gx < 0)
-                {
-                  sx += gx;
-                  src -= gx;
-                  gx = 0;
-                }
-              else if (gx > 0)
-                {
-                  dst += DI.bytes_per_pixel * gx;
-                  adst += gx;
-                }
-
-              sx += gx;
-              if (sx > x1)
-                sx = x1;
-              sx -= gx;
-
-              if (sx > 0)
-                {
-                  for (; gy < sy; gy++, src += sbpl, dst += bpl, adst += abpl)
-                    RENDER_BLIT_ALPHA_A(dst, adst, src, r, g, b, alpha, sx);
-                }
-            }
-          else if (sbit->format == ft_pixel_mode_mono)
-            {
-              int gx = x + sbit->left, gy = y - sbit->top;
-              int sbpl = sbit->pitch;
-              int sx = sbit->width, sy = sbit->height;
-              const unsigned char *src = sbit->buffer;
-              unsigned char *dst = buf;
-              unsigned char *adst = abuf;
-              int src_ofs = 0;
-
-              if (gy < 0)
-                {
-                  sy += gy;
-                  src -= sbpl * gy;
-                  gy = 0;
-                }
-              else if (gy > 0)
-                {
-                  dst += bpl * gy;
-                  adst += abpl * gy;
-                }
-
-              sy += gy;
-              if (sy > y1)
-                sy = y1;
-
-              if (gx < 0)
-                {
-                  sx += gx;
-                  src -= gx / 8;
-                  src_ofs = (-gx) & 7;
-                  gx = 0;
-                }
-              else if (gx > 0)
-                {
-                  dst += DI.bytes_per_pixel * gx;
-                  adst += gx;
-                }
-
-              sx += gx;
-              if (sx > x1)
-                sx = x1;
-              sx -= gx;
-
-              if (sx > 0)
-                {
-                  for (; gy < sy; gy++, src += sbpl, dst += bpl, adst += bpl)
-                    RENDER_BLIT_MONO_A(dst, adst, src, src_ofs, r, g, b, alpha, sx);
-                }
-            }
-          else
-            {
-              NSLog(@"unhandled font bitmap format %i", sbit->format);
-            }
-
-          x += sbit->xadvance;
+          x += atlas->entries[entry].xadvance;
         }
       else
         {
@@ -1536,6 +1762,9 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib,
           FT_Done_Glyph(gl);
         }
     }
+
+  if (use_sbit)
+    run_builder_finish(&rb, atlas, RUN_GLYPHS, key, key_length, hash);
 }
 
 
@@ -2159,6 +2388,8 @@ static int filters[3][7]=
     int i;
 
     subpixel_text = [ud integerForKey: @"back-art-subpixel-text"];
+    glyph_cache_statistics
+      = [ud boolForKey: @"back-art-glyph-cache-statistics"];
 
     /* To make it easier to find an optimal (or at least good) filter,
     the filters are configurable (for now). */
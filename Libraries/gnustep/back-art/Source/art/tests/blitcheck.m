@@ -0,0 +1,240 @@
+/*
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNUstep.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+Compares the vector composite functions of blit-simd.m with the functions
+of blit.m they replace, for every 32-bit format and every vector level the
+CPU has, then measures both.
+
+usage: blitcheck [iterations]
+
+Exits with 1 if any result differs.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../blit-main.m"
+#include "../blit-simd-main.m"
+
+
+static const struct
+{
+  const char *name;
+  unsigned int red_mask, green_mask, blue_mask;
+} formats[] = {
+#if GS_WORDS_BIGENDIAN
+  {"rgba", 0xff000000, 0xff0000, 0xff00},
+  {"bgra", 0xff00, 0xff0000, 0xff000000},
+  {"argb", 0xff0000, 0xff00, 0xff},
+  {"abgr", 0xff, 0xff00, 0xff0000},
+#else
+  {"rgba", 0xff, 0xff00, 0xff0000},
+  {"bgra", 0xff0000, 0xff00, 0xff},
+  {"argb", 0xff00, 0xff0000, 0xff000000},
+  {"abgr", 0xff000000, 0xff0000, 0xff00},
+#endif
+};
+
+typedef void (*composite_func_t)(composite_run_t *c, int num);
+
+#define F(x) {#x, offsetof(draw_info_t, x)}
+static const struct
+{
+  const char *name;
+  size_t offset;
+} funcs[] = {
+  F(composite_sover_aa), F(composite_sover_ao),
+  F(composite_sin_aa), F(composite_sin_oa),
+  F(composite_sout_aa), F(composite_sout_oa),
+  F(composite_satop_aa),
+  F(composite_dover_aa), F(composite_dover_oa),
+  F(composite_din_aa), F(composite_dout_aa), F(composite_datop_aa),
+  F(composite_xor_aa),
+  F(composite_plusl_aa), F(composite_plusl_oa),
+  F(composite_plusl_ao), F(composite_plusl_oo),
+  F(composite_plusd_aa), F(composite_plusd_oa),
+  F(composite_plusd_ao), F(composite_plusd_oo),
+  F(dissolve_aa), F(dissolve_oa), F(dissolve_ao), F(dissolve_oo),
+};
+#undef F
+
+#define MAX_RUN 1024
+#define GUARD 16
+
+static unsigned char random_byte(void)
+{
+  return random() & 0xff;
+}
+
+/* mostly valid premultiplied pixels with many fully transparent and
+   opaque ones, and some garbage */
+static void fill(unsigned char *p, int num, int alpha_ofs)
+{
+  int i, j, a;
+
+  for (i = 0; i < num; i++, p += 4)
+    {
+      switch (random() % 4)
+	{
+	case 0: a = 0; break;
+	case 1: a = 255; break;
+	default: a = random_byte(); break;
+	}
+      for (j = 0; j < 4; j++)
+	{
+	  if (j == alpha_ofs)
+	    p[j] = a;
+	  else if (random() % 16)
+	    p[j] = random_byte() * a / 255;
+	  else
+	    p[j] = random_byte();
+	}
+    }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0E9;
+}
+
+static composite_func_t get_func(draw_info_t *di, int i)
+{
+  return *(composite_func_t *)((char *)di + funcs[i].offset);
+}
+
+static int check(draw_info_t *ref, draw_info_t *vec, int i)
+{
+  static unsigned char src[(MAX_RUN + GUARD) * 4];
+  static unsigned char dst[2][(MAX_RUN + GUARD) * 4];
+  composite_run_t c;
+  int n, ofs, k, round;
+
+  for (round = 0; round < 200; round++)
+    {
+      n = random() % (round < 100 ? 40 : MAX_RUN - 4);
+      ofs = random() % 4;
+
+      fill(src, MAX_RUN + GUARD, ref->inline_alpha_ofs);
+      fill(dst[0], MAX_RUN + GUARD, ref->inline_alpha_ofs);
+      memcpy(dst[1], dst[0], sizeof(dst[0]));
+
+      c.fraction = random_byte();
+      for (k = 0; k < 2; k++)
+	{
+	  c.src = src + ofs * 4;
+	  c.dst = dst[k] + ofs * 4;
+	  c.srca = c.dsta = NULL;
+	  get_func(k ? vec : ref, i)(&c, n);
+	}
+
+      for (k = 0; k < (int)sizeof(dst[0]); k++)
+	{
+	  if (dst[0][k] != dst[1][k])
+	    {
+	      printf("  %s: %i pixels at %i, fraction %i: pixel %i byte %i"
+		     " is %i, should be %i\n", funcs[i].name, n, ofs,
+		     c.fraction, k / 4 - ofs, k % 4, dst[1][k], dst[0][k]);
+	      return 0;
+	    }
+	}
+    }
+  return 1;
+}
+
+static double bench(draw_info_t *di, int i, int iterations)
+{
+  static unsigned char src[MAX_RUN * 4], dst[MAX_RUN * 4], orig[MAX_RUN * 4];
+  composite_run_t c;
+  double t0, t = 0;
+  int n;
+
+  fill(src, MAX_RUN, di->inline_alpha_ofs);
+  fill(orig, MAX_RUN, di->inline_alpha_ofs);
+  c.src = src;
+  c.dst = dst;
+  c.srca = c.dsta = NULL;
+  c.fraction = 160;
+
+  for (n = 0; n < iterations; n++)
+    {
+      memcpy(dst, orig, sizeof(dst));
+      t0 = now();
+      get_func(di, i)(&c, MAX_RUN);
+      t += now() - t0;
+    }
+
+  return MAX_RUN * (double)iterations / t / 1.0E6;
+}
+
+int main(int argc, char **argv)
+{
+  draw_info_t ref, vec;
+  int iterations = 2000;
+  int level, f, i;
+  int failed = 0;
+
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+  if (iterations < 1)
+    iterations = 1;
+
+  srandom(1);
+
+  for (level = LEVEL_SSE2; level <= cpu_level(); level++)
+    {
+      for (f = 0; f < (int)(sizeof(formats) / sizeof(formats[0])); f++)
+	{
+	  artcontext_setup_simd("none");
+	  artcontext_setup_draw_info(&ref, formats[f].red_mask,
+	    formats[f].green_mask, formats[f].blue_mask, 32);
+	  artcontext_setup_simd(level_names[level]);
+	  artcontext_setup_draw_info(&vec, formats[f].red_mask,
+	    formats[f].green_mask, formats[f].blue_mask, 32);
+
+	  printf("%s %s\n", level_names[level], formats[f].name);
+	  for (i = 0; i < (int)(sizeof(funcs) / sizeof(funcs[0])); i++)
+	    {
+	      if (get_func(&ref, i) == get_func(&vec, i))
+		continue;
+
+	      if (!check(&ref, &vec, i))
+		{
+		  failed = 1;
+		  continue;
+		}
+	      printf("  %-20s %8.1f %8.1f Mpix/s\n", funcs[i].name,
+		     bench(&ref, i, iterations), bench(&vec, i, iterations));
+	    }
+	}
+    }
+
+  if (cpu_level() == LEVEL_NONE)
+    printf("no vector functions on this CPU\n");
+
+  return failed;
+}
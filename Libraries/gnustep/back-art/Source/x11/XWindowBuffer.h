@@ -62,6 +62,16 @@ struct XWindowBuffer_depth_info_s
   int byte_order;
 };
 
+/* A damaged part of the window, in X coordinates */
+struct XWindowBuffer_rect_s
+{
+  int x, y, w, h;
+};
+
+/* Maximum number of separate rectangles waiting to be pushed; more are
+merged with the closest ones. */
+#define XWINDOWBUFFER_MAX_PENDING_RECTS 16
+
 /*
 XWindowBuffer maintains an XImage for a window. Each ARTGState that
 renders to that window uses the same XWindowBuffer (and thus the same
@@ -90,12 +100,10 @@ that there's only one XWindowBuffer for each window. */
 
   /* While a XShmPutImage is in progress we don't try to call it
   again. The pending updates are stored here, and when we get the
-  ShmCompletion event, we handle them. */
-  int pending_put;     /* There are pending updates */
-  struct
-  {
-    int x, y, w, h;
-  } pending_rect; /* in this rectangle. */
+  ShmCompletion event, we push each of them. Rectangles that are close
+  enough are merged, so that we don't send many small requests. */
+  int pending_put;     /* Number of pending rectangles */
+  struct XWindowBuffer_rect_s pending_rects[XWINDOWBUFFER_MAX_PENDING_RECTS];
 
   int pending_event;   /* We're waiting for the ShmCompletion event. */
 
@@ -118,6 +126,13 @@ that there's only one XWindowBuffer for each window. */
   */
   unsigned char *alpha;
   int has_alpha;
+
+  /* Statistics. A frame is a set of rectangles pushed at the same time:
+  one expose, or the pending rectangles when a ShmCompletion arrives. */
+  unsigned long frames;
+  unsigned long put_count;     /* XShmPutImage/XPutImage calls */
+  unsigned long long bytes_pushed;
+  unsigned long last_frame_bytes;
 }
 
 /*
@@ -143,6 +158,7 @@ created.
 
 -(void) _gotShmCompletion;
 -(void) _exposeRect: (NSRect)r;
+-(void) _pushedFrame: (unsigned long)bytes puts: (int)n;
 +(void) _gotShmCompletion: (Drawable)d;
 
 @end
@@ -44,6 +44,98 @@ static int num_window_buffers;
 
 static int use_shape_hack = 0; /* this is an ugly hack : ) */
 
+static int log_statistics = 0;
+
+
+/* When merging two damaged rectangles, we accept to push this many pixels
+that didn't change, or a quarter of the two areas if it's more, to save a
+request. */
+#define MERGE_MIN_WASTE 4096
+
+static long rect_area(struct XWindowBuffer_rect_s *r)
+{
+  return (long)r->w * r->h;
+}
+
+static struct XWindowBuffer_rect_s rect_union(struct XWindowBuffer_rect_s *a,
+                                              struct XWindowBuffer_rect_s *b)
+{
+  struct XWindowBuffer_rect_s u;
+
+  u.x = a->x < b->x ? a->x : b->x;
+  u.y = a->y < b->y ? a->y : b->y;
+  u.w = (a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w) - u.x;
+  u.h = (a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h) - u.y;
+  return u;
+}
+
+static long rect_overlap(struct XWindowBuffer_rect_s *a,
+                         struct XWindowBuffer_rect_s *b)
+{
+  int x0 = a->x > b->x ? a->x : b->x;
+  int y0 = a->y > b->y ? a->y : b->y;
+  int x1 = a->x + a->w < b->x + b->w ? a->x + a->w : b->x + b->w;
+  int y1 = a->y + a->h < b->y + b->h ? a->y + a->h : b->y + b->h;
+
+  if (x1 <= x0 || y1 <= y0)
+    return 0;
+  return (long)(x1 - x0) * (y1 - y0);
+}
+
+/* Adds a rectangle to the damage list, merging it with the rectangles that
+are close enough. Returns the new number of rectangles. */
+static int add_damage(struct XWindowBuffer_rect_s *rects, int count,
+                      int x, int y, int w, int h)
+{
+  struct XWindowBuffer_rect_s r, u;
+  long a, b, waste, growth, best_growth;
+  int i, best;
+
+  r.x = x;
+  r.y = y;
+  r.w = w;
+  r.h = h;
+
+again:
+  for (i = 0; i < count; i++)
+    {
+      a = rect_area(&rects[i]);
+      b = rect_area(&r);
+      u = rect_union(&rects[i], &r);
+      waste = rect_area(&u) - a - b + rect_overlap(&rects[i], &r);
+      if (waste <= MERGE_MIN_WASTE || waste <= (a + b) / 4)
+        {
+          /* the merged rectangle may now be close to another one */
+          r = u;
+          rects[i] = rects[--count];
+          goto again;
+        }
+    }
+
+  if (count == XWINDOWBUFFER_MAX_PENDING_RECTS)
+    {
+      /* no room left: merge with the one that grows the least */
+      best = 0;
+      best_growth = -1;
+      for (i = 0; i < count; i++)
+        {
+          u = rect_union(&rects[i], &r);
+          growth = rect_area(&u) - rect_area(&rects[i]);
+          if (best_growth < 0 || growth < best_growth)
+            {
+              best = i;
+              best_growth = growth;
+            }
+        }
+      r = rect_union(&rects[best], &r);
+      rects[best] = rects[--count];
+      goto again;
+    }
+
+  rects[count++] = r;
+  return count;
+}
+
 #ifdef XSHM
 
 static int did_test_xshm = 0;
@@ -174,6 +266,25 @@ no_xshm:
 {
   NSUserDefaults *ud = [NSUserDefaults standardUserDefaults];
   use_shape_hack = [ud boolForKey: @"XWindowBuffer-shape-hack"];
+  log_statistics = [ud boolForKey: @"XWindowBufferStatistics"];
+}
+
+/* Update the statistics after a frame was pushed */
+- (void) _pushedFrame: (unsigned long)bytes
+                 puts: (int)n
+{
+  frames++;
+  put_count += n;
+  bytes_pushed += bytes;
+  last_frame_bytes = bytes;
+
+  if (log_statistics && frames % 100 == 0)
+    {
+      NSLog(@"XWindowBuffer for window %lu (%ix%i): %lu frames, %lu puts, "
+            @"%llu bytes, %llu bytes per frame, last frame %lu bytes",
+            (unsigned long)drawable, sx, sy, frames, put_count, bytes_pushed,
+            bytes_pushed / frames, last_frame_bytes);
+    }
 }
 
 + windowBufferForWindow: (gswindow_device_t *)awindow
@@ -434,31 +545,45 @@ extern int XShmGetEventBase(Display *d);
   pending_event = 0;
   if (pending_put)
     {
-      pending_put = 0;
-      if (pending_rect.x + pending_rect.w > window->xframe.size.width)
-        {
-          pending_rect.w = window->xframe.size.width - pending_rect.x;
-          if (pending_rect.w <= 0)
-            return;
-        }
-      if (pending_rect.y + pending_rect.h > window->xframe.size.height)
-        {
-          pending_rect.h = window->xframe.size.height - pending_rect.y;
-          if (pending_rect.h <= 0)
-            return;
-        }
-      if (!XShmPutImage(display, drawable, gc, ximage,
-                        pending_rect.x, pending_rect.y,
-                        pending_rect.x, pending_rect.y,
-                        pending_rect.w, pending_rect.h,
-                        1))
+      struct XWindowBuffer_rect_s rects[XWINDOWBUFFER_MAX_PENDING_RECTS];
+      unsigned long bytes = 0;
+      int i, n = 0;
+
+      /* the window may have shrunk since the rectangles were added */
+      for (i = 0; i < pending_put; i++)
         {
-          NSLog(@"XShmPutImage failed?");
+          struct XWindowBuffer_rect_s r = pending_rects[i];
+
+          if (r.x + r.w > window->xframe.size.width)
+            r.w = window->xframe.size.width - r.x;
+          if (r.y + r.h > window->xframe.size.height)
+            r.h = window->xframe.size.height - r.y;
+          if (r.w > 0 && r.h > 0)
+            rects[n++] = r;
         }
-      else
+      pending_put = 0;
+
+      /* Completion events come in order, so we only ask for one on the
+      last request. */
+      for (i = 0; i < n; i++)
         {
-          pending_event = 1;
+          if (!XShmPutImage(display, drawable, gc, ximage,
+                            rects[i].x, rects[i].y,
+                            rects[i].x, rects[i].y,
+                            rects[i].w, rects[i].h,
+                            i == n - 1))
+            {
+              NSLog(@"XShmPutImage failed?");
+            }
+          else
+            {
+              bytes += rects[i].w * rects[i].h * bytes_per_pixel;
+              if (i == n - 1)
+                pending_event = 1;
+            }
         }
+      if (n)
+        [self _pushedFrame: bytes puts: n];
     }
 //        XFlush(window->display);
 #endif
@@ -593,35 +718,7 @@ static int warn = 0;
 
       if (pending_event)
         {
-          if (!pending_put)
-            {
-              pending_put = 1;
-              pending_rect.x = x;
-              pending_rect.y = y;
-              pending_rect.w = w;
-              pending_rect.h = h;
-            }
-          else
-            {
-              if (x < pending_rect.x)
-                {
-                  pending_rect.w += pending_rect.x - x;
-                  pending_rect.x = x;
-                }
-              if (x + w > pending_rect.x + pending_rect.w)
-                {
-                  pending_rect.w = x + w - pending_rect.x;
-                }
-              if (y < pending_rect.y)
-                {
-                  pending_rect.h += pending_rect.y - y;
-                  pending_rect.y = y;
-                }
-              if (y + h > pending_rect.y + pending_rect.h)
-                {
-                  pending_rect.h = y + h - pending_rect.y;
-                }
-            }
+          pending_put = add_damage(pending_rects, pending_put, x, y, w, h);
         }
       else
         {
@@ -634,6 +731,7 @@ static int warn = 0;
           else
             {
               pending_event = 1;
+              [self _pushedFrame: w * h * bytes_per_pixel puts: 1];
             }
         }
 
@@ -654,6 +752,7 @@ static int warn = 0;
     if (ximage)
     {
       XPutImage(display, drawable, gc, ximage, x, y, x, y, w, h);
+      [self _pushedFrame: w * h * bytes_per_pixel puts: 1];
     }
 }
 
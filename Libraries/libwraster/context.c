@@ -35,6 +35,8 @@
 #include "config.h"
 #include "wraster.h"
 #include "scale.h"
+#include "parallel.h"
+#include "xutil.h"
 
 
 #ifndef HAVE_FLOAT_MATHFUNC
@@ -53,7 +55,8 @@ static const RContextAttributes DEFAULT_CONTEXT_ATTRIBS = {
 	0,
 	True,			/* use_shared_memory */
 	RMitchellFilter,
-	RUseStdColormap
+	RUseStdColormap,
+	1			/* threads */
 };
 
 /*
@@ -547,6 +550,8 @@ RContext *RCreateContext(Display * dpy, int screen_number, const RContextAttribu
 	/* get configuration from environment variables */
 	gatherconfig(context, screen_number);
 	wraster_change_filter(context->attribs->scaling_filter);
+	if (context->attribs->flags & RC_Threads)
+		wraster_set_threads(context->attribs->threads);
 	if ((context->attribs->flags & RC_VisualID)) {
 		XVisualInfo *vinfo, templ;
 		int nret;
@@ -649,6 +654,9 @@ RContext *RCreateContext(Display * dpy, int screen_number, const RContextAttribu
 void RDestroyContext(RContext *context)
 {
 	if (context) {
+#ifdef USE_XSHM
+		r_release_shared_ximage(context);
+#endif
 		if (context->copy_gc)
 			XFreeGC(context->dpy, context->copy_gc);
 		if (context->attribs) {
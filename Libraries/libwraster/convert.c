@@ -35,8 +35,14 @@
 #include "config.h"
 #include "wraster.h"
 #include "convert.h"
+#include "parallel.h"
 #include "xutil.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CONVERT_X86
+#include <immintrin.h>
+#endif
+
 
 #define NFREE(n)  if (n) free(n)
 
@@ -152,6 +158,36 @@ static unsigned int *computeStdTable(unsigned int mult, unsigned int max)
 
 /***************************************************************************/
 
+/*
+ * Direct access to XImage pixels, instead of XPutPixel, when the image uses
+ * 16 or 32 bits per pixel in the byte order of the host. Returns the number
+ * of bits per pixel, or 0 if XPutPixel must be used.
+ */
+static int directPixelSize(XImage *ximage)
+{
+	static const int one = 1;
+	int host_order = (*(const char *)&one) ? LSBFirst : MSBFirst;
+
+	if (ximage->format != ZPixmap || ximage->byte_order != host_order)
+		return 0;
+	if (ximage->bits_per_pixel != 16 && ximage->bits_per_pixel != 32)
+		return 0;
+
+	return ximage->bits_per_pixel;
+}
+
+static inline void putPixel(XImage *ximage, int direct, int x, int y, unsigned long pixel)
+{
+	char *row = ximage->data + y * ximage->bytes_per_line;
+
+	if (direct == 32)
+		((unsigned int *)row)[x] = pixel;
+	else if (direct == 16)
+		((unsigned short *)row)[x] = pixel;
+	else
+		XPutPixel(ximage, x, y, pixel);
+}
+
 static void
 convertTrueColor_generic(RXImage * ximg, RImage * image,
 			 signed char *err, signed char *nerr,
@@ -167,6 +203,7 @@ convertTrueColor_generic(RXImage * ximg, RImage * image,
 	int rer, ger, ber;
 	unsigned char *ptr = image->data;
 	int channels = (HAS_ALPHA(image) ? 4 : 3);
+	int direct = directPixelSize(ximg->image);
 
 	/* convert and dither the image to XImage */
 	for (y = 0; y < image->height; y++) {
@@ -206,7 +243,7 @@ convertTrueColor_generic(RXImage * ximg, RImage * image,
 			ber = pixel - b * db;
 
 			pixel = (r << roffs) | (g << goffs) | (b << boffs);
-			XPutPixel(ximg->image, x, y, pixel);
+			putPixel(ximg->image, direct, x, y, pixel);
 
 			/* distribute error */
 			r = (rer * 3) / 8;
@@ -270,7 +307,7 @@ convertTrueColor_generic(RXImage * ximg, RImage * image,
 		ber = pixel - b * db;
 
 		pixel = (r << roffs) | (g << goffs) | (b << boffs);
-		XPutPixel(ximg->image, x, y, pixel);
+		putPixel(ximg->image, direct, x, y, pixel);
 
 		/* distribute error */
 		r = (rer * 3) / 8;
@@ -291,13 +328,244 @@ convertTrueColor_generic(RXImage * ximg, RImage * image,
 	}
 }
 
+typedef struct TrueColorJob TrueColorJob;
+
+typedef void TrueColorRowFunction(const TrueColorJob *job, const unsigned char *src,
+                                  char *dst, int width);
+
+struct TrueColorJob {
+	RXImage *ximg;
+	RImage *image;
+	const unsigned short *rtable, *gtable, *btable;
+	unsigned short roffs, goffs, boffs;
+	int identity;		/* 8 bits per channel */
+	int direct;		/* see directPixelSize */
+	TrueColorRowFunction *convert_row;
+#ifdef CONVERT_X86
+	__m128i shuffle;	/* source bytes for 4 pixels, for the SSSE3 functions */
+#endif
+};
+
+/*
+ * Row conversion for 8 bits per channel visuals with 32 bits pixels, like
+ * the common RGBX and BGRX layouts.
+ */
+static void convertRow_888_32(const TrueColorJob *job, const unsigned char *src, char *dst, int width)
+{
+	unsigned int *d = (unsigned int *)dst;
+	int channels = (HAS_ALPHA(job->image) ? 4 : 3);
+	int x;
+
+	for (x = 0; x < width; x++, src += channels)
+		d[x] = ((unsigned int)src[0] << job->roffs) | ((unsigned int)src[1] << job->goffs)
+			| ((unsigned int)src[2] << job->boffs);
+}
+
+/* 16 or 32 bits pixels with any channel size */
+static void convertRow_direct(const TrueColorJob *job, const unsigned char *src, char *dst, int width)
+{
+	int channels = (HAS_ALPHA(job->image) ? 4 : 3);
+	unsigned int pixel;
+	int x;
+
+	for (x = 0; x < width; x++, src += channels) {
+		pixel = (job->rtable[src[0]] << job->roffs) | (job->gtable[src[1]] << job->goffs)
+			| (job->btable[src[2]] << job->boffs);
+		if (job->direct == 32)
+			((unsigned int *)dst)[x] = pixel;
+		else
+			((unsigned short *)dst)[x] = pixel;
+	}
+}
+
+#ifdef CONVERT_X86
+
+/*
+ * Source rows of RGB images are read 16 bytes at a time for 4 pixels (12
+ * bytes), which is safe because RCreateImage allocates 4 extra bytes at
+ * the end of the image data.
+ */
+
+__attribute__((target("ssse3")))
+static void convertRow_888_32_ssse3(const TrueColorJob *job, const unsigned char *src, char *dst, int width)
+{
+	int channels = (HAS_ALPHA(job->image) ? 4 : 3);
+	int x;
+
+	for (x = 0; x + 4 <= width; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(v, job->shuffle));
+		src += 4 * channels;
+		dst += 16;
+	}
+	convertRow_888_32(job, src, dst, width - x);
+}
+
+/* c * 31 / 255 or c * 63 / 255 rounded, like computeTable does */
+__attribute__((target("ssse3")))
+static inline __m128i reduce_565(__m128i c, __m128i mask)
+{
+	__m128i t;
+
+	t = _mm_add_epi32(_mm_mullo_epi16(c, mask), _mm_set1_epi32(0x7f));
+	/* exact division by 255 for t < 65535 */
+	return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(t, _mm_set1_epi32(1)), _mm_srli_epi32(t, 8)), 8);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i pixels_565(__m128i v)
+{
+	const __m128i byte = _mm_set1_epi32(0xff);
+	__m128i r, g, b;
+
+	r = reduce_565(_mm_and_si128(v, byte), _mm_set1_epi32(0x1f));
+	g = reduce_565(_mm_and_si128(_mm_srli_epi32(v, 8), byte), _mm_set1_epi32(0x3f));
+	b = reduce_565(_mm_and_si128(_mm_srli_epi32(v, 16), byte), _mm_set1_epi32(0x1f));
+
+	v = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 11), _mm_slli_epi32(g, 5)), b);
+	/* sign extend so that the signed pack keeps the 16 low bits */
+	return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+__attribute__((target("ssse3")))
+static void convertRow_565_ssse3(const TrueColorJob *job, const unsigned char *src, char *dst, int width)
+{
+	int channels = (HAS_ALPHA(job->image) ? 4 : 3);
+	int x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m128i lo, hi;
+
+		/* expand to R G B 0 */
+		lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), job->shuffle);
+		hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 4 * channels)), job->shuffle);
+
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(pixels_565(lo), pixels_565(hi)));
+		src += 8 * channels;
+		dst += 16;
+	}
+	convertRow_direct(job, src, dst, width - x);
+}
+
+static int cpuHasSSSE3(void)
+{
+	static int has_ssse3 = -1;
+
+	if (has_ssse3 < 0) {
+		__builtin_cpu_init();
+		has_ssse3 = __builtin_cpu_supports("ssse3") && !getenv("WRASTER_NO_SIMD");
+	}
+	return has_ssse3;
+}
+
+/* shuffle mask moving R, G and B of 4 source pixels to the given byte offsets */
+static __m128i makeShuffle(int channels, int roffs, int goffs, int boffs)
+{
+	unsigned char mask[16];
+	int i;
+
+	memset(mask, 0x80, sizeof(mask));
+	for (i = 0; i < 4; i++) {
+		mask[i * 4 + roffs / 8] = i * channels;
+		mask[i * 4 + goffs / 8] = i * channels + 1;
+		mask[i * 4 + boffs / 8] = i * channels + 2;
+	}
+	return _mm_loadu_si128((const __m128i *)mask);
+}
+
+#endif /* CONVERT_X86 */
+
+/* choose the row conversion function for the non-dithered conversion */
+static void setupTrueColorRow(TrueColorJob *job, unsigned short rmask, unsigned short gmask, unsigned short bmask)
+{
+	int channels = (HAS_ALPHA(job->image) ? 4 : 3);
+	static const int one = 1;
+	int little_endian = *(const char *)&one;
+	int bytes_888;
+
+	job->direct = directPixelSize(job->ximg->image);
+	job->convert_row = NULL;
+	if (!job->direct)
+		return;
+
+	bytes_888 = (job->direct == 32 && job->identity
+		     && job->roffs % 8 == 0 && job->goffs % 8 == 0 && job->boffs % 8 == 0);
+
+	if (bytes_888)
+		job->convert_row = convertRow_888_32;
+	else
+		job->convert_row = convertRow_direct;
+
+#ifdef CONVERT_X86
+	if (!little_endian || !cpuHasSSSE3())
+		return;
+
+	if (bytes_888) {
+		job->shuffle = makeShuffle(channels, job->roffs, job->goffs, job->boffs);
+		job->convert_row = convertRow_888_32_ssse3;
+	} else if (job->direct == 16 && rmask == 0x1f && gmask == 0x3f && bmask == 0x1f
+		   && job->roffs == 11 && job->goffs == 5 && job->boffs == 0) {
+		job->shuffle = makeShuffle(channels, 0, 8, 16);
+		job->convert_row = convertRow_565_ssse3;
+	}
+#else
+	(void)channels;
+	(void)little_endian;
+	(void)rmask;
+	(void)gmask;
+	(void)bmask;
+#endif
+}
+
+/* rows are independent when not dithering, so they can be done by bands */
+static void convertTrueColor_match(void *data, int band, int first, int last)
+{
+	TrueColorJob *job = data;
+	RImage *image = job->image;
+	XImage *ximage = job->ximg->image;
+	int channels = (HAS_ALPHA(image) ? 4 : 3);
+	unsigned long r, g, b;
+	unsigned long pixel;
+	unsigned char *ptr;
+	int x, y;
+
+	(void)band;
+
+	ptr = image->data + first * image->width * channels;
+
+	if (job->convert_row) {
+		for (y = first; y <= last; y++) {
+			job->convert_row(job, ptr, ximage->data + y * ximage->bytes_per_line, image->width);
+			ptr += image->width * channels;
+		}
+		return;
+	}
+
+	for (y = first; y <= last; y++) {
+		for (x = 0; x < image->width; x++, ptr += channels) {
+			/* reduce pixel */
+			if (job->identity) {
+				r = ptr[0];
+				g = ptr[1];
+				b = ptr[2];
+			} else {
+				r = job->rtable[ptr[0]];
+				g = job->gtable[ptr[1]];
+				b = job->btable[ptr[2]];
+			}
+			pixel = (r << job->roffs) | (g << job->goffs) | (b << job->boffs);
+			XPutPixel(ximage, x, y, pixel);
+		}
+	}
+}
+
 static RXImage *image2TrueColor(RContext * ctx, RImage * image)
 {
 	RXImage *ximg;
 	unsigned short rmask, gmask, bmask;
 	unsigned short roffs, goffs, boffs;
 	unsigned short *rtable, *gtable, *btable;
-	int channels = (HAS_ALPHA(image) ? 4 : 3);
 
 	ximg = RCreateXImage(ctx, ctx->depth, image->width, image->height);
 	if (!ximg) {
@@ -323,39 +591,24 @@ static RXImage *image2TrueColor(RContext * ctx, RImage * image)
 	}
 
 	if (ctx->attribs->render_mode == RBestMatchRendering) {
-		int ofs;
-		unsigned long r, g, b;
-		int x, y;
-		unsigned long pixel;
-		unsigned char *ptr = image->data;
+		TrueColorJob job;
 
 		/* fake match */
 #ifdef WRLIB_DEBUG
 		fputs("true color match\n", stderr);
 #endif
-		if (rmask == 0xff && gmask == 0xff && bmask == 0xff) {
-			for (y = 0; y < image->height; y++) {
-				for (x = 0; x < image->width; x++, ptr += channels) {
-					/* reduce pixel */
-					r = ptr[0];
-					g = ptr[1];
-					b = ptr[2];
-					pixel = (r << roffs) | (g << goffs) | (b << boffs);
-					XPutPixel(ximg->image, x, y, pixel);
-				}
-			}
-		} else {
-			for (y = 0, ofs = 0; y < image->height; y++) {
-				for (x = 0; x < image->width; x++, ofs += channels - 3) {
-					/* reduce pixel */
-					r = rtable[ptr[ofs++]];
-					g = gtable[ptr[ofs++]];
-					b = btable[ptr[ofs++]];
-					pixel = (r << roffs) | (g << goffs) | (b << boffs);
-					XPutPixel(ximg->image, x, y, pixel);
-				}
-			}
-		}
+		job.ximg = ximg;
+		job.image = image;
+		job.rtable = rtable;
+		job.gtable = gtable;
+		job.btable = btable;
+		job.roffs = roffs;
+		job.goffs = goffs;
+		job.boffs = boffs;
+		job.identity = (rmask == 0xff && gmask == 0xff && bmask == 0xff);
+		setupTrueColorRow(&job, rmask, gmask, bmask);
+
+		r_parallel_run(r_parallel_bands(image->height, 32), image->height, convertTrueColor_match, &job);
 	} else {
 		/* dither */
 		const int dr = 0xff / rmask;
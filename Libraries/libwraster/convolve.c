@@ -26,6 +26,92 @@
 
 #include "config.h"
 #include "wraster.h"
+#include "parallel.h"
+
+#define MASK(prev, cur, next, ch)\
+    (*(prev-ch) + *prev + *(prev+ch)\
+    +*(cur-ch) + 2 * *cur + *(cur+ch)\
+    +*(next-ch) + *next + *(next+ch)) / 10
+
+/*
+ * Blur one row in place. 'prev' holds the previous row and receives the
+ * original values of the current one as they get replaced.
+ */
+static inline void blur_row(unsigned char *ptr, unsigned char *pptr, const unsigned char *nptr,
+                            int width, const int ch)
+{
+	int x, c, tmp;
+
+	ptr += ch;
+	nptr += ch;
+	pptr += ch;
+
+	for (x = 1; x < width - 1; x++) {
+		for (c = 0; c < ch; c++) {
+			tmp = *ptr;
+			*ptr = MASK(pptr, ptr, nptr, ch);
+			*pptr = tmp;
+			ptr++;
+			nptr++;
+			pptr++;
+		}
+	}
+}
+
+typedef struct {
+	RImage *image;
+	unsigned char *saved;	/* original rows around band boundaries */
+	int nbands;
+	int failed;
+} BlurJob;
+
+/*
+ * Bands are numbered on the rows to blur, which start at 1.
+ *
+ * The rows just above and below a band are modified by the neighbour bands,
+ * so their original content is saved before the bands are started. For
+ * band b, saved row 2*b is the row above it and 2*b+1 the row below.
+ */
+static void blur_band(void *data, int band, int first, int last)
+{
+	BlurJob *job = data;
+	RImage *image = job->image;
+	int ch = image->format == RRGBAFormat ? 4 : 3;
+	int stride = image->width * ch;
+	unsigned char *prev, *ptr;
+	const unsigned char *nptr;
+	int y;
+
+	first++;
+	last++;
+
+	prev = malloc(stride);
+	if (!prev) {
+		job->failed = 1;
+		return;
+	}
+
+	/* first and last pixels of the previous row buffer are never updated
+	 * and keep the values of row 0 */
+	memcpy(prev, job->saved + 2 * band * stride, stride);
+	memcpy(prev, image->data, ch);
+	memcpy(prev + stride - ch, image->data + stride - ch, ch);
+
+	ptr = image->data + first * stride;
+	for (y = first; y <= last; y++) {
+		if (y == last)
+			nptr = job->saved + (2 * band + 1) * stride;
+		else
+			nptr = ptr + stride;
+
+		if (ch == 3)
+			blur_row(ptr, prev, nptr, image->width, 3);
+		else
+			blur_row(ptr, prev, nptr, image->width, 4);
+		ptr += stride;
+	}
+	free(prev);
+}
 
 /*
  *----------------------------------------------------------------------
@@ -37,105 +123,38 @@
  */
 int RBlurImage(RImage * image)
 {
-	register int x, y;
-	register int tmp;
-	unsigned char *ptr, *nptr;
-	unsigned char *pptr = NULL, *tmpp;
+	BlurJob job;
 	int ch = image->format == RRGBAFormat ? 4 : 3;
+	int stride = image->width * ch;
+	int band, first, last;
 
-	pptr = malloc(image->width * ch);
-	if (!pptr) {
+	if (image->height < 3)
+		return True;
+
+	job.image = image;
+	job.failed = 0;
+	job.nbands = r_parallel_bands(image->height - 2, 32);
+	job.saved = malloc(2 * job.nbands * stride);
+	if (!job.saved) {
 		RErrorCode = RERR_NOMEMORY;
 		return False;
 	}
-#define MASK(prev, cur, next, ch)\
-    (*(prev-ch) + *prev + *(prev+ch)\
-    +*(cur-ch) + 2 * *cur + *(cur+ch)\
-    +*(next-ch) + *next + *(next+ch)) / 10
 
-	memcpy(pptr, image->data, image->width * ch);
-
-	ptr = image->data;
-	nptr = ptr + image->width * ch;
-	tmpp = pptr;
-
-	if (ch == 3) {
-		ptr += 3;
-		nptr += 3;
-		pptr += 3;
-
-		for (y = 1; y < image->height - 1; y++) {
-
-			for (x = 1; x < image->width - 1; x++) {
-				tmp = *ptr;
-				*ptr = MASK(pptr, ptr, nptr, 3);
-				*pptr = tmp;
-				ptr++;
-				nptr++;
-				pptr++;
-
-				tmp = *ptr;
-				*ptr = MASK(pptr, ptr, nptr, 3);
-				*pptr = tmp;
-				ptr++;
-				nptr++;
-				pptr++;
-
-				tmp = *ptr;
-				*ptr = MASK(pptr, ptr, nptr, 3);
-				*pptr = tmp;
-				ptr++;
-				nptr++;
-				pptr++;
-			}
-			pptr = tmpp;
-			ptr += 6;
-			nptr += 6;
-			pptr += 6;
-		}
-	} else {
-		ptr += 4;
-		nptr += 4;
-		pptr += 4;
-
-		for (y = 1; y < image->height - 1; y++) {
-			for (x = 1; x < image->width - 1; x++) {
-				tmp = *ptr;
-				*ptr = MASK(pptr, ptr, nptr, 4);
-				*pptr = tmp;
-				ptr++;
-				nptr++;
-				pptr++;
-
-				tmp = *ptr;
-				*ptr = MASK(pptr, ptr, nptr, 4);
-				*pptr = tmp;
-				ptr++;
-				nptr++;
-				pptr++;
-
-				tmp = *ptr;
-				*ptr = MASK(pptr, ptr, nptr, 4);
-				*pptr = tmp;
-				ptr++;
-				nptr++;
-				pptr++;
-
-				tmp = *ptr;
-				*ptr = MASK(pptr, ptr, nptr, 4);
-				*pptr = tmp;
-				ptr++;
-				nptr++;
-				pptr++;
-			}
-			pptr = tmpp;
-			ptr += 8;
-			nptr += 8;
-			pptr += 8;
-		}
+	for (band = 0; band < job.nbands; band++) {
+		first = r_parallel_band_start(band, job.nbands, image->height - 2) + 1;
+		last = r_parallel_band_start(band + 1, job.nbands, image->height - 2);
+		memcpy(job.saved + 2 * band * stride, image->data + (first - 1) * stride, stride);
+		memcpy(job.saved + (2 * band + 1) * stride, image->data + (last + 1) * stride, stride);
 	}
 
-	free(tmpp);
+	r_parallel_run(job.nbands, image->height - 2, blur_band, &job);
+
+	free(job.saved);
+
+	if (job.failed) {
+		RErrorCode = RERR_NOMEMORY;
+		return False;
+	}
 
 	return True;
 }
@@ -29,6 +29,7 @@
 
 #include "config.h"
 #include "wraster.h"
+#include "parallel.h"
 
 static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0, int b0, int rf, int gf, int bf);
 static RImage *renderVGradient(unsigned width, unsigned height, int r0, int g0, int b0, int rf, int gf, int bf);
@@ -38,6 +39,9 @@ static RImage *renderMHGradient(unsigned width, unsigned height, RColor ** color
 static RImage *renderMVGradient(unsigned width, unsigned height, RColor ** colors, int count);
 static RImage *renderMDGradient(unsigned width, unsigned height, RColor ** colors, int count);
 
+static void renderGradientRows(RImage *image, int first_row, const unsigned char *line,
+                               const unsigned char **lines, const unsigned char *colors);
+
 RImage *RRenderMultiGradient(unsigned width, unsigned height, RColor **colors, RGradientStyle style)
 {
 	int count;
@@ -171,6 +175,56 @@ static inline unsigned char *renderGradientWidth(unsigned char *ptr, unsigned wi
 	return ptr;
 }
 
+typedef struct {
+	RImage *image;
+	int first_row;
+	const unsigned char *line;	/* same line for all rows */
+	const unsigned char **lines;	/* or one line per row */
+	const unsigned char *colors;	/* or one r,g,b colour per row */
+} GradientRowsJob;
+
+static void gradient_rows_band(void *data, int band, int first, int last)
+{
+	GradientRowsJob *job = data;
+	unsigned lineSize = job->image->width * 3;
+	unsigned char *ptr;
+	int y;
+
+	(void)band;
+
+	first += job->first_row;
+	last += job->first_row;
+	ptr = job->image->data + first * lineSize;
+
+	for (y = first; y <= last; y++) {
+		if (job->colors)
+			renderGradientWidth(ptr, job->image->width,
+			                    job->colors[3 * y], job->colors[3 * y + 1], job->colors[3 * y + 2]);
+		else
+			memcpy(ptr, job->lines ? job->lines[y] : job->line, lineSize);
+		ptr += lineSize;
+	}
+}
+
+/*
+ * Fill the rows of an RGB image starting at first_row, either by copying
+ * 'line' in all of them, by copying lines[row], or with colors[row]
+ */
+static void renderGradientRows(RImage *image, int first_row, const unsigned char *line,
+                               const unsigned char **lines, const unsigned char *colors)
+{
+	GradientRowsJob job;
+	int rows = image->height - first_row;
+
+	job.image = image;
+	job.first_row = first_row;
+	job.line = line;
+	job.lines = lines;
+	job.colors = colors;
+
+	r_parallel_run(r_parallel_bands(rows, 64), rows, gradient_rows_band, &job);
+}
+
 /*
  *----------------------------------------------------------------------
  * renderVGradient--
@@ -270,7 +324,6 @@ static RImage *renderMHGradient(unsigned width, unsigned height, RColor ** color
 {
 	int i, j, k;
 	long r, g, b, dr, dg, db;
-	unsigned lineSize = width * 3;
 	RImage *image;
 	unsigned char *ptr;
 	unsigned width2;
@@ -322,9 +375,8 @@ static RImage *renderMHGradient(unsigned width, unsigned height, RColor ** color
 	}
 
 	/* copy the first line to the other lines */
-	for (i = 1; i < height; i++) {
-		memcpy(&(image->data[i * lineSize]), image->data, lineSize);
-	}
+	if (height > 1)
+		renderGradientRows(image, 1, image->data, NULL, NULL);
 	return image;
 }
 
@@ -332,9 +384,8 @@ static RImage *renderMVGradient(unsigned width, unsigned height, RColor ** color
 {
 	int i, j, k;
 	long r, g, b, dr, dg, db;
-	unsigned lineSize = width * 3;
 	RImage *image;
-	unsigned char *ptr, *tmp;
+	unsigned char *ptr, *line_colors;
 	unsigned height2;
 
 	assert(count > 2);
@@ -343,7 +394,15 @@ static RImage *renderMVGradient(unsigned width, unsigned height, RColor ** color
 	if (!image) {
 		return NULL;
 	}
-	ptr = image->data;
+
+	/* compute the colour of each line, then fill them */
+	line_colors = malloc(height * 3);
+	if (!line_colors) {
+		RErrorCode = RERR_NOMEMORY;
+		RReleaseImage(image);
+		return NULL;
+	}
+	ptr = line_colors;
 
 	if (count > height)
 		count = height;
@@ -365,7 +424,9 @@ static RImage *renderMVGradient(unsigned width, unsigned height, RColor ** color
 		db = ((int)(colors[i]->blue - colors[i - 1]->blue) << 16) / (int)height2;
 
 		for (j = 0; j < height2; j++) {
-			ptr = renderGradientWidth(ptr, width, r >> 16, g >> 16, b >> 16);
+			*ptr++ = (unsigned char)(r >> 16);
+			*ptr++ = (unsigned char)(g >> 16);
+			*ptr++ = (unsigned char)(b >> 16);
 			r += dr;
 			g += dg;
 			b += db;
@@ -376,15 +437,15 @@ static RImage *renderMVGradient(unsigned width, unsigned height, RColor ** color
 		b = colors[i]->blue << 16;
 	}
 
-	if (k < height) {
-		tmp = ptr;
-		ptr = renderGradientWidth(ptr, width, r >> 16, g >> 16, b >> 16);
-		for (j = k + 1; j < height; j++) {
-			memcpy(ptr, tmp, lineSize);
-			ptr += lineSize;
-		}
+	for (j = k; j < height; j++) {
+		*ptr++ = (unsigned char)(r >> 16);
+		*ptr++ = (unsigned char)(g >> 16);
+		*ptr++ = (unsigned char)(b >> 16);
 	}
 
+	renderGradientRows(image, 0, NULL, NULL, line_colors);
+	free(line_colors);
+
 	return image;
 }
 
@@ -394,6 +455,7 @@ static RImage *renderMDGradient(unsigned width, unsigned height, RColor ** color
 	float a, offset;
 	int j;
 	unsigned char *ptr;
+	const unsigned char **lines;
 
 	assert(count > 2);
 
@@ -425,14 +487,24 @@ static RImage *renderMDGradient(unsigned width, unsigned height, RColor ** color
 	}
 	ptr = tmp->data;
 
+	lines = malloc(height * sizeof(unsigned char *));
+	if (!lines) {
+		RErrorCode = RERR_NOMEMORY;
+		RReleaseImage(tmp);
+		RReleaseImage(image);
+		return NULL;
+	}
+
 	a = ((float)(width - 1)) / ((float)(height - 1));
-	width = width * 3;
 
 	/* copy the first line to the other lines with corresponding offset */
-	for (j = 0, offset = 0; j < width * height; j += width) {
-		memcpy(&(image->data[j]), &ptr[3 * (int)offset], width);
+	for (j = 0, offset = 0; j < height; j++) {
+		lines[j] = &ptr[3 * (int)offset];
 		offset += a;
 	}
+	renderGradientRows(image, 0, NULL, lines, NULL);
+
+	free(lines);
 	RReleaseImage(tmp);
 	return image;
 }
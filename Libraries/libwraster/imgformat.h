@@ -49,21 +49,31 @@ typedef enum {
 
 /*
  * Function for Loading in a specific format
+ *
+ * The loaders taking a max_width x max_height box may return an image
+ * reduced while decoding when the full image does not fit in the box; the
+ * reduced image is never smaller than the size needed to fit in the box,
+ * and never fits in it, so an image that fits in the box is always the
+ * full size image. A box of 0 x 0 loads the full size image. The size of
+ * the full image is stored in full_width x full_height either way.
  */
 RImage *RLoadPPM(const char *file);
 
 RImage *RLoadXPM(RContext *context, const char *file);
 
 #ifdef USE_TIFF
-RImage *RLoadTIFF(const char *file, int index);
+RImage *RLoadTIFF(const char *file, int index, unsigned max_width, unsigned max_height,
+                  unsigned *full_width, unsigned *full_height);
 #endif
 
 #ifdef USE_PNG
-RImage *RLoadPNG(RContext *context, const char *file);
+RImage *RLoadPNG(RContext *context, const char *file, unsigned max_width, unsigned max_height,
+                 unsigned *full_width, unsigned *full_height);
 #endif
 
 #ifdef USE_JPEG
-RImage *RLoadJPEG(const char *file);
+RImage *RLoadJPEG(const char *file, unsigned max_width, unsigned max_height,
+                  unsigned *full_width, unsigned *full_height);
 #endif
 
 #ifdef USE_GIF
@@ -80,6 +90,38 @@ RImage *RLoadMagick(const char *file_name);
 void RReleaseMagick(void);
 #endif
 
+/*
+ * Reduction by an integer factor of images read row by row
+ */
+typedef struct RImageReducer {
+	RImage *image;		/* reduced image */
+	unsigned int *sums;	/* 4 sums per pixel of the reduced row */
+	int factor;
+	int width;		/* size of the source image */
+	int height;
+	int channels;		/* 3 or 4, same for source and reduced image */
+	int nrows;		/* source rows in sums */
+	int y;			/* next source row */
+	int row;		/* next reduced row */
+} RImageReducer;
+
+/* size of the image scaled down to fit in the box, keeping its aspect */
+void r_fit_size(unsigned width, unsigned height, unsigned max_width, unsigned max_height,
+                unsigned *fit_width, unsigned *fit_height);
+
+/* largest factor usable for a reduction, following the rules given above */
+int r_reduce_factor(unsigned width, unsigned height, unsigned max_width, unsigned max_height);
+
+RImageReducer *r_reducer_create(unsigned width, unsigned height, int alpha, int factor);
+
+/* add the next source row, in the format of the reduced image */
+void r_reducer_add_row(RImageReducer *reducer, const unsigned char *row);
+
+/* returns the reduced image and frees the reducer */
+RImage *r_reducer_finish(RImageReducer *reducer);
+
+void r_reducer_destroy(RImageReducer *reducer);
+
 /*
  * Function for Saving in a specific format
  */
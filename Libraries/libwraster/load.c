@@ -31,26 +31,46 @@
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "wraster.h"
 #include "imgformat.h"
 
 
+/*
+ * Loaded images are kept in a cache indexed by file name (and image index
+ * for multi-image formats). Entries are found through a hash table and kept
+ * in a doubly linked list ordered from the most to the least recently used
+ * one, so eviction always drops the real LRU entry.
+ *
+ * The cache holds a reference on each image; RLoadSharedImage() hands out
+ * more references to the same RImage, RLoadImage() returns a private copy.
+ *
+ * Images may be loaded from several threads: the cache is used with
+ * cache_lock held, files are decoded without it.
+ */
 typedef struct RCachedImage {
 	RImage *image;
 	char *file;
+	int index;
+	unsigned int hash;
+	size_t size;		/* bytes used by image data */
 	time_t last_modif;	/* last time file was modified */
-	time_t last_use;	/* last time image was used */
+	time_t last_check;	/* last time last_modif was validated */
+
+	struct RCachedImage *hnext;	/* next in hash bucket */
+	struct RCachedImage *prev;	/* LRU list, toward most recent */
+	struct RCachedImage *next;	/* LRU list, toward least recent */
 } RCachedImage;
 
 /*
- * Number of image to keep in the cache
+ * Maximum number of images to keep in the cache
  */
 static int RImageCacheSize = -1;
 
-#define IMAGE_CACHE_DEFAULT_NBENTRIES	  8
-#define IMAGE_CACHE_MAXIMUM_NBENTRIES	256
+#define IMAGE_CACHE_DEFAULT_NBENTRIES	 64
+#define IMAGE_CACHE_MAXIMUM_NBENTRIES	4096
 
 /*
  * Max. size of image (in pixels) to store in the cache
@@ -60,8 +80,38 @@ static int RImageCacheMaxImage = -1;	/* 0 = any size */
 #define IMAGE_CACHE_DEFAULT_MAXPIXELS	(64 * 64)
 #define IMAGE_CACHE_MAXIMUM_MAXPIXELS	(256 * 256)
 
+/*
+ * Max. total size (in bytes) of the image data kept in the cache
+ */
+static size_t RImageCacheMaxBytes;
+
+#define IMAGE_CACHE_DEFAULT_MAXBYTES	(2 * 1024 * 1024)
+#define IMAGE_CACHE_MAXIMUM_MAXBYTES	(256 * 1024 * 1024)
 
-static RCachedImage *RImageCache;
+/*
+ * Min. delay (in seconds) between two checks of the file modification time
+ * for a cached image. 0 = check on every lookup.
+ */
+static int RImageCacheCheckDelay;
+
+#define IMAGE_CACHE_DEFAULT_CHECKDELAY	0
+
+#define IMAGE_CACHE_HASH_SIZE	256	/* must be a power of 2 */
+
+static struct {
+	RCachedImage *buckets[IMAGE_CACHE_HASH_SIZE];
+	RCachedImage *lru_first;	/* most recently used */
+	RCachedImage *lru_last;		/* least recently used */
+	int count;
+	size_t bytes;
+
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	unsigned long invalidations;
+} RImageCache;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 static WRImgFormat identFile(const char *path);
@@ -102,9 +152,20 @@ char **RSupportedFileFormats(void)
 	return tmp;
 }
 
+static time_t cache_clock(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return time(NULL);
+
+	return ts.tv_sec;
+}
+
 static void init_cache(void)
 {
 	char *tmp;
+	long value;
 
 	tmp = getenv("RIMAGE_CACHE");
 	if (!tmp || sscanf(tmp, "%i", &RImageCacheSize) != 1)
@@ -122,62 +183,185 @@ static void init_cache(void)
 	if (RImageCacheMaxImage > IMAGE_CACHE_MAXIMUM_MAXPIXELS)
 		RImageCacheMaxImage = IMAGE_CACHE_MAXIMUM_MAXPIXELS;
 
-	if (RImageCacheSize > 0) {
-		RImageCache = malloc(sizeof(RCachedImage) * RImageCacheSize);
-		if (RImageCache == NULL) {
-			printf("wrlib: out of memory for image cache\n");
-			return;
-		}
-		memset(RImageCache, 0, sizeof(RCachedImage) * RImageCacheSize);
+	tmp = getenv("RIMAGE_CACHE_BYTES");
+	if (!tmp || sscanf(tmp, "%li", &value) != 1)
+		value = IMAGE_CACHE_DEFAULT_MAXBYTES;
+	if (value < 0)
+		value = 0;
+	if (value > IMAGE_CACHE_MAXIMUM_MAXBYTES)
+		value = IMAGE_CACHE_MAXIMUM_MAXBYTES;
+	RImageCacheMaxBytes = value;
+
+	tmp = getenv("RIMAGE_CACHE_CHECK");
+	if (!tmp || sscanf(tmp, "%i", &RImageCacheCheckDelay) != 1)
+		RImageCacheCheckDelay = IMAGE_CACHE_DEFAULT_CHECKDELAY;
+	if (RImageCacheCheckDelay < 0)
+		RImageCacheCheckDelay = 0;
+
+	if (RImageCacheMaxBytes == 0)
+		RImageCacheSize = 0;
+}
+
+static unsigned int cache_hash(const char *file, int index)
+{
+	/* FNV-1a */
+	unsigned int hash = 2166136261u;
+
+	while (*file) {
+		hash ^= (unsigned char)*file++;
+		hash *= 16777619u;
 	}
+	hash ^= (unsigned int)index;
+	hash *= 16777619u;
+
+	return hash;
 }
 
-void RReleaseCache(void)
+static void cache_lru_unlink(RCachedImage *entry)
 {
-	int i;
-
-	if (RImageCacheSize > 0) {
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (RImageCache[i].file) {
-				RReleaseImage(RImageCache[i].image);
-				free(RImageCache[i].file);
-			}
-		}
-		free(RImageCache);
-		RImageCache = NULL;
-		RImageCacheSize = -1;
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		RImageCache.lru_first = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		RImageCache.lru_last = entry->prev;
+
+	entry->prev = entry->next = NULL;
+}
+
+static void cache_lru_push(RCachedImage *entry)
+{
+	entry->prev = NULL;
+	entry->next = RImageCache.lru_first;
+	if (RImageCache.lru_first)
+		RImageCache.lru_first->prev = entry;
+	else
+		RImageCache.lru_last = entry;
+	RImageCache.lru_first = entry;
+}
+
+static RCachedImage *cache_lookup(const char *file, int index, unsigned int hash)
+{
+	RCachedImage *entry;
+
+	entry = RImageCache.buckets[hash & (IMAGE_CACHE_HASH_SIZE - 1)];
+	while (entry) {
+		if (entry->hash == hash && entry->index == index && strcmp(entry->file, file) == 0)
+			return entry;
+		entry = entry->hnext;
 	}
+
+	return NULL;
 }
 
-RImage *RLoadImage(RContext *context, const char *file, int index)
+static void cache_remove(RCachedImage *entry)
 {
-	RImage *image = NULL;
-	int i;
-	struct stat st;
+	RCachedImage **link;
 
-	assert(file != NULL);
+	link = &RImageCache.buckets[entry->hash & (IMAGE_CACHE_HASH_SIZE - 1)];
+	while (*link != entry)
+		link = &(*link)->hnext;
+	*link = entry->hnext;
 
-	if (RImageCacheSize < 0)
-		init_cache();
+	cache_lru_unlink(entry);
 
-	if (RImageCacheSize > 0) {
+	RImageCache.count--;
+	RImageCache.bytes -= entry->size;
 
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (RImageCache[i].file && strcmp(file, RImageCache[i].file) == 0) {
+	RReleaseImage(entry->image);
+	free(entry->file);
+	free(entry);
+}
 
-				if (stat(file, &st) == 0 && st.st_mtime == RImageCache[i].last_modif) {
-					RImageCache[i].last_use = time(NULL);
+static void cache_insert(const char *file, int index, unsigned int hash, RImage *image, time_t mtime)
+{
+	RCachedImage *entry;
+	size_t size;
+
+	size = (size_t)image->width * image->height * (image->format == RRGBAFormat ? 4 : 3);
+	if (size > RImageCacheMaxBytes)
+		return;
+
+	/* another thread may have loaded the same file meanwhile */
+	entry = cache_lookup(file, index, hash);
+	if (entry)
+		cache_remove(entry);
+
+	/* make room by dropping least recently used images */
+	while (RImageCache.lru_last &&
+	       (RImageCache.count >= RImageCacheSize || RImageCache.bytes + size > RImageCacheMaxBytes)) {
+		cache_remove(RImageCache.lru_last);
+		RImageCache.evictions++;
+	}
 
-					return RCloneImage(RImageCache[i].image);
+	entry = malloc(sizeof(RCachedImage));
+	if (entry == NULL)
+		return;
+	memset(entry, 0, sizeof(RCachedImage));
 
-				} else {
-					free(RImageCache[i].file);
-					RImageCache[i].file = NULL;
-					RReleaseImage(RImageCache[i].image);
-				}
-			}
-		}
+	entry->file = malloc(strlen(file) + 1);
+	if (entry->file == NULL) {
+		free(entry);
+		return;
 	}
+	strcpy(entry->file, file);
+	entry->index = index;
+	entry->hash = hash;
+	entry->size = size;
+	entry->last_modif = mtime;
+	entry->last_check = cache_clock();
+	entry->image = RRetainImage(image);
+
+	entry->hnext = RImageCache.buckets[hash & (IMAGE_CACHE_HASH_SIZE - 1)];
+	RImageCache.buckets[hash & (IMAGE_CACHE_HASH_SIZE - 1)] = entry;
+	cache_lru_push(entry);
+
+	RImageCache.count++;
+	RImageCache.bytes += size;
+}
+
+void RReleaseCache(void)
+{
+	pthread_mutex_lock(&cache_lock);
+	while (RImageCache.lru_last)
+		cache_remove(RImageCache.lru_last);
+
+	RImageCacheSize = -1;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void RGetImageCacheStats(RImageCacheStats *stats)
+{
+	assert(stats != NULL);
+
+	pthread_mutex_lock(&cache_lock);
+	if (RImageCacheSize < 0)
+		init_cache();
+
+	stats->hits = RImageCache.hits;
+	stats->misses = RImageCache.misses;
+	stats->evictions = RImageCache.evictions;
+	stats->invalidations = RImageCache.invalidations;
+	stats->count = RImageCache.count;
+	stats->bytes = RImageCache.bytes;
+	stats->max_count = RImageCacheSize;
+	stats->max_bytes = RImageCacheMaxBytes;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/*
+ * The size of the full image is stored in full_width x full_height when
+ * they are not NULL, even if the loader reduced the image.
+ */
+static RImage *load_image_file(RContext *context, const char *file, int index,
+                               unsigned max_width, unsigned max_height,
+                               unsigned *full_width, unsigned *full_height)
+{
+	RImage *image = NULL;
+	unsigned width = 0, height = 0;
 
 	switch (identFile(file)) {
 	case IM_ERROR:
@@ -201,19 +385,19 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 
 #ifdef USE_TIFF
 	case IM_TIFF:
-		image = RLoadTIFF(file, index);
+		image = RLoadTIFF(file, index, max_width, max_height, &width, &height);
 		break;
 #endif				/* USE_TIFF */
 
 #ifdef USE_PNG
 	case IM_PNG:
-		image = RLoadPNG(context, file);
+		image = RLoadPNG(context, file, max_width, max_height, &width, &height);
 		break;
 #endif				/* USE_PNG */
 
 #ifdef USE_JPEG
 	case IM_JPEG:
-		image = RLoadJPEG(file);
+		image = RLoadJPEG(file, max_width, max_height, &width, &height);
 		break;
 #endif				/* USE_JPEG */
 
@@ -238,45 +422,179 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 		return NULL;
 	}
 
-	/* store image in cache */
-	if (RImageCacheSize > 0 && image &&
-	    (RImageCacheMaxImage == 0 || RImageCacheMaxImage >= image->width * image->height)) {
-		time_t oldest = time(NULL);
-		int oldest_idx = 0;
-		int done = 0;
-
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (!RImageCache[i].file) {
-				RImageCache[i].file = malloc(strlen(file) + 1);
-				strcpy(RImageCache[i].file, file);
-				RImageCache[i].image = RCloneImage(image);
-				RImageCache[i].last_modif = st.st_mtime;
-				RImageCache[i].last_use = time(NULL);
-				done = 1;
-				break;
-			} else {
-				if (oldest > RImageCache[i].last_use) {
-					oldest = RImageCache[i].last_use;
-					oldest_idx = i;
-				}
-			}
+	/* the other loaders always give the full size image */
+	if (image && width == 0) {
+		width = image->width;
+		height = image->height;
+	}
+	if (full_width)
+		*full_width = width;
+	if (full_height)
+		*full_height = height;
+
+	return image;
+}
+
+/* Images in the cache are never reduced */
+static RImage *full_size_image(RImage *image, unsigned *full_width, unsigned *full_height)
+{
+	if (full_width)
+		*full_width = image->width;
+	if (full_height)
+		*full_height = image->height;
+
+	return image;
+}
+
+/*
+ * Returns a new reference on the cached image for 'file', or loads it and
+ * stores it in the cache. The returned image may be shared with the cache
+ * and other callers.
+ *
+ * With a max_width x max_height box, the image may be reduced while it is
+ * loaded (see imgformat.h); only full size images go in the cache. The size
+ * of the full image is stored as in load_image_file().
+ */
+static RImage *load_cached_image(RContext *context, const char *file, int index,
+                                 unsigned max_width, unsigned max_height,
+                                 unsigned *full_width, unsigned *full_height)
+{
+	RImage *image;
+	RCachedImage *entry;
+	unsigned int hash;
+	struct stat st;
+	time_t now;
+
+	assert(file != NULL);
+
+	pthread_mutex_lock(&cache_lock);
+	if (RImageCacheSize < 0)
+		init_cache();
+
+	if (RImageCacheSize == 0) {
+		pthread_mutex_unlock(&cache_lock);
+		return load_image_file(context, file, index, max_width, max_height,
+		                       full_width, full_height);
+	}
+
+	hash = cache_hash(file, index);
+	entry = cache_lookup(file, index, hash);
+	if (entry) {
+		now = cache_clock();
+		if (RImageCacheCheckDelay > 0 && now - entry->last_check < RImageCacheCheckDelay) {
+			RImageCache.hits++;
+			cache_lru_unlink(entry);
+			cache_lru_push(entry);
+			image = RRetainImage(entry->image);
+			pthread_mutex_unlock(&cache_lock);
+			return full_size_image(image, full_width, full_height);
 		}
 
-		/* if no slot available, dump least recently used one */
-		if (!done) {
-			free(RImageCache[oldest_idx].file);
-			RReleaseImage(RImageCache[oldest_idx].image);
-			RImageCache[oldest_idx].file = malloc(strlen(file) + 1);
-			strcpy(RImageCache[oldest_idx].file, file);
-			RImageCache[oldest_idx].image = RCloneImage(image);
-			RImageCache[oldest_idx].last_modif = st.st_mtime;
-			RImageCache[oldest_idx].last_use = time(NULL);
+		if (stat(file, &st) == 0 && st.st_mtime == entry->last_modif) {
+			RImageCache.hits++;
+			entry->last_check = now;
+			cache_lru_unlink(entry);
+			cache_lru_push(entry);
+			image = RRetainImage(entry->image);
+			pthread_mutex_unlock(&cache_lock);
+			return full_size_image(image, full_width, full_height);
 		}
+
+		RImageCache.invalidations++;
+		cache_remove(entry);
+	}
+
+	RImageCache.misses++;
+	pthread_mutex_unlock(&cache_lock);
+
+	if (stat(file, &st) != 0) {
+		RErrorCode = RERR_OPEN;
+		return NULL;
+	}
+
+	image = load_image_file(context, file, index, max_width, max_height,
+	                        full_width, full_height);
+
+	if (image && max_width > 0 && max_height > 0 &&
+	    (image->width > max_width || image->height > max_height))
+		return image;
+
+	if (image && (RImageCacheMaxImage == 0 || RImageCacheMaxImage >= image->width * image->height)) {
+		pthread_mutex_lock(&cache_lock);
+		cache_insert(file, index, hash, image, st.st_mtime);
+		pthread_mutex_unlock(&cache_lock);
 	}
 
 	return image;
 }
 
+/* Whether the cache holds a reference on the image too */
+static int is_shared_image(RImage *image)
+{
+	int shared;
+
+	pthread_mutex_lock(&cache_lock);
+	shared = image->refCount > 1;
+	pthread_mutex_unlock(&cache_lock);
+
+	return shared;
+}
+
+RImage *RLoadImage(RContext *context, const char *file, int index)
+{
+	RImage *image, *copy;
+
+	image = load_cached_image(context, file, index, 0, 0, NULL, NULL);
+	if (image == NULL || !is_shared_image(image))
+		return image;
+
+	/* the image is shared with the cache: caller gets its own copy */
+	copy = RCloneImage(image);
+	RReleaseImage(image);
+
+	return copy;
+}
+
+RImage *RLoadSharedImage(RContext *context, const char *file, int index)
+{
+	return load_cached_image(context, file, index, 0, 0, NULL, NULL);
+}
+
+RImage *RLoadImageAtSize(RContext *context, const char *file, int index,
+                         unsigned max_width, unsigned max_height)
+{
+	RImage *image, *scaled;
+	unsigned full_width, full_height, width, height;
+
+	if (max_width == 0 || max_height == 0)
+		return RLoadImage(context, file, index);
+
+	image = load_cached_image(context, file, index, max_width, max_height,
+	                          &full_width, &full_height);
+	if (image == NULL)
+		return NULL;
+
+	if (image->width <= max_width && image->height <= max_height) {
+		if (!is_shared_image(image))
+			return image;
+
+		scaled = RCloneImage(image);
+		RReleaseImage(image);
+		return scaled;
+	}
+
+	/*
+	 * Finish what the loader could not do while decoding. The size comes
+	 * from the full image: loaders reduce by different factors, and the
+	 * rounding of the reduced size would show in the result.
+	 */
+	r_fit_size(full_width, full_height, max_width, max_height, &width, &height);
+	scaled = RSmoothScaleImage(image, width, height);
+	RReleaseImage(image);
+
+	return scaled;
+}
+
 char *RGetImageFileFormat(const char *file)
 {
 	switch (identFile(file)) {
@@ -90,11 +90,11 @@ static noreturn void my_error_exit(j_common_ptr cinfo)
 	longjmp(myerr->setjmp_buffer, 1);
 }
 
-RImage *RLoadJPEG(const char *file_name)
+RImage *RLoadJPEG(const char *file_name, unsigned max_width, unsigned max_height,
+                  unsigned *full_width, unsigned *full_height)
 {
-	RImage *image = NULL;
 	struct jpeg_decompress_struct cinfo;
-	int i;
+	int i, factor, denom;
 	unsigned char *ptr;
 	JSAMPROW buffer[1], bptr;
 	FILE *file;
@@ -103,6 +103,11 @@ RImage *RLoadJPEG(const char *file_name)
 	 * struct, to avoid dangling-pointer problems.
 	 */
 	struct my_error_mgr jerr;
+	/* Set after setjmp() and freed when the JPEG code signals an error */
+	RImage *volatile image = NULL;
+	JSAMPROW volatile line = NULL;
+	unsigned char *volatile row = NULL;
+	RImageReducer *volatile reducer = NULL;
 
 	file = fopen(file_name, "rb");
 	if (!file) {
@@ -119,6 +124,14 @@ RImage *RLoadJPEG(const char *file_name)
 		 */
 		jpeg_destroy_decompress(&cinfo);
 		fclose(file);
+		if (line)
+			free(line);
+		if (row)
+			free(row);
+		if (reducer)
+			r_reducer_destroy(reducer);
+		if (image)
+			RReleaseImage(image);
 		return NULL;
 	}
 
@@ -129,17 +142,11 @@ RImage *RLoadJPEG(const char *file_name)
 	jpeg_read_header(&cinfo, TRUE);
 
 	if (cinfo.image_width < 1 || cinfo.image_height < 1) {
-		buffer[0] = NULL;	/* Initialize pointer to avoid spurious free in cleanup code */
 		RErrorCode = RERR_BADIMAGEFILE;
 		goto bye;
 	}
-
-	buffer[0] = (JSAMPROW) malloc(cinfo.image_width * cinfo.num_components);
-
-	if (!buffer[0]) {
-		RErrorCode = RERR_NOMEMORY;
-		goto bye;
-	}
+	*full_width = cinfo.image_width;
+	*full_height = cinfo.image_height;
 
 	if (cinfo.jpeg_color_space == JCS_GRAYSCALE) {
 		cinfo.out_color_space = JCS_GRAYSCALE;
@@ -148,46 +155,85 @@ RImage *RLoadJPEG(const char *file_name)
 	cinfo.quantize_colors = FALSE;
 	cinfo.do_fancy_upsampling = FALSE;
 	cinfo.do_block_smoothing = FALSE;
+
+	/* the IDCT can reduce by 2, 4 or 8 at almost no cost, we do the rest */
+	factor = r_reduce_factor(cinfo.image_width, cinfo.image_height, max_width, max_height);
+	denom = 8;
+	while (denom > factor)
+		denom /= 2;
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = denom;
+
 	jpeg_calc_output_dimensions(&cinfo);
 
-	image = RCreateImage(cinfo.image_width, cinfo.image_height, False);
+	factor = r_reduce_factor(cinfo.output_width, cinfo.output_height, max_width, max_height);
 
-	if (!image) {
+	line = (JSAMPROW) malloc(cinfo.output_width * cinfo.output_components);
+
+	if (!line) {
 		RErrorCode = RERR_NOMEMORY;
 		goto bye;
 	}
-	jpeg_start_decompress(&cinfo);
 
-	ptr = image->data;
-
-	if (cinfo.out_color_space == JCS_RGB) {
-		while (cinfo.output_scanline < cinfo.output_height) {
-			jpeg_read_scanlines(&cinfo, buffer, (JDIMENSION) 1);
-			bptr = buffer[0];
-			memcpy(ptr, bptr, cinfo.image_width * 3);
-			ptr += cinfo.image_width * 3;
+	if (factor > 1) {
+		row = malloc(cinfo.output_width * 3);
+		if (!row) {
+			RErrorCode = RERR_NOMEMORY;
+			goto bye;
 		}
+		reducer = r_reducer_create(cinfo.output_width, cinfo.output_height, False, factor);
+		if (!reducer)
+			goto bye;
+		ptr = row;
 	} else {
-		while (cinfo.output_scanline < cinfo.output_height) {
-			jpeg_read_scanlines(&cinfo, buffer, (JDIMENSION) 1);
-			bptr = buffer[0];
-			for (i = 0; i < cinfo.image_width; i++) {
-				*ptr++ = *bptr;
-				*ptr++ = *bptr;
-				*ptr++ = *bptr++;
+		image = RCreateImage(cinfo.output_width, cinfo.output_height, False);
+		if (!image) {
+			RErrorCode = RERR_NOMEMORY;
+			goto bye;
+		}
+		ptr = image->data;
+	}
+
+	buffer[0] = line;
+	jpeg_start_decompress(&cinfo);
+
+	while (cinfo.output_scanline < cinfo.output_height) {
+		jpeg_read_scanlines(&cinfo, buffer, (JDIMENSION) 1);
+		bptr = buffer[0];
+		if (cinfo.out_color_space == JCS_RGB) {
+			memcpy(ptr, bptr, cinfo.output_width * 3);
+		} else {
+			for (i = 0; i < cinfo.output_width; i++) {
+				ptr[3 * i] = *bptr;
+				ptr[3 * i + 1] = *bptr;
+				ptr[3 * i + 2] = *bptr++;
 			}
 		}
+
+		if (reducer)
+			r_reducer_add_row(reducer, row);
+		else
+			ptr += cinfo.output_width * 3;
 	}
 
 	jpeg_finish_decompress(&cinfo);
 
+	if (reducer) {
+		image = r_reducer_finish(reducer);
+		reducer = NULL;
+	}
+
  bye:
 	jpeg_destroy_decompress(&cinfo);
 
 	fclose(file);
 
-	if (buffer[0])
-		free(buffer[0]);
+	if (line)
+		free(line);
+	if (row)
+		free(row);
+	if (reducer)
+		r_reducer_destroy(reducer);
 
 	return image;
 }
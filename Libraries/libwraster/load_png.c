@@ -30,21 +30,23 @@
 #include "wraster.h"
 #include "imgformat.h"
 
-RImage *RLoadPNG(RContext *context, const char *file)
+RImage *RLoadPNG(RContext *context, const char *file, unsigned max_width, unsigned max_height,
+                 unsigned *full_width, unsigned *full_height)
 {
 	char *tmp;
-	RImage *image = NULL;
+	RImage *volatile image = NULL;
 	FILE *f;
 	png_structp png;
 	png_infop pinfo, einfo;
 	png_color_16p bkcolor;
 	int alpha;
-	int x, y, i;
+	int y;
 	double gamma, sgamma;
 	png_uint_32 width, height;
 	int depth, junk, color_type;
-	png_bytep *png_rows;
-	unsigned char *ptr;
+	png_bytep *volatile png_rows = NULL;
+	RImageReducer *volatile reducer = NULL;
+	int factor;
 
 	f = fopen(file, "rb");
 	if (!f) {
@@ -84,6 +86,10 @@ RImage *RLoadPNG(RContext *context, const char *file)
 		png_destroy_read_struct(&png, &pinfo, &einfo);
 		if (image)
 			RReleaseImage(image);
+		if (reducer)
+			r_reducer_destroy(reducer);
+		if (png_rows)
+			free(png_rows);
 		return NULL;
 	}
 
@@ -100,6 +106,8 @@ RImage *RLoadPNG(RContext *context, const char *file)
 		RErrorCode = RERR_BADIMAGEFILE;
 		return NULL;
 	}
+	*full_width = width;
+	*full_height = height;
 
 	/* check for an alpha channel */
 	if (png_get_valid(png, pinfo, PNG_INFO_tRNS))
@@ -107,12 +115,27 @@ RImage *RLoadPNG(RContext *context, const char *file)
 	else
 		alpha = (color_type & PNG_COLOR_MASK_ALPHA);
 
+	/* interlaced images can only be read whole */
+	if (png_get_interlace_type(png, pinfo) == PNG_INTERLACE_NONE)
+		factor = r_reduce_factor(width, height, max_width, max_height);
+	else
+		factor = 1;
+
 	/* allocate RImage */
-	image = RCreateImage(width, height, alpha);
-	if (!image) {
-		fclose(f);
-		png_destroy_read_struct(&png, &pinfo, &einfo);
-		return NULL;
+	if (factor > 1) {
+		reducer = r_reducer_create(width, height, alpha, factor);
+		if (!reducer) {
+			fclose(f);
+			png_destroy_read_struct(&png, &pinfo, &einfo);
+			return NULL;
+		}
+	} else {
+		image = RCreateImage(width, height, alpha);
+		if (!image) {
+			fclose(f);
+			png_destroy_read_struct(&png, &pinfo, &einfo);
+			return NULL;
+		}
 	}
 
 	/* normalize to 8bpp with alpha channel */
@@ -149,40 +172,49 @@ RImage *RLoadPNG(RContext *context, const char *file)
 	else
 		png_set_gamma(png, sgamma, 0.45);
 
+	if (factor == 1)
+		png_set_interlace_handling(png);
+
 	/* do the transforms */
 	png_read_update_info(png, pinfo);
 
 	/* set background color */
 	if (png_get_bKGD(png, pinfo, &bkcolor)) {
-		image->background.red = bkcolor->red >> 8;
-		image->background.green = bkcolor->green >> 8;
-		image->background.blue = bkcolor->blue >> 8;
+		RImage *target = reducer ? reducer->image : image;
+
+		target->background.red = bkcolor->red >> 8;
+		target->background.green = bkcolor->green >> 8;
+		target->background.blue = bkcolor->blue >> 8;
 	}
 
-	png_rows = calloc(height, sizeof(png_bytep));
-	if (!png_rows) {
-		RErrorCode = RERR_NOMEMORY;
-		fclose(f);
-		RReleaseImage(image);
-		png_destroy_read_struct(&png, &pinfo, &einfo);
-		return NULL;
+	if (png_get_rowbytes(png, pinfo) != width * (alpha ? 4 : 3)) {
+		RErrorCode = RERR_BADIMAGEFILE;
+		png_error(png, "unexpected row size");
 	}
-	for (y = 0; y < height; y++) {
-		png_rows[y] = malloc(png_get_rowbytes(png, pinfo));
-		if (!png_rows[y]) {
+
+	if (reducer) {
+		/* stream the rows through a single buffer */
+		png_rows = malloc(sizeof(png_bytep) + png_get_rowbytes(png, pinfo));
+		if (!png_rows) {
 			RErrorCode = RERR_NOMEMORY;
-			fclose(f);
-			RReleaseImage(image);
-			png_destroy_read_struct(&png, &pinfo, &einfo);
-			while (y-- > 0)
-				if (png_rows[y])
-					free(png_rows[y]);
-			free(png_rows);
-			return NULL;
+			png_error(png, "out of memory");
+		}
+		png_rows[0] = (png_bytep) (png_rows + 1);
+		for (y = 0; y < height; y++) {
+			png_read_row(png, png_rows[0], NULL);
+			r_reducer_add_row(reducer, png_rows[0]);
 		}
+	} else {
+		/* read data directly into the RImage */
+		png_rows = calloc(height, sizeof(png_bytep));
+		if (!png_rows) {
+			RErrorCode = RERR_NOMEMORY;
+			png_error(png, "out of memory");
+		}
+		for (y = 0; y < height; y++)
+			png_rows[y] = image->data + (size_t)y * png_get_rowbytes(png, pinfo);
+		png_read_image(png, png_rows);
 	}
-	/* read data */
-	png_read_image(png, png_rows);
 
 	png_read_end(png, einfo);
 
@@ -190,25 +222,10 @@ RImage *RLoadPNG(RContext *context, const char *file)
 
 	fclose(f);
 
-	ptr = image->data;
-
-	/* convert to RImage */
-	if (alpha) {
-		for (y = 0; y < height; y++) {
-			for (x = 0, i = width * 4; x < i; x++, ptr++) {
-				*ptr = *(png_rows[y] + x);
-			}
-		}
-	} else {
-		for (y = 0; y < height; y++) {
-			for (x = 0, i = width * 3; x < i; x++, ptr++) {
-				*ptr = *(png_rows[y] + x);
-			}
-		}
-	}
-	for (y = 0; y < height; y++)
-		if (png_rows[y])
-			free(png_rows[y]);
 	free(png_rows);
+
+	if (reducer)
+		image = r_reducer_finish(reducer);
+
 	return image;
 }
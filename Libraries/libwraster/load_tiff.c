@@ -31,18 +31,100 @@
 #include "wraster.h"
 #include "imgformat.h"
 
-RImage *RLoadTIFF(const char *file, int index)
+static void convertRow(const uint32 *data, unsigned char *ptr, uint32 width, int alpha, int amode)
+{
+	uint32 x;
+
+	for (x = 0; x < width; x++, data++) {
+		ptr[0] = (*data) & 0xff;
+		ptr[1] = (*data >> 8) & 0xff;
+		ptr[2] = (*data >> 16) & 0xff;
+
+		if (alpha) {
+			ptr[3] = (*data >> 24) & 0xff;
+
+			if (amode && (ptr[3] > 0)) {
+				ptr[0] = (ptr[0] * 255) / ptr[3];
+				ptr[1] = (ptr[1] * 255) / ptr[3];
+				ptr[2] = (ptr[2] * 255) / ptr[3];
+			}
+			ptr += 4;
+		} else {
+			ptr += 3;
+		}
+	}
+}
+
+/*
+ * Reads the image one strip at a time and reduces it on the fly, so that
+ * only one strip is in memory at full size
+ */
+static RImage *loadStrips(TIFF *tif, uint32 width, uint32 height, int alpha, int amode, int factor)
+{
+	RImageReducer *reducer;
+	uint32 rows_per_strip, y;
+	uint32 *data;
+	unsigned char *row;
+	int i, nrows;
+
+	TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+	if (rows_per_strip > height)
+		rows_per_strip = height;
+
+	data = (uint32 *) _TIFFmalloc(width * rows_per_strip * sizeof(uint32));
+	row = malloc(width * 4);
+	if (!data || !row) {
+		RErrorCode = RERR_NOMEMORY;
+		if (data)
+			_TIFFfree(data);
+		if (row)
+			free(row);
+		return NULL;
+	}
+
+	reducer = r_reducer_create(width, height, alpha, factor);
+	if (!reducer) {
+		_TIFFfree(data);
+		free(row);
+		return NULL;
+	}
+
+	for (y = 0; y < height; y += rows_per_strip) {
+		if (!TIFFReadRGBAStrip(tif, y, data)) {
+			RErrorCode = RERR_BADIMAGEFILE;
+			r_reducer_destroy(reducer);
+			_TIFFfree(data);
+			free(row);
+			return NULL;
+		}
+
+		/* rows of the strip are stored upside down too */
+		nrows = (height - y < rows_per_strip) ? height - y : rows_per_strip;
+		for (i = nrows - 1; i >= 0; i--) {
+			convertRow(data + i * width, row, width, alpha, amode);
+			r_reducer_add_row(reducer, row);
+		}
+	}
+
+	_TIFFfree(data);
+	free(row);
+
+	return r_reducer_finish(reducer);
+}
+
+RImage *RLoadTIFF(const char *file, int index, unsigned max_width, unsigned max_height,
+                  unsigned *full_width, unsigned *full_height)
 {
 	RImage *image = NULL;
 	TIFF *tif;
 	int i;
-	unsigned char *r, *g, *b, *a;
 	uint16 alpha, amode;
 	uint32 width, height;
 	uint32 *data, *ptr;
 	uint16 extrasamples;
 	uint16 *sampleinfo;
-	int ch;
+	uint16 orientation;
+	int factor;
 
 	tif = TIFFOpen(file, "r");
 	if (!tif)
@@ -74,6 +156,20 @@ RImage *RLoadTIFF(const char *file, int index)
 		TIFFClose(tif);
 		return NULL;
 	}
+	*full_width = width;
+	*full_height = height;
+
+	/* strips in top to bottom order can be reduced while reading */
+	factor = 1;
+	TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &orientation);
+	if (!TIFFIsTiled(tif) && orientation == ORIENTATION_TOPLEFT)
+		factor = r_reduce_factor(width, height, max_width, max_height);
+
+	if (factor > 1) {
+		image = loadStrips(tif, width, height, alpha, amode, factor);
+		TIFFClose(tif);
+		return image;
+	}
 
 	/* read data */
 	ptr = data = (uint32 *) _TIFFmalloc(width * height * sizeof(uint32));
@@ -88,46 +184,16 @@ RImage *RLoadTIFF(const char *file, int index)
 			/* convert data */
 			image = RCreateImage(width, height, alpha);
 
-			if (alpha)
-				ch = 4;
-			else
-				ch = 3;
-
 			if (image) {
-				int x, y;
-
-				r = image->data;
-				g = image->data + 1;
-				b = image->data + 2;
-				a = image->data + 3;
+				unsigned char *p = image->data;
+				int y;
 
 				/* data seems to be stored upside down */
 				data += width * (height - 1);
 				for (y = 0; y < height; y++) {
-					for (x = 0; x < width; x++) {
-
-						*(r) = (*data) & 0xff;
-						*(g) = (*data >> 8) & 0xff;
-						*(b) = (*data >> 16) & 0xff;
-
-						if (alpha) {
-							*(a) = (*data >> 24) & 0xff;
-
-							if (amode && (*a > 0)) {
-								*r = (*r * 255) / *(a);
-								*g = (*g * 255) / *(a);
-								*b = (*b * 255) / *(a);
-							}
-
-							a += 4;
-						}
-
-						r += ch;
-						g += ch;
-						b += ch;
-						data++;
-					}
-					data -= 2 * width;
+					convertRow(data, p, width, alpha, amode);
+					p += width * (alpha ? 4 : 3);
+					data -= width;
 				}
 			}
 		}
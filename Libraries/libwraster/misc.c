@@ -28,6 +28,8 @@
 #include "wraster.h"
 #include "imgformat.h"
 #include "convert.h"
+#include "scale.h"
+#include "parallel.h"
 
 
 void RBevelImage(RImage * image, int bevel_type)
@@ -253,5 +255,7 @@ void RShutdown(void)
 	RReleaseMagick();
 #endif
 	RReleaseCache();
+	wraster_release_scale_tables();
 	r_destroy_conversion_tables();
+	r_parallel_shutdown();
 }
@@ -0,0 +1,222 @@
+/* parallel.c - thread pool for image operations
+ *
+ * Raster graphics library
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Operations are split in bands of rows whose boundaries only depend on
+ * the number of bands, and each band is computed exactly like the serial
+ * code would do, so the result does not depend on which thread did what.
+ *
+ * Only one operation uses the pool at a time: if the pool is busy (another
+ * thread, or a band calling a threaded operation itself) the operation is
+ * run in the calling thread.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <X11/Xlib.h>
+
+#include "config.h"
+#include "wraster.h"
+#include "parallel.h"
+
+
+#define MAXIMUM_THREADS	64
+
+static int thread_count = -1;	/* -1 = not initialized yet */
+
+static pthread_t workers[MAXIMUM_THREADS];
+static int worker_count;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static struct {
+	RBandFunction *func;
+	void *data;
+	int nbands;
+	int rows;
+	int next_band;		/* next band to hand out */
+	int done_bands;
+	int active;
+	unsigned long serial;	/* incremented for each job */
+	int quit;
+} job;
+
+
+static int cpu_count(void)
+{
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	if (n > MAXIMUM_THREADS)
+		return MAXIMUM_THREADS;
+	return n;
+}
+
+static void init_threads(void)
+{
+	char *tmp;
+
+	tmp = getenv("WRASTER_THREADS");
+	if (!tmp || sscanf(tmp, "%i", &thread_count) != 1)
+		thread_count = 1;
+	if (thread_count < 0)
+		thread_count = 1;
+	if (thread_count == 0)
+		thread_count = cpu_count();
+	if (thread_count > MAXIMUM_THREADS)
+		thread_count = MAXIMUM_THREADS;
+}
+
+/* take bands of the current job until there are none left; called locked */
+static void run_bands(void)
+{
+	int band, first, last;
+
+	while (job.next_band < job.nbands) {
+		band = job.next_band++;
+		first = r_parallel_band_start(band, job.nbands, job.rows);
+		last = r_parallel_band_start(band + 1, job.nbands, job.rows) - 1;
+
+		pthread_mutex_unlock(&pool_lock);
+		job.func(job.data, band, first, last);
+		pthread_mutex_lock(&pool_lock);
+
+		if (++job.done_bands == job.nbands)
+			pthread_cond_signal(&done_cond);
+	}
+}
+
+static void *worker_main(void *arg)
+{
+	unsigned long serial = 0;
+
+	(void)arg;
+
+	pthread_mutex_lock(&pool_lock);
+	for (;;) {
+		while (!job.quit && (!job.active || job.serial == serial))
+			pthread_cond_wait(&work_cond, &pool_lock);
+		if (job.quit)
+			break;
+
+		serial = job.serial;
+		run_bands();
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	return NULL;
+}
+
+void r_parallel_shutdown(void)
+{
+	int i;
+
+	pthread_mutex_lock(&pool_lock);
+	job.quit = 1;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&pool_lock);
+
+	for (i = 0; i < worker_count; i++)
+		pthread_join(workers[i], NULL);
+	worker_count = 0;
+	job.quit = 0;
+}
+
+void wraster_set_threads(int count)
+{
+	if (count < 0)
+		count = 1;
+	if (count == 0)
+		count = cpu_count();
+	if (count > MAXIMUM_THREADS)
+		count = MAXIMUM_THREADS;
+
+	if (worker_count > count - 1)
+		r_parallel_shutdown();
+
+	thread_count = count;
+}
+
+int r_parallel_bands(int rows, int min_rows)
+{
+	int nbands;
+
+	if (thread_count < 0)
+		init_threads();
+
+	if (thread_count <= 1 || min_rows < 1)
+		return 1;
+
+	nbands = rows / min_rows;
+	if (nbands > thread_count)
+		nbands = thread_count;
+	if (nbands < 1)
+		nbands = 1;
+
+	return nbands;
+}
+
+void r_parallel_run(int nbands, int rows, RBandFunction *func, void *data)
+{
+	int band;
+
+	if (nbands > 1) {
+		pthread_mutex_lock(&pool_lock);
+
+		/* start the missing workers */
+		while (worker_count < thread_count - 1) {
+			if (pthread_create(&workers[worker_count], NULL, worker_main, NULL) != 0)
+				break;
+			worker_count++;
+		}
+
+		if (!job.active && worker_count > 0) {
+			job.func = func;
+			job.data = data;
+			job.nbands = nbands;
+			job.rows = rows;
+			job.next_band = 0;
+			job.done_bands = 0;
+			job.active = 1;
+			job.serial++;
+			pthread_cond_broadcast(&work_cond);
+
+			run_bands();
+			while (job.done_bands < job.nbands)
+				pthread_cond_wait(&done_cond, &pool_lock);
+
+			job.active = 0;
+			pthread_mutex_unlock(&pool_lock);
+			return;
+		}
+		pthread_mutex_unlock(&pool_lock);
+	}
+
+	/* same bands, in the calling thread */
+	for (band = 0; band < nbands; band++)
+		func(data, band, r_parallel_band_start(band, nbands, rows),
+		     r_parallel_band_start(band + 1, nbands, rows) - 1);
+}
@@ -0,0 +1,67 @@
+/*
+ * Raster graphics library
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library.
+ */
+
+/*
+ * Thread pool used to split image operations in bands of rows
+ *
+ * The functions here are for WRaster library's internal use only,
+ * Please use functions in 'wraster.h' in applications
+ */
+
+#ifndef __WRASTER_PARALLEL_H__
+#define __WRASTER_PARALLEL_H__
+
+
+/*
+ * Function called for each band: process rows 'first' to 'last' included.
+ * Bands are numbered from 0, they never overlap and cover all the rows.
+ */
+typedef void RBandFunction(void *data, int band, int first, int last);
+
+/*
+ * Set the number of threads used for image operations, the calling thread
+ * included. 1 disables threading, 0 uses one thread per CPU.
+ */
+void wraster_set_threads(int count);
+
+/*
+ * Returns how many bands should be used to process 'rows' rows, so that no
+ * band has less than 'min_rows' rows. Returns 1 when threading is disabled.
+ */
+int r_parallel_bands(int rows, int min_rows);
+
+/*
+ * Returns the first row of band 'band' when 'rows' are split in 'nbands'
+ */
+static inline int r_parallel_band_start(int band, int nbands, int rows)
+{
+	return (int)((long)rows * band / nbands);
+}
+
+/*
+ * Run 'func' on each of the 'nbands' bands of 'rows' rows and wait for all
+ * of them to complete. The calling thread takes part in the work.
+ */
+void r_parallel_run(int nbands, int rows, RBandFunction *func, void *data);
+
+/*
+ * Stop the worker threads
+ */
+void r_parallel_shutdown(void);
+
+
+#endif
@@ -28,6 +28,7 @@
 
 #include "config.h"
 #include "wraster.h"
+#include "parallel.h"
 
 char *WRasterLibVersion = "0.9";
 
@@ -79,7 +80,7 @@ RImage *RCreateImage(unsigned width, unsigned height, int alpha)
 RImage *RRetainImage(RImage * image)
 {
 	if (image)
-		image->refCount++;
+		__atomic_add_fetch(&image->refCount, 1, __ATOMIC_RELAXED);
 
 	return image;
 }
@@ -88,9 +89,8 @@ void RReleaseImage(RImage * image)
 {
 	assert(image != NULL);
 
-	image->refCount--;
-
-	if (image->refCount < 1) {
+	/* images shared with the cache may be released from other threads */
+	if (__atomic_sub_fetch(&image->refCount, 1, __ATOMIC_ACQ_REL) < 1) {
 		free(image->data);
 		free(image);
 	}
@@ -298,16 +298,13 @@ static int calculateCombineArea(RImage *des, int *sx, int *sy, unsigned int *swi
 	return False;
 }
 
-void RCombineArea(RImage * image, RImage * src, int sx, int sy, unsigned width, unsigned height, int dx, int dy)
+static void combineArea(RImage * image, RImage * src, int sx, int sy, unsigned width, unsigned height, int dx, int dy)
 {
 	int x, y, dwi, swi;
 	unsigned char *d;
 	unsigned char *s;
 	int alpha, calpha;
 
-	if (!calculateCombineArea(image, &sx, &sy, &width, &height, &dx, &dy))
-		return;
-
 	if (!HAS_ALPHA(src)) {
 		if (!HAS_ALPHA(image)) {
 			swi = src->width * 3;
@@ -377,6 +374,48 @@ void RCombineArea(RImage * image, RImage * src, int sx, int sy, unsigned width,
 	}
 }
 
+typedef struct {
+	RImage *image;
+	RImage *src;
+	int sx, sy;
+	unsigned width;
+	int dx, dy;
+} CombineAreaJob;
+
+static void combine_area_band(void *data, int band, int first, int last)
+{
+	CombineAreaJob *job = data;
+
+	(void)band;
+
+	combineArea(job->image, job->src, job->sx, job->sy + first, job->width, last - first + 1,
+		    job->dx, job->dy + first);
+}
+
+void RCombineArea(RImage * image, RImage * src, int sx, int sy, unsigned width, unsigned height, int dx, int dy)
+{
+	CombineAreaJob job;
+	int nbands;
+
+	if (!calculateCombineArea(image, &sx, &sy, &width, &height, &dx, &dy))
+		return;
+
+	nbands = r_parallel_bands(height, width < 256 ? height : 64);
+	if (nbands == 1) {
+		combineArea(image, src, sx, sy, width, height, dx, dy);
+		return;
+	}
+
+	job.image = image;
+	job.src = src;
+	job.sx = sx;
+	job.sy = sy;
+	job.width = width;
+	job.dx = dx;
+	job.dy = dy;
+	r_parallel_run(nbands, height, combine_area_band, &job);
+}
+
 void RCopyArea(RImage * image, RImage * src, int sx, int sy, unsigned width, unsigned height, int dx, int dy)
 {
 	int x, y, dwi, swi;
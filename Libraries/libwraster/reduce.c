@@ -0,0 +1,216 @@
+/* reduce.c - shrink images by an integer factor while they are loaded
+ *
+ * Raster graphics library
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Loaders that can read their file row by row feed the rows to a reducer,
+ * which averages each block of factor x factor pixels into one pixel of
+ * the destination image. Only one row of sums is kept, so the full size
+ * image is never in memory.
+ *
+ * Color is averaged weighted by alpha, so that fully transparent pixels do
+ * not bleed into the visible ones.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+
+#include "config.h"
+#include "wraster.h"
+#include "imgformat.h"
+
+
+void r_fit_size(unsigned width, unsigned height, unsigned max_width, unsigned max_height,
+                unsigned *fit_width, unsigned *fit_height)
+{
+	if (max_width == 0 || max_height == 0 || (width <= max_width && height <= max_height)) {
+		*fit_width = width;
+		*fit_height = height;
+	} else if ((unsigned long)width * max_height > (unsigned long)height * max_width) {
+		*fit_width = max_width;
+		*fit_height = ((unsigned long)height * max_width + width / 2) / width;
+	} else {
+		*fit_width = ((unsigned long)width * max_height + height / 2) / height;
+		*fit_height = max_height;
+	}
+
+	if (*fit_width < 1)
+		*fit_width = 1;
+	if (*fit_height < 1)
+		*fit_height = 1;
+}
+
+/* keeps the sums of a block of alpha weighted colors in 32 bits */
+#define MAXIMUM_FACTOR	255
+
+int r_reduce_factor(unsigned width, unsigned height, unsigned max_width, unsigned max_height)
+{
+	unsigned fw, fh, w, h;
+	int factor;
+
+	if (max_width == 0 || max_height == 0)
+		return 1;
+
+	r_fit_size(width, height, max_width, max_height, &fw, &fh);
+
+	for (factor = MAXIMUM_FACTOR; factor > 1; factor--) {
+		w = (width + factor - 1) / factor;
+		h = (height + factor - 1) / factor;
+
+		/*
+		 * Do not go under the final size, and keep the reduced image
+		 * larger than the box: this way an image that fits in the box
+		 * after loading is always the full size image.
+		 */
+		if (w >= fw && h >= fh && (w > max_width || h > max_height))
+			return factor;
+	}
+
+	return 1;
+}
+
+RImageReducer *r_reducer_create(unsigned width, unsigned height, int alpha, int factor)
+{
+	RImageReducer *reducer;
+
+	reducer = malloc(sizeof(RImageReducer));
+	if (!reducer) {
+		RErrorCode = RERR_NOMEMORY;
+		return NULL;
+	}
+	memset(reducer, 0, sizeof(RImageReducer));
+
+	reducer->factor = factor;
+	reducer->width = width;
+	reducer->height = height;
+	reducer->channels = alpha ? 4 : 3;
+
+	reducer->image = RCreateImage((width + factor - 1) / factor, (height + factor - 1) / factor, alpha);
+	if (!reducer->image) {
+		free(reducer);
+		return NULL;
+	}
+
+	reducer->sums = calloc(reducer->image->width * 4, sizeof(unsigned int));
+	if (!reducer->sums) {
+		RErrorCode = RERR_NOMEMORY;
+		RReleaseImage(reducer->image);
+		free(reducer);
+		return NULL;
+	}
+
+	return reducer;
+}
+
+static void flush_sums(RImageReducer *reducer)
+{
+	RImage *image = reducer->image;
+	unsigned char *ptr;
+	unsigned int *sum = reducer->sums;
+	unsigned int n, last_n;
+	int x;
+
+	ptr = image->data + (size_t)reducer->row * image->width * reducer->channels;
+
+	n = reducer->nrows * reducer->factor;
+	last_n = reducer->nrows * (reducer->width - (image->width - 1) * reducer->factor);
+
+	for (x = 0; x < image->width; x++, sum += 4) {
+		if (x == image->width - 1)
+			n = last_n;
+
+		if (reducer->channels == 4) {
+			if (sum[3] == 0) {
+				ptr[0] = ptr[1] = ptr[2] = ptr[3] = 0;
+			} else {
+				ptr[0] = (sum[0] + sum[3] / 2) / sum[3];
+				ptr[1] = (sum[1] + sum[3] / 2) / sum[3];
+				ptr[2] = (sum[2] + sum[3] / 2) / sum[3];
+				ptr[3] = (sum[3] + n / 2) / n;
+			}
+			ptr += 4;
+		} else {
+			ptr[0] = (sum[0] + n / 2) / n;
+			ptr[1] = (sum[1] + n / 2) / n;
+			ptr[2] = (sum[2] + n / 2) / n;
+			ptr += 3;
+		}
+	}
+
+	memset(reducer->sums, 0, image->width * 4 * sizeof(unsigned int));
+	reducer->nrows = 0;
+	reducer->row++;
+}
+
+void r_reducer_add_row(RImageReducer *reducer, const unsigned char *row)
+{
+	unsigned int *sum = reducer->sums;
+	int x, i;
+
+	if (reducer->row >= reducer->image->height)
+		return;
+
+	for (x = 0; x < reducer->width; x += reducer->factor, sum += 4) {
+		int end = x + reducer->factor;
+
+		if (end > reducer->width)
+			end = reducer->width;
+
+		if (reducer->channels == 4) {
+			for (i = x; i < end; i++, row += 4) {
+				sum[0] += row[0] * row[3];
+				sum[1] += row[1] * row[3];
+				sum[2] += row[2] * row[3];
+				sum[3] += row[3];
+			}
+		} else {
+			for (i = x; i < end; i++, row += 3) {
+				sum[0] += row[0];
+				sum[1] += row[1];
+				sum[2] += row[2];
+			}
+		}
+	}
+
+	reducer->nrows++;
+	reducer->y++;
+	if (reducer->nrows == reducer->factor || reducer->y == reducer->height)
+		flush_sums(reducer);
+}
+
+RImage *r_reducer_finish(RImageReducer *reducer)
+{
+	RImage *image = reducer->image;
+
+	if (reducer->nrows > 0)
+		flush_sums(reducer);
+
+	free(reducer->sums);
+	free(reducer);
+
+	return image;
+}
+
+void r_reducer_destroy(RImageReducer *reducer)
+{
+	RReleaseImage(reducer->image);
+	free(reducer->sums);
+	free(reducer);
+}
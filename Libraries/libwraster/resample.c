@@ -0,0 +1,280 @@
+/* resample.c - fixed-point row kernels for smoothed scaling
+ *
+ * Raster graphics library
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * All kernels work on 4 bytes per pixel and accumulate in 32 bits
+ * integers, so the SIMD versions produce exactly the same result as the
+ * scalar ones.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+
+#include "config.h"
+#include "wraster.h"
+#include "resample.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define RESAMPLE_X86
+#include <immintrin.h>
+#endif
+
+
+static inline unsigned char clamp_sum(int sum)
+{
+	sum = (sum + (RESAMPLE_ONE >> 1)) >> RESAMPLE_BITS;
+
+	if (sum < 0)
+		return 0;
+	if (sum > 255)
+		return 255;
+	return sum;
+}
+
+void r_resample_row_h_scalar(const unsigned char *src, unsigned char *dst, const RScaleTable *table)
+{
+	const int *index = table->index;
+	const short *weight = table->weight;
+	int i, k;
+
+	for (i = 0; i < table->dst_size; i++) {
+		int r = 0, g = 0, b = 0, a = 0;
+
+		for (k = 0; k < table->ntaps; k++) {
+			const unsigned char *s = src + (index[k] << 2);
+
+			r += s[0] * weight[k];
+			g += s[1] * weight[k];
+			b += s[2] * weight[k];
+			a += s[3] * weight[k];
+		}
+		*dst++ = clamp_sum(r);
+		*dst++ = clamp_sum(g);
+		*dst++ = clamp_sum(b);
+		*dst++ = clamp_sum(a);
+
+		index += table->ntaps;
+		weight += table->ntaps;
+	}
+}
+
+void r_resample_row_v_scalar(unsigned char *const *rows, const short *weight, int ntaps,
+                             unsigned char *dst, int nbytes)
+{
+	int x, k;
+
+	for (x = 0; x < nbytes; x++) {
+		int sum = 0;
+
+		for (k = 0; k < ntaps; k++)
+			sum += rows[k][x] * weight[k];
+		dst[x] = clamp_sum(sum);
+	}
+}
+
+#ifdef RESAMPLE_X86
+
+static void resample_row_h_sse2(const unsigned char *src, unsigned char *dst, const RScaleTable *table)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(RESAMPLE_ONE >> 1);
+	const int *index = table->index;
+	const short *weight = table->weight;
+	int i, k;
+
+	for (i = 0; i < table->dst_size; i++) {
+		__m128i acc = _mm_setzero_si128();
+		int p0, p1;
+
+		/* taps are processed by pairs: (p0.r p1.r p0.g p1.g ...) * (w0 w1 w0 w1 ...) */
+		for (k = 0; k < table->ntaps; k += 2) {
+			__m128i a, b, w;
+
+			memcpy(&p0, src + (index[k] << 2), 4);
+			memcpy(&p1, src + (index[k + 1] << 2), 4);
+			a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p0), zero);
+			b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p1), zero);
+			w = _mm_set1_epi32(((unsigned short)weight[k]) | ((int)weight[k + 1] << 16));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+		}
+		acc = _mm_srai_epi32(_mm_add_epi32(acc, round), RESAMPLE_BITS);
+		acc = _mm_packs_epi32(acc, acc);
+		p0 = _mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+		memcpy(dst, &p0, 4);
+		dst += 4;
+
+		index += table->ntaps;
+		weight += table->ntaps;
+	}
+}
+
+static void resample_row_v_sse2(unsigned char *const *rows, const short *weight, int ntaps,
+                                unsigned char *dst, int nbytes)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(RESAMPLE_ONE >> 1);
+	int x, k;
+
+	for (x = 0; x + 16 <= nbytes; x += 16) {
+		__m128i acc0, acc1, acc2, acc3;
+
+		acc0 = acc1 = acc2 = acc3 = _mm_setzero_si128();
+		for (k = 0; k < ntaps; k += 2) {
+			__m128i r0, r1, lo, hi, w;
+
+			r0 = _mm_loadu_si128((const __m128i *)(rows[k] + x));
+			r1 = _mm_loadu_si128((const __m128i *)(rows[k + 1] + x));
+			w = _mm_set1_epi32(((unsigned short)weight[k]) | ((int)weight[k + 1] << 16));
+
+			lo = _mm_unpacklo_epi8(r0, zero);
+			hi = _mm_unpacklo_epi8(r1, zero);
+			acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, hi), w));
+			acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, hi), w));
+
+			lo = _mm_unpackhi_epi8(r0, zero);
+			hi = _mm_unpackhi_epi8(r1, zero);
+			acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(lo, hi), w));
+			acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(lo, hi), w));
+		}
+		acc0 = _mm_srai_epi32(_mm_add_epi32(acc0, round), RESAMPLE_BITS);
+		acc1 = _mm_srai_epi32(_mm_add_epi32(acc1, round), RESAMPLE_BITS);
+		acc2 = _mm_srai_epi32(_mm_add_epi32(acc2, round), RESAMPLE_BITS);
+		acc3 = _mm_srai_epi32(_mm_add_epi32(acc3, round), RESAMPLE_BITS);
+		_mm_storeu_si128((__m128i *)(dst + x),
+		                 _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3)));
+	}
+
+	if (x < nbytes) {
+		unsigned char *tail[ntaps];
+
+		for (k = 0; k < ntaps; k++)
+			tail[k] = rows[k] + x;
+		r_resample_row_v_scalar(tail, weight, ntaps, dst + x, nbytes - x);
+	}
+}
+
+/*
+ * Same as the SSE2 version on 32 bytes at a time. The AVX2 unpack/pack
+ * instructions work inside each 128 bits lane, so the byte order is kept.
+ */
+__attribute__((target("avx2")))
+static void resample_row_v_avx2(unsigned char *const *rows, const short *weight, int ntaps,
+                                unsigned char *dst, int nbytes)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i round = _mm256_set1_epi32(RESAMPLE_ONE >> 1);
+	int x, k;
+
+	for (x = 0; x + 32 <= nbytes; x += 32) {
+		__m256i acc0, acc1, acc2, acc3;
+
+		acc0 = acc1 = acc2 = acc3 = _mm256_setzero_si256();
+		for (k = 0; k < ntaps; k += 2) {
+			__m256i r0, r1, lo, hi, w;
+
+			r0 = _mm256_loadu_si256((const __m256i *)(rows[k] + x));
+			r1 = _mm256_loadu_si256((const __m256i *)(rows[k + 1] + x));
+			w = _mm256_set1_epi32(((unsigned short)weight[k]) | ((int)weight[k + 1] << 16));
+
+			lo = _mm256_unpacklo_epi8(r0, zero);
+			hi = _mm256_unpacklo_epi8(r1, zero);
+			acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(lo, hi), w));
+			acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(lo, hi), w));
+
+			lo = _mm256_unpackhi_epi8(r0, zero);
+			hi = _mm256_unpackhi_epi8(r1, zero);
+			acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(lo, hi), w));
+			acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(lo, hi), w));
+		}
+		acc0 = _mm256_srai_epi32(_mm256_add_epi32(acc0, round), RESAMPLE_BITS);
+		acc1 = _mm256_srai_epi32(_mm256_add_epi32(acc1, round), RESAMPLE_BITS);
+		acc2 = _mm256_srai_epi32(_mm256_add_epi32(acc2, round), RESAMPLE_BITS);
+		acc3 = _mm256_srai_epi32(_mm256_add_epi32(acc3, round), RESAMPLE_BITS);
+		_mm256_storeu_si256((__m256i *)(dst + x),
+		                    _mm256_packus_epi16(_mm256_packs_epi32(acc0, acc1),
+		                                        _mm256_packs_epi32(acc2, acc3)));
+	}
+
+	if (x < nbytes) {
+		unsigned char *tail[ntaps];
+
+		for (k = 0; k < ntaps; k++)
+			tail[k] = rows[k] + x;
+		resample_row_v_sse2(tail, weight, ntaps, dst + x, nbytes - x);
+	}
+}
+
+#endif /* RESAMPLE_X86 */
+
+
+typedef void (*resample_h_func)(const unsigned char *, unsigned char *, const RScaleTable *);
+typedef void (*resample_v_func)(unsigned char *const *, const short *, int, unsigned char *, int);
+
+static resample_h_func resample_h;
+static resample_v_func resample_v;
+static const char *resample_name;
+
+static void select_kernels(void)
+{
+	resample_h = r_resample_row_h_scalar;
+	resample_v = r_resample_row_v_scalar;
+	resample_name = "scalar";
+
+	if (getenv("WRASTER_NO_SIMD"))
+		return;
+
+#ifdef RESAMPLE_X86
+	resample_h = resample_row_h_sse2;
+	resample_v = resample_row_v_sse2;
+	resample_name = "sse2";
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		resample_v = resample_row_v_avx2;
+		resample_name = "avx2";
+	}
+#endif
+}
+
+void r_resample_row_h(const unsigned char *src, unsigned char *dst, const RScaleTable *table)
+{
+	if (!resample_h)
+		select_kernels();
+
+	resample_h(src, dst, table);
+}
+
+void r_resample_row_v(unsigned char *const *rows, const short *weight, int ntaps,
+                      unsigned char *dst, int nbytes)
+{
+	if (!resample_v)
+		select_kernels();
+
+	resample_v(rows, weight, ntaps, dst, nbytes);
+}
+
+const char *r_resample_kernel_name(void)
+{
+	if (!resample_name)
+		select_kernels();
+
+	return resample_name;
+}
@@ -0,0 +1,78 @@
+/*
+ * Raster graphics library
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library.
+ */
+
+/*
+ * Fixed-point separable resampling kernels used by RSmoothScaleImage
+ *
+ * The functions here are for WRaster library's internal use only,
+ * Please use functions in 'wraster.h' in applications
+ */
+
+#ifndef __WRASTER_RESAMPLE_H__
+#define __WRASTER_RESAMPLE_H__
+
+
+/* weights are signed fixed point numbers with this many fraction bits */
+#define RESAMPLE_BITS	14
+#define RESAMPLE_ONE	(1 << RESAMPLE_BITS)
+
+/*
+ * Precomputed filter contributions for scaling one axis from src_size
+ * to dst_size pixels. Every destination pixel has exactly 'ntaps'
+ * contributors (padded with null weights, ntaps is always even):
+ * contributor k of pixel i is source pixel index[i * ntaps + k] with
+ * weight weight[i * ntaps + k].
+ */
+typedef struct RScaleTable {
+	int src_size;
+	int dst_size;
+	RScalingFilter filter;
+	int ntaps;
+	int *index;
+	short *weight;
+
+	int refCount;
+} RScaleTable;
+
+/*
+ * Filter one row of 4-byte pixels horizontally.
+ * 'src' holds table->src_size pixels, 'dst' receives table->dst_size pixels
+ */
+void r_resample_row_h(const unsigned char *src, unsigned char *dst, const RScaleTable *table);
+
+/*
+ * Filter vertically 'ntaps' rows of 'nbytes' bytes with the given weights
+ * into 'dst'
+ */
+void r_resample_row_v(unsigned char *const *rows, const short *weight, int ntaps,
+                      unsigned char *dst, int nbytes);
+
+/*
+ * Same as above, using only portable C code. Used as reference for tests
+ */
+void r_resample_row_h_scalar(const unsigned char *src, unsigned char *dst, const RScaleTable *table);
+
+void r_resample_row_v_scalar(unsigned char *const *rows, const short *weight, int ntaps,
+                             unsigned char *dst, int nbytes);
+
+/*
+ * Returns the name of the row kernels selected for the running CPU
+ */
+const char *r_resample_kernel_name(void);
+
+
+#endif
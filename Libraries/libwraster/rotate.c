@@ -30,6 +30,7 @@
 #include "config.h"
 #include "wraster.h"
 #include "rotate.h"
+#include "parallel.h"
 
 
 static RImage *rotate_image_90(RImage *source);
@@ -322,110 +323,92 @@ copyLine(int x1, int y1, int x2, int y2, int nwidth, int format, unsigned char *
 }
 #endif
 
-static RImage *rotate_image_any(RImage *source, float angle)
-{
-	(void) angle;
-	puts("NOT FULLY IMPLEMENTED");
-	return RCloneImage(source);
-#if 0
-	RImage *img;
-	int nwidth, nheight;
-	int x1, y1;
-	int x2, y2;
-	int dx, dy;
-	int xi, yi;
-	int xx, yy;
-	unsigned char *src, *dst;
-	int dpr, dpru, p;
-
-	/* only 180o for now */
-	if (angle > 180.0F)
-		angle -= 180.0F;
-
-	angle = (angle * WM_PI) / 180.0;
-
-	nwidth = ceil(abs(cos(angle) * image->width))
-	    + ceil(abs(cos(WM_PI / 2 - angle) * image->width));
-
-	nheight = ceil(abs(sin(angle) * image->height))
-	    + ceil(abs(cos(WM_PI / 2 - angle) * image->height));
-
-	img = RCreateImage(nwidth, nheight, True);
-	if (!img)
-		return NULL;
-
-	src = image->data;
-	dst = img->data;
-
-	x1 = floor(abs(cos(WM_PI / 2 - angle) * image->width));
-	y1 = 0;
-
-	x2 = 0;
-	y2 = floor(abs(sin(WM_PI / 2 - angle) * image->width));
+typedef struct {
+	RImage *source;
+	RImage *target;
+	/*
+	 * source position of target pixel (0, 0) and the steps along a row,
+	 * in pixels; bands turn them into 16.16 fixed point at each row
+	 */
+	double x0, y0;
+	double cosa, sina;
+} RotateJob;
 
-	xx = floor(abs(cos(angle) * image->height)) - 1;
-	yy = nheight - 1;
+static void rotate_rows_band(void *data, int band, int first, int last)
+{
+	RotateJob *job = data;
+	RImage *source = job->source;
+	int sch = (source->format == RRGBAFormat) ? 4 : 3;
+	int swidth = source->width << 16;
+	int sheight = source->height << 16;
+	int dxx, dxy;
+	int sx, sy;
+	int x, y;
+	unsigned char *optr, *nptr;
 
-	printf("%ix%i, %i %i     %i %i %i\n", nwidth, nheight, x1, y1, x2, y2, (int)((angle * 180.0) / WM_PI));
+	(void)band;
 
-	dx = abs(x2 - x1);
-	dy = abs(y2 - y1);
+	dxx = lrint(job->cosa * 65536.0);
+	dxy = lrint(-job->sina * 65536.0);
 
-	if (x1 > x2)
-		xi = -1;
-	else
-		xi = 1;
-	if (y1 > y2)
-		yi = -1;
-	else
-		yi = 1;
+	nptr = job->target->data + first * job->target->width * 4;
+	for (y = first; y <= last; y++) {
+		/* each row is started from its own position, not from the previous row */
+		sx = lrint((job->x0 + y * job->sina) * 65536.0);
+		sy = lrint((job->y0 + y * job->cosa) * 65536.0);
 
-	if (dx >= dy) {
-		dpr = dy << 1;
-		dpru = dpr - (dx << 1);
-		p = dpr - dx;
+		for (x = 0; x < job->target->width; x++) {
+			if (sx >= 0 && sx < swidth && sy >= 0 && sy < sheight) {
+				optr = source->data + ((sy >> 16) * source->width + (sx >> 16)) * sch;
+				nptr[0] = optr[0];
+				nptr[1] = optr[1];
+				nptr[2] = optr[2];
+				nptr[3] = (sch == 4) ? optr[3] : 255;
+			} else {
+				nptr[0] = nptr[1] = nptr[2] = nptr[3] = 0;
+			}
+			nptr += 4;
+			sx += dxx;
+			sy += dxy;
+		}
+	}
+}
 
-		while (dx-- >= 0) {
+/*
+ * Rotation by any angle, clockwise like the other functions. Each target
+ * pixel takes the colour of the nearest source pixel; target pixels outside
+ * of the source image are transparent.
+ */
+static RImage *rotate_image_any(RImage *source, float angle)
+{
+	RotateJob job;
+	double a, cosa, sina;
+	int nwidth, nheight;
 
-			copyLine(x1, y1, xx, yy, nwidth, image->format, dst, &src);
+	a = (angle * WM_PI) / 180.0;
+	cosa = cos(a);
+	sina = sin(a);
 
-			/* calc next step */
+	nwidth = ceil(fabs(cosa * source->width) + fabs(sina * source->height) - 0.001);
+	nheight = ceil(fabs(sina * source->width) + fabs(cosa * source->height) - 0.001);
+	if (nwidth < 1)
+		nwidth = 1;
+	if (nheight < 1)
+		nheight = 1;
 
-			if (p > 0) {
-				x1 += xi;
-				y1 += yi;
-				xx += xi;
-				yy += yi;
-				p += dpru;
-			} else {
-				x1 += xi;
-				xx += xi;
-				p += dpr;
-			}
-		}
-	} else {
-		dpr = dx << 1;
-		dpru = dpr - (dy << 1);
-		p = dpr - dy;
+	job.target = RCreateImage(nwidth, nheight, True);
+	if (!job.target)
+		return NULL;
 
-		while (dy-- >= 0) {
-			xx = abs(x1 * sin(angle * WM_PI / 180.0));
-			yy = abs(y1 * cos(angle * WM_PI / 180.0));
+	job.source = source;
+	job.cosa = cosa;
+	job.sina = sina;
 
-			copyLine(x1, y1, xx, yy, nwidth, image->format, dst, &src);
+	/* inverse rotation of the center of target pixel (0, 0) around the image center */
+	job.x0 = source->width / 2.0 + (0.5 - nwidth / 2.0) * cosa + (0.5 - nheight / 2.0) * sina;
+	job.y0 = source->height / 2.0 - (0.5 - nwidth / 2.0) * sina + (0.5 - nheight / 2.0) * cosa;
 
-			/* calc next step */
-			if (p > 0) {
-				x1 += xi;
-				y1 += yi;
-				p += dpru;
-			} else {
-				y1 += yi;
-				p += dpr;
-			}
-		}
-	}
+	r_parallel_run(r_parallel_bands(nheight, 32), nheight, rotate_rows_band, &job);
 
-	return img;
-#endif
+	return job.target;
 }
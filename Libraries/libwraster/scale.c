@@ -25,11 +25,14 @@
 #include <string.h>
 #include <X11/Xlib.h>
 #include <math.h>
+#include <pthread.h>
 #include <assert.h>
 
 #include "config.h"
 #include "wraster.h"
 #include "scale.h"
+#include "resample.h"
+#include "parallel.h"
 
 /*
  *----------------------------------------------------------------------
@@ -243,9 +246,19 @@ static double Mitchell_filter(double t)
 
 static double (*filterf)(double) = Mitchell_filter;
 static double fwidth = Mitchell_support;
+static RScalingFilter filter_type = RMitchellFilter;
+
+/*
+ * Guards the filter settings above and the scale table cache below, as
+ * images may be scaled from several threads.
+ */
+static pthread_mutex_t scale_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void wraster_change_filter(RScalingFilter type)
 {
+	pthread_mutex_lock(&scale_lock);
+	filter_type = type;
+
 	switch (type) {
 	case RBoxFilter:
 		filterf = box_filter;
@@ -268,11 +281,14 @@ void wraster_change_filter(RScalingFilter type)
 		fwidth = Lanczos3_support;
 		break;
 	default:
+		filter_type = RMitchellFilter;
+		/* Fall through */
 	case RMitchellFilter:
 		filterf = Mitchell_filter;
 		fwidth = Mitchell_support;
 		break;
 	}
+	pthread_mutex_unlock(&scale_lock);
 }
 
 /*
@@ -292,8 +308,13 @@ typedef struct {
 /* clamp the input to the specified range */
 #define CLAMP(v,l,h)    ((v)<(l) ? (l) : (v) > (h) ? (h) : v)
 
-/* return of calloc is not checked if NULL in the function below! */
-RImage *RSmoothScaleImage(RImage * src, unsigned new_width, unsigned new_height)
+/*
+ * Original floating point implementation of RSmoothScaleImage, kept as a
+ * reference for tests and benchmarks. Alpha channel is dropped.
+ *
+ * return of calloc is not checked if NULL in the function below!
+ */
+RImage *wraster_smooth_scale_reference(RImage * src, unsigned new_width, unsigned new_height)
 {
 	CLIST *contrib;			/* array of contribution lists */
 	RImage *tmp;		/* intermediate image */
@@ -494,3 +515,354 @@ RImage *RSmoothScaleImage(RImage * src, unsigned new_width, unsigned new_height)
 
 	return dst;
 }
+
+/*
+ * Fixed-point implementation
+ *
+ * The image is converted row by row to 4 bytes per pixel (with alpha
+ * premultiplied), filtered horizontally into an intermediate image, then
+ * each destination row is filtered vertically from the intermediate rows.
+ * Filter weights only depend on sizes and filter type, so the last tables
+ * computed are kept for reuse. Tables are made outside of scale_lock from
+ * the filter read under it.
+ */
+
+#define SCALE_TABLE_CACHE_SIZE	8
+
+static RScaleTable *scale_table_cache[SCALE_TABLE_CACHE_SIZE];	/* most recent first */
+
+static void free_scale_table(RScaleTable *table)
+{
+	free(table->index);
+	free(table->weight);
+	free(table);
+}
+
+/* called with scale_lock held */
+static void unref_scale_table(RScaleTable *table)
+{
+	if (--table->refCount < 1)
+		free_scale_table(table);
+}
+
+static void release_scale_table(RScaleTable *table)
+{
+	pthread_mutex_lock(&scale_lock);
+	unref_scale_table(table);
+	pthread_mutex_unlock(&scale_lock);
+}
+
+static RScaleTable *create_scale_table(int src_size, int dst_size, RScalingFilter filter,
+                                       double (*filter_func)(double), double filter_width)
+{
+	RScaleTable *table;
+	double *contrib;
+	double scale, width, fscale, center, sum;
+	int i, j, k, left, right, n, ntaps;
+
+	scale = (double)dst_size / (double)src_size;
+	if (scale < 1.0) {
+		width = filter_width / scale;
+		fscale = 1.0 / scale;
+	} else {
+		width = filter_width;
+		fscale = 1.0;
+	}
+
+	ntaps = (int)ceil(width * 2 + 1);
+	ntaps += ntaps & 1;
+
+	table = malloc(sizeof(RScaleTable));
+	contrib = malloc(ntaps * sizeof(double));
+	if (!table || !contrib) {
+		free(table);
+		free(contrib);
+		return NULL;
+	}
+	table->src_size = src_size;
+	table->dst_size = dst_size;
+	table->filter = filter;
+	table->ntaps = ntaps;
+	table->refCount = 1;
+	table->index = calloc(dst_size * ntaps, sizeof(int));
+	table->weight = calloc(dst_size * ntaps, sizeof(short));
+	if (!table->index || !table->weight) {
+		free(contrib);
+		free_scale_table(table);
+		return NULL;
+	}
+
+	for (i = 0; i < dst_size; i++) {
+		int *index = table->index + i * ntaps;
+		short *weight = table->weight + i * ntaps;
+		int total, largest;
+
+		center = (double)i / scale;
+		left = ceil(center - width);
+		right = floor(center + width);
+
+		sum = 0.0;
+		for (j = left, k = 0; j <= right && k < ntaps; j++, k++) {
+			contrib[k] = (*filter_func) ((center - (double)j) / fscale) / fscale;
+			sum += contrib[k];
+
+			/* mirror pixels outside of the image */
+			if (j < 0)
+				n = -j;
+			else if (j >= src_size)
+				n = (src_size - j) + src_size - 1;
+			else
+				n = j;
+			index[k] = CLAMP(n, 0, src_size - 1);
+		}
+		n = k;
+
+		/* normalize so that plain areas keep their exact colour */
+		if (fabs(sum) < 1.0E-9)
+			sum = 1.0;
+
+		total = 0;
+		largest = 0;
+		for (k = 0; k < n; k++) {
+			weight[k] = (short)lrint(contrib[k] / sum * RESAMPLE_ONE);
+			total += weight[k];
+			if (weight[k] > weight[largest])
+				largest = k;
+		}
+		weight[largest] += RESAMPLE_ONE - total;
+
+		/* padding taps have a null weight, point them at a valid pixel */
+		for (; k < ntaps; k++)
+			index[k] = index[0];
+	}
+	free(contrib);
+
+	return table;
+}
+
+static RScaleTable *get_scale_table(int src_size, int dst_size)
+{
+	RScaleTable *table;
+	RScalingFilter filter;
+	double (*filter_func)(double);
+	double filter_width;
+	int i;
+
+	pthread_mutex_lock(&scale_lock);
+	filter = filter_type;
+	filter_func = filterf;
+	filter_width = fwidth;
+
+	for (i = 0; i < SCALE_TABLE_CACHE_SIZE && scale_table_cache[i]; i++) {
+		table = scale_table_cache[i];
+		if (table->src_size == src_size && table->dst_size == dst_size && table->filter == filter) {
+			memmove(&scale_table_cache[1], &scale_table_cache[0], i * sizeof(RScaleTable *));
+			scale_table_cache[0] = table;
+			table->refCount++;
+			pthread_mutex_unlock(&scale_lock);
+			return table;
+		}
+	}
+	pthread_mutex_unlock(&scale_lock);
+
+	table = create_scale_table(src_size, dst_size, filter, filter_func, filter_width);
+	if (!table)
+		return NULL;
+
+	pthread_mutex_lock(&scale_lock);
+	if (scale_table_cache[SCALE_TABLE_CACHE_SIZE - 1])
+		unref_scale_table(scale_table_cache[SCALE_TABLE_CACHE_SIZE - 1]);
+	memmove(&scale_table_cache[1], &scale_table_cache[0],
+	        (SCALE_TABLE_CACHE_SIZE - 1) * sizeof(RScaleTable *));
+	scale_table_cache[0] = table;
+	table->refCount++;
+	pthread_mutex_unlock(&scale_lock);
+
+	return table;
+}
+
+void wraster_release_scale_tables(void)
+{
+	int i;
+
+	pthread_mutex_lock(&scale_lock);
+	for (i = 0; i < SCALE_TABLE_CACHE_SIZE; i++) {
+		if (scale_table_cache[i])
+			unref_scale_table(scale_table_cache[i]);
+		scale_table_cache[i] = NULL;
+	}
+	pthread_mutex_unlock(&scale_lock);
+}
+
+/* convert a row to 4 bytes per pixel, with premultiplied alpha */
+static void load_row(const unsigned char *s, unsigned char *d, int width, int has_alpha)
+{
+	int x, a, t;
+
+	if (!has_alpha) {
+		for (x = 0; x < width; x++) {
+			*d++ = *s++;
+			*d++ = *s++;
+			*d++ = *s++;
+			*d++ = 255;
+		}
+		return;
+	}
+
+	for (x = 0; x < width; x++) {
+		a = s[3];
+		/* t / 255 rounded, without division */
+		t = s[0] * a + 128;
+		*d++ = (t + (t >> 8)) >> 8;
+		t = s[1] * a + 128;
+		*d++ = (t + (t >> 8)) >> 8;
+		t = s[2] * a + 128;
+		*d++ = (t + (t >> 8)) >> 8;
+		*d++ = a;
+		s += 4;
+	}
+}
+
+/* store a filtered row in the destination image, undoing alpha premultiplication */
+static void store_row(const unsigned char *s, unsigned char *d, int width, int has_alpha)
+{
+	int x, a;
+	unsigned int inv;
+
+	if (!has_alpha) {
+		for (x = 0; x < width; x++) {
+			*d++ = *s++;
+			*d++ = *s++;
+			*d++ = *s++;
+			s++;
+		}
+		return;
+	}
+
+	for (x = 0; x < width; x++) {
+		a = s[3];
+		if (a == 255) {
+			memcpy(d, s, 4);
+		} else if (a == 0) {
+			memset(d, 0, 4);
+		} else {
+			inv = (255 << 16) / a;
+			/* colours can overshoot alpha with filters having negative lobes */
+			d[0] = s[0] >= a ? 255 : (s[0] * inv + 0x8000) >> 16;
+			d[1] = s[1] >= a ? 255 : (s[1] * inv + 0x8000) >> 16;
+			d[2] = s[2] >= a ? 255 : (s[2] * inv + 0x8000) >> 16;
+			d[3] = a;
+		}
+		d += 4;
+		s += 4;
+	}
+}
+
+typedef struct {
+	RImage *src;
+	RImage *dst;
+	RScaleTable *htable;
+	RScaleTable *vtable;
+	unsigned char *tmp;	/* horizontally scaled image, 4 bytes per pixel */
+	int failed;
+} ScaleJob;
+
+/* horizontal pass: src -> tmp */
+static void scale_rows_h(void *data, int band, int first, int last)
+{
+	ScaleJob *job = data;
+	RImage *src = job->src;
+	int has_alpha = (src->format == RRGBAFormat);
+	int sch = has_alpha ? 4 : 3;
+	unsigned char *row;
+	int y;
+
+	(void)band;
+
+	row = malloc((size_t)src->width * 4);
+	if (!row) {
+		job->failed = 1;
+		return;
+	}
+
+	for (y = first; y <= last; y++) {
+		load_row(src->data + (size_t)y * src->width * sch, row, src->width, has_alpha);
+		r_resample_row_h(row, job->tmp + (size_t)y * job->dst->width * 4, job->htable);
+	}
+	free(row);
+}
+
+/* vertical pass: tmp -> dst */
+static void scale_rows_v(void *data, int band, int first, int last)
+{
+	ScaleJob *job = data;
+	RImage *dst = job->dst;
+	RScaleTable *vtable = job->vtable;
+	int has_alpha = (dst->format == RRGBAFormat);
+	int dch = has_alpha ? 4 : 3;
+	unsigned char *out, **rows;
+	int y, k;
+
+	(void)band;
+
+	out = malloc((size_t)dst->width * 4);
+	rows = malloc(vtable->ntaps * sizeof(unsigned char *));
+	if (!out || !rows) {
+		free(out);
+		free(rows);
+		job->failed = 1;
+		return;
+	}
+
+	for (y = first; y <= last; y++) {
+		const int *index = vtable->index + y * vtable->ntaps;
+
+		for (k = 0; k < vtable->ntaps; k++)
+			rows[k] = job->tmp + (size_t)index[k] * dst->width * 4;
+		r_resample_row_v(rows, vtable->weight + y * vtable->ntaps, vtable->ntaps, out, dst->width * 4);
+		store_row(out, dst->data + (size_t)y * dst->width * dch, dst->width, has_alpha);
+	}
+	free(out);
+	free(rows);
+}
+
+RImage *RSmoothScaleImage(RImage * src, unsigned new_width, unsigned new_height)
+{
+	ScaleJob job;
+
+	assert(src != NULL);
+
+	job.src = src;
+	job.failed = 0;
+	job.dst = RCreateImage(new_width, new_height, src->format == RRGBAFormat);
+	if (!job.dst)
+		return NULL;
+
+	job.htable = get_scale_table(src->width, new_width);
+	job.vtable = get_scale_table(src->height, new_height);
+	job.tmp = malloc((size_t)new_width * src->height * 4);
+
+	if (job.htable && job.vtable && job.tmp) {
+		r_parallel_run(r_parallel_bands(src->height, 16), src->height, scale_rows_h, &job);
+		if (!job.failed)
+			r_parallel_run(r_parallel_bands(new_height, 16), new_height, scale_rows_v, &job);
+	} else {
+		job.failed = 1;
+	}
+
+	if (job.failed) {
+		RErrorCode = RERR_NOMEMORY;
+		RReleaseImage(job.dst);
+		job.dst = NULL;
+	} else {
+		job.dst->background = src->background;
+	}
+
+	if (job.htable)
+		release_scale_table(job.htable);
+	if (job.vtable)
+		release_scale_table(job.vtable);
+	free(job.tmp);
+
+	return job.dst;
+}
@@ -26,5 +26,16 @@
  */
 void wraster_change_filter(RScalingFilter type);
 
+/*
+ * Release the filter weight tables kept by RSmoothScaleImage
+ */
+void wraster_release_scale_tables(void);
+
+/*
+ * Former floating point implementation of RSmoothScaleImage, which does not
+ * preserve alpha. Only kept as a reference for tests and benchmarks
+ */
+RImage *wraster_smooth_scale_reference(RImage *src, unsigned new_width, unsigned new_height);
+
 
 #endif
@@ -0,0 +1,467 @@
+/*
+ * Measures RConvertImage speed for every TrueColor, PseudoColor, GrayScale
+ * and StaticGray visual of the screen, on wallpaper and icon sized images.
+ * Most servers only have TrueColor visuals; the others can be had from
+ * Xvfb with an 8 bit screen, e.g. "Xvfb :1 -screen 0 1280x1024x8".
+ *
+ * Then checks that the operations split in bands of rows give the same
+ * output with threads as without: conversion for every visual above,
+ * smoothed scaling, rotation, blur, combining and gradients. Last, runs
+ * itself again with WRASTER_NO_SIMD set and checks that every conversion
+ * gives the same XImage bytes as with the vector fast paths. Exits with 1
+ * if any output differs.
+ *
+ * usage: benchconvert [iterations]
+ *
+ * The copy without SIMD is started as "benchconvert --reference" and
+ * writes its conversions to its standard output.
+ */
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "wraster.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* threads used for the checks, whatever the number of CPUs */
+#define CHECK_THREADS	4
+
+static const struct {
+	int width, height;
+	const char *name;
+} sizes[] = {
+	{ 1920, 1080, "wallpaper" },
+	{ 256, 256, "preview" },
+	{ 64, 64, "icon" }
+};
+
+static const struct {
+	int class;
+	const char *name;
+} classes[] = {
+	{ TrueColor, "TrueColor" },
+	{ PseudoColor, "PseudoColor" },
+	{ GrayScale, "GrayScale" },
+	{ StaticGray, "StaticGray" }
+};
+
+static const struct {
+	int mode;
+	const char *name;
+} modes[] = {
+	{ RBestMatchRendering, "match" },
+	{ RDitheredRendering, "dither" }
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0E9;
+}
+
+static RImage *make_image(int width, int height, int alpha)
+{
+	RImage *image;
+	unsigned char *p;
+	int x, y;
+
+	image = RCreateImage(width, height, alpha);
+	if (!image) {
+		puts(RMessageForError(RErrorCode));
+		exit(1);
+	}
+
+	p = image->data;
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			*p++ = x * 255 / width;
+			*p++ = y * 255 / height;
+			*p++ = ((x / 8) ^ (y / 8)) & 1 ? 220 : 30;
+			if (alpha)
+				*p++ = (x + y) * 255 / (width + height);
+		}
+	}
+
+	return image;
+}
+
+static void bench_visual(Display *dpy, XVisualInfo *vinfo, int iterations)
+{
+	RContextAttributes attr;
+	RContext *ctx;
+	RImage *img;
+	Pixmap pix;
+	double t0, ms;
+	int s, m, a, i;
+
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+		attr.flags = RC_VisualID | RC_RenderMode;
+		attr.visualid = vinfo->visualid;
+		attr.render_mode = modes[m].mode;
+
+		ctx = RCreateContext(dpy, vinfo->screen, &attr);
+		if (!ctx) {
+			printf("0x%lx: %s\n", vinfo->visualid, RMessageForError(RErrorCode));
+			return;
+		}
+
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for (a = 0; a < 2; a++) {
+				img = make_image(sizes[s].width, sizes[s].height, a);
+
+				t0 = now();
+				for (i = 0; i < iterations; i++) {
+					if (!RConvertImage(ctx, img, &pix)) {
+						puts(RMessageForError(RErrorCode));
+						exit(1);
+					}
+					XFreePixmap(dpy, pix);
+				}
+				XSync(dpy, False);
+				ms = (now() - t0) * 1000.0 / iterations;
+
+				printf("0x%-6lx %5d %-7s %-10s %-5s %10.3f %10.1f\n",
+				       vinfo->visualid, vinfo->depth, modes[m].name, sizes[s].name,
+				       a ? "RGBA" : "RGB", ms,
+				       sizes[s].width * sizes[s].height / (ms * 1000.0));
+				RReleaseImage(img);
+			}
+		}
+		RDestroyContext(ctx);
+	}
+}
+
+static RImage *scale_op(RImage *img)
+{
+	return RSmoothScaleImage(img, img->width * 2 / 3, img->height * 2 / 3);
+}
+
+static RImage *rotate_op(RImage *img)
+{
+	return RRotateImage(img, 30);
+}
+
+static RImage *blur_op(RImage *img)
+{
+	RImage *res = RCloneImage(img);
+
+	RBlurImage(res);
+	return res;
+}
+
+static RImage *combine_op(RImage *img)
+{
+	RImage *src, *res;
+	unsigned char *p;
+	int x, y;
+
+	src = make_image(img->width, img->height, True);
+	p = src->data;
+	for (y = 0; y < src->height; y++) {
+		for (x = 0; x < src->width; x++, p += 4)
+			p[3] = x + y;
+	}
+	res = RCloneImage(img);
+	RCombineArea(res, src, 0, 0, src->width, src->height, 0, 0);
+	RReleaseImage(src);
+
+	return res;
+}
+
+static RImage *gradient_op(RImage *img)
+{
+	RColor from = { 200, 20, 60, 255 }, to = { 10, 180, 240, 255 };
+
+	return RRenderGradient(img->width, img->height, &from, &to, RDiagonalGradient);
+}
+
+static const struct {
+	RImage *(*func)(RImage *img);
+	const char *name;
+} operations[] = {
+	{ scale_op, "scale" },
+	{ rotate_op, "rotate" },
+	{ blur_op, "blur" },
+	{ combine_op, "combine" },
+	{ gradient_op, "gradient" }
+};
+
+static int same_images(RImage *a, RImage *b)
+{
+	if (!a || !b || a->width != b->width || a->height != b->height || a->format != b->format)
+		return 0;
+
+	return memcmp(a->data, b->data,
+		      a->width * a->height * (a->format == RRGBAFormat ? 4 : 3)) == 0;
+}
+
+/* returns the number of operations whose threaded output differs */
+static int check_operations(void)
+{
+	RImage *img, *serial, *threaded;
+	int o, s, a, failed = 0;
+
+	for (o = 0; o < sizeof(operations) / sizeof(operations[0]); o++) {
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for (a = 0; a < 2; a++) {
+				img = make_image(sizes[s].width, sizes[s].height, a);
+
+				wraster_set_threads(1);
+				serial = operations[o].func(img);
+				wraster_set_threads(CHECK_THREADS);
+				threaded = operations[o].func(img);
+
+				if (!same_images(serial, threaded)) {
+					printf("%-8s %-10s %-5s differs with threads\n", operations[o].name,
+					       sizes[s].name, a ? "RGBA" : "RGB");
+					failed++;
+				}
+				if (serial)
+					RReleaseImage(serial);
+				if (threaded)
+					RReleaseImage(threaded);
+				RReleaseImage(img);
+			}
+		}
+	}
+
+	return failed;
+}
+
+static XImage *convert_image(RContext *ctx, RImage *img, int threads)
+{
+	XImage *ximg;
+	Pixmap pix;
+
+	wraster_set_threads(threads);
+	if (!RConvertImage(ctx, img, &pix)) {
+		puts(RMessageForError(RErrorCode));
+		exit(1);
+	}
+	ximg = XGetImage(ctx->dpy, pix, 0, 0, img->width, img->height, AllPlanes, ZPixmap);
+	XFreePixmap(ctx->dpy, pix);
+
+	return ximg;
+}
+
+/* returns the number of conversions whose threaded output differs */
+static int check_visual(Display *dpy, XVisualInfo *vinfo)
+{
+	RContextAttributes attr;
+	RContext *ctx;
+	RImage *img;
+	XImage *serial, *threaded;
+	int s, m, a, failed = 0;
+
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+		attr.flags = RC_VisualID | RC_RenderMode;
+		attr.visualid = vinfo->visualid;
+		attr.render_mode = modes[m].mode;
+
+		ctx = RCreateContext(dpy, vinfo->screen, &attr);
+		if (!ctx)
+			return failed;
+
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for (a = 0; a < 2; a++) {
+				img = make_image(sizes[s].width, sizes[s].height, a);
+
+				serial = convert_image(ctx, img, 1);
+				threaded = convert_image(ctx, img, CHECK_THREADS);
+
+				if (!serial || !threaded ||
+				    memcmp(serial->data, threaded->data,
+					   (size_t)serial->bytes_per_line * serial->height) != 0) {
+					printf("0x%-6lx %-7s %-10s %-5s differs with threads\n",
+					       vinfo->visualid, modes[m].name, sizes[s].name,
+					       a ? "RGBA" : "RGB");
+					failed++;
+				}
+				if (serial)
+					XDestroyImage(serial);
+				if (threaded)
+					XDestroyImage(threaded);
+				RReleaseImage(img);
+			}
+		}
+		RDestroyContext(ctx);
+	}
+
+	return failed;
+}
+
+/*
+ * Converts as check_visual does with a single thread, and writes the
+ * XImage bytes to ref if write is set, or compares them with those read
+ * from it. Returns the number of conversions that differ.
+ */
+static int check_simd_visual(Display *dpy, XVisualInfo *vinfo, FILE *ref, int write)
+{
+	RContextAttributes attr;
+	RContext *ctx;
+	RImage *img;
+	XImage *ximg;
+	char *data = NULL;
+	size_t size;
+	int s, m, a, failed = 0;
+
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+		attr.flags = RC_VisualID | RC_RenderMode;
+		attr.visualid = vinfo->visualid;
+		attr.render_mode = modes[m].mode;
+
+		ctx = RCreateContext(dpy, vinfo->screen, &attr);
+		if (!ctx)
+			break;
+
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for (a = 0; a < 2; a++) {
+				img = make_image(sizes[s].width, sizes[s].height, a);
+				ximg = convert_image(ctx, img, 1);
+				if (!ximg) {
+					puts("could not read back the pixmap");
+					exit(1);
+				}
+				size = (size_t)ximg->bytes_per_line * ximg->height;
+
+				if (write) {
+					fwrite(ximg->data, 1, size, ref);
+				} else {
+					data = realloc(data, size);
+					if (fread(data, 1, size, ref) != size ||
+					    memcmp(data, ximg->data, size) != 0) {
+						printf("0x%-6lx %-7s %-10s %-5s differs without SIMD\n",
+						       vinfo->visualid, modes[m].name, sizes[s].name,
+						       a ? "RGBA" : "RGB");
+						failed++;
+					}
+				}
+				XDestroyImage(ximg);
+				RReleaseImage(img);
+			}
+		}
+		RDestroyContext(ctx);
+	}
+	free(data);
+
+	return failed;
+}
+
+/* starts this program with WRASTER_NO_SIMD set, returns its output */
+static FILE *start_reference(const char *self, pid_t *pid)
+{
+	int fds[2];
+
+	fflush(stdout);
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		exit(1);
+	}
+	*pid = fork();
+	if (*pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (*pid == 0) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		setenv("WRASTER_NO_SIMD", "1", 1);
+		execlp(self, self, "--reference", (char *)NULL);
+		perror(self);
+		_exit(1);
+	}
+	close(fds[1]);
+
+	return fdopen(fds[0], "r");
+}
+
+int main(int argc, char **argv)
+{
+	Display *dpy;
+	XVisualInfo template, *vinfo[sizeof(classes) / sizeof(classes[0])];
+	int iterations = 20;
+	int c, i, count[sizeof(classes) / sizeof(classes[0])], total, failed, simd_failed, status;
+	int reference = (argc > 1 && strcmp(argv[1], "--reference") == 0);
+	FILE *ref;
+	pid_t pid;
+
+	if (argc > 1 && !reference)
+		iterations = atoi(argv[1]);
+	if (iterations < 1)
+		iterations = 1;
+
+	dpy = XOpenDisplay("");
+	if (!dpy) {
+		puts("could not open display");
+		exit(1);
+	}
+
+	template.screen = DefaultScreen(dpy);
+	total = 0;
+	for (c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+		template.class = classes[c].class;
+		vinfo[c] = XGetVisualInfo(dpy, VisualScreenMask | VisualClassMask, &template, &count[c]);
+		if (!vinfo[c]) {
+			if (!reference)
+				printf("no %s visual\n", classes[c].name);
+			count[c] = 0;
+		}
+		total += count[c];
+	}
+	if (total == 0)
+		exit(1);
+
+	if (reference) {
+		for (c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+			for (i = 0; i < count[c]; i++)
+				check_simd_visual(dpy, &vinfo[c][i], stdout, True);
+		}
+		XCloseDisplay(dpy);
+		return 0;
+	}
+
+	for (c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+		if (count[c] == 0)
+			continue;
+		printf("%s\n%-8s %5s %-7s %-10s %-5s %10s %10s\n", classes[c].name,
+		       "visual", "depth", "mode", "size", "image", "ms", "Mpix/s");
+		for (i = 0; i < count[c]; i++)
+			bench_visual(dpy, &vinfo[c][i], iterations);
+	}
+
+	failed = check_operations();
+	for (c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+		for (i = 0; i < count[c]; i++)
+			failed += check_visual(dpy, &vinfo[c][i]);
+	}
+	printf("threaded output: %s\n", failed ? "DIFFERS" : "same as serial");
+
+	simd_failed = 0;
+	ref = start_reference(argv[0], &pid);
+	for (c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+		for (i = 0; i < count[c]; i++)
+			simd_failed += check_simd_visual(dpy, &vinfo[c][i], ref, False);
+	}
+	fclose(ref);
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		simd_failed++;
+	printf("output without SIMD: %s\n", simd_failed ? "DIFFERS" : "same");
+	failed += simd_failed;
+
+	for (c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+		if (vinfo[c])
+			XFree(vinfo[c]);
+	}
+	XCloseDisplay(dpy);
+	RShutdown();
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * Compares speed and output of RSmoothScaleImage with the former floating
+ * point implementation for every scaling filter.
+ *
+ * usage: benchscale [iterations]
+ */
+
+#include <X11/Xlib.h>
+#include "wraster.h"
+#include "scale.h"
+#include "resample.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const struct {
+	RScalingFilter filter;
+	const char *name;
+} filters[] = {
+	{ RBoxFilter, "box" },
+	{ RTriangleFilter, "triangle" },
+	{ RBellFilter, "bell" },
+	{ RBSplineFilter, "bspline" },
+	{ RLanczos3Filter, "lanczos3" },
+	{ RMitchellFilter, "mitchell" }
+};
+
+static const struct {
+	int sw, sh, dw, dh;
+	const char *name;
+} sizes[] = {
+	{ 1920, 1080, 64, 64, "photo to icon" },
+	{ 1280, 1024, 128, 102, "minipreview" },
+	{ 640, 480, 1920, 1440, "wallpaper" }
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0E9;
+}
+
+static RImage *make_image(int width, int height, int alpha)
+{
+	RImage *image;
+	unsigned char *p;
+	int x, y;
+
+	image = RCreateImage(width, height, alpha);
+	if (!image) {
+		puts(RMessageForError(RErrorCode));
+		exit(1);
+	}
+
+	p = image->data;
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			*p++ = x * 255 / width;
+			*p++ = y * 255 / height;
+			*p++ = ((x / 8) ^ (y / 8)) & 1 ? 220 : 30;
+			if (alpha)
+				*p++ = (x + y) & 0xff;
+		}
+	}
+
+	return image;
+}
+
+/* compare RGB channels of two images */
+static void compare(RImage *a, RImage *b, int *max_diff, double *mean_diff)
+{
+	int ach = a->format == RRGBAFormat ? 4 : 3;
+	int bch = b->format == RRGBAFormat ? 4 : 3;
+	long total = 0;
+	int i, c, d;
+
+	*max_diff = 0;
+	for (i = 0; i < a->width * a->height; i++) {
+		for (c = 0; c < 3; c++) {
+			d = abs(a->data[i * ach + c] - b->data[i * bch + c]);
+			total += d;
+			if (d > *max_diff)
+				*max_diff = d;
+		}
+	}
+	*mean_diff = (double)total / (a->width * a->height * 3);
+}
+
+/* check that the selected SIMD kernel gives the same result as plain C */
+static int check_kernels(void)
+{
+	unsigned char *rows[8], out1[1027], out2[1027];
+	short weight[8] = { -1200, 3000, 9000, 7000, -2000, -1500, 900, 1184 };
+	int i, k;
+
+	for (k = 0; k < 8; k++) {
+		rows[k] = malloc(sizeof(out1));
+		for (i = 0; i < sizeof(out1); i++)
+			rows[k][i] = rand();
+	}
+	r_resample_row_v(rows, weight, 8, out1, sizeof(out1));
+	r_resample_row_v_scalar(rows, weight, 8, out2, sizeof(out2));
+	for (k = 0; k < 8; k++)
+		free(rows[k]);
+
+	return memcmp(out1, out2, sizeof(out1)) == 0;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 5;
+	int f, s, i, max_diff;
+	double mean_diff, t0, t_ref, t_new;
+	RImage *src, *ref, *img;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (iterations < 1)
+		iterations = 1;
+
+	printf("kernels: %s, %s\n", r_resample_kernel_name(),
+	       check_kernels() ? "identical to scalar" : "DIFFERENT FROM SCALAR");
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		src = make_image(sizes[s].sw, sizes[s].sh, False);
+		printf("\n%s: %dx%d -> %dx%d\n", sizes[s].name,
+		       sizes[s].sw, sizes[s].sh, sizes[s].dw, sizes[s].dh);
+		printf("%-10s %12s %12s %8s %9s %9s\n",
+		       "filter", "reference ms", "current ms", "speedup", "max diff", "mean diff");
+
+		for (f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+			wraster_change_filter(filters[f].filter);
+
+			t0 = now();
+			for (i = 0; i < iterations; i++) {
+				ref = wraster_smooth_scale_reference(src, sizes[s].dw, sizes[s].dh);
+				if (i < iterations - 1)
+					RReleaseImage(ref);
+			}
+			t_ref = (now() - t0) * 1000.0 / iterations;
+
+			t0 = now();
+			for (i = 0; i < iterations; i++) {
+				img = RSmoothScaleImage(src, sizes[s].dw, sizes[s].dh);
+				if (i < iterations - 1)
+					RReleaseImage(img);
+			}
+			t_new = (now() - t0) * 1000.0 / iterations;
+
+			compare(ref, img, &max_diff, &mean_diff);
+			printf("%-10s %12.2f %12.2f %7.1fx %9d %9.3f\n", filters[f].name,
+			       t_ref, t_new, t_ref / t_new, max_diff, mean_diff);
+
+			RReleaseImage(ref);
+			RReleaseImage(img);
+		}
+		RReleaseImage(src);
+	}
+
+	/* alpha is kept by the current implementation */
+	src = make_image(512, 512, True);
+	img = RSmoothScaleImage(src, 48, 48);
+	printf("\nRGBA source gives %s image\n", img->format == RRGBAFormat ? "RGBA" : "RGB");
+	RReleaseImage(img);
+	RReleaseImage(src);
+
+	RShutdown();
+
+	return 0;
+}
@@ -34,6 +34,41 @@
  * preceded by a hash to the variable name as in
  * WRASTER_GAMMA#1
  * for screen number 1
+ *
+ *
+ * RIMAGE_CACHE <count>
+ * maximum number of images kept in the image cache of RLoadImage.
+ * 0 disables the cache.
+ *
+ * RIMAGE_CACHE_SIZE <pixels>
+ * maximum size (width * height) of an image to be kept in the cache.
+ * 0 means any size.
+ *
+ * RIMAGE_CACHE_BYTES <bytes>
+ * maximum amount of image data kept in the cache.
+ *
+ * RIMAGE_CACHE_CHECK <seconds>
+ * minimum delay between two checks of the modification time of a
+ * cached file. 0 checks the file on every load.
+ *
+ * Defaults:
+ * RIMAGE_CACHE 64
+ * RIMAGE_CACHE_SIZE 4096
+ * RIMAGE_CACHE_BYTES 2097152
+ * RIMAGE_CACHE_CHECK 0
+ *
+ *
+ * WRASTER_NO_SIMD
+ * if set, use plain C code instead of SSE2/AVX2 for smoothed scaling.
+ *
+ * WRASTER_THREADS <count>
+ * number of threads used to process large images (scaling, rotation,
+ * gradients, blur, combining and conversion), split in bands of rows.
+ * 1 disables threading, 0 uses one thread per CPU. The RC_Threads
+ * context attribute takes precedence.
+ *
+ * Default:
+ * WRASTER_THREADS 1
  */
 
 #ifndef __WRASTER_WRASTER_H__
@@ -41,7 +76,7 @@
 
 
 /* version of the header for the library */
-#define WRASTER_HEADER_VERSION	23
+#define WRASTER_HEADER_VERSION	25
 
 
 #include <X11/Xlib.h>
@@ -98,6 +133,9 @@ extern "C" {
 /* standard colormap usage */
 #define RC_StandardColormap	(1<<7)
 
+/* number of threads for image operations */
+#define RC_Threads		(1<<8)
+
 
 
 /* image display modes */
@@ -137,6 +175,7 @@ typedef struct RContextAttributes {
     int use_shared_memory;	       /* True of False */
     RScalingFilter scaling_filter;
     RStdColormapMode standard_colormap_mode;    /* what to do with std cma */
+    int threads;		       /* 1 = no threading, 0 = one per CPU */
 } RContextAttributes;
 
 
@@ -182,6 +221,9 @@ typedef struct RContext {
             __wrlib_deprecated("Flag optimize_for_speed in RContext is not used anymore "
                                "and will be removed in future version, please do not use");
     } flags;
+
+    /* Private data. Do not access */
+    struct RXImage *spare_ximage;      /* shared image kept for reuse */
 } RContext;
 
 
@@ -231,6 +273,21 @@ typedef struct RImage {
 } RImage;
 
 
+/*
+ * statistics of the image cache used by RLoadImage
+ */
+typedef struct RImageCacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;       /* dropped to make room */
+    unsigned long invalidations;   /* dropped because file changed */
+    int count;			   /* number of cached images */
+    int max_count;
+    size_t bytes;		   /* image data held by the cache */
+    size_t max_bytes;
+} RImageCacheStats;
+
+
 /*
  * internal wrapper for XImage. Used for shm abstraction
  */
@@ -241,6 +298,7 @@ typedef struct RXImage {
 #ifdef USE_XSHM
     XShmSegmentInfo info;
     char is_shared;
+    size_t shm_size;
 #endif
 } RXImage;
 
@@ -350,6 +408,24 @@ RImage *RCreateImageFromDrawable(RContext *context, Drawable drawable,
 
 RImage *RLoadImage(RContext *context, const char *file, int index);
 
+/*
+ * Same as RLoadImage, but the returned image may be shared with the image
+ * cache and other callers, so it must not be modified.
+ * Release it with RReleaseImage.
+ */
+RImage *RLoadSharedImage(RContext *context, const char *file, int index);
+
+/*
+ * Loads the image scaled down to fit in max_width x max_height, keeping
+ * its aspect ratio; smaller images are returned at their size. JPEG, PNG
+ * and TIFF files are reduced while they are decoded, so the full size
+ * image is never in memory.
+ */
+RImage *RLoadImageAtSize(RContext *context, const char *file, int index,
+                         unsigned max_width, unsigned max_height);
+
+void RGetImageCacheStats(RImageCacheStats *stats);
+
 RImage* RRetainImage(RImage *image);
 
 void RReleaseImage(RImage *image);
@@ -33,6 +33,7 @@
 #ifdef USE_XSHM
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <pthread.h>
 #endif				/* USE_XSHM */
 
 #include "wraster.h"
@@ -53,6 +54,78 @@ static int errorHandler(Display * dpy, XErrorEvent * err)
 	return 0;
 }
 
+/*
+ * Creating a shared XImage costs a few system calls and two round trips
+ * to the server, so each context keeps the segment of the largest shared
+ * image destroyed with it and reuses it for the next one that fits in it.
+ * Images smaller than SHM_MINIMUM_SIZE are cheaper to send through the
+ * connection. Segments larger than SHM_SPARE_MAXIMUM (a full screen
+ * background, say) are not kept, so a single big conversion does not pin
+ * that much shared memory for the life of the context.
+ */
+#define SHM_MINIMUM_SIZE	(64 * 1024)
+#define SHM_SPARE_MAXIMUM	(4 * 1024 * 1024)
+
+/* Guards the spare images of the contexts, which may be used by several threads */
+static pthread_mutex_t spare_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void destroySharedXImage(RContext * context, RXImage * rximage)
+{
+	XShmDetach(context->dpy, &rximage->info);
+	if (rximage->image)
+		XDestroyImage(rximage->image);
+	if (shmdt(rximage->info.shmaddr) < 0)
+		perror("wrlib: shmdt");
+	free(rximage);
+}
+
+static RXImage *reuseSharedXImage(RContext * context, int depth, unsigned width, unsigned height)
+{
+	RXImage *rximg;
+	XImage *image;
+
+	pthread_mutex_lock(&spare_lock);
+	rximg = context->spare_ximage;
+	if (!rximg || rximg->image->depth != depth) {
+		pthread_mutex_unlock(&spare_lock);
+		return NULL;
+	}
+
+	image = XShmCreateImage(context->dpy, context->visual, depth,
+				ZPixmap, NULL, &rximg->info, width, height);
+	if (!image) {
+		pthread_mutex_unlock(&spare_lock);
+		return NULL;
+	}
+
+	if ((size_t)image->bytes_per_line * height > rximg->shm_size) {
+		XDestroyImage(image);
+		pthread_mutex_unlock(&spare_lock);
+		return NULL;
+	}
+	context->spare_ximage = NULL;
+	pthread_mutex_unlock(&spare_lock);
+
+	XDestroyImage(rximg->image);
+	rximg->image = image;
+	rximg->image->data = rximg->info.shmaddr;
+
+	return rximg;
+}
+
+void r_release_shared_ximage(RContext * context)
+{
+	RXImage *rximg;
+
+	pthread_mutex_lock(&spare_lock);
+	rximg = context->spare_ximage;
+	context->spare_ximage = NULL;
+	pthread_mutex_unlock(&spare_lock);
+
+	if (rximg)
+		destroySharedXImage(context, rximg);
+}
+
 #endif
 
 RXImage *RCreateXImage(RContext * context, int depth, unsigned width, unsigned height)
@@ -80,10 +153,23 @@ RXImage *RCreateXImage(RContext * context, int depth, unsigned width, unsigned h
 		return NULL;
 	}
 #else				/* USE_XSHM */
-	if (!context->attribs->use_shared_memory) {
+	if (context->attribs->use_shared_memory && (size_t)width * height * 4 >= SHM_MINIMUM_SIZE) {
+		RXImage *spare = reuseSharedXImage(context, depth, width, height);
+
+		if (spare) {
+			free(rximg);
+			return spare;
+		}
+	}
+
+	if (!context->attribs->use_shared_memory || (size_t)width * height * 4 < SHM_MINIMUM_SIZE) {
  retry_without_shm:
+		/*
+		 * Small images come here too, so use_shared_memory is not
+		 * cleared here: every failure below clears it before jumping
+		 * back, and shared memory stays off for the context after that.
+		 */
 
-		context->attribs->use_shared_memory = 0;
 		rximg->is_shared = 0;
 		rximg->image = XCreateImage(context->dpy, visual, depth, ZPixmap, 0, NULL, width, height, 8, 0);
 		if (!rximg->image) {
@@ -106,7 +192,8 @@ RXImage *RCreateXImage(RContext * context, int depth, unsigned width, unsigned h
 		rximg->image = XShmCreateImage(context->dpy, visual, depth,
 					       ZPixmap, NULL, &rximg->info, width, height);
 
-		rximg->info.shmid = shmget(IPC_PRIVATE, rximg->image->bytes_per_line * height, IPC_CREAT | 0777);
+		rximg->shm_size = rximg->image->bytes_per_line * height;
+		rximg->info.shmid = shmget(IPC_PRIVATE, rximg->shm_size, IPC_CREAT | 0777);
 		if (rximg->info.shmid < 0) {
 			context->attribs->use_shared_memory = 0;
 			perror("wrlib: could not allocate shared memory segment");
@@ -131,6 +218,13 @@ RXImage *RCreateXImage(RContext * context, int depth, unsigned width, unsigned h
 		XSync(context->dpy, False);
 		XSetErrorHandler(oldErrorHandler);
 
+		/*
+		 * Both sides are attached now: mark the segment for removal so
+		 * that it goes away with the last detach, even if we crash
+		 */
+		if (shmctl(rximg->info.shmid, IPC_RMID, 0) < 0)
+			perror("wrlib: shmctl");
+
 		rximg->image->data = rximg->info.shmaddr;
 		/*      rximg->image->obdata = &(rximg->info); */
 
@@ -139,8 +233,6 @@ RXImage *RCreateXImage(RContext * context, int depth, unsigned width, unsigned h
 			XDestroyImage(rximg->image);
 			if (shmdt(rximg->info.shmaddr) < 0)
 				perror("wrlib: shmdt");
-			if (shmctl(rximg->info.shmid, IPC_RMID, 0) < 0)
-				perror("wrlib: shmctl");
 			/*      printf("wrlib:error attaching shared memory segment to XImage\n");
 			 */
 			goto retry_without_shm;
@@ -160,16 +252,26 @@ void RDestroyXImage(RContext * context, RXImage * rximage)
 	XDestroyImage(rximage->image);
 #else				/* USE_XSHM */
 	if (rximage->is_shared) {
+		RXImage *spare;
+
+		/* wait for the server to be done with the segment */
 		XSync(context->dpy, False);
-		XShmDetach(context->dpy, &rximage->info);
-		XDestroyImage(rximage->image);
-		if (shmdt(rximage->info.shmaddr) < 0)
-			perror("wrlib: shmdt");
-		if (shmctl(rximage->info.shmid, IPC_RMID, 0) < 0)
-			perror("wrlib: shmctl");
-	} else {
-		XDestroyImage(rximage->image);
+
+		/* keep the largest segment under the cap for reuse, its image tells the depth */
+		pthread_mutex_lock(&spare_lock);
+		spare = context->spare_ximage;
+		if (rximage->shm_size <= SHM_SPARE_MAXIMUM &&
+		    (!spare || spare->shm_size < rximage->shm_size)) {
+			context->spare_ximage = rximage;
+			rximage = spare;
+		}
+		pthread_mutex_unlock(&spare_lock);
+
+		if (rximage)
+			destroySharedXImage(context, rximage);
+		return;
 	}
+	XDestroyImage(rximage->image);
 #endif
 	free(rximage);
 }
@@ -23,6 +23,9 @@
 
 #ifdef USE_XSHM
 Pixmap R_CreateXImageMappedPixmap(RContext *context, RXImage *ximage);
+
+/* Free the shared memory segment kept for reuse by the context */
+void r_release_shared_ximage(RContext *context);
 #endif
 
 